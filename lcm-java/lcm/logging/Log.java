@@ -16,8 +16,17 @@ public class Log
     BufferedRandomAccessFile raf;
 
     static final int LOG_MAGIC = 0xEDA1DA01;
+    static final int ZLOG_MAGIC = 0xEDA1DA2C;
+    static final int BLOCK_MAGIC = 0xEDA1DA0B;
     String path;
 
+    /** Set if the log file is in the compressed format, where events are
+     * grouped in blocks. **/
+    boolean compressed;
+
+    /** The events of the block being read, in a compressed log file. **/
+    DataInputStream block;
+
     /** Used to count the number of messages written so far. **/
     long numMessagesWritten = 0;
 
@@ -59,6 +68,12 @@ public class Log
         this.path = path;
         raf = new BufferedRandomAccessFile(path, mode);
         //raf = new RandomAccessFile(path, mode);
+
+        if (raf.length() >= 8) {
+            compressed = raf.readInt() == ZLOG_MAGIC;
+            if (!compressed)
+                raf.seek(0);
+        }
     }
 
     /**
@@ -85,6 +100,9 @@ public class Log
      */
     public synchronized Event readNext() throws IOException
     {
+        if (compressed)
+            return readNextCompressed();
+
         int magic = 0;
         Event e = new Event();
         int channellen = 0, datalen = 0;
@@ -122,6 +140,126 @@ public class Log
         return e;
     }
 
+    private Event readNextCompressed() throws IOException
+    {
+        while (true) {
+            if (block == null || block.available() == 0)
+                readNextBlock();
+            if (block.available() < 28) {
+                System.out.println("Bad log event in block, skipping the rest of it");
+                block = null;
+                continue;
+            }
+
+            Event e = new Event();
+            int magic = block.readInt();
+            e.eventNumber = block.readLong();
+            e.utime       = block.readLong();
+            int channellen = block.readInt();
+            int datalen    = block.readInt();
+            if (magic != LOG_MAGIC || channellen <= 0 || channellen >= 1000 ||
+                datalen < 0 || channellen + datalen > block.available()) {
+                System.out.println("Bad log event in block, skipping the rest of it");
+                block = null;
+                continue;
+            }
+
+            byte bchannel[] = new byte[channellen];
+            e.data = new byte[datalen];
+            block.readFully(bchannel);
+            e.channel = new String(bchannel);
+            block.readFully(e.data);
+            return e;
+        }
+    }
+
+    /**
+     * Reads the next valid block of a compressed log file.
+     *
+     * @throws java.io.EOFException if the end of the file has been reached.
+     */
+    private void readNextBlock() throws IOException
+    {
+        while (true) {
+            int magic = 0;
+            while (magic != BLOCK_MAGIC)
+                magic = (magic<<8) | (raf.readByte()&0xff);
+
+            int rawSize    = raf.readInt();
+            int storedSize = raf.readInt();
+            raf.readLong(); // timestamp of the first event
+            if (storedSize < 0 || rawSize < storedSize || rawSize / 256 > storedSize + 1)
+                continue;
+
+            byte stored[] = new byte[storedSize];
+            raf.readFully(stored);
+            byte raw[] = stored;
+            if (storedSize < rawSize) {
+                raw = new byte[rawSize];
+                if (!decompress(stored, raw)) {
+                    System.out.println("Log block is corrupt");
+                    continue;
+                }
+            }
+            block = new DataInputStream(new ByteArrayInputStream(raw));
+            return;
+        }
+    }
+
+    /**
+     * Decompresses a block compressed by lcm_lz_compress() in the C library.
+     * Returns false if the data is invalid.
+     */
+    static boolean decompress(byte src[], byte dst[])
+    {
+        int ip = 0, op = 0;
+        while (ip < src.length) {
+            int token = src[ip++] & 0xff;
+
+            long nlit = token >> 4;
+            if (nlit == 15) {
+                int b;
+                do {
+                    if (ip >= src.length)
+                        return false;
+                    b = src[ip++] & 0xff;
+                    nlit += b;
+                } while (b == 255);
+            }
+            if (nlit > src.length - ip || nlit > dst.length - op)
+                return false;
+            System.arraycopy(src, ip, dst, op, (int) nlit);
+            ip += nlit;
+            op += nlit;
+            if (ip == src.length)
+                break;
+
+            if (src.length - ip < 2)
+                return false;
+            int offset = (src[ip] & 0xff) | ((src[ip + 1] & 0xff) << 8);
+            ip += 2;
+            if (offset == 0 || offset > op)
+                return false;
+            long mlen = token & 15;
+            if (mlen == 15) {
+                int b;
+                do {
+                    if (ip >= src.length)
+                        return false;
+                    b = src[ip++] & 0xff;
+                    mlen += b;
+                } while (b == 255);
+            }
+            mlen += 4;
+            if (mlen > dst.length - op)
+                return false;
+            // the match may overlap what it produces
+            for (int i = 0; i < mlen; i++, op++)
+                dst[op] = dst[op - offset];
+        }
+        return op == dst.length;
+    }
+
     public synchronized double getPositionFraction() throws IOException
     {
         return raf.getFilePointer()/((double) raf.length());
@@ -135,6 +273,7 @@ public class Log
     public synchronized void seekPositionFraction(double frac) throws IOException
     {
         raf.seek((long) (raf.length()*frac));
+        block = null;
     }
 
     /**
@@ -144,6 +283,9 @@ public class Log
      */
     public synchronized void write(Event e) throws IOException
     {
+        if (compressed)
+            throw new IOException("Can't write to a compressed log file");
+
         byte[] channelb = e.channel.getBytes();
 
         raf.writeInt(LOG_MAGIC);
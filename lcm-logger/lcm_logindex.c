@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <string.h>
+
+#include <lcm/lcm.h>
+
+static void
+usage (char * cmd)
+{
+    fprintf (stderr, "\
+Usage: %s [OPTION...] FILE...\n\
+  Builds the index of each LCM log file FILE, and writes it to FILE.idx.\n\
+\n\
+Options:\n\
+  -e, --every-events=N  Index every Nth event.  Default is 1000.\n\
+  -t, --every-ms=MS     Index an event at least every MS milliseconds of\n\
+                        log time.  Default is 1000.\n\
+  -o, --output=PATH     Write the index to PATH instead of FILE.idx.  Only\n\
+                        valid with a single FILE.\n\
+  -q, --quiet           Only report errors.\n\
+  -h, --help            Shows some help text and exits.\n\
+  \n", cmd);
+}
+
+int
+main(int argc, char ** argv)
+{
+    int every_events = 1000;
+    int every_ms = 1000;
+    int quiet = 0;
+    char * output = NULL;
+    int c;
+    struct option long_opts[] = {
+        { "help", no_argument, 0, 'h' },
+        { "every-events", required_argument, 0, 'e' },
+        { "every-ms", required_argument, 0, 't' },
+        { "output", required_argument, 0, 'o' },
+        { "quiet", no_argument, 0, 'q' },
+        { 0, 0, 0, 0 }
+    };
+
+    while ((c = getopt_long (argc, argv, "he:t:o:q", long_opts, 0)) >= 0)
+    {
+        switch (c) {
+            case 'e':
+                every_events = atoi (optarg);
+                break;
+            case 't':
+                every_ms = atoi (optarg);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            case 'h':
+            default:
+                usage (argv[0]);
+                return 1;
+        };
+    }
+
+    if (optind == argc || (output && optind != argc - 1) ||
+            every_events < 0 || every_ms < 0) {
+        usage (argv[0]);
+        return 1;
+    }
+
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        const char * file = argv[i];
+        char * index_path = output;
+        if (!output) {
+            index_path = (char *) malloc (strlen (file) + 5);
+            sprintf (index_path, "%s.idx", file);
+        }
+
+        int64_t nevents = lcm_eventlog_build_index (file, index_path,
+                every_events, every_ms);
+        if (nevents < 0) {
+            fprintf (stderr, "Error: Failed to index %s\n", file);
+            status = 1;
+        } else if (!quiet) {
+            printf ("%s: %lld events, index written to %s\n", file,
+                    (long long) nevents, index_path);
+        }
+
+        if (index_path != output)
+            free (index_path);
+    }
+    return status;
+}
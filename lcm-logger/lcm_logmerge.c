@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <errno.h>
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <lcm/lcm.h>
+
+// The output is written in large chunks rather than event by event
+#define OUTPUT_BUFFER_SIZE (4 << 20)
+
+// How much of the data of an event goes into the hash that duplicates are
+// looked up by.  The rest is only compared.
+#define DEDUP_HASH_BYTES 256
+
+// One of the logs being merged.  Logs that aren't compressed are memory
+// mapped, and their events are read without copying.  Compressed logs are
+// read with an lcm_eventlog_t.
+typedef struct {
+    const char *path;
+    lcm_eventlog_reader_t *reader;
+    lcm_eventlog_t *log;
+
+    // the next event, or NULL once the log has been read
+    const lcm_eventlog_event_t *next;
+    lcm_eventlog_event_t *owned;
+} input_t;
+
+// An event that was written recently, for recognizing the copies of it that
+// other loggers captured
+typedef struct {
+    uint64_t hash;
+    int64_t timestamp;
+    int input;
+    int32_t datalen;
+    const void *data;
+    lcm_eventlog_event_t *owned;
+
+    // the previous event in the same bucket, plus 1, or 0 for none
+    int64_t prev;
+} recent_t;
+
+// The events written in the last window_us microseconds.  Entry number n is
+// stored in ring[n & mask], and the entries from oldest to count are still in
+// the window.  Each bucket holds the newest entry number in it, plus 1.
+typedef struct {
+    int64_t window_us;
+    recent_t *ring;
+    int64_t *buckets;
+    int64_t mask;
+    int64_t oldest;
+    int64_t count;
+} dedup_t;
+
+static void
+usage (char * cmd)
+{
+    fprintf (stderr, "\
+Usage: %s [OPTION...] -o OUTPUT FILE...\n\
+  Merges the LCM log files FILE into one log, OUTPUT, with the events of all\n\
+  of them in timestamp order.  The events are renumbered.\n\
+\n\
+Options:\n\
+  -o, --output=OUTPUT    The merged log file.  Required.\n\
+  -d, --dedup            Drop an event if an event from another FILE with the\n\
+                         same channel and data was written shortly before\n\
+                         it, as happens when several loggers capture the\n\
+                         same message.\n\
+  -w, --dedup-window=MS  With --dedup, how far apart in time copies of a\n\
+                         message can be, in milliseconds.  Default is 100.\n\
+  -f, --force            Overwrite OUTPUT if it exists.\n\
+  -x, --index            Also write an index of OUTPUT to OUTPUT.idx.\n\
+  -z, --compress         Write OUTPUT in the compressed format.\n\
+  -q, --quiet            Only report errors.\n\
+  -h, --help             Shows some help text and exits.\n\
+  \n", cmd);
+}
+
+static int
+input_open (input_t * in, const char * path)
+{
+    memset (in, 0, sizeof (input_t));
+    in->path = path;
+    in->reader = lcm_eventlog_reader_create (path);
+    if (!in->reader) {
+        // compressed logs can't be mapped
+        if (errno != EINVAL)
+            return -1;
+        in->log = lcm_eventlog_create (path, "r");
+        if (!in->log)
+            return -1;
+    }
+    return 0;
+}
+
+// Reads the next event of an input into in->next.  An owned event that the
+// caller hasn't taken is freed.
+static void
+input_advance (input_t * in)
+{
+    if (in->reader) {
+        in->next = lcm_eventlog_reader_next (in->reader);
+        return;
+    }
+    if (in->owned)
+        lcm_eventlog_free_event (in->owned);
+    in->owned = lcm_eventlog_read_next_event (in->log);
+    in->next = in->owned;
+}
+
+static void
+input_close (input_t * in)
+{
+    if (in->owned)
+        lcm_eventlog_free_event (in->owned);
+    if (in->reader)
+        lcm_eventlog_reader_destroy (in->reader);
+    if (in->log)
+        lcm_eventlog_destroy (in->log);
+}
+
+// Orders the inputs by their next event, and by their position on the
+// command line for events with the same timestamp
+static int
+input_before (const input_t * inputs, int a, int b)
+{
+    int64_t ta = inputs[a].next->timestamp;
+    int64_t tb = inputs[b].next->timestamp;
+    return ta < tb || (ta == tb && a < b);
+}
+
+static void
+heap_sift_down (const input_t * inputs, int * heap, int n, int i)
+{
+    while (1) {
+        int first = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < n && input_before (inputs, heap[left], heap[first]))
+            first = left;
+        if (right < n && input_before (inputs, heap[right], heap[first]))
+            first = right;
+        if (first == i)
+            return;
+        int tmp = heap[i];
+        heap[i] = heap[first];
+        heap[first] = tmp;
+        i = first;
+    }
+}
+
+// FNV-1a
+static uint64_t
+hash_bytes (uint64_t hash, const void * data, size_t len)
+{
+    const uint8_t * p = (const uint8_t *) data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void
+dedup_init (dedup_t * d, int64_t window_us)
+{
+    memset (d, 0, sizeof (dedup_t));
+    d->window_us = window_us;
+    d->mask = 1023;
+    d->ring = (recent_t *) calloc (d->mask + 1, sizeof (recent_t));
+    d->buckets = (int64_t *) calloc (d->mask + 1, sizeof (int64_t));
+}
+
+static void
+dedup_free (dedup_t * d)
+{
+    for (int64_t n = d->oldest; n < d->count; n++) {
+        if (d->ring[n & d->mask].owned)
+            lcm_eventlog_free_event (d->ring[n & d->mask].owned);
+    }
+    free (d->ring);
+    free (d->buckets);
+}
+
+// Doubles the size of the ring and the buckets when every entry is still in
+// the window
+static void
+dedup_grow (dedup_t * d)
+{
+    int64_t mask = d->mask * 2 + 1;
+    recent_t * ring = (recent_t *) calloc (mask + 1, sizeof (recent_t));
+    free (d->buckets);
+    d->buckets = (int64_t *) calloc (mask + 1, sizeof (int64_t));
+    for (int64_t n = d->oldest; n < d->count; n++) {
+        recent_t * r = &ring[n & mask];
+        *r = d->ring[n & d->mask];
+        int64_t * bucket = &d->buckets[r->hash & mask];
+        r->prev = *bucket;
+        *bucket = n + 1;
+    }
+    free (d->ring);
+    d->ring = ring;
+    d->mask = mask;
+}
+
+// Returns 1 if the event, which is newer than any seen before, is a copy of a
+// recent event from another input.  Otherwise, remembers it and returns 0.
+// The event's data must stay valid while it is in the window, so if it was
+// read from an lcm_eventlog_t, the event is taken over.
+static int
+dedup_check (dedup_t * d, input_t * inputs, int input)
+{
+    const lcm_eventlog_event_t * le = inputs[input].next;
+    int64_t start = le->timestamp - d->window_us;
+    while (d->oldest < d->count &&
+            d->ring[d->oldest & d->mask].timestamp < start) {
+        recent_t * r = &d->ring[d->oldest & d->mask];
+        if (r->owned)
+            lcm_eventlog_free_event (r->owned);
+        d->oldest++;
+    }
+
+    uint64_t hash = hash_bytes (0xcbf29ce484222325ULL, le->channel,
+            le->channellen + 1);
+    hash = hash_bytes (hash, le->data, le->datalen < DEDUP_HASH_BYTES ?
+            le->datalen : DEDUP_HASH_BYTES);
+    int64_t n = d->buckets[hash & d->mask] - 1;
+    // the older entries of a bucket have left the window
+    for (; n >= d->oldest; n = d->ring[n & d->mask].prev - 1) {
+        const recent_t * r = &d->ring[n & d->mask];
+        if (r->hash == hash && r->input != input &&
+                r->datalen == le->datalen &&
+                !memcmp (r->data, le->data, le->datalen))
+            return 1;
+    }
+
+    if (d->count - d->oldest > d->mask)
+        dedup_grow (d);
+    recent_t * r = &d->ring[d->count & d->mask];
+    r->hash = hash;
+    r->timestamp = le->timestamp;
+    r->input = input;
+    r->datalen = le->datalen;
+    r->data = le->data;
+    r->owned = inputs[input].owned;
+    inputs[input].owned = NULL;
+    int64_t * bucket = &d->buckets[hash & d->mask];
+    r->prev = *bucket;
+    *bucket = d->count + 1;
+    d->count++;
+    return 0;
+}
+
+int
+main(int argc, char ** argv)
+{
+    char * output = NULL;
+    int dedup = 0;
+    double window_ms = 100;
+    int force = 0;
+    int write_index = 0;
+    int compress = 0;
+    int quiet = 0;
+    int c;
+    struct option long_opts[] = {
+        { "help", no_argument, 0, 'h' },
+        { "output", required_argument, 0, 'o' },
+        { "dedup", no_argument, 0, 'd' },
+        { "dedup-window", required_argument, 0, 'w' },
+        { "force", no_argument, 0, 'f' },
+        { "index", no_argument, 0, 'x' },
+        { "compress", no_argument, 0, 'z' },
+        { "quiet", no_argument, 0, 'q' },
+        { 0, 0, 0, 0 }
+    };
+
+    while ((c = getopt_long (argc, argv, "ho:dw:fxzq", long_opts, 0)) >= 0)
+    {
+        switch (c) {
+            case 'o':
+                output = optarg;
+                break;
+            case 'd':
+                dedup = 1;
+                break;
+            case 'w':
+                window_ms = strtod (optarg, NULL);
+                break;
+            case 'f':
+                force = 1;
+                break;
+            case 'x':
+                write_index = 1;
+                break;
+            case 'z':
+                compress = 1;
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            case 'h':
+            default:
+                usage (argv[0]);
+                return 1;
+        };
+    }
+
+    if (optind == argc || !output || window_ms < 0) {
+        usage (argv[0]);
+        return 1;
+    }
+    if (compress && write_index) {
+        fprintf (stderr, "Compressed logs can't have an index\n");
+        return 1;
+    }
+
+    struct stat st;
+    if (!force && 0 == stat (output, &st)) {
+        fprintf (stderr, "Refusing to overwrite existing file \"%s\"\n",
+                output);
+        return 1;
+    }
+    for (int i = optind; i < argc; i++) {
+        if (!strcmp (argv[i], output)) {
+            fprintf (stderr, "%s is both an input and the output\n", output);
+            return 1;
+        }
+    }
+
+    int ninputs = argc - optind;
+    input_t * inputs = (input_t *) calloc (ninputs, sizeof (input_t));
+    int * heap = (int *) malloc (ninputs * sizeof (int));
+    int nheap = 0;
+    int status = 0;
+    for (int i = 0; i < ninputs; i++) {
+        if (0 != input_open (&inputs[i], argv[optind + i])) {
+            fprintf (stderr, "Unable to open %s: %s\n", argv[optind + i],
+                    strerror (errno));
+            for (int j = 0; j < i; j++)
+                input_close (&inputs[j]);
+            free (inputs);
+            free (heap);
+            return 1;
+        }
+        input_advance (&inputs[i]);
+        if (inputs[i].next)
+            heap[nheap++] = i;
+    }
+    for (int i = nheap / 2 - 1; i >= 0; i--)
+        heap_sift_down (inputs, heap, nheap, i);
+
+    lcm_eventlog_t * log = compress ?
+        lcm_eventlog_create_compressed (output, "w") :
+        lcm_eventlog_create (output, "w");
+    if (!log) {
+        perror ("Error: Failed to open output");
+        status = 1;
+        goto done;
+    }
+    if (!compress)
+        setvbuf (log->f, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    if (write_index) {
+        char * index_path = (char *) malloc (strlen (output) + 5);
+        sprintf (index_path, "%s.idx", output);
+        int index_status = lcm_eventlog_write_index (log, index_path, 1000,
+                1000);
+        free (index_path);
+        if (0 != index_status) {
+            perror ("Error: Failed to open index");
+            lcm_eventlog_destroy (log);
+            status = 1;
+            goto done;
+        }
+    }
+
+    dedup_t recent;
+    if (dedup)
+        dedup_init (&recent, (int64_t) (window_ms * 1000));
+
+    int64_t nwritten = 0;
+    int64_t nduplicates = 0;
+    while (nheap > 0) {
+        int i = heap[0];
+        input_t * in = &inputs[i];
+        if (dedup && dedup_check (&recent, inputs, i)) {
+            nduplicates++;
+        } else {
+            lcm_eventlog_event_t le = *in->next;
+            if (0 != lcm_eventlog_write_event (log, &le)) {
+                perror ("Error: Failed to write");
+                status = 1;
+                break;
+            }
+            nwritten++;
+        }
+
+        input_advance (in);
+        if (!in->next)
+            heap[0] = heap[--nheap];
+        heap_sift_down (inputs, heap, nheap, 0);
+    }
+
+    if (dedup)
+        dedup_free (&recent);
+    if (0 != lcm_eventlog_flush (log)) {
+        perror ("Error: Failed to write");
+        status = 1;
+    }
+    lcm_eventlog_destroy (log);
+
+    if (!status && !quiet) {
+        printf ("%s: %lld events from %d logs", output, (long long) nwritten,
+                ninputs);
+        if (dedup)
+            printf (", %lld duplicates dropped", (long long) nduplicates);
+        printf ("\n");
+    }
+
+done:
+    for (int i = 0; i < ninputs; i++)
+        input_close (&inputs[i]);
+    free (inputs);
+    free (heap);
+    return status;
+}
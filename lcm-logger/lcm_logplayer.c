@@ -39,6 +39,9 @@ Options:\n\
   -s, --speed=NUM     Playback speed multiplier.  Default is 1.0.\n\
   -e, --regexp=EXPR   GLib regular expression of channels to play.\n\
   -l, --lcm-url=URL   Play logged messages on the specified LCM URL.\n\
+  -t, --start-timestamp=USEC\n\
+                      Start playing at the first message logged at or\n\
+                      after USEC microseconds since the epoch.\n\
   -h, --help          Shows some help text and exits.\n\
   \n", cmd);
 }
@@ -50,18 +53,20 @@ main(int argc, char ** argv)
     double speed = 1.0;
     int c;
     char * expression = NULL;
+    long long start_timestamp = -1;
     struct option long_opts[] = {
         { "help", no_argument, 0, 'h' },
         { "speed", required_argument, 0, 's' },
         { "lcm-url", required_argument, 0, 'l' },
         { "verbose", no_argument, 0, 'v' },
         { "regexp", required_argument, 0, 'e' },
+        { "start-timestamp", required_argument, 0, 't' },
         { 0, 0, 0, 0 }
     };
 
     char *lcmurl = NULL;
     memset (&l, 0, sizeof (logplayer_t));
-    while ((c = getopt_long (argc, argv, "hp:s:ve:l:", long_opts, 0)) >= 0)
+    while ((c = getopt_long (argc, argv, "hp:s:ve:l:t:", long_opts, 0)) >= 0)
     {
         switch (c) {
             case 's':
@@ -77,6 +82,9 @@ main(int argc, char ** argv)
             case 'e':
                 expression = strdup (optarg);
                 break;
+            case 't':
+                start_timestamp = strtoll (optarg, NULL, 10);
+                break;
             case 'h':
             default:
                 usage (argv[0]);
@@ -94,11 +102,14 @@ main(int argc, char ** argv)
     if (!expression)
         expression = strdup (".*");
 #ifndef WIN32
-    char url_in[strlen(file) + 64];
+    char url_in[strlen(file) + 128];
 #else
     char url_in[2048];
 #endif
     sprintf (url_in, "file://%s?speed=%f", argv[optind], speed);
+    if (start_timestamp > 0)
+        sprintf (url_in + strlen (url_in), "&start_timestamp=%lld",
+                start_timestamp);
     l.lcm_in = lcm_create (url_in);
     if (!l.lcm_in) {
         fprintf (stderr, "Error: Failed to open %s\n", file);
@@ -32,7 +32,7 @@ to next() returning the next L{Event<lcm.Event>} in the log.
 
 @undocumented: __iter__
     """
-    def __init__ (self, path, mode = "r", overwrite = False):
+    def __init__ (self, path, mode = "r", overwrite = False, mmap = False):
         """
         Initializer
 
@@ -42,6 +42,12 @@ to next() returning the next L{Event<lcm.Event>} in the log.
         exists, then EventLog will truncate and overwrite the file if this
         parameter is set to True.  Otherwise, EventLog refuses to overwrite
         existing files and raises a ValueError.
+        @param mmap:  If mode is 'r', read the log through a memory mapping
+        of it instead of a file stream.  Reading is faster, but events
+        appended to the log after it's opened aren't read, seek() goes to the
+        first event at or after the offset, and truncating the log while
+        it's open crashes the interpreter.  Ignored in write mode, and for
+        logs that can't be mapped, such as compressed ones.
         """
         if mode not in [ "r", "w" ]:
             raise ValueError ("invalid event log mode")
@@ -52,7 +58,7 @@ to next() returning the next L{Event<lcm.Event>} in the log.
 
         self.mode = mode
 
-        self.c_eventlog = _lcm.EventLog (path, mode)
+        self.c_eventlog = _lcm.EventLog (path, mode, mmap)
         self.f = None
 
     def seek (self, filepos):
@@ -67,7 +73,7 @@ to next() returning the next L{Event<lcm.Event>} in the log.
         return self.c_eventlog.seek (filepos)
 
     def seek_to_timestamp (self, timestamp):
-        """Seek (approximately) to a particular timestamp.
+        """Seek to the first event at or after a particular timestamp.
 
         @param eventlog The log file object
         @param ts Timestamp of the target event in the log file.
@@ -19,6 +19,9 @@ typedef struct {
     PyObject_HEAD
 
     lcm_eventlog_t *eventlog;
+    // used instead of eventlog in read mode if a memory-mapped reader was
+    // asked for, unless the file can't be mapped
+    lcm_eventlog_reader_t *reader;
     char mode;
 } PyLogObject;
 
@@ -36,6 +39,10 @@ pylog_close (PyLogObject *self)
         lcm_eventlog_destroy (self->eventlog);
         self->eventlog = NULL;
     }
+    if (self->reader) {
+        lcm_eventlog_reader_destroy (self->reader);
+        self->reader = NULL;
+    }
     Py_INCREF (Py_None);
     return Py_None;
 }
@@ -43,7 +50,7 @@ pylog_close (PyLogObject *self)
 static PyObject *
 pylog_read_next_event (PyLogObject *self)
 {
-    if (!self->eventlog) {
+    if (!self->eventlog && !self->reader) {
         PyErr_SetString (PyExc_ValueError, "event log already closed");
         return NULL;
     }
@@ -54,6 +61,28 @@ pylog_read_next_event (PyLogObject *self)
         return NULL;
     }
 
+    if (self->reader) {
+        const lcm_eventlog_event_t *event =
+            lcm_eventlog_reader_next (self->reader);
+        if (!event) {
+            Py_INCREF (Py_None);
+            return Py_None;
+        }
+    #if PY_MAJOR_VERSION >= 3
+        return Py_BuildValue ("LLs#y#",
+                event->eventnum,
+                event->timestamp,
+                event->channel, event->channellen,
+                event->data, event->datalen);
+    #else
+        return Py_BuildValue ("LLs#s#",
+                event->eventnum,
+                event->timestamp,
+                event->channel, event->channellen,
+                event->data, event->datalen);
+    #endif
+    }
+
     lcm_eventlog_event_t *next_event = 
         lcm_eventlog_read_next_event (self->eventlog);
     if (!next_event) {
@@ -85,7 +114,7 @@ pylog_seek (PyLogObject *self, PyObject *arg)
     int64_t offset = PyLong_AsLongLong (arg);
     if (PyErr_Occurred ()) return 0;
 
-    if (!self->eventlog) {
+    if (!self->eventlog && !self->reader) {
         PyErr_SetString (PyExc_ValueError, "event log already closed");
         return NULL;
     }
@@ -96,7 +125,10 @@ pylog_seek (PyLogObject *self, PyObject *arg)
         return NULL;
     }
 
-    fseeko (self->eventlog->f, offset, SEEK_SET);
+    if (self->reader)
+        lcm_eventlog_reader_seek (self->reader, offset);
+    else
+        lcm_eventlog_seek (self->eventlog, offset);
 
     Py_INCREF (Py_None);
     return Py_None;
@@ -108,7 +140,7 @@ pylog_seek_to_timestamp (PyLogObject *self, PyObject *arg)
     int64_t timestamp = PyLong_AsLongLong (arg);
     if (PyErr_Occurred ()) return 0;
 
-    if (!self->eventlog) {
+    if (!self->eventlog && !self->reader) {
         PyErr_SetString (PyExc_ValueError, "event log already closed");
         return NULL;
     }
@@ -119,7 +151,10 @@ pylog_seek_to_timestamp (PyLogObject *self, PyObject *arg)
         return NULL;
     }
 
-    if (0 == lcm_eventlog_seek_to_timestamp(self->eventlog, timestamp)) {
+    int status = self->reader ?
+        lcm_eventlog_reader_seek_to_timestamp (self->reader, timestamp) :
+        lcm_eventlog_seek_to_timestamp (self->eventlog, timestamp);
+    if (0 == status) {
         Py_INCREF (Py_None);
         return Py_None;
     } else {
@@ -144,7 +179,7 @@ pylog_write_next_event (PyLogObject *self, PyObject *args)
         return NULL;
     }
 
-    if (!self->eventlog) {
+    if (!self->eventlog && !self->reader) {
         PyErr_SetString (PyExc_ValueError, "event log already closed");
         return NULL;
     }
@@ -176,6 +211,9 @@ pylog_write_next_event (PyLogObject *self, PyObject *args)
 static PyObject *
 pylog_size (PyLogObject *self)
 {
+    if (self->reader)
+        return PyLong_FromLongLong (lcm_eventlog_reader_size (self->reader));
+
     struct stat sbuf;
     if (0 != fstat (fileno (self->eventlog->f), &sbuf)) {
         PyErr_SetFromErrno (PyExc_IOError);
@@ -187,6 +225,8 @@ pylog_size (PyLogObject *self)
 static PyObject *
 pylog_ftell (PyLogObject *self)
 {
+    if (self->reader)
+        return PyLong_FromLongLong (lcm_eventlog_reader_tell (self->reader));
     return PyLong_FromLongLong (ftello(self->eventlog->f));
 }
 
@@ -221,6 +261,7 @@ pylog_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 	newobj = type->tp_alloc(type, 0);
 	if (newobj != NULL) {
 		((PyLogObject *)newobj)->eventlog = NULL;
+		((PyLogObject *)newobj)->reader = NULL;
         ((PyLogObject *)newobj)->mode = 0;
     }
 	return newobj;
@@ -232,6 +273,9 @@ pylog_dealloc(PyLogObject *self)
     if (self->eventlog) {
         lcm_eventlog_destroy (self->eventlog);
     }
+    if (self->reader) {
+        lcm_eventlog_reader_destroy (self->reader);
+    }
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -239,12 +283,13 @@ static int
 pylog_initobj(PyObject *s, PyObject *args, PyObject *kwds)
 {
     PyLogObject *self = (PyLogObject *)s;
-    static char *keywords[] = { "filename", "mode", 0 };
+    static char *keywords[] = { "filename", "mode", "mmap", 0 };
     char *filename = NULL;
     char *mode = "r";
+    int use_mmap = 0;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|s", keywords, &filename,
-                &mode))
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|si", keywords, &filename,
+                &mode, &use_mmap))
         return -1;
 
     if (!strcmp (mode, "r")) {
@@ -257,6 +302,15 @@ pylog_initobj(PyObject *s, PyObject *args, PyObject *kwds)
     }
 
     if (self->eventlog) { lcm_eventlog_destroy (self->eventlog); }
+    if (self->reader) { lcm_eventlog_reader_destroy (self->reader); }
+    self->eventlog = NULL;
+    self->reader = NULL;
+
+    if (self->mode == 'r' && use_mmap) {
+        self->reader = lcm_eventlog_reader_create (filename);
+        if (self->reader)
+            return 0;
+    }
 
     self->eventlog = lcm_eventlog_create (filename, mode);
     if (!self->eventlog) {
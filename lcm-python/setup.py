@@ -12,12 +12,17 @@ sources = [ \
     os.path.join("..", "lcm", "eventlog.c"),
     os.path.join("..", "lcm", "lcm.c"),
     os.path.join("..", "lcm", "lcm_file.c"),
+    os.path.join("..", "lcm", "lcm_inproc.c"),
+    os.path.join("..", "lcm", "lcm_lz.c"),
     os.path.join("..", "lcm", "lcm_memq.c"),
     os.path.join("..", "lcm", "lcm_mpudpm.c"),
     os.path.join("..", "lcm", "lcm_tcpq.c"),
+    os.path.join("..", "lcm", "lcmtypes", "channel_port_map_delta_t.c"),
     os.path.join("..", "lcm", "lcmtypes", "channel_port_map_update_t.c"),
     os.path.join("..", "lcm", "lcmtypes", "channel_to_port_t.c"),
+    os.path.join("..", "lcm", "lcmtypes", "channel_to_port_move_t.c"),
     os.path.join("..", "lcm", "lcm_udpm.c"),
+    os.path.join("..", "lcm", "lcm_udpu.c"),
     os.path.join("..", "lcm", "ringbuffer.c"),
     os.path.join("..", "lcm", "udpm_util.c")
     ]
@@ -86,6 +91,13 @@ else:
     pkgconfig_biglflags = subprocess.check_output( ["pkg-config", "--libs-only-L", pkg_deps ] ).decode(sys.stdout.encoding)
     library_dirs = [ t[2:] for t in pkgconfig_biglflags.split() ]
 
+    # the shared memory provider isn't available on Windows
+    sources.append(os.path.join("..", "lcm", "lcm_shm.c"))
+
+    # shm_open() lives in librt on older C libraries
+    if sys.platform.startswith('linux'):
+        libraries.append('rt')
+
     # other compiler flags
     pkgconfig_cflags = subprocess.check_output( ["pkg-config", "--cflags", pkg_deps] ).decode(sys.stdout.encoding).split()
     extra_compile_args = [ \
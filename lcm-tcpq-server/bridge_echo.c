@@ -0,0 +1,155 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "bridge_echo.h"
+
+typedef struct {
+    uint32_t hash;
+    int64_t utime;
+    GList *link;        // in bridge_echoes_t.queue
+
+    // the message, compared in full so that a hash collision isn't taken
+    // for an echo
+    char *channel;
+    uint8_t *data;
+    uint32_t data_len;
+} bridge_echo_t;
+
+struct _bridge_echoes {
+    int64_t timeout_usec;
+
+    // all outstanding echoes, oldest first
+    GQueue *queue;
+
+    // hash => GQueue of the outstanding echoes with that hash, oldest first
+    GHashTable *by_hash;
+};
+
+static uint32_t
+fnv1a (uint32_t h, const void *data, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t*) data;
+    for (uint32_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619;
+    }
+    return h;
+}
+
+static uint32_t
+message_hash (const char *channel, const void *data, uint32_t data_len)
+{
+    return fnv1a (fnv1a (2166136261u, channel, strlen (channel)),
+            data, data_len);
+}
+
+bridge_echoes_t *
+bridge_echoes_new (int64_t timeout_usec)
+{
+    bridge_echoes_t *echoes = (bridge_echoes_t*) calloc (1,
+            sizeof (bridge_echoes_t));
+    echoes->timeout_usec = timeout_usec;
+    echoes->queue = g_queue_new ();
+    echoes->by_hash = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+            NULL, (GDestroyNotify) g_queue_free);
+    return echoes;
+}
+
+void
+bridge_echoes_destroy (bridge_echoes_t *echoes)
+{
+    bridge_echo_t *echo;
+    while ((echo = (bridge_echo_t*) g_queue_pop_head (echoes->queue)))
+        free (echo);
+    g_queue_free (echoes->queue);
+    g_hash_table_destroy (echoes->by_hash);
+    free (echoes);
+}
+
+void
+bridge_echoes_add (bridge_echoes_t *echoes, const char *channel,
+        const void *data, uint32_t data_len, int64_t now)
+{
+    // the channel and data are kept in the same allocation
+    size_t channel_size = strlen (channel) + 1;
+    bridge_echo_t *echo = (bridge_echo_t*) malloc (sizeof (bridge_echo_t) +
+            channel_size + data_len);
+    echo->hash = message_hash (channel, data, data_len);
+    echo->utime = now;
+    echo->channel = (char*) (echo + 1);
+    memcpy (echo->channel, channel, channel_size);
+    echo->data = (uint8_t*) echo->channel + channel_size;
+    if (data_len)
+        memcpy (echo->data, data, data_len);
+    echo->data_len = data_len;
+    g_queue_push_tail (echoes->queue, echo);
+    echo->link = g_queue_peek_tail_link (echoes->queue);
+
+    gpointer key = GUINT_TO_POINTER (echo->hash);
+    GQueue *same_hash = (GQueue*) g_hash_table_lookup (echoes->by_hash, key);
+    if (!same_hash) {
+        same_hash = g_queue_new ();
+        g_hash_table_insert (echoes->by_hash, key, same_hash);
+    }
+    g_queue_push_tail (same_hash, echo);
+}
+
+// Removes an echo from the hash index
+static void
+unindex (bridge_echoes_t *echoes, GQueue *same_hash, GList *link)
+{
+    bridge_echo_t *echo = (bridge_echo_t*) link->data;
+    g_queue_delete_link (same_hash, link);
+    if (g_queue_is_empty (same_hash))
+        g_hash_table_remove (echoes->by_hash, GUINT_TO_POINTER (echo->hash));
+}
+
+static void
+expire (bridge_echoes_t *echoes, int64_t now)
+{
+    bridge_echo_t *echo;
+    while ((echo = (bridge_echo_t*) g_queue_peek_head (echoes->queue)) &&
+            echo->utime + echoes->timeout_usec < now) {
+        g_queue_pop_head (echoes->queue);
+        // echoes expire in the order they were added, so it's also the
+        // oldest one with its hash
+        GQueue *same_hash = (GQueue*) g_hash_table_lookup (echoes->by_hash,
+                GUINT_TO_POINTER (echo->hash));
+        unindex (echoes, same_hash, g_queue_peek_head_link (same_hash));
+        free (echo);
+    }
+}
+
+int
+bridge_echoes_match (bridge_echoes_t *echoes, const char *channel,
+        const void *data, uint32_t data_len, int64_t now)
+{
+    expire (echoes, now);
+    if (g_queue_is_empty (echoes->queue))
+        return 0;
+
+    uint32_t hash = message_hash (channel, data, data_len);
+    GQueue *same_hash = (GQueue*) g_hash_table_lookup (echoes->by_hash,
+            GUINT_TO_POINTER (hash));
+    if (!same_hash)
+        return 0;
+    for (GList *link = same_hash->head; link; link = link->next) {
+        bridge_echo_t *echo = (bridge_echo_t*) link->data;
+        if (echo->data_len != data_len || strcmp (echo->channel, channel) ||
+                memcmp (echo->data, data, data_len))
+            continue;
+        unindex (echoes, same_hash, link);
+        g_queue_delete_link (echoes->queue, echo->link);
+        free (echo);
+        return 1;
+    }
+    return 0;
+}
+
+unsigned int
+bridge_echoes_size (bridge_echoes_t *echoes)
+{
+    return g_queue_get_length (echoes->queue);
+}
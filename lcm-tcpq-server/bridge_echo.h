@@ -0,0 +1,42 @@
+#ifndef __lcm_tcpq_server_bridge_echo_h__
+#define __lcm_tcpq_server_bridge_echo_h__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Remembers the messages that lcm-tcpq-server publishes to its bridge
+// network, so that they aren't relayed back to the clients when the bridge
+// loops them back.  A copy of each message is kept, and a message received
+// from the bridge is only an echo if its channel and contents are the same.
+// Any outstanding message can be matched, so an echo that the bridge drops
+// only costs memory until it expires.  An identical message published by
+// another bridge node meanwhile is taken for that echo, which is harmless
+// unless the echo was dropped: the clients get as many copies of the message
+// as were published, whichever of them is relayed.
+typedef struct _bridge_echoes bridge_echoes_t;
+
+// Echoes that don't arrive within timeout_usec are forgotten
+bridge_echoes_t *bridge_echoes_new (int64_t timeout_usec);
+
+void bridge_echoes_destroy (bridge_echoes_t *echoes);
+
+// Records a message about to be published to the bridge at time now
+void bridge_echoes_add (bridge_echoes_t *echoes, const char *channel,
+        const void *data, uint32_t data_len, int64_t now);
+
+// Returns 1 if a message received from the bridge at time now is the echo of
+// an outstanding message, which is then forgotten.  Returns 0 otherwise.
+int bridge_echoes_match (bridge_echoes_t *echoes, const char *channel,
+        const void *data, uint32_t data_len, int64_t now);
+
+// Number of outstanding messages
+unsigned int bridge_echoes_size (bridge_echoes_t *echoes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,914 @@
+// lcm-tcpq-server
+//
+// Relays messages between clients that use the tcpq:// provider, and
+// optionally between those clients and another LCM network.  It speaks the
+// same protocol as the Java lcm.lcm.TCPService, but runs all clients from a
+// single epoll loop:
+//
+//  - every relayed message is serialized once into a reference counted
+//    frame, which is queued on each subscribed client without copying.
+//  - each client's output queue is bounded.  When a slow client's queue is
+//    full, messages are dropped according to the drop policy instead of
+//    stalling every other client.
+//  - the set of clients subscribed to a channel is cached, so subscription
+//    regexes are only evaluated the first time a channel is seen after the
+//    subscriptions change.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+
+#include <lcm/lcm.h>
+
+#include "bridge_echo.h"
+
+#define MAGIC_SERVER 0x287617fa      // first word sent by server
+#define MAGIC_CLIENT 0x287617fb      // first word sent by client
+#define PROTOCOL_VERSION 0x0100
+#define MESSAGE_TYPE_PUBLISH     1
+#define MESSAGE_TYPE_SUBSCRIBE   2
+#define MESSAGE_TYPE_UNSUBSCRIBE 3
+
+#define DEFAULT_PORT 7700
+#define DEFAULT_MAX_QUEUE_KB 4096
+
+// initial size of each client's receive buffer.  It grows if a single frame
+// doesn't fit.
+#define RECV_BUF_SIZE (64 * 1024)
+
+// frames larger than this are treated as garbage, and the client is dropped
+#define MAX_FRAME_SIZE (1 << 30)
+
+// maximum length of a channel name or subscription regex
+#define MAX_CHANNEL_LEN 4096
+
+// number of queued frames written with a single writev()
+#define MAX_WRITE_IOV 64
+
+// number of channels to remember subscribers for before starting over
+#define MAX_MATCH_CACHE_SIZE 10000
+
+// how long to remember a message published to the bridge, so that it isn't
+// relayed back to the clients when the bridge network loops it back.
+#define BRIDGE_ECHO_USEC 1000000
+
+typedef enum {
+    DROP_OLDEST,
+    DROP_NEWEST,
+    DROP_DISCONNECT
+} drop_policy_t;
+
+// A complete PUBLISH frame, shared by all the clients it is queued on
+typedef struct {
+    int refcount;
+    uint32_t len;
+    uint8_t data[];
+} frame_t;
+
+typedef struct {
+    char *channel;
+    GRegex *regex;
+} subscription_t;
+
+typedef struct _server server_t;
+
+typedef struct {
+    server_t *server;
+    int fd;
+    char *name;
+
+    int handshake_done;
+    uint8_t *recv_buf;
+    uint32_t recv_buf_size;
+    uint32_t recv_buf_len;
+
+    GPtrArray *subs;
+
+    GQueue *out_queue;
+    uint32_t out_offset;    // bytes of the first queued frame already sent
+    uint64_t out_bytes;     // bytes queued and not sent yet
+    int want_write;         // EPOLLOUT is set
+
+    int dead;
+    uint64_t dropped;
+} client_t;
+
+struct _server {
+    int epoll_fd;
+    int listen_fd;
+
+    GList *clients;
+    GList *dead_clients;
+
+    // channel name => GPtrArray of subscribed client_t*
+    GHashTable *match_cache;
+
+    uint64_t max_queue_bytes;
+    drop_policy_t drop_policy;
+
+    lcm_t *bridge;
+    bridge_echoes_t *bridge_echoes;
+
+    char *chan_buf;
+    uint32_t chan_buf_size;
+
+    int verbose;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t dropped;
+};
+
+static volatile sig_atomic_t _quit = 0;
+
+static void
+sig_handler (int signum)
+{
+    _quit = 1;
+}
+
+static int64_t
+timestamp_now (void)
+{
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static uint32_t
+read_uint32 (const uint8_t *p)
+{
+    uint32_t v;
+    memcpy (&v, p, 4);
+    return ntohl (v);
+}
+
+static void
+write_uint32 (uint8_t *p, uint32_t v)
+{
+    v = htonl (v);
+    memcpy (p, &v, 4);
+}
+
+static frame_t *
+frame_new (const char *channel, uint32_t channel_len, const void *data,
+        uint32_t data_len)
+{
+    uint32_t len = 12 + channel_len + data_len;
+    frame_t *frame = (frame_t*) malloc (sizeof (frame_t) + len);
+    if (!frame)
+        return NULL;
+    frame->refcount = 0;
+    frame->len = len;
+    write_uint32 (frame->data, MESSAGE_TYPE_PUBLISH);
+    write_uint32 (frame->data + 4, channel_len);
+    memcpy (frame->data + 8, channel, channel_len);
+    write_uint32 (frame->data + 8 + channel_len, data_len);
+    memcpy (frame->data + 12 + channel_len, data, data_len);
+    return frame;
+}
+
+static void
+frame_unref (frame_t *frame)
+{
+    if (--frame->refcount <= 0)
+        free (frame);
+}
+
+static void
+subscription_free (gpointer data)
+{
+    subscription_t *sub = (subscription_t*) data;
+    g_regex_unref (sub->regex);
+    g_free (sub->channel);
+    free (sub);
+}
+
+static void
+free_subscriber_list (gpointer data)
+{
+    g_ptr_array_free ((GPtrArray*) data, TRUE);
+}
+
+static void
+match_cache_invalidate (server_t *server)
+{
+    g_hash_table_remove_all (server->match_cache);
+}
+
+static void
+client_set_want_write (client_t *client, int want_write)
+{
+    if (client->want_write == want_write)
+        return;
+    struct epoll_event ev;
+    memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+    ev.data.ptr = client;
+    if (epoll_ctl (client->server->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev) < 0) {
+        perror ("epoll_ctl");
+        return;
+    }
+    client->want_write = want_write;
+}
+
+// Marks the client for removal at the end of the current loop iteration.
+// Clients aren't freed right away, since they may still be referenced from
+// a match cache entry that is being iterated over.
+static void
+client_kill (client_t *client)
+{
+    if (client->dead)
+        return;
+    server_t *server = client->server;
+    client->dead = 1;
+    server->dead_clients = g_list_prepend (server->dead_clients, client);
+}
+
+static void
+client_destroy (client_t *client)
+{
+    server_t *server = client->server;
+    if (server->verbose)
+        printf ("%s disconnected (%" G_GUINT64_FORMAT " messages dropped)\n",
+                client->name, client->dropped);
+
+    server->clients = g_list_remove (server->clients, client);
+    if (client->subs->len)
+        match_cache_invalidate (server);
+
+    epoll_ctl (server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close (client->fd);
+
+    frame_t *frame;
+    while ((frame = (frame_t*) g_queue_pop_head (client->out_queue)))
+        frame_unref (frame);
+    g_queue_free (client->out_queue);
+    for (unsigned int i = 0; i < client->subs->len; i++)
+        subscription_free (g_ptr_array_index (client->subs, i));
+    g_ptr_array_free (client->subs, TRUE);
+    free (client->recv_buf);
+    g_free (client->name);
+    free (client);
+}
+
+// Writes as much of the output queue as the socket accepts
+static void
+client_flush (client_t *client)
+{
+    while (!g_queue_is_empty (client->out_queue)) {
+        struct iovec iov[MAX_WRITE_IOV];
+        int iovcnt = 0;
+        for (GList *elem = client->out_queue->head;
+                elem && iovcnt < MAX_WRITE_IOV; elem = elem->next) {
+            frame_t *frame = (frame_t*) elem->data;
+            uint32_t offset = iovcnt ? 0 : client->out_offset;
+            iov[iovcnt].iov_base = frame->data + offset;
+            iov[iovcnt].iov_len = frame->len - offset;
+            iovcnt++;
+        }
+
+        ssize_t n = writev (client->fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (client->server->verbose)
+                fprintf (stderr, "%s: %s\n", client->name, strerror (errno));
+            client_kill (client);
+            return;
+        }
+
+        client->server->bytes_out += n;
+        client->out_bytes -= n;
+        while (n > 0) {
+            frame_t *frame = (frame_t*) g_queue_peek_head (client->out_queue);
+            uint32_t remaining = frame->len - client->out_offset;
+            if (n < remaining) {
+                client->out_offset += n;
+                break;
+            }
+            n -= remaining;
+            client->out_offset = 0;
+            g_queue_pop_head (client->out_queue);
+            frame_unref (frame);
+        }
+    }
+
+    client_set_want_write (client, !g_queue_is_empty (client->out_queue));
+}
+
+static void
+client_enqueue (client_t *client, frame_t *frame)
+{
+    if (client->dead)
+        return;
+
+    server_t *server = client->server;
+    if (client->out_bytes + frame->len > server->max_queue_bytes &&
+            !g_queue_is_empty (client->out_queue)) {
+        switch (server->drop_policy) {
+            case DROP_NEWEST:
+                client->dropped++;
+                server->dropped++;
+                return;
+            case DROP_DISCONNECT:
+                fprintf (stderr, "%s is not keeping up, disconnecting\n",
+                        client->name);
+                client_kill (client);
+                return;
+            case DROP_OLDEST:
+                // The first frame can't be dropped if part of it was
+                // already sent.
+                while (client->out_bytes + frame->len > server->max_queue_bytes) {
+                    GList *victim = client->out_queue->head;
+                    if (client->out_offset)
+                        victim = victim->next;
+                    if (!victim)
+                        break;
+                    frame_t *old = (frame_t*) victim->data;
+                    client->out_bytes -= old->len;
+                    g_queue_delete_link (client->out_queue, victim);
+                    frame_unref (old);
+                    client->dropped++;
+                    server->dropped++;
+                }
+                break;
+        }
+    }
+
+    frame->refcount++;
+    g_queue_push_tail (client->out_queue, frame);
+    client->out_bytes += frame->len;
+
+    // If nothing was waiting, try to send it right away.  Otherwise, it
+    // goes out when the socket becomes writable again.
+    if (!client->want_write)
+        client_flush (client);
+}
+
+// Returns the clients subscribed to channel.  channel must be NUL terminated.
+static GPtrArray *
+get_subscribers (server_t *server, const char *channel)
+{
+    GPtrArray *subscribers =
+        (GPtrArray*) g_hash_table_lookup (server->match_cache, channel);
+    if (subscribers)
+        return subscribers;
+
+    if (g_hash_table_size (server->match_cache) >= MAX_MATCH_CACHE_SIZE)
+        match_cache_invalidate (server);
+
+    subscribers = g_ptr_array_new ();
+    for (GList *elem = server->clients; elem; elem = elem->next) {
+        client_t *client = (client_t*) elem->data;
+        for (unsigned int i = 0; i < client->subs->len; i++) {
+            subscription_t *sub =
+                (subscription_t*) g_ptr_array_index (client->subs, i);
+            if (g_regex_match (sub->regex, channel, (GRegexMatchFlags) 0, NULL)) {
+                g_ptr_array_add (subscribers, client);
+                break;
+            }
+        }
+    }
+    g_hash_table_insert (server->match_cache, g_strdup (channel), subscribers);
+    return subscribers;
+}
+
+static void
+relay (server_t *server, const char *channel, uint32_t channel_len,
+        const void *data, uint32_t data_len)
+{
+    GPtrArray *subscribers = get_subscribers (server, channel);
+    if (!subscribers->len)
+        return;
+
+    frame_t *frame = frame_new (channel, channel_len, data, data_len);
+    if (!frame) {
+        fprintf (stderr, "Memory allocation error\n");
+        return;
+    }
+    // Hold a reference while queueing, so the frame isn't freed by a client
+    // that manages to send it right away.
+    frame->refcount = 1;
+    for (unsigned int i = 0; i < subscribers->len; i++)
+        client_enqueue ((client_t*) g_ptr_array_index (subscribers, i), frame);
+    frame_unref (frame);
+}
+
+static void
+bridge_publish (server_t *server, const char *channel, const void *data,
+        uint32_t data_len)
+{
+    bridge_echoes_add (server->bridge_echoes, channel, data, data_len,
+            timestamp_now ());
+
+    if (lcm_publish (server->bridge, channel, data, data_len) < 0) {
+        fprintf (stderr, "Error publishing %s to the bridge\n", channel);
+        // won't be looped back.  Forget it, or an identical one.
+        bridge_echoes_match (server->bridge_echoes, channel, data, data_len,
+                timestamp_now ());
+    }
+}
+
+static void
+bridge_handler (const lcm_recv_buf_t *rbuf, const char *channel, void *user)
+{
+    server_t *server = (server_t*) user;
+    if (bridge_echoes_match (server->bridge_echoes, channel, rbuf->data,
+                rbuf->data_size, timestamp_now ()))
+        return;
+    server->bytes_in += rbuf->data_size;
+    relay (server, channel, strlen (channel), rbuf->data, rbuf->data_size);
+}
+
+// Returns a NUL terminated copy of a channel name from a frame
+static const char *
+terminate_channel (server_t *server, const uint8_t *channel,
+        uint32_t channel_len)
+{
+    if (server->chan_buf_size < channel_len + 1) {
+        server->chan_buf_size = channel_len + 1;
+        server->chan_buf = (char*) realloc (server->chan_buf,
+                server->chan_buf_size);
+    }
+    memcpy (server->chan_buf, channel, channel_len);
+    server->chan_buf[channel_len] = 0;
+    return server->chan_buf;
+}
+
+static void
+client_subscribe (client_t *client, const char *channel)
+{
+    subscription_t *sub = (subscription_t*) calloc (1, sizeof (subscription_t));
+    char *regexbuf = g_strdup_printf ("^%s$", channel);
+    GError *rerr = NULL;
+    sub->regex = g_regex_new (regexbuf, (GRegexCompileFlags) 0,
+            (GRegexMatchFlags) 0, &rerr);
+    g_free (regexbuf);
+    if (rerr) {
+        fprintf (stderr, "%s: invalid subscription %s: %s\n", client->name,
+                channel, rerr->message);
+        g_error_free (rerr);
+        free (sub);
+        return;
+    }
+    sub->channel = g_strdup (channel);
+    g_ptr_array_add (client->subs, sub);
+    match_cache_invalidate (client->server);
+
+    if (client->server->verbose)
+        printf ("%s subscribed to %s\n", client->name, channel);
+}
+
+static void
+client_unsubscribe (client_t *client, const char *channel)
+{
+    for (unsigned int i = 0; i < client->subs->len; i++) {
+        subscription_t *sub =
+            (subscription_t*) g_ptr_array_index (client->subs, i);
+        if (!strcmp (sub->channel, channel)) {
+            g_ptr_array_remove_index (client->subs, i);
+            subscription_free (sub);
+            match_cache_invalidate (client->server);
+            if (client->server->verbose)
+                printf ("%s unsubscribed from %s\n", client->name, channel);
+            return;
+        }
+    }
+}
+
+// Handles one frame at p, which holds avail bytes.  Returns the number of
+// bytes consumed, 0 if the frame is incomplete, or -1 if it is garbage.
+static int64_t
+client_handle_frame (client_t *client, const uint8_t *p, uint32_t avail)
+{
+    server_t *server = client->server;
+
+    if (!client->handshake_done) {
+        if (avail < 8)
+            return 0;
+        if (read_uint32 (p) != MAGIC_CLIENT) {
+            fprintf (stderr, "%s: invalid handshake\n", client->name);
+            return -1;
+        }
+        client->handshake_done = 1;
+        return 8;
+    }
+
+    if (avail < 8)
+        return 0;
+    uint32_t type = read_uint32 (p);
+    uint32_t channel_len = read_uint32 (p + 4);
+    if (channel_len > MAX_CHANNEL_LEN) {
+        fprintf (stderr, "%s: invalid channel length %u\n", client->name,
+                channel_len);
+        return -1;
+    }
+
+    switch (type) {
+        case MESSAGE_TYPE_PUBLISH: {
+            if (avail < 12 + channel_len)
+                return 0;
+            uint32_t data_len = read_uint32 (p + 8 + channel_len);
+            if (data_len > MAX_FRAME_SIZE - 12 - channel_len) {
+                fprintf (stderr, "%s: invalid message length %u\n",
+                        client->name, data_len);
+                return -1;
+            }
+            if (avail < 12 + channel_len + data_len)
+                return 0;
+            const char *channel = terminate_channel (server, p + 8, channel_len);
+            const uint8_t *data = p + 12 + channel_len;
+            server->bytes_in += channel_len + data_len + 8;
+            relay (server, channel, channel_len, data, data_len);
+            if (server->bridge)
+                bridge_publish (server, channel, data, data_len);
+            return 12 + channel_len + data_len;
+        }
+        case MESSAGE_TYPE_SUBSCRIBE:
+        case MESSAGE_TYPE_UNSUBSCRIBE: {
+            if (avail < 8 + channel_len)
+                return 0;
+            const char *channel = terminate_channel (server, p + 8, channel_len);
+            if (type == MESSAGE_TYPE_SUBSCRIBE)
+                client_subscribe (client, channel);
+            else
+                client_unsubscribe (client, channel);
+            return 8 + channel_len;
+        }
+        default:
+            fprintf (stderr, "%s: invalid message type %u\n", client->name, type);
+            return -1;
+    }
+}
+
+static void
+client_read (client_t *client)
+{
+    if (client->recv_buf_len == client->recv_buf_size) {
+        // a single frame doesn't fit.  Make room for it.
+        uint32_t new_size = client->recv_buf_size * 2;
+        uint8_t *new_buf = (uint8_t*) realloc (client->recv_buf, new_size);
+        if (!new_buf) {
+            fprintf (stderr, "Memory allocation error\n");
+            client_kill (client);
+            return;
+        }
+        client->recv_buf = new_buf;
+        client->recv_buf_size = new_size;
+    }
+
+    ssize_t n = read (client->fd, client->recv_buf + client->recv_buf_len,
+            client->recv_buf_size - client->recv_buf_len);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+    if (n <= 0) {
+        client_kill (client);
+        return;
+    }
+    client->recv_buf_len += n;
+
+    // dispatch every complete frame in the buffer
+    uint32_t pos = 0;
+    while (pos < client->recv_buf_len && !client->dead) {
+        int64_t consumed = client_handle_frame (client, client->recv_buf + pos,
+                client->recv_buf_len - pos);
+        if (consumed < 0) {
+            client_kill (client);
+            return;
+        }
+        if (!consumed)
+            break;
+        pos += consumed;
+    }
+
+    if (pos) {
+        memmove (client->recv_buf, client->recv_buf + pos,
+                client->recv_buf_len - pos);
+        client->recv_buf_len -= pos;
+    }
+}
+
+static void
+accept_client (server_t *server)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof (addr);
+    int fd = accept4 (server->listen_fd, (struct sockaddr*) &addr, &addrlen,
+            SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            perror ("accept");
+        return;
+    }
+
+    int opt = 1;
+    setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof (opt));
+
+    client_t *client = (client_t*) calloc (1, sizeof (client_t));
+    client->server = server;
+    client->fd = fd;
+    client->name = g_strdup_printf ("%s:%d", inet_ntoa (addr.sin_addr),
+            ntohs (addr.sin_port));
+    client->recv_buf_size = RECV_BUF_SIZE;
+    client->recv_buf = (uint8_t*) malloc (client->recv_buf_size);
+    client->subs = g_ptr_array_new ();
+    client->out_queue = g_queue_new ();
+
+    struct epoll_event ev;
+    memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = client;
+    if (epoll_ctl (server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror ("epoll_ctl");
+        close (fd);
+        g_queue_free (client->out_queue);
+        g_ptr_array_free (client->subs, TRUE);
+        free (client->recv_buf);
+        g_free (client->name);
+        free (client);
+        return;
+    }
+    server->clients = g_list_prepend (server->clients, client);
+
+    uint8_t handshake[8];
+    write_uint32 (handshake, MAGIC_SERVER);
+    write_uint32 (handshake + 4, PROTOCOL_VERSION);
+    if (write (fd, handshake, 8) != 8) {
+        client_kill (client);
+        return;
+    }
+
+    if (server->verbose)
+        printf ("%s connected\n", client->name);
+}
+
+static int
+setup_listen_socket (server_t *server, const char *bind_addr, int port)
+{
+    struct sockaddr_in addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (port);
+    if (!inet_aton (bind_addr, &addr.sin_addr)) {
+        fprintf (stderr, "Invalid bind address %s\n", bind_addr);
+        return -1;
+    }
+
+    server->listen_fd = socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK |
+            SOCK_CLOEXEC, 0);
+    if (server->listen_fd < 0) {
+        perror ("socket");
+        return -1;
+    }
+    int opt = 1;
+    setsockopt (server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof (opt));
+    if (bind (server->listen_fd, (struct sockaddr*) &addr, sizeof (addr)) < 0) {
+        perror ("bind");
+        return -1;
+    }
+    if (listen (server->listen_fd, SOMAXCONN) < 0) {
+        perror ("listen");
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset (&ev, 0, sizeof (ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &server->listen_fd;
+    if (epoll_ctl (server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &ev) < 0) {
+        perror ("epoll_ctl");
+        return -1;
+    }
+    return 0;
+}
+
+static void
+print_stats (server_t *server, int64_t start_utime, int64_t *last_utime)
+{
+    int64_t now = timestamp_now ();
+    double dt = (now - *last_utime) / 1e6;
+    *last_utime = now;
+    printf ("%10.3f : %10.1f kB/s in, %10.1f kB/s out, %d clients, "
+            "%" G_GUINT64_FORMAT " dropped\n",
+            (now - start_utime) / 1e6,
+            server->bytes_in / 1024.0 / dt, server->bytes_out / 1024.0 / dt,
+            g_list_length (server->clients), server->dropped);
+    server->bytes_in = 0;
+    server->bytes_out = 0;
+    server->dropped = 0;
+}
+
+static void usage ()
+{
+    fprintf (stderr, "usage: lcm-tcpq-server [options] [PORT]\n"
+            "\n"
+            "    Relays LCM messages between clients that use the tcpq:// provider.\n"
+            "    Listens on PORT, which defaults to %d.\n"
+            "\n"
+            "Options:\n"
+            "\n"
+            "  -a, --bind=ADDR            Listen on the address ADDR.\n"
+            "                             (default: 0.0.0.0)\n"
+            "  -b, --bridge=URL           Also relay messages to and from the LCM\n"
+            "                             network at URL, e.g. udpm://\n"
+            "  -d, --drop=POLICY          What to do when a client's output queue is full.\n"
+            "                             POLICY is one of:\n"
+            "                               oldest      drop its oldest queued messages\n"
+            "                               newest      drop the new message\n"
+            "                               disconnect  disconnect the client\n"
+            "                             (default: oldest)\n"
+            "  -h, --help                 Shows this help text and exits\n"
+            "  -q, --max-queue-kb=KB      Maximum size of the messages queued for a\n"
+            "                             single client.  (default: %d kB)\n"
+            "  -v, --verbose              Print connections, subscriptions and\n"
+            "                             throughput once a second.\n"
+            "\n", DEFAULT_PORT, DEFAULT_MAX_QUEUE_KB);
+}
+
+int main (int argc, char *argv[])
+{
+    setlinebuf (stdout);
+
+    server_t server;
+    memset (&server, 0, sizeof (server));
+    server.listen_fd = -1;
+    server.max_queue_bytes = (uint64_t) DEFAULT_MAX_QUEUE_KB * 1024;
+    server.drop_policy = DROP_OLDEST;
+
+    int port = DEFAULT_PORT;
+    char *bind_addr = "0.0.0.0";
+    char *bridge_url = NULL;
+
+    char *optstring = "a:b:d:hq:v";
+    int c;
+    struct option long_opts[] = {
+        { "bind", required_argument, 0, 'a' },
+        { "bridge", required_argument, 0, 'b' },
+        { "drop", required_argument, 0, 'd' },
+        { "help", no_argument, 0, 'h' },
+        { "max-queue-kb", required_argument, 0, 'q' },
+        { "verbose", no_argument, 0, 'v' },
+        { 0, 0, 0, 0 }
+    };
+
+    while ((c = getopt_long (argc, argv, optstring, long_opts, 0)) >= 0)
+    {
+        switch (c) {
+            case 'a':
+                bind_addr = optarg;
+                break;
+            case 'b':
+                bridge_url = optarg;
+                break;
+            case 'd':
+                if (!strcmp (optarg, "oldest"))
+                    server.drop_policy = DROP_OLDEST;
+                else if (!strcmp (optarg, "newest"))
+                    server.drop_policy = DROP_NEWEST;
+                else if (!strcmp (optarg, "disconnect"))
+                    server.drop_policy = DROP_DISCONNECT;
+                else {
+                    usage ();
+                    return 1;
+                }
+                break;
+            case 'q':
+                {
+                    char *eptr = NULL;
+                    long kb = strtol (optarg, &eptr, 10);
+                    if (*eptr || kb <= 0) {
+                        usage ();
+                        return 1;
+                    }
+                    server.max_queue_bytes = (uint64_t) kb * 1024;
+                }
+                break;
+            case 'v':
+                server.verbose = 1;
+                break;
+            case 'h':
+            default:
+                usage ();
+                return 1;
+        };
+    }
+
+    if (optind == argc - 1) {
+        char *eptr = NULL;
+        port = strtol (argv[optind], &eptr, 10);
+        if (*eptr || port <= 0 || port > 65535) {
+            usage ();
+            return 1;
+        }
+    } else if (optind < argc - 1) {
+        usage ();
+        return 1;
+    }
+
+    signal (SIGPIPE, SIG_IGN);
+    signal (SIGINT, sig_handler);
+    signal (SIGTERM, sig_handler);
+
+    server.match_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+            g_free, free_subscriber_list);
+    server.bridge_echoes = bridge_echoes_new (BRIDGE_ECHO_USEC);
+
+    server.epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+    if (server.epoll_fd < 0) {
+        perror ("epoll_create1");
+        return 1;
+    }
+    if (setup_listen_socket (&server, bind_addr, port) < 0)
+        return 1;
+
+    if (bridge_url) {
+        server.bridge = lcm_create (bridge_url);
+        if (!server.bridge) {
+            fprintf (stderr, "Couldn't initialize LCM with %s\n", bridge_url);
+            return 1;
+        }
+        lcm_subscribe (server.bridge, ".*", bridge_handler, &server);
+
+        struct epoll_event ev;
+        memset (&ev, 0, sizeof (ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = server.bridge;
+        if (epoll_ctl (server.epoll_fd, EPOLL_CTL_ADD,
+                    lcm_get_fileno (server.bridge), &ev) < 0) {
+            perror ("epoll_ctl");
+            return 1;
+        }
+    }
+
+    printf ("Listening on %s:%d\n", bind_addr, port);
+
+    int64_t start_utime = timestamp_now ();
+    int64_t last_stats_utime = start_utime;
+
+    while (!_quit) {
+        struct epoll_event events[64];
+        int nevents = epoll_wait (server.epoll_fd, events, 64, 1000);
+        if (nevents < 0) {
+            if (errno == EINTR)
+                continue;
+            perror ("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < nevents; i++) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &server.listen_fd) {
+                accept_client (&server);
+            } else if (server.bridge && ptr == server.bridge) {
+                lcm_handle (server.bridge);
+            } else {
+                client_t *client = (client_t*) ptr;
+                if (client->dead)
+                    continue;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    client_kill (client);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT)
+                    client_flush (client);
+                if (events[i].events & EPOLLIN && !client->dead)
+                    client_read (client);
+            }
+        }
+
+        for (GList *elem = server.dead_clients; elem; elem = elem->next)
+            client_destroy ((client_t*) elem->data);
+        g_list_free (server.dead_clients);
+        server.dead_clients = NULL;
+
+        if (server.verbose && timestamp_now () - last_stats_utime >= 1000000)
+            print_stats (&server, start_utime, &last_stats_utime);
+    }
+
+    while (server.clients)
+        client_destroy ((client_t*) server.clients->data);
+    g_hash_table_destroy (server.match_cache);
+    bridge_echoes_destroy (server.bridge_echoes);
+    if (server.bridge)
+        lcm_destroy (server.bridge);
+    close (server.listen_fd);
+    close (server.epoll_fd);
+    free (server.chan_buf);
+    return 0;
+}
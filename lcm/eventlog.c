@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <string.h>
+#include <errno.h>
 #include <assert.h>
 #include <stdlib.h>
 #ifdef WIN32
@@ -10,13 +11,620 @@
 
 #include "ioutils.h"
 #include "eventlog.h"
+#include "lcm_lz.h"
 
 #ifdef WIN32
 #include "./windows/WinPorting.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 #define MAGIC ((int32_t) 0xEDA1DA01L)
 
+// size of an event in the log, not counting its channel and data: magic,
+// eventnum, timestamp, channellen, datalen
+#define EVENT_HEADER_SIZE 28
+
+// The sidecar index is a header (INDEX_MAGIC, INDEX_VERSION) followed by
+// records, in the same byte order as the log.  Each record starts with its
+// type:
+//   INDEX_RECORD_CHANNEL  channel id, name length, name
+//   INDEX_RECORD_ENTRY    channel id, offset, eventnum, timestamp
+// Channel ids are assigned in order starting at 0, and a channel's record
+// comes before any entry that uses it.  Entries are in log order.
+#define INDEX_MAGIC ((int32_t) 0xEDA1DA1DL)
+#define INDEX_VERSION 1
+#define INDEX_RECORD_CHANNEL 1
+#define INDEX_RECORD_ENTRY 2
+
+// A compressed log is a header (ZLOG_MAGIC, ZLOG_VERSION) followed by blocks.
+// Each block is a header (BLOCK_MAGIC, raw size, stored size, timestamp of
+// its first event) and its events, in the same format as in other logs,
+// compressed with lcm_lz_compress().  A block whose stored size is its raw
+// size isn't compressed.  Blocks are independent of each other.
+#define ZLOG_MAGIC ((int32_t) 0xEDA1DA2CL)
+#define ZLOG_VERSION 1
+#define BLOCK_MAGIC ((int32_t) 0xEDA1DA0BL)
+#define BLOCK_HEADER_SIZE 20
+
+// Blocks are written once their events add up to this size
+#define BLOCK_TARGET_SIZE (1 << 20)
+
+typedef struct _index_entry index_entry_t;
+struct _index_entry {
+    int64_t offset;
+    int64_t eventnum;
+    int64_t timestamp;
+    int32_t channel_id;
+};
+
+struct _lcm_eventlog_index_t {
+    // channel names, by id
+    char **channels;
+    int32_t nchannels;
+    int32_t channels_size;
+    // channel id + 1 of each channel, by hash of its name.  0 if unused.
+    int32_t *hash;
+    int32_t hash_size;
+
+    // when reading
+    index_entry_t *entries;
+    int64_t nentries;
+    int64_t entries_size;
+
+    // when writing
+    FILE *f;
+    int every_events;
+    int64_t every_usec;
+    int64_t next_offset;        // where the next event goes in the log
+    int events_since_entry;
+    int have_entry;
+    int64_t last_entry_time;
+};
+
+static uint32_t index_hash(const char *s, int32_t len)
+{
+    uint32_t h = 2166136261u;
+    for (int32_t i = 0; i < len; i++)
+        h = (h ^ (uint8_t) s[i]) * 16777619u;
+    return h;
+}
+
+static void index_hash_insert(lcm_eventlog_index_t *idx, int32_t id)
+{
+    const char *name = idx->channels[id];
+    uint32_t i = index_hash(name, strlen(name)) & (idx->hash_size - 1);
+    while (idx->hash[i])
+        i = (i + 1) & (idx->hash_size - 1);
+    idx->hash[i] = id + 1;
+}
+
+static int32_t index_find_channel(lcm_eventlog_index_t *idx, const char *name,
+        int32_t len)
+{
+    if (!idx->hash_size)
+        return -1;
+    uint32_t i = index_hash(name, len) & (idx->hash_size - 1);
+    while (idx->hash[i]) {
+        const char *s = idx->channels[idx->hash[i] - 1];
+        if (!strncmp(s, name, len) && s[len] == 0)
+            return idx->hash[i] - 1;
+        i = (i + 1) & (idx->hash_size - 1);
+    }
+    return -1;
+}
+
+static int32_t index_add_channel(lcm_eventlog_index_t *idx, const char *name,
+        int32_t len)
+{
+    if (idx->nchannels == idx->channels_size) {
+        int32_t size = idx->channels_size ? idx->channels_size * 2 : 64;
+        char **channels = (char**) realloc(idx->channels, size * sizeof(char*));
+        if (!channels)
+            return -1;
+        idx->channels = channels;
+        idx->channels_size = size;
+    }
+    char *s = (char*) malloc(len + 1);
+    if (!s)
+        return -1;
+    memcpy(s, name, len);
+    s[len] = 0;
+    int32_t id = idx->nchannels++;
+    idx->channels[id] = s;
+
+    // keep the hash table at most half full
+    if (idx->nchannels * 2 > idx->hash_size) {
+        int32_t size = idx->hash_size ? idx->hash_size * 2 : 128;
+        int32_t *hash = (int32_t*) calloc(size, sizeof(int32_t));
+        if (!hash) {
+            idx->nchannels--;
+            free(s);
+            return -1;
+        }
+        free(idx->hash);
+        idx->hash = hash;
+        idx->hash_size = size;
+        for (int32_t i = 0; i < idx->nchannels; i++)
+            index_hash_insert(idx, i);
+    } else {
+        index_hash_insert(idx, id);
+    }
+    return id;
+}
+
+static lcm_eventlog_index_t *index_new(int every_events, int every_ms)
+{
+    lcm_eventlog_index_t *idx =
+        (lcm_eventlog_index_t*) calloc(1, sizeof(lcm_eventlog_index_t));
+    idx->every_events = every_events;
+    idx->every_usec = (int64_t) every_ms * 1000;
+    return idx;
+}
+
+static void index_free(lcm_eventlog_index_t *idx)
+{
+    if (idx->f)
+        fclose(idx->f);
+    for (int32_t i = 0; i < idx->nchannels; i++)
+        free(idx->channels[i]);
+    free(idx->channels);
+    free(idx->hash);
+    free(idx->entries);
+    free(idx);
+}
+
+// Reads the records of an index file.  Entries that don't fit in a log of
+// log_size bytes are skipped, unless log_size is negative.  Returns 0 if f
+// is an index file, even if its last record was cut short.  If valid_size is
+// not NULL, it's set to the size of the records that were read completely.
+static int index_read(lcm_eventlog_index_t *idx, FILE *f, int64_t log_size,
+        int keep_entries, int64_t *valid_size)
+{
+    int32_t magic, version;
+    if (0 != fread32(f, &magic) || magic != INDEX_MAGIC ||
+        0 != fread32(f, &version) || version != INDEX_VERSION)
+        return -1;
+
+    char name[1000];
+    int32_t type;
+    int64_t end = 8;
+    while (0 == fread32(f, &type)) {
+        if (type == INDEX_RECORD_CHANNEL) {
+            int32_t id, len;
+            if (0 != fread32(f, &id) || 0 != fread32(f, &len) ||
+                id != idx->nchannels || len <= 0 || len >= (int32_t) sizeof(name) ||
+                fread(name, 1, len, f) != (size_t) len ||
+                index_add_channel(idx, name, len) < 0)
+                break;
+            end += 12 + len;
+        } else if (type == INDEX_RECORD_ENTRY) {
+            index_entry_t e;
+            if (0 != fread32(f, &e.channel_id) ||
+                0 != fread64(f, &e.offset) ||
+                0 != fread64(f, &e.eventnum) ||
+                0 != fread64(f, &e.timestamp) ||
+                e.channel_id < 0 || e.channel_id >= idx->nchannels)
+                break;
+            end += 32;
+            if (!keep_entries ||
+                (log_size >= 0 && e.offset + EVENT_HEADER_SIZE > log_size))
+                continue;
+            if (idx->nentries == idx->entries_size) {
+                int64_t size = idx->entries_size ? idx->entries_size * 2 : 1024;
+                index_entry_t *entries = (index_entry_t*) realloc(idx->entries,
+                        size * sizeof(index_entry_t));
+                if (!entries)
+                    break;
+                idx->entries = entries;
+                idx->entries_size = size;
+            }
+            idx->entries[idx->nentries++] = e;
+        } else {
+            break;
+        }
+    }
+    if (valid_size)
+        *valid_size = end;
+    return 0;
+}
+
+// Adds an event that is about to be written at idx->next_offset to the index,
+// if it's time for another entry.
+static void index_add_event(lcm_eventlog_index_t *idx,
+        const lcm_eventlog_event_t *le)
+{
+    int64_t offset = idx->next_offset;
+    idx->next_offset += EVENT_HEADER_SIZE + le->channellen + le->datalen;
+    idx->events_since_entry++;
+
+    int add_entry = !idx->have_entry ||
+        (idx->every_events > 0 && idx->events_since_entry >= idx->every_events) ||
+        (idx->every_usec > 0 &&
+         le->timestamp - idx->last_entry_time >= idx->every_usec);
+
+    int status = 0;
+    int32_t id = index_find_channel(idx, le->channel, le->channellen);
+    if (id < 0) {
+        // the first event on each channel is always indexed
+        id = index_add_channel(idx, le->channel, le->channellen);
+        if (id < 0 ||
+            0 != fwrite32(idx->f, INDEX_RECORD_CHANNEL) ||
+            0 != fwrite32(idx->f, id) ||
+            0 != fwrite32(idx->f, le->channellen) ||
+            fwrite(le->channel, 1, le->channellen, idx->f) !=
+                (size_t) le->channellen)
+            status = -1;
+        add_entry = 1;
+    }
+
+    if (!status && add_entry) {
+        if (0 != fwrite32(idx->f, INDEX_RECORD_ENTRY) ||
+            0 != fwrite32(idx->f, id) ||
+            0 != fwrite64(idx->f, offset) ||
+            0 != fwrite64(idx->f, le->eventnum) ||
+            0 != fwrite64(idx->f, le->timestamp) ||
+            0 != fflush(idx->f))
+            status = -1;
+        idx->events_since_entry = 0;
+        idx->have_entry = 1;
+        idx->last_entry_time = le->timestamp;
+    }
+
+    if (status) {
+        perror("Error writing log index.  Indexing stopped");
+        fclose(idx->f);
+        idx->f = NULL;
+    }
+}
+
+static int32_t get32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+static int64_t get64(const uint8_t *p)
+{
+    return (int64_t) (((uint64_t) (uint32_t) get32(p) << 32) |
+            (uint32_t) get32(p + 4));
+}
+
+static void put32(uint8_t *p, int32_t v)
+{
+    uint32_t n = htonl((uint32_t) v);
+    memcpy(p, &n, 4);
+}
+
+static void put64(uint8_t *p, int64_t v)
+{
+    put32(p, (int32_t) ((uint64_t) v >> 32));
+    put32(p + 4, (int32_t) (v & 0xffffffff));
+}
+
+// Returns the size of the event at the start of p, or 0 if avail bytes don't
+// hold a valid event.
+static int64_t raw_event_size(const uint8_t *p, int64_t avail)
+{
+    if (avail < EVENT_HEADER_SIZE || get32(p) != MAGIC)
+        return 0;
+    int32_t channellen = get32(p + 20);
+    int32_t datalen = get32(p + 24);
+    if (channellen <= 0 || channellen >= 1000 || datalen < 0)
+        return 0;
+    int64_t size = EVENT_HEADER_SIZE + (int64_t) channellen + datalen;
+    return size <= avail ? size : 0;
+}
+
+struct _lcm_eventlog_block_t {
+    int writing;
+
+    // events, in the same format as in an uncompressed log
+    uint8_t *raw;
+    int32_t raw_size;
+    int32_t raw_capacity;
+    int32_t raw_pos;            // when reading, where the next event is
+    int64_t first_timestamp;    // when writing
+
+    // compressed data
+    uint8_t *buf;
+    int32_t buf_capacity;
+};
+
+static void block_free(lcm_eventlog_block_t *b)
+{
+    free(b->raw);
+    free(b->buf);
+    free(b);
+}
+
+static int block_reserve(uint8_t **buf, int32_t *capacity, int64_t size)
+{
+    if (size <= *capacity)
+        return 0;
+    if (size > INT32_MAX)
+        return -1;
+    int64_t new_capacity = *capacity ? *capacity : 4096;
+    while (new_capacity < size)
+        new_capacity *= 2;
+    if (new_capacity > INT32_MAX)
+        new_capacity = INT32_MAX;
+    uint8_t *new_buf = (uint8_t *) realloc(*buf, new_capacity);
+    if (!new_buf)
+        return -1;
+    *buf = new_buf;
+    *capacity = (int32_t) new_capacity;
+    return 0;
+}
+
+// Writes out the events of the block being written
+static int block_flush(lcm_eventlog_t *l)
+{
+    lcm_eventlog_block_t *b = l->block;
+    if (!b->raw_size)
+        return 0;
+
+    const uint8_t *data = b->raw;
+    int32_t stored_size = b->raw_size;
+    if (0 == block_reserve(&b->buf, &b->buf_capacity,
+                lcm_lz_compress_bound(b->raw_size))) {
+        int32_t compressed_size =
+            lcm_lz_compress(b->raw, b->raw_size, b->buf);
+        if (compressed_size < b->raw_size) {
+            data = b->buf;
+            stored_size = compressed_size;
+        }
+    }
+
+    int status = 0;
+    if (0 != fwrite32(l->f, BLOCK_MAGIC) ||
+        0 != fwrite32(l->f, b->raw_size) ||
+        0 != fwrite32(l->f, stored_size) ||
+        0 != fwrite64(l->f, b->first_timestamp) ||
+        fwrite(data, 1, stored_size, l->f) != (size_t) stored_size)
+        status = -1;
+    b->raw_size = 0;
+    return status;
+}
+
+static int block_write_event(lcm_eventlog_t *l, lcm_eventlog_event_t *le)
+{
+    lcm_eventlog_block_t *b = l->block;
+    int64_t size = EVENT_HEADER_SIZE + (int64_t) le->channellen + le->datalen;
+    if (0 != block_reserve(&b->raw, &b->raw_capacity, b->raw_size + size))
+        return -1;
+
+    le->eventnum = l->eventcount;
+    if (!b->raw_size)
+        b->first_timestamp = le->timestamp;
+
+    uint8_t *p = b->raw + b->raw_size;
+    put32(p, MAGIC);
+    put64(p + 4, le->eventnum);
+    put64(p + 12, le->timestamp);
+    put32(p + 20, le->channellen);
+    put32(p + 24, le->datalen);
+    memcpy(p + EVENT_HEADER_SIZE, le->channel, le->channellen);
+    memcpy(p + EVENT_HEADER_SIZE + le->channellen, le->data, le->datalen);
+    b->raw_size += (int32_t) size;
+
+    l->eventcount++;
+
+    if (b->raw_size >= BLOCK_TARGET_SIZE)
+        return block_flush(l);
+    return 0;
+}
+
+// Reads the header of a block.  Returns -1 if it isn't valid.
+static int block_read_header(FILE *f, int32_t *raw_size, int32_t *stored_size,
+        int64_t *first_timestamp)
+{
+    if (0 != fread32(f, raw_size) ||
+        0 != fread32(f, stored_size) ||
+        0 != fread64(f, first_timestamp))
+        return -1;
+    // Nothing compresses by more than about 255 times
+    if (*stored_size < 0 || *raw_size < *stored_size ||
+        *raw_size / 256 > *stored_size + 1)
+        return -1;
+    return 0;
+}
+
+// Reads the next valid block, skipping over anything else.  Returns -1 at the
+// end of the log.
+static int block_read_next(lcm_eventlog_t *l)
+{
+    lcm_eventlog_block_t *b = l->block;
+    b->raw_size = 0;
+    b->raw_pos = 0;
+
+    while (1) {
+        uint32_t magic = 0;
+        do {
+            int r = fgetc(l->f);
+            if (r < 0)
+                return -1;
+            magic = (magic << 8) | r;
+        } while (magic != (uint32_t) BLOCK_MAGIC);
+
+        int32_t raw_size, stored_size;
+        int64_t first_timestamp;
+        if (0 != block_read_header(l->f, &raw_size, &stored_size,
+                    &first_timestamp)) {
+            if (feof(l->f))
+                return -1;
+            continue;
+        }
+
+        int compressed = stored_size < raw_size;
+        if (0 != block_reserve(&b->raw, &b->raw_capacity, raw_size) ||
+            (compressed &&
+             0 != block_reserve(&b->buf, &b->buf_capacity, stored_size)))
+            return -1;
+        uint8_t *data = compressed ? b->buf : b->raw;
+        if (fread(data, 1, stored_size, l->f) != (size_t) stored_size)
+            return -1;
+        if (compressed &&
+            0 != lcm_lz_decompress(b->buf, stored_size, b->raw, raw_size)) {
+            fprintf(stderr, "Log block is corrupt\n");
+            continue;
+        }
+        b->raw_size = raw_size;
+        return 0;
+    }
+}
+
+static lcm_eventlog_event_t *block_read_event(lcm_eventlog_t *l,
+        lcm_eventlog_channel_filter_t filter, void *user)
+{
+    lcm_eventlog_block_t *b = l->block;
+    char channel[1000];
+
+    while (1) {
+        if (b->raw_pos >= b->raw_size && 0 != block_read_next(l))
+            return NULL;
+
+        const uint8_t *p = b->raw + b->raw_pos;
+        int64_t size = raw_event_size(p, b->raw_size - b->raw_pos);
+        if (!size) {
+            fprintf(stderr, "Log block has an invalid event\n");
+            b->raw_pos = b->raw_size;
+            continue;
+        }
+        b->raw_pos += (int32_t) size;
+
+        int32_t channellen = get32(p + 20);
+        memcpy(channel, p + EVENT_HEADER_SIZE, channellen);
+        channel[channellen] = 0;
+        if (filter && !filter(channel, user))
+            continue;
+
+        lcm_eventlog_event_t *le =
+            (lcm_eventlog_event_t*) calloc(1, sizeof(lcm_eventlog_event_t));
+        le->eventnum = get64(p + 4);
+        le->timestamp = get64(p + 12);
+        le->channellen = channellen;
+        le->datalen = get32(p + 24);
+        le->channel = (char *) malloc(channellen + 1);
+        memcpy(le->channel, channel, channellen + 1);
+        le->data = calloc(1, le->datalen + 1);
+        memcpy(le->data, p + EVENT_HEADER_SIZE + channellen, le->datalen);
+        return le;
+    }
+}
+
+// Finds the first valid block header that starts at or after pos, and before
+// limit.  Returns its offset, or -1 if there is none.
+static int64_t block_find(lcm_eventlog_t *l, int64_t pos, int64_t limit,
+        int64_t *first_timestamp, int64_t *size)
+{
+    if (0 != fseeko(l->f, pos, SEEK_SET))
+        return -1;
+    uint32_t magic = 0;
+    while (pos < limit + 4) {
+        int r = fgetc(l->f);
+        if (r < 0)
+            return -1;
+        magic = (magic << 8) | r;
+        pos++;
+        if (magic != (uint32_t) BLOCK_MAGIC)
+            continue;
+
+        int32_t raw_size, stored_size;
+        if (0 == block_read_header(l->f, &raw_size, &stored_size,
+                    first_timestamp)) {
+            *size = BLOCK_HEADER_SIZE + stored_size;
+            return pos - 4;
+        }
+        fseeko(l->f, pos, SEEK_SET);
+    }
+    return -1;
+}
+
+// Seeks to the first event at or after timestamp, by bisecting over the
+// blocks of the log and then reading through the right one.
+static int block_seek_to_timestamp(lcm_eventlog_t *l, int64_t timestamp)
+{
+    lcm_eventlog_block_t *b = l->block;
+    fseeko(l->f, 0, SEEK_END);
+    int64_t file_size = ftello(l->f);
+
+    // find the last block that starts with an earlier event
+    int64_t first_timestamp, size;
+    int64_t start = block_find(l, 0, file_size, &first_timestamp, &size);
+    if (start < 0) {
+        lcm_eventlog_seek(l, file_size);
+        return 0;
+    }
+    if (first_timestamp < timestamp) {
+        int64_t lo = start + size;
+        int64_t hi = file_size;
+        while (lo < hi) {
+            int64_t mid = lo + (hi - lo) / 2;
+            int64_t pos = block_find(l, mid, hi, &first_timestamp, &size);
+            if (pos >= 0 && first_timestamp < timestamp) {
+                start = pos;
+                lo = pos + size;
+            } else {
+                hi = mid;
+            }
+        }
+    }
+
+    lcm_eventlog_seek(l, start);
+    while (0 == block_read_next(l)) {
+        while (b->raw_pos < b->raw_size) {
+            const uint8_t *p = b->raw + b->raw_pos;
+            int64_t event_size = raw_event_size(p, b->raw_size - b->raw_pos);
+            if (!event_size) {
+                b->raw_pos = b->raw_size;
+                break;
+            }
+            if (get64(p + 12) >= timestamp)
+                return 0;
+            b->raw_pos += (int32_t) event_size;
+        }
+    }
+    return 0;
+}
+
+// Returns 1 if f is at the start of a compressed log, and moves past its
+// header.  Otherwise, returns 0 and leaves f where it was.
+static int is_compressed(FILE *f)
+{
+    int32_t magic, version;
+    off_t pos = ftello(f);
+    if (0 == fread32(f, &magic) && magic == ZLOG_MAGIC &&
+        0 == fread32(f, &version)) {
+        if (version != ZLOG_VERSION)
+            fprintf(stderr, "Unknown compressed log version: %d\n", version);
+        return 1;
+    }
+    fseeko(f, pos, SEEK_SET);
+    return 0;
+}
+
+// Returns 1 if the file at path is a compressed log, 0 if it's another log,
+// or -1 if it doesn't exist or is empty.
+static int log_format(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return -1;
+    int format = is_compressed(f);
+    if (!format) {
+        fseeko(f, 0, SEEK_END);
+        if (ftello(f) == 0)
+            format = -1;
+    }
+    fclose(f);
+    return format;
+}
+
 lcm_eventlog_t *lcm_eventlog_create(const char *path, const char *mode)
 {
     assert(!strcmp(mode, "r") || !strcmp(mode, "w") || !strcmp(mode, "a"));
@@ -39,61 +647,211 @@ lcm_eventlog_t *lcm_eventlog_create(const char *path, const char *mode)
 
     l->eventcount = 0;
 
+    // keep reading and appending to compressed logs in blocks
+    if (*mode == 'r' ? is_compressed(l->f) :
+            *mode == 'a' && log_format(path) == 1) {
+        l->block = (lcm_eventlog_block_t *)
+            calloc(1, sizeof(lcm_eventlog_block_t));
+        l->block->writing = *mode != 'r';
+    }
+
+    if (*mode == 'r' && !l->block) {
+        char *index_path = (char*) malloc(strlen(path) + 5);
+        sprintf(index_path, "%s.idx", path);
+        lcm_eventlog_load_index(l, index_path);
+        free(index_path);
+    }
+
+    return l;
+}
+
+lcm_eventlog_t *lcm_eventlog_create_compressed(const char *path,
+        const char *mode)
+{
+    assert(!strcmp(mode, "w") || !strcmp(mode, "a"));
+    if (*mode == 'a' && log_format(path) == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    lcm_eventlog_t *l = lcm_eventlog_create(path, mode);
+    if (!l || l->block)
+        return l;
+
+    l->block = (lcm_eventlog_block_t *) calloc(1, sizeof(lcm_eventlog_block_t));
+    l->block->writing = 1;
+    if (0 != fwrite32(l->f, ZLOG_MAGIC) || 0 != fwrite32(l->f, ZLOG_VERSION)) {
+        lcm_eventlog_destroy(l);
+        return NULL;
+    }
     return l;
 }
 
+int lcm_eventlog_flush(lcm_eventlog_t *l)
+{
+    int status = 0;
+    if (l->block && l->block->writing)
+        status = block_flush(l);
+    if (0 != fflush(l->f))
+        status = -1;
+    return status;
+}
+
 void lcm_eventlog_destroy(lcm_eventlog_t *l)
 {
+    if (l->block) {
+        if (l->block->writing)
+            block_flush(l);
+        block_free(l->block);
+    }
     fflush(l->f);
     fclose(l->f);
+    if (l->index)
+        index_free(l->index);
     free(l);
 }
 
+int lcm_eventlog_write_index(lcm_eventlog_t *l, const char *path,
+        int every_events, int every_ms)
+{
+    if (l->index || l->block)
+        return -1;
+    lcm_eventlog_index_t *idx = index_new(every_events, every_ms);
+
+    fflush(l->f);
+    fseeko(l->f, 0, SEEK_END);
+    idx->next_offset = ftello(l->f);
+
+    // When appending to a log, keep its index if it has one, and keep
+    // numbering channels where it left off.  If the index ends in a partial
+    // record, start a new one instead.
+    if (idx->next_offset > 0) {
+        FILE *old = fopen(path, "rb");
+        if (old) {
+            int64_t valid_size;
+            if (0 == index_read(idx, old, -1, 0, &valid_size)) {
+                fseeko(old, 0, SEEK_END);
+                if (ftello(old) == valid_size)
+                    idx->f = fopen(path, "ab");
+            }
+            fclose(old);
+        }
+    }
+    if (!idx->f) {
+        for (int32_t i = 0; i < idx->nchannels; i++)
+            free(idx->channels[i]);
+        idx->nchannels = 0;
+        if (idx->hash)
+            memset(idx->hash, 0, idx->hash_size * sizeof(int32_t));
+
+        idx->f = fopen(path, "wb");
+        if (idx->f && (0 != fwrite32(idx->f, INDEX_MAGIC) ||
+                    0 != fwrite32(idx->f, INDEX_VERSION))) {
+            fclose(idx->f);
+            idx->f = NULL;
+        }
+    }
+    if (!idx->f) {
+        index_free(idx);
+        return -1;
+    }
+    l->index = idx;
+    return 0;
+}
+
+int lcm_eventlog_load_index(lcm_eventlog_t *l, const char *path)
+{
+    if (l->block)
+        return -1;
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return -1;
+
+    off_t pos = ftello(l->f);
+    fseeko(l->f, 0, SEEK_END);
+    int64_t log_size = ftello(l->f);
+    fseeko(l->f, pos, SEEK_SET);
+
+    lcm_eventlog_index_t *idx = index_new(0, 0);
+    int status = index_read(idx, f, log_size, 1, NULL);
+    fclose(f);
+    if (status) {
+        index_free(idx);
+        return -1;
+    }
+    if (l->index)
+        index_free(l->index);
+    l->index = idx;
+    return 0;
+}
+
 lcm_eventlog_event_t *lcm_eventlog_read_next_event(lcm_eventlog_t *l)
 {
+    return lcm_eventlog_read_next_event_filtered(l, NULL, NULL);
+}
+
+lcm_eventlog_event_t *lcm_eventlog_read_next_event_filtered(lcm_eventlog_t *l,
+        lcm_eventlog_channel_filter_t filter, void *user)
+{
+    if (l->block)
+        return block_read_event(l, filter, user);
+
     lcm_eventlog_event_t *le =
         (lcm_eventlog_event_t*) calloc(1, sizeof(lcm_eventlog_event_t));
+    char channel[1000];
 
-    int32_t magic = 0;
-    int r;
+    while (1) {
+        int32_t magic = 0;
+        int r;
 
-    do {
-        r = fgetc(l->f);
-        if (r < 0) {
+        do {
+            r = fgetc(l->f);
+            if (r < 0) {
+                free(le);
+                return NULL;
+            }
+            magic = (magic << 8) | r;
+        } while( magic != MAGIC );
+
+        if (0 != fread64(l->f, &le->eventnum) ||
+            0 != fread64(l->f, &le->timestamp) ||
+            0 != fread32(l->f, &le->channellen) ||
+            0 != fread32(l->f, &le->datalen)) {
             free(le);
             return NULL;
         }
-        magic = (magic << 8) | r;
-    } while( magic != MAGIC );
 
-    if (0 != fread64(l->f, &le->eventnum) ||
-        0 != fread64(l->f, &le->timestamp) ||
-        0 != fread32(l->f, &le->channellen) ||
-        0 != fread32(l->f, &le->datalen)) {
-        free(le);
-        return NULL;
-    }
+        // Sanity check the channel length and data length
+        if (le->channellen <= 0 || le->channellen >= (int32_t) sizeof(channel)) {
+            fprintf(stderr, "Log event has invalid channel length: %d\n", le->channellen);
+            free(le);
+            return NULL;
+        }
+        if (le->datalen < 0) {
+            fprintf(stderr, "Log event has invalid data length: %d\n", le->datalen);
+            free(le);
+            return NULL;
+        }
 
-    // Sanity check the channel length and data length
-    if (le->channellen <= 0 || le->channellen >= 1000) {
-        fprintf(stderr, "Log event has invalid channel length: %d\n", le->channellen);
-        free(le);
-        return NULL;
-    }
-    if (le->datalen < 0) {
-        fprintf(stderr, "Log event has invalid data length: %d\n", le->datalen);
-        free(le);
-        return NULL;
-    }
+        if (fread(channel, 1, le->channellen, l->f) != (size_t) le->channellen) {
+            free(le);
+            return NULL;
+        }
+        channel[le->channellen] = 0;
+        if (!filter || filter(channel, user))
+            break;
 
-    le->channel = (char *) calloc(1, le->channellen+1);
-    if (fread(le->channel, 1, le->channellen, l->f) != (size_t) le->channellen) {
-        free(le->channel);
-        free(le->data);
-        free(le);
-        return NULL;
+        // Skip the data.  If the event was corrupt, the search for the next
+        // MAGIC resynchronizes.
+        if (0 != fseeko(l->f, le->datalen, SEEK_CUR)) {
+            free(le);
+            return NULL;
+        }
     }
 
+    le->channel = (char *) malloc(le->channellen+1);
+    memcpy(le->channel, channel, le->channellen+1);
+
     le->data = calloc(1, le->datalen+1);
     if (fread(le->data, 1, le->datalen, l->f) != (size_t) le->datalen) {
         free(le->channel);
@@ -117,7 +875,7 @@ lcm_eventlog_event_t *lcm_eventlog_read_next_event(lcm_eventlog_t *l)
     return le;
 }
 
-int lcm_eventlog_write_event(lcm_eventlog_t *l, lcm_eventlog_event_t *le)
+static int write_event(lcm_eventlog_t *l, lcm_eventlog_event_t *le)
 {
     if (0 != fwrite32(l->f, MAGIC)) return -1;
 
@@ -138,6 +896,24 @@ int lcm_eventlog_write_event(lcm_eventlog_t *l, lcm_eventlog_event_t *le)
     return 0;
 }
 
+int lcm_eventlog_write_event(lcm_eventlog_t *l, lcm_eventlog_event_t *le)
+{
+    if (l->block)
+        return block_write_event(l, le);
+
+    int status = write_event(l, le);
+    if (l->index && l->index->f) {
+        if (0 == status) {
+            index_add_event(l->index, le);
+        } else {
+            // whatever was written of the event is still in the log
+            fflush(l->f);
+            l->index->next_offset = ftello(l->f);
+        }
+    }
+    return status;
+}
+
 void lcm_eventlog_free_event(lcm_eventlog_event_t *le)
 {
     if (le->data) free(le->data);
@@ -174,8 +950,74 @@ eof:
 }
 
 
+// Seeks to the first event at or after timestamp, starting from the last
+// indexed event before it and skipping over events by their headers.  Returns
+// -1 if the index doesn't match the log.
+static int seek_with_index(lcm_eventlog_t *l, int64_t timestamp)
+{
+    lcm_eventlog_index_t *idx = l->index;
+
+    // find the first entry after timestamp
+    int64_t lo = 0;
+    int64_t hi = idx->nentries;
+    while (lo < hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (idx->entries[mid].timestamp <= timestamp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    int64_t pos = lo > 0 ? idx->entries[lo - 1].offset : 0;
+    if (0 != fseeko(l->f, pos, SEEK_SET))
+        return -1;
+
+    while (1) {
+        int32_t magic, channellen, datalen;
+        int64_t eventnum, event_time;
+        if (0 != fread32(l->f, &magic))
+            break;
+        if (magic != MAGIC)
+            return -1;
+        if (0 != fread64(l->f, &eventnum) ||
+            0 != fread64(l->f, &event_time) ||
+            0 != fread32(l->f, &channellen) ||
+            0 != fread32(l->f, &datalen))
+            break;
+        if (event_time >= timestamp) {
+            l->eventcount = eventnum;
+            break;
+        }
+        if (channellen <= 0 || datalen < 0)
+            return -1;
+        pos += EVENT_HEADER_SIZE + channellen + datalen;
+        if (0 != fseeko(l->f, channellen + datalen, SEEK_CUR))
+            return -1;
+    }
+    // stop at the start of the event, or at the end of the log
+    fseeko(l->f, pos, SEEK_SET);
+    return 0;
+}
+
+int lcm_eventlog_seek(lcm_eventlog_t *l, int64_t offset)
+{
+    if (0 != fseeko(l->f, offset, SEEK_SET))
+        return -1;
+    if (l->block) {
+        l->block->raw_size = 0;
+        l->block->raw_pos = 0;
+    }
+    return 0;
+}
+
 int lcm_eventlog_seek_to_timestamp(lcm_eventlog_t *l, int64_t timestamp)
 {
+    if (l->block)
+        return block_seek_to_timestamp(l, timestamp);
+
+    if (l->index && l->index->nentries > 0 &&
+        0 == seek_with_index(l, timestamp))
+        return 0;
+
     fseeko (l->f, 0, SEEK_END);
     off_t file_len = ftello(l->f);
 
@@ -215,3 +1057,611 @@ int lcm_eventlog_seek_to_timestamp(lcm_eventlog_t *l, int64_t timestamp)
 
     return 0;
 }
+
+int64_t lcm_eventlog_build_index(const char *log_path, const char *index_path,
+        int every_events, int every_ms)
+{
+    FILE *f = fopen(log_path, "rb");
+    if (!f)
+        return -1;
+    if (is_compressed(f)) {
+        fclose(f);
+        errno = EINVAL;
+        return -1;
+    }
+    fseeko(f, 0, SEEK_END);
+    int64_t log_size = ftello(f);
+    fseeko(f, 0, SEEK_SET);
+
+    lcm_eventlog_index_t *idx = index_new(every_events, every_ms);
+    idx->f = fopen(index_path, "wb");
+    if (!idx->f || 0 != fwrite32(idx->f, INDEX_MAGIC) ||
+        0 != fwrite32(idx->f, INDEX_VERSION)) {
+        fclose(f);
+        index_free(idx);
+        return -1;
+    }
+
+    char channel[1000];
+    lcm_eventlog_event_t le;
+    le.channel = channel;
+    le.data = NULL;
+    int64_t offset = 0;
+    int64_t count = 0;
+    while (idx->f) {
+        int32_t magic;
+        if (0 != fread32(f, &magic))
+            break;
+        if (magic != MAGIC) {
+            // skip over garbage, the same way lcm_eventlog_read_next_event()
+            // does
+            int r;
+            do {
+                r = fgetc(f);
+                if (r < 0)
+                    break;
+                magic = (magic << 8) | r;
+            } while (magic != MAGIC);
+            if (r < 0)
+                break;
+            offset = ftello(f) - 4;
+        }
+
+        if (0 != fread64(f, &le.eventnum) ||
+            0 != fread64(f, &le.timestamp) ||
+            0 != fread32(f, &le.channellen) ||
+            0 != fread32(f, &le.datalen) ||
+            le.channellen <= 0 || le.channellen >= (int32_t) sizeof(channel) ||
+            le.datalen < 0 ||
+            fread(channel, 1, le.channellen, f) != (size_t) le.channellen)
+            break;
+
+        int64_t size = EVENT_HEADER_SIZE + le.channellen + le.datalen;
+        if (offset + size > log_size)
+            break;
+        idx->next_offset = offset;
+        index_add_event(idx, &le);
+        offset += size;
+        count++;
+        fseeko(f, le.datalen, SEEK_CUR);
+    }
+
+    int status = idx->f ? 0 : -1;
+    fclose(f);
+    index_free(idx);
+    return status ? -1 : count;
+}
+
+// How much of the file to ask the kernel to read ahead after a seek
+#define READER_WILLNEED_SIZE (4 << 20)
+
+struct _lcm_eventlog_reader_t {
+    const uint8_t *map;
+    int64_t size;
+    int64_t pos;                // where the next event is read from
+    int64_t end;                // events that start here or after aren't read
+    lcm_eventlog_index_t *index;
+    lcm_eventlog_event_t event;
+    char channel[1000];
+};
+
+// Returns the size of the event at pos, or 0 if there's no complete event
+// there.
+static int64_t reader_event_size(lcm_eventlog_reader_t *r, int64_t pos)
+{
+    if (pos + EVENT_HEADER_SIZE > r->size)
+        return 0;
+    const uint8_t *p = r->map + pos;
+    if (get32(p) != MAGIC)
+        return 0;
+    int32_t channellen = get32(p + 20);
+    int32_t datalen = get32(p + 24);
+    if (channellen <= 0 || channellen >= (int32_t) sizeof(r->channel) ||
+        datalen < 0)
+        return 0;
+    int64_t size = EVENT_HEADER_SIZE + (int64_t) channellen + datalen;
+    if (pos + size > r->size)
+        return 0;
+    return size;
+}
+
+// Returns the offset of the first event at or after pos, or the size of the
+// file if there is none.  To tell events from a MAGIC in the data of
+// another, an event must be followed by another MAGIC, or by the end of the
+// file.
+static int64_t reader_find_event(lcm_eventlog_reader_t *r, int64_t pos)
+{
+    const uint8_t first = ((uint32_t) MAGIC) >> 24;
+    while (pos + EVENT_HEADER_SIZE <= r->size) {
+        const uint8_t *p = (const uint8_t *) memchr(r->map + pos, first,
+                r->size - pos);
+        if (!p)
+            break;
+        pos = p - r->map;
+        int64_t size = reader_event_size(r, pos);
+        if (size) {
+            int64_t end = pos + size;
+            if (end + 4 > r->size || get32(r->map + end) == MAGIC)
+                return pos;
+        }
+        pos++;
+    }
+    return r->size;
+}
+
+// Moves to the first event at or after pos with a timestamp of at least ts
+static void reader_walk_to(lcm_eventlog_reader_t *r, int64_t pos, int64_t ts)
+{
+    pos = reader_find_event(r, pos);
+    while (pos < r->size) {
+        int64_t size = reader_event_size(r, pos);
+        if (!size) {
+            pos = reader_find_event(r, pos + 1);
+            continue;
+        }
+        if (get64(r->map + pos + 12) >= ts)
+            break;
+        pos += size;
+    }
+    r->pos = pos;
+}
+
+// Reading will likely continue from where a seek ended up, which the
+// sequential access hint doesn't anticipate.
+static void reader_will_need(lcm_eventlog_reader_t *r)
+{
+#if !defined(WIN32) && defined(MADV_WILLNEED)
+    if (r->pos >= r->size)
+        return;
+    int64_t page = sysconf(_SC_PAGESIZE);
+    int64_t start = r->pos - r->pos % page;
+    int64_t len = READER_WILLNEED_SIZE;
+    if (start + len > r->size)
+        len = r->size - start;
+    madvise((void *) (r->map + start), len, MADV_WILLNEED);
+#endif
+}
+
+lcm_eventlog_reader_t *lcm_eventlog_reader_create(const char *path)
+{
+    lcm_eventlog_reader_t *r =
+        (lcm_eventlog_reader_t *) calloc(1, sizeof(lcm_eventlog_reader_t));
+
+#ifndef WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(r);
+        return NULL;
+    }
+    struct stat st;
+    if (0 != fstat(fd, &st)) {
+        close(fd);
+        free(r);
+        return NULL;
+    }
+    r->size = st.st_size;
+    if (r->size > 0 && (uint64_t) r->size == (size_t) r->size) {
+        void *map = mmap(NULL, r->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            r->map = (const uint8_t *) map;
+#ifdef MADV_SEQUENTIAL
+            madvise(map, r->size, MADV_SEQUENTIAL);
+#endif
+        }
+    }
+    close(fd);
+#else
+    // no mmap.  Read the whole file instead.
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        free(r);
+        return NULL;
+    }
+    fseeko(f, 0, SEEK_END);
+    r->size = ftello(f);
+    fseeko(f, 0, SEEK_SET);
+    if (r->size > 0 && (uint64_t) r->size == (size_t) r->size) {
+        uint8_t *buf = (uint8_t *) malloc(r->size);
+        if (buf && fread(buf, 1, r->size, f) == (size_t) r->size)
+            r->map = buf;
+        else
+            free(buf);
+    }
+    fclose(f);
+#endif
+    if (r->size > 0 && !r->map) {
+        free(r);
+        return NULL;
+    }
+    if (r->size >= 4 && get32(r->map) == ZLOG_MAGIC) {
+        // compressed logs can't be read in place
+        lcm_eventlog_reader_destroy(r);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    char *index_path = (char *) malloc(strlen(path) + 5);
+    sprintf(index_path, "%s.idx", path);
+    FILE *f_index = fopen(index_path, "rb");
+    free(index_path);
+    if (f_index) {
+        r->index = index_new(0, 0);
+        if (0 != index_read(r->index, f_index, r->size, 1, NULL)) {
+            index_free(r->index);
+            r->index = NULL;
+        }
+        fclose(f_index);
+    }
+
+    r->end = r->size;
+    r->event.channel = r->channel;
+    return r;
+}
+
+void lcm_eventlog_reader_destroy(lcm_eventlog_reader_t *r)
+{
+#ifndef WIN32
+    if (r->map)
+        munmap((void *) r->map, r->size);
+#else
+    free((void *) r->map);
+#endif
+    if (r->index)
+        index_free(r->index);
+    free(r);
+}
+
+const lcm_eventlog_event_t *lcm_eventlog_reader_next(lcm_eventlog_reader_t *r)
+{
+    // skip over any garbage, like lcm_eventlog_read_next_event() does
+    int64_t pos = r->pos;
+    while (pos + 4 <= r->size && get32(r->map + pos) != MAGIC)
+        pos++;
+
+    if (pos >= r->end) {
+        r->pos = pos;
+        return NULL;
+    }
+    int64_t size = reader_event_size(r, pos);
+    if (!size) {
+        r->pos = r->size;
+        return NULL;
+    }
+    int64_t end = pos + size;
+    if (end + 4 <= r->size && get32(r->map + end) != MAGIC) {
+        fprintf(stderr, "Invalid header after log data\n");
+        r->pos = r->size;
+        return NULL;
+    }
+
+    const uint8_t *p = r->map + pos;
+    lcm_eventlog_event_t *le = &r->event;
+    le->eventnum = get64(p + 4);
+    le->timestamp = get64(p + 12);
+    le->channellen = get32(p + 20);
+    le->datalen = get32(p + 24);
+    memcpy(le->channel, p + EVENT_HEADER_SIZE, le->channellen);
+    le->channel[le->channellen] = 0;
+    le->data = (void *) (p + EVENT_HEADER_SIZE + le->channellen);
+
+    r->pos = end;
+    return le;
+}
+
+int lcm_eventlog_reader_seek(lcm_eventlog_reader_t *r, int64_t offset)
+{
+    if (offset < 0 || offset > r->size)
+        return -1;
+    r->pos = reader_find_event(r, offset);
+    reader_will_need(r);
+    return 0;
+}
+
+int lcm_eventlog_reader_seek_to_timestamp(lcm_eventlog_reader_t *r,
+        int64_t ts)
+{
+    if (r->index && r->index->nentries > 0) {
+        lcm_eventlog_index_t *idx = r->index;
+        int64_t lo = 0;
+        int64_t hi = idx->nentries;
+        while (lo < hi) {
+            int64_t mid = lo + (hi - lo) / 2;
+            if (idx->entries[mid].timestamp <= ts)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        reader_walk_to(r, lo > 0 ? idx->entries[lo - 1].offset : 0, ts);
+        reader_will_need(r);
+        return 0;
+    }
+
+    // Bisect by offset.  The target event starts at or after lo, and at or
+    // before the first event after hi.
+    int64_t lo = 0;
+    int64_t hi = r->size;
+    while (hi - lo > 65536) {
+        int64_t mid = lo + (hi - lo) / 2;
+        int64_t pos = reader_find_event(r, mid);
+        if (pos >= hi) {
+            hi = mid;
+        } else if (get64(r->map + pos + 12) < ts) {
+            lo = pos + reader_event_size(r, pos);
+        } else {
+            hi = mid;
+        }
+    }
+    reader_walk_to(r, lo, ts);
+    reader_will_need(r);
+    return 0;
+}
+
+// The number of consecutive valid events that must follow a chunk boundary.
+// A single event that looks valid may be in the data of another.
+#define SPLIT_CHECK_EVENTS 4
+
+int lcm_eventlog_reader_split(lcm_eventlog_reader_t *r, int nchunks,
+        int64_t *offsets)
+{
+    if (nchunks <= 0)
+        return -1;
+    offsets[0] = 0;
+    for (int i = 1; i < nchunks; i++) {
+        int64_t pos = reader_find_event(r, r->size / nchunks * i);
+        if (pos < offsets[i - 1])
+            pos = offsets[i - 1];
+        while (pos < r->size) {
+            int64_t next = pos;
+            int n;
+            for (n = 0; n < SPLIT_CHECK_EVENTS && next < r->size; n++) {
+                int64_t size = reader_event_size(r, next);
+                if (!size)
+                    break;
+                next += size;
+            }
+            if (n == SPLIT_CHECK_EVENTS || next == r->size)
+                break;
+            pos = reader_find_event(r, pos + 1);
+        }
+        offsets[i] = pos;
+    }
+    offsets[nchunks] = r->size;
+    return 0;
+}
+
+int lcm_eventlog_reader_set_range(lcm_eventlog_reader_t *r, int64_t start,
+        int64_t end)
+{
+    if (start < 0 || end < start || end > r->size)
+        return -1;
+    r->end = end;
+    return lcm_eventlog_reader_seek(r, start);
+}
+
+int64_t lcm_eventlog_reader_tell(lcm_eventlog_reader_t *r)
+{
+    return r->pos;
+}
+
+int64_t lcm_eventlog_reader_size(lcm_eventlog_reader_t *r)
+{
+    return r->size;
+}
+
+#define MANIFEST_HEADER "# lcm log manifest"
+
+struct _lcm_eventlog_merge_t
+{
+    int nlogs;
+    lcm_eventlog_t **logs;
+
+    // the next event of each log file, or NULL once it has been read
+    lcm_eventlog_event_t **next;
+};
+
+// Returns the length of the directory part of path, including the last
+// separator
+static size_t dir_length(const char *path)
+{
+    const char *sep = strrchr(path, '/');
+#ifdef WIN32
+    const char *bsep = strrchr(path, '\\');
+    if (bsep > sep)
+        sep = bsep;
+#endif
+    return sep ? sep - path + 1 : 0;
+}
+
+static int is_absolute(const char *path)
+{
+#ifdef WIN32
+    if (path[0] == '\\' || (path[0] && path[1] == ':'))
+        return 1;
+#endif
+    return path[0] == '/';
+}
+
+lcm_eventlog_merge_t *lcm_eventlog_merge_create(const char *const *paths,
+        int npaths)
+{
+    lcm_eventlog_merge_t *m =
+        (lcm_eventlog_merge_t*) calloc(1, sizeof(lcm_eventlog_merge_t));
+    m->logs = (lcm_eventlog_t**) calloc(npaths, sizeof(lcm_eventlog_t*));
+    m->next = (lcm_eventlog_event_t**)
+        calloc(npaths, sizeof(lcm_eventlog_event_t*));
+
+    for (int i = 0; i < npaths; i++) {
+        m->logs[i] = lcm_eventlog_create(paths[i], "r");
+        if (!m->logs[i]) {
+            int saved_errno = errno;
+            lcm_eventlog_merge_destroy(m);
+            errno = saved_errno;
+            return NULL;
+        }
+        m->nlogs++;
+        m->next[i] = lcm_eventlog_read_next_event(m->logs[i]);
+    }
+    return m;
+}
+
+lcm_eventlog_merge_t *lcm_eventlog_merge_create_from_manifest(
+        const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return NULL;
+
+    char line[4096];
+    if (!fgets(line, sizeof(line), f) ||
+        strncmp(line, MANIFEST_HEADER, strlen(MANIFEST_HEADER))) {
+        fclose(f);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t dirlen = dir_length(path);
+    int npaths = 0;
+    int capacity = 0;
+    char **paths = NULL;
+    while (fgets(line, sizeof(line), f)) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = 0;
+        if (!len || line[0] == '#')
+            continue;
+
+        char *log_path = (char*) malloc(dirlen + len + 1);
+        if (is_absolute(line)) {
+            strcpy(log_path, line);
+        } else {
+            memcpy(log_path, path, dirlen);
+            strcpy(log_path + dirlen, line);
+        }
+        if (npaths == capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            paths = (char**) realloc(paths, capacity * sizeof(char*));
+        }
+        paths[npaths++] = log_path;
+    }
+    fclose(f);
+
+    lcm_eventlog_merge_t *m =
+        lcm_eventlog_merge_create((const char *const *) paths, npaths);
+    for (int i = 0; i < npaths; i++)
+        free(paths[i]);
+    free(paths);
+    return m;
+}
+
+int lcm_eventlog_is_manifest(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return 0;
+    char line[64];
+    int is_manifest = fgets(line, sizeof(line), f) &&
+        !strncmp(line, MANIFEST_HEADER, strlen(MANIFEST_HEADER));
+    fclose(f);
+    return is_manifest;
+}
+
+int lcm_eventlog_manifest_add(const char *manifest_path, const char *log_path)
+{
+    size_t dirlen = dir_length(manifest_path);
+    if (dir_length(log_path) == dirlen &&
+        !strncmp(log_path, manifest_path, dirlen))
+        log_path += dirlen;
+
+    // a log file that is appended to is only listed once
+    FILE *f = fopen(manifest_path, "r");
+    if (f) {
+        char line[4096];
+        int listed = 0;
+        while (!listed && fgets(line, sizeof(line), f)) {
+            line[strcspn(line, "\r\n")] = 0;
+            listed = !strcmp(line, log_path);
+        }
+        fclose(f);
+        if (listed)
+            return 0;
+    }
+
+    f = fopen(manifest_path, "a");
+    if (!f)
+        return -1;
+
+    int status = 0;
+    fseeko(f, 0, SEEK_END);
+    if (ftello(f) == 0 && fprintf(f, MANIFEST_HEADER "\n") < 0)
+        status = -1;
+    if (fprintf(f, "%s\n", log_path) < 0)
+        status = -1;
+    if (0 != fclose(f))
+        status = -1;
+    return status;
+}
+
+lcm_eventlog_event_t *lcm_eventlog_merge_read_next_event(
+        lcm_eventlog_merge_t *m)
+{
+    return lcm_eventlog_merge_read_next_event_filtered(m, NULL, NULL);
+}
+
+lcm_eventlog_event_t *lcm_eventlog_merge_read_next_event_filtered(
+        lcm_eventlog_merge_t *m, lcm_eventlog_channel_filter_t filter,
+        void *user)
+{
+    while (1) {
+        int first = -1;
+        for (int i = 0; i < m->nlogs; i++) {
+            if (m->next[i] && (first < 0 ||
+                    m->next[i]->timestamp < m->next[first]->timestamp))
+                first = i;
+        }
+        if (first < 0)
+            return NULL;
+
+        lcm_eventlog_event_t *le = m->next[first];
+        m->next[first] = lcm_eventlog_read_next_event_filtered(
+                m->logs[first], filter, user);
+
+        // the first event of each log, and those read after a seek, weren't
+        // filtered
+        if (!filter || filter(le->channel, user))
+            return le;
+        lcm_eventlog_free_event(le);
+    }
+}
+
+int lcm_eventlog_merge_seek_to_timestamp(lcm_eventlog_merge_t *m, int64_t ts)
+{
+    // A log that can't be seeked has no events at or after ts
+    int status = -1;
+    for (int i = 0; i < m->nlogs; i++) {
+        if (m->next[i])
+            lcm_eventlog_free_event(m->next[i]);
+        m->next[i] = NULL;
+        if (0 != lcm_eventlog_seek_to_timestamp(m->logs[i], ts))
+            continue;
+        status = 0;
+
+        // without an index, the seek may land before ts
+        lcm_eventlog_event_t *le;
+        while ((le = lcm_eventlog_read_next_event(m->logs[i])) &&
+               le->timestamp < ts)
+            lcm_eventlog_free_event(le);
+        m->next[i] = le;
+    }
+    return status;
+}
+
+void lcm_eventlog_merge_destroy(lcm_eventlog_merge_t *m)
+{
+    for (int i = 0; i < m->nlogs; i++) {
+        if (m->next[i])
+            lcm_eventlog_free_event(m->next[i]);
+        lcm_eventlog_destroy(m->logs[i]);
+    }
+    free(m->next);
+    free(m->logs);
+    free(m);
+}
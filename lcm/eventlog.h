@@ -28,6 +28,9 @@ extern "C" {
  * @{
  */
 
+typedef struct _lcm_eventlog_index_t lcm_eventlog_index_t;
+typedef struct _lcm_eventlog_block_t lcm_eventlog_block_t;
+
 typedef struct _lcm_eventlog_t lcm_eventlog_t;
 struct _lcm_eventlog_t
 {
@@ -40,6 +43,18 @@ struct _lcm_eventlog_t
      * Internal counter, keeps track of how many events have been written.
      */
     int64_t eventcount;
+
+    /**
+     * Internal.  The sidecar index of the log file, if one is being read or
+     * written.
+     */
+    lcm_eventlog_index_t *index;
+
+    /**
+     * Internal.  The block of events being read or written, if the log file
+     * is compressed.
+     */
+    lcm_eventlog_block_t *block;
 };
 
 /**
@@ -79,6 +94,9 @@ struct _lcm_eventlog_event_t {
 /**
  * Open a log file for reading or writing.
  *
+ * In read mode, the sidecar index @c path.idx is loaded if it exists.  See
+ * lcm_eventlog_load_index().
+ *
  * @param path Log file to open
  * @param mode "r" (read mode), "w" (write mode), or "a" (append mode)
  *
@@ -87,6 +105,36 @@ struct _lcm_eventlog_event_t {
 LCM_EXPORT
 lcm_eventlog_t *lcm_eventlog_create(const char *path, const char *mode);
 
+/**
+ * Open a log file for writing in the compressed format.
+ *
+ * Events are buffered and written in blocks, each compressed on its own.
+ * Compressed logs are read with the same functions as others, and opening
+ * one in append mode with lcm_eventlog_create() keeps it compressed.
+ * Compressed logs can't have an index, or be read with
+ * lcm_eventlog_reader_t.
+ *
+ * @param path Log file to open
+ * @param mode "w" (write) or "a" (append).  Can't append to a log file that
+ * isn't compressed.
+ *
+ * @return a newly allocated lcm_eventlog_t, or NULL on failure.
+ */
+LCM_EXPORT
+lcm_eventlog_t *lcm_eventlog_create_compressed(const char *path,
+        const char *mode);
+
+/**
+ * Write out the events that have been buffered, and flush the underlying
+ * file handle.  Valid in write mode only.
+ *
+ * @param eventlog The log file object
+ *
+ * @return 0 on success, -1 on failure
+ */
+LCM_EXPORT
+int lcm_eventlog_flush(lcm_eventlog_t *eventlog);
+
 /**
  * Read the next event in the log file.  Valid in read mode only.  Free the
  * returned structure with lcm_eventlog_free_event() after use.
@@ -99,6 +147,35 @@ lcm_eventlog_t *lcm_eventlog_create(const char *path, const char *mode);
 LCM_EXPORT
 lcm_eventlog_event_t *lcm_eventlog_read_next_event(lcm_eventlog_t *eventlog);
 
+/**
+ * Decides whether the events on a channel are wanted.
+ *
+ * @param channel The channel of an event
+ * @param user The user data passed along with the filter
+ *
+ * @return nonzero to read the event, 0 to skip it.
+ */
+typedef int (*lcm_eventlog_channel_filter_t)(const char *channel, void *user);
+
+/**
+ * Read the next event in the log file whose channel passes a filter.  Valid
+ * in read mode only.  The data of the events that don't pass it is seeked
+ * over instead of being read.  Free the returned structure with
+ * lcm_eventlog_free_event() after use.
+ *
+ * @param eventlog The log file object
+ * @param filter Decides which events are read.  Can match the channel
+ * against a set of names, a regular expression, or anything else.
+ * @param user Passed to @c filter
+ *
+ * @return the next wanted event in the log file.  Returns NULL when the end
+ * of the file has been reached or when invalid data is read.
+ */
+LCM_EXPORT
+lcm_eventlog_event_t *lcm_eventlog_read_next_event_filtered(
+        lcm_eventlog_t *eventlog, lcm_eventlog_channel_filter_t filter,
+        void *user);
+
 /**
  * Free a structure returned by lcm_eventlog_read_next_event().
  *
@@ -107,9 +184,28 @@ lcm_eventlog_event_t *lcm_eventlog_read_next_event(lcm_eventlog_t *eventlog);
 LCM_EXPORT
 void lcm_eventlog_free_event(lcm_eventlog_event_t *event);
 
+/**
+ * Seek to a byte offset.  Reading continues with the first event that
+ * starts at or after it, or in a compressed log, with the first block.
+ * Valid in read mode only.
+ *
+ * @param eventlog The log file object
+ * @param offset Byte offset from the start of the file
+ *
+ * @return 0 on success, -1 on failure
+ */
+LCM_EXPORT
+int lcm_eventlog_seek(lcm_eventlog_t *eventlog, int64_t offset);
+
 /**
  * Seek (approximately) to a particular timestamp.
  *
+ * If the log file has an index, this seeks to the first event with a
+ * timestamp at or after @c ts, reading only a few event headers.  A
+ * compressed log is bisected by its blocks, and this also seeks to the first
+ * event at or after @c ts.  Otherwise, it bisects the file by size, and lands
+ * on an event near @c ts.
+ *
  * @param eventlog The log file object
  * @param ts Timestamp of the target event in the log file.
  *
@@ -131,6 +227,55 @@ LCM_EXPORT
 int lcm_eventlog_write_event(lcm_eventlog_t *eventlog,
         lcm_eventlog_event_t *event);
 
+/**
+ * Write a sidecar index as events are written to the log.  Valid in write or
+ * append mode only.
+ *
+ * An index lists the file offset, timestamp, and channel of every
+ * @c every_events th event, of an event at least every @c every_ms
+ * milliseconds, and of the first event on each channel.  With it, readers can
+ * seek to a timestamp without scanning the log.  By convention, the index of
+ * @c path is @c path.idx.  When appending, an existing index is appended to.
+ *
+ * @param eventlog The log file object
+ * @param path Index file to write
+ * @param every_events Index every this many events.  0 disables.
+ * @param every_ms Index an event at least this often.  0 disables.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+LCM_EXPORT
+int lcm_eventlog_write_index(lcm_eventlog_t *eventlog, const char *path,
+        int every_events, int every_ms);
+
+/**
+ * Load a sidecar index for a log file opened in read mode, replacing any
+ * index that was loaded before.  Entries that point past the end of the log
+ * are ignored, so the index of a log that is still being written can be used.
+ *
+ * @param eventlog The log file object
+ * @param path Index file to read
+ *
+ * @return 0 on success, -1 on failure.
+ */
+LCM_EXPORT
+int lcm_eventlog_load_index(lcm_eventlog_t *eventlog, const char *path);
+
+/**
+ * Build the sidecar index of an existing log file.  See
+ * lcm_eventlog_write_index().
+ *
+ * @param log_path Log file to index
+ * @param index_path Index file to write
+ * @param every_events Index every this many events.  0 disables.
+ * @param every_ms Index an event at least this often.  0 disables.
+ *
+ * @return the number of events in the log, or -1 on failure.
+ */
+LCM_EXPORT
+int64_t lcm_eventlog_build_index(const char *log_path, const char *index_path,
+        int every_events, int every_ms);
+
 /**
  * Close a log file and release allocated resources.
  *
@@ -139,6 +284,231 @@ int lcm_eventlog_write_event(lcm_eventlog_t *eventlog,
 LCM_EXPORT
 void lcm_eventlog_destroy(lcm_eventlog_t *eventlog);
 
+/**
+ * A read-only log file that is memory-mapped, for reading through large logs
+ * quickly.  Reading an event doesn't allocate memory or copy its data.
+ *
+ * Only the events that were in the file when it was opened can be read.
+ */
+typedef struct _lcm_eventlog_reader_t lcm_eventlog_reader_t;
+
+/**
+ * Open a log file for reading with a memory mapping.  The sidecar index
+ * @c path.idx is used if it exists.
+ *
+ * @param path Log file to open
+ *
+ * @return a newly allocated lcm_eventlog_reader_t, or NULL on failure.
+ */
+LCM_EXPORT
+lcm_eventlog_reader_t *lcm_eventlog_reader_create(const char *path);
+
+/**
+ * Read the next event in the log file.
+ *
+ * The returned event belongs to the reader.  Its @c data points into the
+ * mapping of the file, and stays valid until the reader is destroyed.  Its
+ * @c channel stays valid until the next call to this function.
+ *
+ * @param reader The log file object
+ *
+ * @return the next event in the log file.  Returns NULL when the end of the
+ * file has been reached or when invalid data is read.
+ */
+LCM_EXPORT
+const lcm_eventlog_event_t *
+lcm_eventlog_reader_next(lcm_eventlog_reader_t *reader);
+
+/**
+ * Seek to the first event that starts at or after a byte offset.
+ *
+ * @param reader The log file object
+ * @param offset Byte offset from the start of the file
+ *
+ * @return 0 on success, -1 on failure
+ */
+LCM_EXPORT
+int lcm_eventlog_reader_seek(lcm_eventlog_reader_t *reader, int64_t offset);
+
+/**
+ * Seek to the first event with a timestamp at or after @c ts.  If the
+ * timestamps in the log aren't in order, this is approximate.
+ *
+ * @param reader The log file object
+ * @param ts Timestamp of the target event in the log file.
+ *
+ * @return 0 on success, -1 on failure
+ */
+LCM_EXPORT
+int lcm_eventlog_reader_seek_to_timestamp(lcm_eventlog_reader_t *reader,
+        int64_t ts);
+
+/**
+ * Split a log file into byte ranges that start on event boundaries, so that
+ * it can be read in parallel.  Each range can be read by a different reader
+ * on the same file, after a call to lcm_eventlog_reader_set_range().  Every
+ * event is in exactly one range.
+ *
+ * @param reader The log file object
+ * @param nchunks The number of ranges
+ * @param offsets Filled with @c nchunks + 1 offsets.  Range @c i is
+ * [offsets[i], offsets[i + 1]).  Ranges may be empty.
+ *
+ * @return 0 on success, -1 on failure
+ */
+LCM_EXPORT
+int lcm_eventlog_reader_split(lcm_eventlog_reader_t *reader, int nchunks,
+        int64_t *offsets);
+
+/**
+ * Limit reading to the events that start in a byte range, and seek to the
+ * first of them.  lcm_eventlog_reader_next() returns NULL at the end of the
+ * range.  Seeking doesn't change the end of the range.
+ *
+ * @param reader The log file object
+ * @param start Byte offset of the start of the range
+ * @param end Byte offset of the end of the range
+ *
+ * @return 0 on success, -1 on failure
+ */
+LCM_EXPORT
+int lcm_eventlog_reader_set_range(lcm_eventlog_reader_t *reader,
+        int64_t start, int64_t end);
+
+/**
+ * @param reader The log file object
+ *
+ * @return the byte offset of the next event to be read
+ */
+LCM_EXPORT
+int64_t lcm_eventlog_reader_tell(lcm_eventlog_reader_t *reader);
+
+/**
+ * @param reader The log file object
+ *
+ * @return the size of the log file, in bytes, when it was opened
+ */
+LCM_EXPORT
+int64_t lcm_eventlog_reader_size(lcm_eventlog_reader_t *reader);
+
+/**
+ * Unmap a log file and release allocated resources.  The data of events read
+ * from it is no longer valid.
+ *
+ * @param reader The log file object
+ */
+LCM_EXPORT
+void lcm_eventlog_reader_destroy(lcm_eventlog_reader_t *reader);
+
+/**
+ * Several log files read as one, with their events merged in timestamp
+ * order.  Used to read the shards that lcm-logger writes with @c --shard or
+ * @c --shards.
+ */
+typedef struct _lcm_eventlog_merge_t lcm_eventlog_merge_t;
+
+/**
+ * Open log files for reading as one.
+ *
+ * @param paths The log files to open
+ * @param npaths The number of log files
+ *
+ * @return a newly allocated lcm_eventlog_merge_t, or NULL on failure.
+ */
+LCM_EXPORT
+lcm_eventlog_merge_t *lcm_eventlog_merge_create(const char *const *paths,
+        int npaths);
+
+/**
+ * Open the log files listed in a manifest for reading as one.
+ *
+ * A manifest is a text file that starts with the line
+ * <tt># lcm log manifest</tt>, and then lists the log files of a set, one
+ * per line.  Relative paths are relative to the directory of the manifest.
+ *
+ * @param path The manifest to read
+ *
+ * @return a newly allocated lcm_eventlog_merge_t, or NULL on failure.
+ */
+LCM_EXPORT
+lcm_eventlog_merge_t *lcm_eventlog_merge_create_from_manifest(
+        const char *path);
+
+/**
+ * @param path A file
+ *
+ * @return 1 if the file is a manifest, 0 if not or if it can't be read
+ */
+LCM_EXPORT
+int lcm_eventlog_is_manifest(const char *path);
+
+/**
+ * Add a log file to a manifest, creating the manifest if it doesn't exist.
+ * A log file in the same directory as the manifest is listed by name only,
+ * so that the set can be moved.  Any other is listed as given, so it should
+ * have an absolute path unless the manifest is in the current directory.
+ *
+ * @param manifest_path The manifest to add to
+ * @param log_path The log file to list
+ *
+ * @return 0 on success, -1 on failure
+ */
+LCM_EXPORT
+int lcm_eventlog_manifest_add(const char *manifest_path, const char *log_path);
+
+/**
+ * Read the next event, in timestamp order, from any of the log files.
+ * Events with equal timestamps are read in the order the log files were
+ * given.  Each event keeps the @c eventnum it has in its own log file.  Free
+ * the returned structure with lcm_eventlog_free_event() after use.
+ *
+ * @param merge The merged log files
+ *
+ * @return the next event, or NULL once all the log files have been read.
+ */
+LCM_EXPORT
+lcm_eventlog_event_t *lcm_eventlog_merge_read_next_event(
+        lcm_eventlog_merge_t *merge);
+
+/**
+ * Like lcm_eventlog_merge_read_next_event(), but reads only the events
+ * whose channel passes a filter.  See
+ * lcm_eventlog_read_next_event_filtered().
+ *
+ * @param merge The merged log files
+ * @param filter Decides which events are read
+ * @param user Passed to @c filter
+ *
+ * @return the next wanted event, or NULL once all the log files have been
+ * read.
+ */
+LCM_EXPORT
+lcm_eventlog_event_t *lcm_eventlog_merge_read_next_event_filtered(
+        lcm_eventlog_merge_t *merge, lcm_eventlog_channel_filter_t filter,
+        void *user);
+
+/**
+ * Seek every log file to the first event with a timestamp at or after
+ * @c ts.  This is as exact as lcm_eventlog_seek_to_timestamp() is for each
+ * log file, except that events before @c ts are always skipped.
+ *
+ * @param merge The merged log files
+ * @param ts Timestamp of the target event
+ *
+ * @return 0 on success, -1 on failure
+ */
+LCM_EXPORT
+int lcm_eventlog_merge_seek_to_timestamp(lcm_eventlog_merge_t *merge,
+        int64_t ts);
+
+/**
+ * Close the log files and release allocated resources.
+ *
+ * @param merge The merged log files
+ */
+LCM_EXPORT
+void lcm_eventlog_merge_destroy(lcm_eventlog_merge_t *merge);
+
 /**
  * @}
  */
@@ -152,12 +152,21 @@ LCM::publish(const std::string& channel, const void *data, unsigned int datalen)
 template<class MessageType>
 inline int
 LCM::publish(const std::string& channel, const MessageType *msg) {
+    if(!this->lcm) {
+        fprintf(stderr,
+            "LCM instance not initialized.  Ignoring call to publish()\n");
+        return -1;
+    }
     unsigned int datalen = msg->getEncodedSize();
-    uint8_t *buf = new uint8_t[datalen];
-    msg->encode(buf, 0, datalen);
-    int status = this->publish(channel, buf, datalen);
-    delete[] buf;
-    return status;
+    void *buf = lcm_publish_loan(this->lcm, channel.c_str(), datalen);
+    if(!buf)
+        return -1;
+    int encoded = msg->encode(buf, 0, datalen);
+    if(encoded < 0) {
+        lcm_publish_abort(this->lcm, buf);
+        return encoded;
+    }
+    return lcm_publish_commit(this->lcm, buf, encoded);
 }
 
 inline int
@@ -362,3 +371,41 @@ LogFile::getFilePtr()
 {
     return eventlog->f;
 }
+
+LogReader::LogReader(const std::string & path) :
+  reader(lcm_eventlog_reader_create(path.c_str()))
+{
+}
+
+LogReader::~LogReader()
+{
+    if(reader)
+        lcm_eventlog_reader_destroy(reader);
+    reader = NULL;
+}
+
+bool
+LogReader::good() const
+{
+    return reader != NULL;
+}
+
+const LogEvent*
+LogReader::readNextEvent()
+{
+    const lcm_eventlog_event_t* evt = lcm_eventlog_reader_next(reader);
+    if(!evt)
+        return NULL;
+    curEvent.eventnum = evt->eventnum;
+    curEvent.timestamp = evt->timestamp;
+    curEvent.channel.assign(evt->channel, evt->channellen);
+    curEvent.datalen = evt->datalen;
+    curEvent.data = evt->data;
+    return &curEvent;
+}
+
+int
+LogReader::seekToTimestamp(int64_t timestamp)
+{
+    return lcm_eventlog_reader_seek_to_timestamp(reader, timestamp);
+}
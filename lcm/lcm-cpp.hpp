@@ -571,6 +571,67 @@ class LogFile {
         lcm_eventlog_event_t* last_event;
 };
 
+/**
+ * @brief Read %LCM log files quickly, through a memory mapping.
+ *
+ * Unlike LogFile, reading an event doesn't copy its data.
+ *
+ * This class is the C++ counterpart for lcm_eventlog_reader_t.
+ *
+ * @sa lcm_eventlog_reader_t
+ *
+ * @headerfile lcm/lcm-cpp.hpp
+ */
+class LogReader {
+    public:
+        /**
+         * Constructor.  Opens the specified log file for reading.
+         * @param path the file to open
+         *
+         * @sa lcm_eventlog_reader_create()
+         */
+        inline LogReader(const std::string & path);
+
+        /**
+         * Destructor.  Closes the log file.
+         */
+        inline ~LogReader();
+
+        /**
+         * @return true if the log file is ready for reading.
+         */
+        inline bool good() const;
+
+        /**
+         * Reads the next event in the log file.
+         *
+         * The returned event is valid until the next call to this method.
+         * Its data points into the log file, and stays valid until the
+         * LogReader is destroyed.
+         *
+         * @return the next event, or NULL if the end of the log file has been
+         * reached.
+         */
+        inline const LogEvent* readNextEvent();
+
+        /**
+         * Seek to the first event at or after the specified timestamp.
+         *
+         * @param timestamp the desired seek point in the log file.
+         *
+         * @return 0 on success, -1 on error.
+         * @sa lcm_eventlog_reader_seek_to_timestamp()
+         */
+        inline int seekToTimestamp(int64_t timestamp);
+
+    private:
+        LogReader(const LogReader&);
+        LogReader& operator=(const LogReader&);
+
+        LogEvent curEvent;
+        lcm_eventlog_reader_t* reader;
+};
+
 /**
  * @}
  */
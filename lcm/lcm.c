@@ -34,6 +34,30 @@ struct _lcm_t {
 
     int default_max_num_queued_messages;
     int in_handle;
+
+    // a heap loan that was given back, kept for the next lcm_publish_loan()
+    volatile gpointer loan_cache;
+
+    // the taps of each kind, or NULL.  A list is never changed once it's
+    // installed: adding or removing a tap installs a new one, so that taps
+    // are called without holding taps_mutex.  The counts can be read without
+    // it.
+    struct _lcm_tap_list_t *taps[LCM_NUM_TAPS];
+    volatile gint num_taps[LCM_NUM_TAPS];
+    GMutex *taps_mutex;
+    GCond *taps_cond;   // signaled when a replaced list is no longer in use
+};
+
+typedef struct _lcm_tap_t lcm_tap_t;
+struct _lcm_tap_t {
+    lcm_msg_handler_t handler;
+    void *userdata;
+};
+
+typedef struct _lcm_tap_list_t lcm_tap_list_t;
+struct _lcm_tap_list_t {
+    GArray *taps;   // lcm_tap_t
+    int refcount;   // one for the lcm_t while installed, one per caller
 };
 
 struct _lcm_subscription_t {
@@ -54,6 +78,11 @@ extern void lcm_logprov_provider_init (GPtrArray * providers);
 extern void lcm_tcpq_provider_init (GPtrArray * providers);
 extern void lcm_mpudpm_provider_init(GPtrArray * providers);
 extern void lcm_memq_provider_init(GPtrArray * providers);
+extern void lcm_udpu_provider_init(GPtrArray * providers);
+extern void lcm_inproc_provider_init(GPtrArray * providers);
+#ifndef WIN32
+extern void lcm_shm_provider_init(GPtrArray * providers);
+#endif
 
 lcm_t * 
 lcm_create (const char *url)
@@ -80,6 +109,11 @@ lcm_create (const char *url)
     lcm_tcpq_provider_init (providers);
     lcm_mpudpm_provider_init (providers);
     lcm_memq_provider_init (providers);
+    lcm_udpu_provider_init (providers);
+    lcm_inproc_provider_init (providers);
+#ifndef WIN32
+    lcm_shm_provider_init (providers);
+#endif
     if (providers->len == 0) {
         fprintf (stderr, "Error: no LCM providers found\n");
         goto fail;
@@ -120,6 +154,8 @@ lcm_create (const char *url)
     lcm->vtable = info->vtable;
     lcm->handlers_all = g_ptr_array_new();
     lcm->handlers_map = g_hash_table_new (g_str_hash, g_str_equal);
+    lcm->taps_mutex = g_mutex_new ();
+    lcm->taps_cond = g_cond_new ();
 
     g_static_rec_mutex_init (&lcm->mutex);
     g_static_rec_mutex_init (&lcm->handle_mutex);
@@ -195,6 +231,17 @@ lcm_destroy (lcm_t * lcm)
         lcm_handler_free(h);
     }
     g_ptr_array_free(lcm->handlers_all, TRUE);
+    for (int i = 0; i < LCM_NUM_TAPS; i++) {
+        if (lcm->taps[i]) {
+            g_array_free (lcm->taps[i]->taps, TRUE);
+            free (lcm->taps[i]);
+        }
+    }
+    g_cond_free (lcm->taps_cond);
+    g_mutex_free (lcm->taps_mutex);
+
+    if (lcm->loan_cache)
+        free (LCM_LOAN_HDR (lcm->loan_cache));
 
     g_static_rec_mutex_free (&lcm->handle_mutex);
     g_static_rec_mutex_free (&lcm->mutex);
@@ -256,16 +303,240 @@ lcm_get_fileno (lcm_t * lcm)
         return -1;
 }
 
+static void
+tap_list_free (lcm_tap_list_t *list)
+{
+    g_array_free (list->taps, TRUE);
+    free (list);
+}
+
+// Calls the taps of one kind, without holding any lock, from a snapshot of
+// the installed list.
+static void
+call_taps (lcm_t *lcm, int tap, const lcm_recv_buf_t *rbuf,
+        const char *channel)
+{
+    g_mutex_lock (lcm->taps_mutex);
+    lcm_tap_list_t *list = lcm->taps[tap];
+    if (list)
+        list->refcount++;
+    g_mutex_unlock (lcm->taps_mutex);
+    if (!list)
+        return;
+
+    for (unsigned int i = 0; i < list->taps->len; i++) {
+        lcm_tap_t *t = &g_array_index (list->taps, lcm_tap_t, i);
+        t->handler (rbuf, channel, t->userdata);
+    }
+
+    g_mutex_lock (lcm->taps_mutex);
+    int refcount = --list->refcount;
+    // a list that was replaced is freed by its last caller, unless a
+    // remover is waiting to free it
+    if (list != lcm->taps[tap] && refcount <= 1)
+        g_cond_broadcast (lcm->taps_cond);
+    g_mutex_unlock (lcm->taps_mutex);
+    if (!refcount)
+        tap_list_free (list);
+}
+
+// Installs a copy of the taps of one kind, with a tap added or removed.
+// Returns -1 if the tap to remove isn't there.  When removing, waits for the
+// calls of the tap that are under way to return, so that the tap's userdata
+// can be freed once lcm_remove_tap() returns.
+static int
+replace_taps (lcm_t *lcm, int tap, const lcm_tap_t *add,
+        const lcm_tap_t *remove)
+{
+    g_mutex_lock (lcm->taps_mutex);
+    lcm_tap_list_t *old = lcm->taps[tap];
+    lcm_tap_list_t *list = (lcm_tap_list_t *) calloc (1,
+            sizeof (lcm_tap_list_t));
+    list->taps = g_array_new (FALSE, FALSE, sizeof (lcm_tap_t));
+    list->refcount = 1;
+    int removed = 0;
+    for (unsigned int i = 0; old && i < old->taps->len; i++) {
+        lcm_tap_t *t = &g_array_index (old->taps, lcm_tap_t, i);
+        if (remove && !removed && t->handler == remove->handler &&
+                t->userdata == remove->userdata) {
+            removed = 1;
+            continue;
+        }
+        g_array_append_val (list->taps, *t);
+    }
+    if (add)
+        g_array_append_vals (list->taps, add, 1);
+    if (remove && !removed) {
+        g_mutex_unlock (lcm->taps_mutex);
+        tap_list_free (list);
+        return -1;
+    }
+
+    if (!list->taps->len) {
+        tap_list_free (list);
+        list = NULL;
+    }
+    lcm->taps[tap] = list;
+    if (add)
+        g_atomic_int_inc (&lcm->num_taps[tap]);
+    else
+        g_atomic_int_add (&lcm->num_taps[tap], -1);
+
+    if (old) {
+        if (remove) {
+            while (old->refcount > 1)
+                g_cond_wait (lcm->taps_cond, lcm->taps_mutex);
+        }
+        if (--old->refcount)
+            old = NULL;     // freed by its last caller
+    }
+    g_mutex_unlock (lcm->taps_mutex);
+    if (old)
+        tap_list_free (old);
+    return 0;
+}
+
+static void
+tap_published (lcm_t *lcm, const char *channel, const void *data,
+        unsigned int datalen)
+{
+    if (!g_atomic_int_get (&lcm->num_taps[LCM_TAP_PUBLISHED]))
+        return;
+    GTimeVal tv;
+    g_get_current_time (&tv);
+    lcm_recv_buf_t rbuf;
+    memset (&rbuf, 0, sizeof (rbuf));
+    rbuf.data = (void*) data;
+    rbuf.data_size = datalen;
+    rbuf.recv_utime = (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+    rbuf.lcm = lcm;
+    call_taps (lcm, LCM_TAP_PUBLISHED, &rbuf, channel);
+}
+
 int
 lcm_publish (lcm_t *lcm, const char *channel, const void *data,
         unsigned int datalen)
 {
-    if (lcm->provider && lcm->vtable->publish)
+    if (lcm->provider && lcm->vtable->publish) {
+        tap_published (lcm, channel, data, datalen);
         return lcm->vtable->publish (lcm->provider, channel, data, datalen);
+    }
     else
         return -1;
 }
 
+int
+lcm_publishv (lcm_t *lcm, const char *channel, const struct iovec *iov,
+        int iovcnt)
+{
+    if (!lcm->provider || iovcnt < 0)
+        return -1;
+
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++)
+        total += iov[i].iov_len;
+    if (total > LCM_MAX_MESSAGE_SIZE) {
+        fprintf (stderr, "LCM Error: message on [%s] too large (%lu bytes)\n",
+                channel, (unsigned long) total);
+        return -1;
+    }
+    unsigned int datalen = (unsigned int) total;
+
+    // taps are given the message in one piece, by way of a loan
+    if (lcm->vtable->publishv &&
+            !g_atomic_int_get (&lcm->num_taps[LCM_TAP_PUBLISHED]))
+        return lcm->vtable->publishv (lcm->provider, channel, iov, iovcnt,
+                datalen);
+    if (iovcnt == 1)
+        return lcm_publish (lcm, channel, iov[0].iov_base, datalen);
+
+    char *buf = (char*) lcm_publish_loan (lcm, channel, datalen);
+    if (!buf)
+        return -1;
+    char *p = buf;
+    for (int i = 0; i < iovcnt; i++) {
+        // empty pieces may have a NULL iov_base
+        if (iov[i].iov_len)
+            memcpy (p, iov[i].iov_base, iov[i].iov_len);
+        p += iov[i].iov_len;
+    }
+    return lcm_publish_commit (lcm, buf, datalen);
+}
+
+void *
+lcm_heap_loan_new (lcm_t * lcm, const char * channel, unsigned int datalen)
+{
+    size_t channel_size = strlen (channel) + 1;
+    size_t needed = (size_t) datalen + channel_size;
+
+    // take the cached buffer, if nobody else beat us to it
+    void *buf = g_atomic_pointer_get (&lcm->loan_cache);
+    if (buf && !g_atomic_pointer_compare_and_exchange (&lcm->loan_cache,
+                buf, NULL))
+        buf = NULL;
+
+    lcm_loan_hdr_t *hdr = buf ? LCM_LOAN_HDR (buf) : NULL;
+    if (!hdr || hdr->capacity < needed) {
+        free (hdr);
+        hdr = (lcm_loan_hdr_t*) malloc (sizeof (lcm_loan_hdr_t) + needed);
+        if (!hdr)
+            return NULL;
+        hdr->capacity = needed;
+    }
+    hdr->owner = NULL;
+    hdr->size = datalen;
+    hdr->tag = 0;
+    hdr->channel = (char*) (hdr + 1) + datalen;
+    memcpy (hdr->channel, channel, channel_size);
+    return hdr + 1;
+}
+
+void
+lcm_heap_loan_free (lcm_t * lcm, void * buf)
+{
+    if (!g_atomic_pointer_compare_and_exchange (&lcm->loan_cache, NULL, buf))
+        free (LCM_LOAN_HDR (buf));
+}
+
+void *
+lcm_publish_loan (lcm_t *lcm, const char *channel, unsigned int datalen)
+{
+    if (!lcm->provider || !lcm->vtable->publish)
+        return NULL;
+    if (lcm->vtable->publish_loan)
+        return lcm->vtable->publish_loan (lcm->provider, channel, datalen);
+    return lcm_heap_loan_new (lcm, channel, datalen);
+}
+
+int
+lcm_publish_commit (lcm_t *lcm, void *buf, unsigned int datalen)
+{
+    lcm_loan_hdr_t *hdr = LCM_LOAN_HDR (buf);
+    if (datalen > hdr->size) {
+        fprintf (stderr, "LCM Error: committing %u bytes to a %u byte "
+                "loan on [%s]\n", datalen, hdr->size, hdr->channel);
+        lcm_publish_abort (lcm, buf);
+        return -1;
+    }
+    tap_published (lcm, hdr->channel, buf, datalen);
+    if (lcm->vtable->publish_commit)
+        return lcm->vtable->publish_commit (lcm->provider, buf, datalen);
+
+    int status = lcm->vtable->publish (lcm->provider, hdr->channel, buf,
+            datalen);
+    lcm_heap_loan_free (lcm, buf);
+    return status;
+}
+
+void
+lcm_publish_abort (lcm_t *lcm, void *buf)
+{
+    if (lcm->vtable->publish_abort)
+        lcm->vtable->publish_abort (lcm->provider, buf);
+    else
+        lcm_heap_loan_free (lcm, buf);
+}
+
 static int 
 is_handler_subscriber(lcm_subscription_t *h, const char *channel_name)
 {
@@ -422,9 +693,103 @@ lcm_has_handlers (lcm_t * lcm, const char * channel)
     return has_handlers;
 }
 
+// What rbuf->retain_ctx points to, while a message is being dispatched
+typedef struct _retain_ctx {
+    lcm_retain_func_t retain;
+    void *user;
+    // set once a handler has retained the message.  The dispatch holds a
+    // reference to it, so that the data stays valid for the other handlers.
+    lcm_retained_t *retained;
+} retain_ctx_t;
+
+lcm_retained_t *
+lcm_retained_new (const lcm_recv_buf_t *rbuf, void *owner,
+        void (*free_owner)(void *owner))
+{
+    lcm_retained_t *r = (lcm_retained_t *) malloc (sizeof (lcm_retained_t));
+    if (!r)
+        return NULL;
+    r->rbuf = *rbuf;
+    r->rbuf.retain_ctx = r;
+    r->refcount = 1;
+    r->owner = owner;
+    r->free_owner = free_owner;
+    return r;
+}
+
+// Copies rbuf and its data into a single allocation
+static lcm_retained_t *
+retained_copy (const lcm_recv_buf_t *rbuf)
+{
+    lcm_retained_t *r = (lcm_retained_t *) malloc (sizeof (lcm_retained_t) +
+            rbuf->data_size);
+    if (!r) {
+        fprintf (stderr, "Memory allocation error\n");
+        return NULL;
+    }
+    r->rbuf = *rbuf;
+    r->rbuf.data = r + 1;
+    r->rbuf.retain_ctx = r;
+    memcpy (r->rbuf.data, rbuf->data, rbuf->data_size);
+    r->refcount = 1;
+    r->owner = NULL;
+    r->free_owner = NULL;
+    return r;
+}
+
+lcm_recv_buf_t *
+lcm_recv_buf_retain (const lcm_recv_buf_t *rbuf)
+{
+    // a retained buffer points to itself
+    if (rbuf->retain_ctx == rbuf) {
+        lcm_retained_t *r = (lcm_retained_t *) rbuf;
+        g_atomic_int_inc (&r->refcount);
+        return &r->rbuf;
+    }
+
+    retain_ctx_t *ctx = (retain_ctx_t *) rbuf->retain_ctx;
+    if (!ctx) {
+        lcm_retained_t *r = retained_copy (rbuf);
+        return r ? &r->rbuf : NULL;
+    }
+    if (!ctx->retained) {
+        lcm_retained_t *r = NULL;
+        if (ctx->retain)
+            r = ctx->retain (rbuf, ctx->user);
+        if (!r)
+            r = retained_copy (rbuf);
+        if (!r)
+            return NULL;
+        ctx->retained = r;
+    }
+    g_atomic_int_inc (&ctx->retained->refcount);
+    return &ctx->retained->rbuf;
+}
+
+void
+lcm_recv_buf_release (lcm_recv_buf_t *rbuf)
+{
+    lcm_retained_t *r = (lcm_retained_t *) rbuf;
+    if (!g_atomic_int_dec_and_test (&r->refcount))
+        return;
+    if (r->free_owner)
+        r->free_owner (r->owner);
+    free (r);
+}
+
 int
 lcm_dispatch_handlers (lcm_t * lcm, lcm_recv_buf_t * buf, const char *channel)
 {
+    return lcm_dispatch_handlers_retainable (lcm, buf, channel, NULL, NULL);
+}
+
+int
+lcm_dispatch_handlers_retainable (lcm_t * lcm, lcm_recv_buf_t * buf,
+        const char *channel, lcm_retain_func_t retain, void *user)
+{
+    retain_ctx_t ctx = { retain, user, NULL };
+    buf->retain_ctx = &ctx;
+
     g_static_rec_mutex_lock (&lcm->mutex);
 
     GPtrArray * handlers = lcm_get_handlers (lcm, channel);
@@ -441,6 +806,7 @@ lcm_dispatch_handlers (lcm_t * lcm, lcm_recv_buf_t * buf, const char *channel)
     }
 
     // now, call the handlers.
+    int dispatched = 0;
     for (int i = 0; i < nhandlers; i++) {
         lcm_subscription_t *h = (lcm_subscription_t *) g_ptr_array_index(handlers, i);
         if (!h->marked_for_deletion && h->num_queued_messages > 0) {
@@ -448,8 +814,14 @@ lcm_dispatch_handlers (lcm_t * lcm, lcm_recv_buf_t * buf, const char *channel)
             int depth = g_static_rec_mutex_unlock_full (&lcm->mutex);
             h->handler (buf, channel, h->userdata);
             g_static_rec_mutex_lock_full (&lcm->mutex, depth);
+            dispatched = 1;
         }
     }
+    if (dispatched && g_atomic_int_get (&lcm->num_taps[LCM_TAP_RECEIVED])) {
+        int depth = g_static_rec_mutex_unlock_full (&lcm->mutex);
+        call_taps (lcm, LCM_TAP_RECEIVED, buf, channel);
+        g_static_rec_mutex_lock_full (&lcm->mutex, depth);
+    }
 
     // unref the handlers and check if any should be deleted
     GList *to_remove = NULL;
@@ -469,9 +841,27 @@ lcm_dispatch_handlers (lcm_t * lcm, lcm_recv_buf_t * buf, const char *channel)
     }
     g_static_rec_mutex_unlock (&lcm->mutex);
 
+    buf->retain_ctx = NULL;
+    if (ctx.retained)
+        lcm_recv_buf_release (&ctx.retained->rbuf);
     return 0;
 }
 
+void
+lcm_add_tap (lcm_t * lcm, int tap, lcm_msg_handler_t handler, void *userdata)
+{
+    lcm_tap_t t = { handler, userdata };
+    replace_taps (lcm, tap, &t, NULL);
+}
+
+int
+lcm_remove_tap (lcm_t * lcm, int tap, lcm_msg_handler_t handler,
+        void *userdata)
+{
+    lcm_tap_t t = { handler, userdata };
+    return replace_taps (lcm, tap, NULL, &t);
+}
+
 int
 lcm_parse_url (const char * url, char ** provider, char ** network,
         GHashTable * args)
@@ -2,6 +2,9 @@
 #define __lightweight_communications_h__
 
 #include <stdint.h>
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
 
 #include "lcm_version.h"
 
@@ -78,6 +81,10 @@ struct _lcm_recv_buf_t
      * pointer to the lcm_t struct that owns this buffer
      */
     lcm_t *lcm;
+    /**
+     * for internal use by lcm_recv_buf_retain()
+     */
+    void *retain_ctx;
 };
 
 /**
@@ -121,6 +128,12 @@ typedef void (*lcm_msg_handler_t) (const lcm_recv_buf_t *rbuf,
          ttl = N
              time to live of transmitted packets.  Default 0
 
+         loopback_shortcut = 0 | 1
+             If 1, messages published by this LCM instance are passed
+             directly to its own subscribers without a round trip through
+             the kernel.  Other processes still receive them over the
+             network.  Default 0
+
      examples:
          "udpm://239.255.76.67:7667"
              Default initialization string
@@ -129,6 +142,115 @@ typedef void (*lcm_msg_handler_t) (const lcm_recv_buf_t *rbuf,
              Sets the multicast TTL to 1 so that packets published will enter
              the local network.
  @endverbatim
+ *
+ * @verbatim
+ udpu://
+     UDP Unicast provider
+     network can be of the form "bind_address:port", and specifies the
+     local address and port that messages are received on.  Either may be
+     omitted; the defaults are all interfaces and port 7667.
+
+     Messages use the same packet format as udpm, but each published
+     message is sent to every peer individually.  This provider is useful
+     on networks that do not support multicast.
+
+     options:
+         peers = HOST:PORT,HOST:PORT,...
+             comma-separated list of hosts to transmit messages to.  If the
+             port is omitted for a peer, the local port is used.
+
+         recv_buf_size = N
+             size of the kernel UDP receive buffer to request.  Defaults to
+             operating system defaults
+
+     examples:
+         "udpu://:7667?peers=10.0.0.2,10.0.0.3"
+             Receives on port 7667, and transmits to port 7667 on two hosts.
+
+         "udpu://127.0.0.1:7700?peers=127.0.0.1:7700,127.0.0.1:7701"
+             Receives on the loopback interface, and transmits to itself and
+             to another process on the same host.
+@endverbatim
+ *
+ * @verbatim
+ shm://
+     Shared memory provider
+     network is a name identifying the shared memory segment.  Defaults to
+     "lcm".  All LCM instances on the same host that use the same name can
+     communicate with each other.
+
+     Messages are exchanged through a ring of fixed-size slots in a POSIX
+     shared memory segment (/dev/shm/lcm-shm-NAME on Linux), and are never
+     copied on the receiving side.  The rbuf->data pointer passed to message
+     handlers points directly into shared memory, and is only valid for the
+     duration of the callback.  Subscribers that fall behind by more than
+     the number of slots lose messages.  This provider is not available on
+     Windows.
+
+     The ring geometry is fixed by the first instance to create the segment.
+     The segment is removed when the last instance using it is destroyed.
+     Processes that exit without calling lcm_destroy() leave it behind, and
+     it then persists until it is removed from /dev/shm.
+
+     If a publisher stops in the middle of publishing a message, that message
+     is skipped after a few seconds.  When the ring wraps around to its slot,
+     publishing fails if the publisher is still alive, and the slot is taken
+     over if it has exited.
+
+     options:
+         slots = N
+             number of messages the ring can hold.  Defaults to 32
+
+         slot_size = N
+             maximum message size, in bytes.  Defaults to 1048576
+
+     examples:
+         "shm://"
+             Uses the default segment.
+
+         "shm://camera?slots=8&slot_size=8388608"
+             Uses the segment "camera", which holds up to 8 messages of up to
+             8 MiB each.
+@endverbatim
+ *
+ * @verbatim
+ tcpq://
+     TCP queue provider
+     network is of the form "host:port".  Defaults to "127.0.0.1:7700".
+     Messages are sent to, and received from, a tcpq server (lcm-tcpq-server,
+     or the Java lcm.lcm.TCPService), which relays them to every client that
+     subscribed to their channel.
+
+     options:
+         nodelay = [0 or 1]
+             if 1, disables Nagle's algorithm on the connection.  Defaults
+             to 1, since every message is written to the socket in one call.
+
+         cork = [0 or 1]
+             if 1, sets TCP_CORK on the connection so that the kernel only
+             sends full segments until coalesce_usec microseconds after the
+             first of a burst of messages was published.  Unlike
+             coalesce_bytes, messages aren't copied.  Linux only.  Defaults
+             to 0
+
+         coalesce_bytes = N
+             if non-zero, messages smaller than N bytes are collected and
+             sent together once N bytes have accumulated, or coalesce_usec
+             microseconds after the first of them was published.  Defaults
+             to 0 (disabled)
+
+         coalesce_usec = N
+             maximum time a coalesced message waits before it is sent.
+             Defaults to 1000
+
+     examples:
+         "tcpq://"
+             Connects to a server on 127.0.0.1:7700
+
+         "tcpq://relay.local:7700?coalesce_bytes=65536&coalesce_usec=500"
+             Batches small messages into up to 64 KiB writes, with at most
+             half a millisecond of added latency.
+@endverbatim
  *
  * @verbatim
  file://
@@ -148,6 +270,11 @@ typedef void (*lcm_msg_handler_t) (const lcm_recv_buf_t *rbuf,
              never skipped in read mode, so actual playback speed may be slower
              than requested, depending on the handlers.
 
+         spin = USEC
+             Busy-wait through the last USEC microseconds before each event
+             is due, instead of sleeping, for more precise timing at the
+             cost of CPU time.  At most 10000.  Defaults to 0.
+
          mode = r | w
              Specifies the log file mode.  Defaults to 'r'
 
@@ -180,12 +307,47 @@ typedef void (*lcm_msg_handler_t) (const lcm_recv_buf_t *rbuf,
     that require deterministic and predictable behavior that is independent of
     a system's network configuration.
 
-    example:
+    Messages are passed through a ring of reusable slots, so publishing does
+    not allocate memory once the ring has warmed up.  If more messages are
+    published than the ring holds before they are handled, the rest are
+    queued separately, and no messages are lost.
+
+    options:
+        queue_size = N
+            number of messages the ring holds.  Rounded up to a power of
+            two.  Defaults to 256
+
+    examples:
         "memq://"
-            This is the only valid way to instantiate this provider.
+            Uses the default ring size.
+
+        "memq://?queue_size=65536"
+            Holds up to 65536 messages without allocating memory.
 
  @endverbatim
  *
+ * @verbatim
+ inproc://
+     In-process provider
+     network is a name identifying a bus.  All LCM instances in the same
+     process that are created with the same name communicate with each
+     other, including the publishing instance itself.  Defaults to the empty
+     name.
+
+     Published messages are copied once, and the copy is shared by every
+     instance that has a subscriber for the channel.  Each instance
+     dispatches messages from its own lcm_handle() calls, so message
+     handlers must treat rbuf->data as read-only.  This provider does not
+     communicate with other processes.
+
+     examples:
+         "inproc://"
+             Joins the default bus.
+
+         "inproc://plugins"
+             Joins the bus named "plugins".
+ @endverbatim
+ *
  * @return a newly allocated lcm_t instance, or NULL on failure.  Free with
  * lcm_destroy() when no longer needed.
  */
@@ -280,6 +442,115 @@ LCM_EXPORT
 int lcm_publish (lcm_t *lcm, const char *channel, const void *data,
         unsigned int datalen);
 
+/**
+ * @brief Borrow a buffer to encode a message into, for lcm_publish_commit().
+ *
+ * Publishing with lcm_publish() copies the message at least once.  Instead, a
+ * message can be encoded directly into a buffer loaned by %LCM, and then
+ * published with lcm_publish_commit().  With the memq, inproc and shm
+ * providers the loaned buffer is handed to subscribers as is.  Other
+ * providers send it straight from the loaned buffer, which is reused from
+ * one message to the next.
+ *
+ * Every loaned buffer must be given back with exactly one call to either
+ * lcm_publish_commit() or lcm_publish_abort(), and should be given back
+ * promptly: with some providers, subscribers can't receive later messages
+ * until it is.  It is okay to call this function from multiple threads.
+ *
+ * The message-specific publish functions generated by @c lcm-gen use this
+ * function.
+ *
+ * @param lcm      The %LCM object
+ * @param channel  The channel the message will be published on
+ * @param datalen  Maximum size of the encoded message
+ *
+ * @return a buffer of at least @p datalen bytes, or NULL on failure.
+ */
+LCM_EXPORT
+void * lcm_publish_loan (lcm_t *lcm, const char *channel,
+        unsigned int datalen);
+
+/**
+ * @brief Publish a message that was encoded into a loaned buffer.
+ *
+ * @param lcm      The %LCM object
+ * @param buf      A buffer returned by lcm_publish_loan()
+ * @param datalen  Size of the encoded message.  May be smaller than the size
+ *                 that was passed to lcm_publish_loan()
+ *
+ * @return 0 on success, -1 on failure.  Either way, @p buf is no longer
+ * valid.
+ */
+LCM_EXPORT
+int lcm_publish_commit (lcm_t *lcm, void *buf, unsigned int datalen);
+
+/**
+ * @brief Give back a loaned buffer without publishing it.
+ *
+ * @param lcm      The %LCM object
+ * @param buf      A buffer returned by lcm_publish_loan()
+ */
+LCM_EXPORT
+void lcm_publish_abort (lcm_t *lcm, void *buf);
+
+/**
+ * @brief Keep a received message after the handler returns.
+ *
+ * The buffer passed to a message handler is normally only valid until the
+ * handler returns.  Calling this from the handler returns a buffer holding
+ * the same message that stays valid until it is passed to
+ * lcm_recv_buf_release(), e.g. so that a worker thread can decode it later.
+ *
+ * Where possible, the provider hands over the memory it received the message
+ * into instead of copying it.  memq and inproc messages, and udpm messages
+ * that were reassembled from fragments, are never copied.  Other messages are
+ * copied once.  Any number of handlers may
+ * retain the same message; they share one buffer.
+ *
+ * A retained buffer stays valid after the lcm_t that received it is
+ * destroyed, but its @c lcm field must not be used then.  It may be released
+ * from any thread.
+ *
+ * @param rbuf     The buffer passed to the handler, or a retained buffer
+ *
+ * @return the retained buffer, or NULL if memory ran out.  Its @c data may
+ * differ from that of @c rbuf.
+ */
+LCM_EXPORT
+lcm_recv_buf_t * lcm_recv_buf_retain (const lcm_recv_buf_t *rbuf);
+
+/**
+ * @brief Release a buffer returned by lcm_recv_buf_retain().
+ *
+ * Each call to lcm_recv_buf_retain() must be matched by one call to this.
+ *
+ * @param rbuf     A retained buffer
+ */
+LCM_EXPORT
+void lcm_recv_buf_release (lcm_recv_buf_t *rbuf);
+
+struct iovec;
+
+/**
+ * @brief Publish a message whose bytes are scattered over several buffers.
+ *
+ * The message is the concatenation of the @c iovcnt buffers in @c iov, e.g.
+ * a header struct followed by a large image that is owned by somebody else.
+ * Providers that can send directly from the buffers (udpm, tcpq) do so, and
+ * the others gather them into a single buffer first, so this is never slower
+ * than concatenating the buffers and calling lcm_publish().
+ *
+ * @param lcm      The %LCM object
+ * @param channel  The channel to publish on
+ * @param iov      The buffers that make up the message, in order
+ * @param iovcnt   Number of buffers in @c iov
+ *
+ * @return 0 on success, -1 on failure.
+ */
+LCM_EXPORT
+int lcm_publishv (lcm_t *lcm, const char *channel, const struct iovec *iov,
+        int iovcnt);
+
 /**
  * @brief Wait for and dispatch the next incoming message.
  *
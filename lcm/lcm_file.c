@@ -2,18 +2,33 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <assert.h>
+#include <time.h>
 #ifndef WIN32
 #include <sys/time.h>
-#include <sys/select.h>
 #else
 #include "windows/WinPorting.h"
 #include <Winsock2.h>
 #endif
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 
 #include "lcm_internal.h"
 #include "dbg.h"
 #include "eventlog.h"
 
+// How many events, and how many bytes of events, the timer thread reads
+// ahead of playback.  At least one event is always read ahead.
+#define READ_AHEAD_EVENTS 64
+#define READ_AHEAD_BYTES (16 << 20)
+
+// The timer thread doesn't start reading an event when the next one is due
+// sooner than this, in microseconds
+#define READ_AHEAD_MARGIN_US 1000
+
+// The longest the timer thread sleeps before checking whether it should exit
+#define MAX_SLEEP_US 10000
+
 typedef enum {
   LCM_LOGPROV_READ_MODE=0,
   LCM_LOGPROV_WRITE_MODE=1,
@@ -32,14 +47,37 @@ struct _lcm_provider_t {
     lcm_eventlog_t * log;
     lcm_eventlog_event_t * event;
 
+    // in read mode, the log files listed in a manifest, instead of log
+    lcm_eventlog_merge_t * merge;
+
     double speed;
-    int64_t next_clock_time;
     int64_t start_timestamp;
+    int64_t spin_us;
+
+    // The monotonic and wall clock times that playback started at, and the
+    // timestamp of the first event played back
+    int64_t start_monotonic;
+    int64_t start_clock_time;
+    int64_t start_log_time;
 
     int thread_created;
     GThread *timer_thread;
     int notify_pipe[2];
-    int timer_pipe[2];
+
+    // Events read by the timer thread.  Of the queue_len events starting at
+    // queue_head, the first num_due are due, and a byte has been written to
+    // notify_pipe for each of them.  Once the log has been read to the end,
+    // and all of its events are due, one more byte is written.
+    GMutex *queue_mutex;
+    GCond *queue_cond;
+    lcm_eventlog_event_t *queue[READ_AHEAD_EVENTS];
+    int64_t queue_deadline[READ_AHEAD_EVENTS];
+    int queue_head;
+    int queue_len;
+    int num_due;
+    int64_t queue_bytes;
+    int end_of_log;
+    int exit_thread;
 };
 
 static void
@@ -48,23 +86,30 @@ lcm_logprov_destroy (lcm_logprov_t *lr)
     dbg (DBG_LCM, "closing lcm log provider context\n");
     if (lr->thread_created) {
         /* Destroy the timer thread */
-        int64_t abort_cmd = -1;
-        int status = lcm_internal_pipe_write(lr->timer_pipe[1], &abort_cmd, sizeof(abort_cmd));
-        if(status < 0) {
-            perror(__FILE__ " - write (abort_cmd)");
-        }
+        g_mutex_lock (lr->queue_mutex);
+        lr->exit_thread = 1;
+        g_cond_signal (lr->queue_cond);
+        g_mutex_unlock (lr->queue_mutex);
         g_thread_join (lr->timer_thread);
     }
 
     if(lr->notify_pipe[0] >= 0) lcm_internal_pipe_close(lr->notify_pipe[0]);
     if(lr->notify_pipe[1] >= 0) lcm_internal_pipe_close(lr->notify_pipe[1]);
-    if(lr->timer_pipe[0] >= 0)  lcm_internal_pipe_close(lr->timer_pipe[0]);
-    if(lr->timer_pipe[1] >= 0)  lcm_internal_pipe_close(lr->timer_pipe[1]);
+
+    for (int i = 0; i < lr->queue_len; i++)
+        lcm_eventlog_free_event (
+                lr->queue[(lr->queue_head + i) % READ_AHEAD_EVENTS]);
+    if (lr->queue_cond)
+        g_cond_free (lr->queue_cond);
+    if (lr->queue_mutex)
+        g_mutex_free (lr->queue_mutex);
 
     if (lr->event)
         lcm_eventlog_free_event (lr->event);
     if (lr->log)
         lcm_eventlog_destroy (lr->log);
+    if (lr->merge)
+        lcm_eventlog_merge_destroy (lr->merge);
 
     free (lr->filename);
     free (lr);
@@ -78,47 +123,6 @@ timestamp_now (void)
     return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
-static void *
-timer_thread (void * user)
-{
-    lcm_logprov_t * lr = (lcm_logprov_t *) user;
-    int64_t abstime;
-    struct timeval sleep_tv;
-
-    while (lcm_internal_pipe_read(lr->timer_pipe[0], &abstime, 8) == 8) {
-        if (abstime < 0) return NULL;
-
-        int64_t now = timestamp_now();
-
-        if (abstime > now) {
-            int64_t sleep_utime = abstime - now;
-            sleep_tv.tv_sec = sleep_utime / 1000000;
-            sleep_tv.tv_usec = sleep_utime % 1000000;
-
-            // sleep until the next timed message, or until an abort message
-            fd_set fds;
-            FD_ZERO (&fds);
-            FD_SET (lr->timer_pipe[0], &fds);
-
-            int status = select (lr->timer_pipe[0] + 1, &fds, NULL, NULL,
-                                 &sleep_tv);
-
-            if (0 == status) {
-                // select timed out
-                if(lcm_internal_pipe_write(lr->notify_pipe[1], "+", 1) < 0) {
-                    perror(__FILE__ " - write (timer select)");
-                }
-            }
-        } else {
-            if(lcm_internal_pipe_write(lr->notify_pipe[1], "+", 1) < 0) {
-                perror(__FILE__ " - write (timer)");
-            }
-       }
-    }
-    perror ("timer_thread read failed");
-    return NULL;
-}
-
 static void
 new_argument (gpointer key, gpointer value, gpointer user)
 {
@@ -128,6 +132,16 @@ new_argument (gpointer key, gpointer value, gpointer user)
         lr->speed = strtod ((char *) value, &endptr);
         if (endptr == value)
             fprintf (stderr, "Warning: Invalid value for speed\n");
+    } else if (!strcmp ((char *) key, "spin")) {
+        char *endptr = NULL;
+        lr->spin_us = strtoll ((char *) value, &endptr, 10);
+        if (endptr == value || lr->spin_us < 0) {
+            fprintf (stderr, "Warning: Invalid value for spin\n");
+            lr->spin_us = 0;
+        }
+        // the timer thread has to wake up that often anyway
+        if (lr->spin_us > MAX_SLEEP_US)
+            lr->spin_us = MAX_SLEEP_US;
     } else if (!strcmp ((char *) key, "start_timestamp")) {
         char *endptr = NULL;
         lr->start_timestamp = strtoll ((char *) value, &endptr, 10);
@@ -151,12 +165,174 @@ new_argument (gpointer key, gpointer value, gpointer user)
 }
 
 static int
-load_next_event (lcm_logprov_t * lr)
+has_handlers (const char *channel, void *user)
+{
+    lcm_logprov_t * lr = (lcm_logprov_t *) user;
+    return lcm_has_handlers (lr->lcm, channel);
+}
+
+// Microseconds on a clock that isn't set, so that deadlines on it don't move
+static int64_t
+monotonic_now (void)
+{
+#ifndef WIN32
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return g_get_monotonic_time ();
+#endif
+}
+
+// Sleeps until a time on the monotonic clock, or for MAX_SLEEP_US, whichever
+// is sooner
+static void
+sleep_until (int64_t deadline)
+{
+    int64_t now = monotonic_now ();
+    if (deadline > now + MAX_SLEEP_US)
+        deadline = now + MAX_SLEEP_US;
+#if !defined(WIN32) && !defined(__APPLE__) && defined(TIMER_ABSTIME)
+    // An absolute deadline isn't pushed back by the time it takes to get
+    // here, or by being woken up by a signal.
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000;
+    ts.tv_nsec = (deadline % 1000000) * 1000;
+    while (EINTR == clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+                NULL))
+        ;
+#else
+    if (deadline > now)
+        g_usleep (deadline - now);
+#endif
+}
+
+// Reads the next event on a channel that has handlers, or any event if
+// unfiltered is set.  Returns NULL at the end of the log.
+static lcm_eventlog_event_t *
+read_event (lcm_logprov_t * lr, int unfiltered)
+{
+    if (lr->merge)
+        return lcm_eventlog_merge_read_next_event_filtered (lr->merge,
+                unfiltered ? NULL : has_handlers, lr);
+    return lcm_eventlog_read_next_event_filtered (lr->log,
+            unfiltered ? NULL : has_handlers, lr);
+}
+
+// Once the whole log has been read and every event is due, lcm_handle() is
+// woken up one more time, to fail.  Called with queue_mutex locked.
+static void
+notify_end_of_log (lcm_logprov_t * lr)
+{
+    if (lr->num_due == lr->queue_len &&
+            lcm_internal_pipe_write(lr->notify_pipe[1], "+", 1) < 0) {
+        perror(__FILE__ " - write (end of log)");
+    }
+}
+
+// Reads events ahead of playback, and releases each one to lcm_handle() when
+// it is due
+static void *
+timer_thread (void * user)
+{
+    lcm_logprov_t * lr = (lcm_logprov_t *) user;
+
+#if defined(__linux__) && defined(PR_SET_TIMERSLACK)
+    // the default 50us of slack would be added to every wakeup
+    prctl (PR_SET_TIMERSLACK, 1, 0, 0, 0);
+#endif
+
+    g_mutex_lock (lr->queue_mutex);
+    while (!lr->exit_thread) {
+        int64_t now = monotonic_now ();
+        int next = (lr->queue_head + lr->num_due) % READ_AHEAD_EVENTS;
+        int have_next = lr->num_due < lr->queue_len;
+
+        if (have_next && lr->queue_deadline[next] <= now) {
+            // Events are read ahead unfiltered, since channels can be
+            // subscribed to in the meantime, and are only dropped once
+            // they're due.  lcm_handle() doesn't touch the events that
+            // aren't due, so this one stays at next.
+            lcm_eventlog_event_t * le = lr->queue[next];
+            g_mutex_unlock (lr->queue_mutex);
+            int wanted = lcm_has_handlers (lr->lcm, le->channel);
+            g_mutex_lock (lr->queue_mutex);
+            if (!wanted) {
+                // move up the events read after it
+                for (int k = lr->num_due + 1; k < lr->queue_len; k++) {
+                    int to = (lr->queue_head + k - 1) % READ_AHEAD_EVENTS;
+                    int from = (lr->queue_head + k) % READ_AHEAD_EVENTS;
+                    lr->queue[to] = lr->queue[from];
+                    lr->queue_deadline[to] = lr->queue_deadline[from];
+                }
+                lr->queue_len--;
+                lr->queue_bytes -= le->datalen;
+                lcm_eventlog_free_event (le);
+                if (lr->end_of_log)
+                    notify_end_of_log (lr);
+                continue;
+            }
+            lr->num_due++;
+            if (lcm_internal_pipe_write(lr->notify_pipe[1], "+", 1) < 0) {
+                perror(__FILE__ " - write (timer)");
+            }
+            if (lr->end_of_log)
+                notify_end_of_log (lr);
+            continue;
+        }
+
+        int room = lr->queue_len == 0 ||
+            (lr->queue_len < READ_AHEAD_EVENTS &&
+             lr->queue_bytes < READ_AHEAD_BYTES);
+        if (room && !lr->end_of_log && (!have_next ||
+                    lr->queue_deadline[next] - now > READ_AHEAD_MARGIN_US)) {
+            g_mutex_unlock (lr->queue_mutex);
+            lcm_eventlog_event_t * le = read_event (lr, 1);
+            g_mutex_lock (lr->queue_mutex);
+            if (!le) {
+                lr->end_of_log = 1;
+                notify_end_of_log (lr);
+                continue;
+            }
+            int i = (lr->queue_head + lr->queue_len) % READ_AHEAD_EVENTS;
+            lr->queue[i] = le;
+            lr->queue_deadline[i] = lr->start_monotonic + (int64_t)
+                ((le->timestamp - lr->start_log_time) / lr->speed);
+            lr->queue_len++;
+            lr->queue_bytes += le->datalen;
+            continue;
+        }
+
+        if (have_next) {
+            int64_t deadline = lr->queue_deadline[next];
+            g_mutex_unlock (lr->queue_mutex);
+            // sleep through most of the wait, and spin through the rest
+            if (now < deadline - lr->spin_us)
+                sleep_until (deadline - lr->spin_us);
+            else
+                while (monotonic_now () < deadline)
+                    ;
+            g_mutex_lock (lr->queue_mutex);
+            continue;
+        }
+
+        // wait for lcm_handle() to make room, or for the provider to be
+        // destroyed
+        g_cond_wait (lr->queue_cond, lr->queue_mutex);
+    }
+    g_mutex_unlock (lr->queue_mutex);
+    return NULL;
+}
+
+// Events on channels nobody is subscribed to are skipped without reading
+// their data, unless unfiltered is set.
+static int
+load_next_event (lcm_logprov_t * lr, int unfiltered)
 {
     if (lr->event)
         lcm_eventlog_free_event (lr->event);
 
-    lr->event = lcm_eventlog_read_next_event (lr->log);
+    lr->event = read_event (lr, unfiltered);
     if (!lr->event)
         return -1;
 
@@ -175,7 +351,6 @@ lcm_logprov_create (lcm_t * parent, const char *target, const GHashTable *args)
     lr->lcm = parent;
     lr->filename = strdup(target);
     lr->speed = 1;
-    lr->next_clock_time = -1;
     lr->start_timestamp = -1;
 
     g_hash_table_foreach ((GHashTable*) args, new_argument, lr);
@@ -188,16 +363,15 @@ lcm_logprov_create (lcm_t * parent, const char *target, const GHashTable *args)
         lcm_logprov_destroy (lr);
         return NULL;
     }
-    if(lcm_internal_pipe_create(lr->timer_pipe) != 0) {
-        perror(__FILE__ " - pipe (timer)");
-        lcm_logprov_destroy (lr);
-        return NULL;
-    }
     //fcntl (lcm->notify_pipe[1], F_SETFL, O_NONBLOCK);
 
     switch (lr->log_mode) {
         case LCM_LOGPROV_READ_MODE:
-            lr->log = lcm_eventlog_create(lr->filename, "r");
+            // play back all the shards of a sharded log together
+            if (lcm_eventlog_is_manifest(lr->filename))
+                lr->merge = lcm_eventlog_merge_create_from_manifest(lr->filename);
+            else
+                lr->log = lcm_eventlog_create(lr->filename, "r");
             break;
         case LCM_LOGPROV_WRITE_MODE:
             lr->log = lcm_eventlog_create(lr->filename, "w");
@@ -211,38 +385,37 @@ lcm_logprov_create (lcm_t * parent, const char *target, const GHashTable *args)
             return NULL;
     }
 
-    if (!lr->log) {
+    if (!lr->log && !lr->merge) {
         fprintf (stderr, "Error: Failed to open %s: %s\n", lr->filename,
                 strerror (errno));
         lcm_logprov_destroy (lr);
         return NULL;
     }
 
-    // only start the reader thread if we're in read mode
     if (lr->log_mode == LCM_LOGPROV_READ_MODE){
-        if (load_next_event (lr) < 0) {
-            fprintf (stderr, "Error: Failed to read first event from log\n");
-            lcm_logprov_destroy (lr);
-            return NULL;
+        if(lr->start_timestamp > 0){
+            dbg (DBG_LCM, "Seeking to timestamp: %lld\n", (long long)lr->start_timestamp);
+            if (lr->merge)
+                lcm_eventlog_merge_seek_to_timestamp(lr->merge,
+                        lr->start_timestamp);
+            else
+                lcm_eventlog_seek_to_timestamp(lr->log, lr->start_timestamp);
         }
 
-        /* Start the reader thread */
-        lr->timer_thread = g_thread_create (timer_thread, lr, TRUE, NULL);
-        if (!lr->timer_thread) {
-            fprintf (stderr, "Error: LCM failed to start timer thread\n");
+        // there are no subscriptions yet.  Past the end of the log, there's
+        // nothing to play back, and lcm_handle() fails.
+        if (load_next_event (lr, 1) < 0 && lr->start_timestamp <= 0) {
+            fprintf (stderr, "Error: Failed to read first event from log\n");
             lcm_logprov_destroy (lr);
             return NULL;
         }
-        lr->thread_created = 1;
+
+        lr->queue_mutex = g_mutex_new ();
+        lr->queue_cond = g_cond_new ();
 
         if(lcm_internal_pipe_write(lr->notify_pipe[1], "+", 1) < 0) {
             perror(__FILE__ " - write (reader create)");
         }
-
-        if(lr->start_timestamp > 0){
-            dbg (DBG_LCM, "Seeking to timestamp: %lld\n", (long long)lr->start_timestamp);
-            lcm_eventlog_seek_to_timestamp(lr->log, lr->start_timestamp);
-        }
     }
 
     return lr;
@@ -254,69 +427,95 @@ lcm_logprov_get_fileno (lcm_logprov_t *lr)
     return lr->notify_pipe[0];
 }
 
+// Starts the clock and the timer thread, when the first event is played back
 static int
-lcm_logprov_handle (lcm_logprov_t * lr)
+start_playback (lcm_logprov_t * lr, int64_t clock_time)
 {
-    lcm_recv_buf_t rbuf;
-
-    if (!lr->event)
-        return -1;
-
+    // the byte written when the provider was created
     char ch;
-    int status = lcm_internal_pipe_read(lr->notify_pipe[0], &ch, 1);
-    if (status == 0) {
-        fprintf (stderr, "Error: lcm_handle read 0 bytes from notify_pipe\n");
-        return -1;
-    }
-    else if (status < 0) {
+    if (lcm_internal_pipe_read(lr->notify_pipe[0], &ch, 1) != 1) {
         fprintf (stderr, "Error: lcm_handle read: %s\n", strerror (errno));
         return -1;
     }
 
-    int64_t now = timestamp_now ();
-    /* Initialize the wall clock if this is the first time through */
-    if (lr->next_clock_time < 0)
-        lr->next_clock_time = now;
-
-//    rbuf.channel = lr->event->channel,
-    rbuf.data = (uint8_t*) lr->event->data;
-    rbuf.data_size = lr->event->datalen;
-    rbuf.recv_utime = lr->next_clock_time;
-    rbuf.lcm = lr->lcm;
-
-    if(lcm_try_enqueue_message(lr->lcm, lr->event->channel))
-        lcm_dispatch_handlers (lr->lcm, &rbuf, lr->event->channel);
+    lr->start_monotonic = monotonic_now ();
+    lr->start_clock_time = clock_time;
+    lr->start_log_time = lr->event->timestamp;
 
-    int64_t prev_log_time = lr->event->timestamp;
-    if (load_next_event (lr) < 0) {
-        /* end-of-file reached.  This call succeeds, but next call to
-         * _handle will fail */
-        lr->event = NULL;
-        if(lcm_internal_pipe_write(lr->notify_pipe[1], "+", 1) < 0) {
-            perror(__FILE__ " - write(notify)");
-        }
-        return 0;
+    lr->timer_thread = g_thread_create (timer_thread, lr, TRUE, NULL);
+    if (!lr->timer_thread) {
+        fprintf (stderr, "Error: LCM failed to start timer thread\n");
+        return -1;
     }
+    lr->thread_created = 1;
+    return 0;
+}
 
-    /* Compute the wall time for the next event */
-    if (lr->speed > 0)
-        lr->next_clock_time +=
-            (lr->event->timestamp - prev_log_time) / lr->speed;
-    else
-        lr->next_clock_time = now;
-
-    if (lr->next_clock_time > now) {
-        int wstatus = lcm_internal_pipe_write(lr->timer_pipe[1], &lr->next_clock_time, 8);
-        if(wstatus < 0) {
-            perror(__FILE__ " - write(timer_pipe)");
-        }
+static int
+lcm_logprov_handle (lcm_logprov_t * lr)
+{
+    lcm_recv_buf_t rbuf;
+    lcm_eventlog_event_t * le;
+
+    if (!lr->thread_created) {
+        // The first event, and with speed <= 0, every event, is read here.
+        // The events after the first are only read when they're about to
+        // be dispatched, so that they're filtered by the subscriptions at
+        // that time.  notify_pipe stays readable until playback starts.
+        if (!lr->event && !lr->end_of_log && load_next_event (lr, 0) < 0)
+            lr->end_of_log = 1;
+        le = lr->event;
+        if (!le)
+            return -1;
+        rbuf.recv_utime = timestamp_now ();
+        if (lr->speed > 0 && start_playback (lr, rbuf.recv_utime) < 0)
+            return -1;
     } else {
-        int wstatus = lcm_internal_pipe_write(lr->notify_pipe[1], "+", 1);
-        if(wstatus < 0) {
-            perror(__FILE__ " - write(notify_pipe)");
+        char ch;
+        int status = lcm_internal_pipe_read(lr->notify_pipe[0], &ch, 1);
+        if (status == 0) {
+            fprintf (stderr, "Error: lcm_handle read 0 bytes from notify_pipe\n");
+            return -1;
+        }
+        else if (status < 0) {
+            fprintf (stderr, "Error: lcm_handle read: %s\n", strerror (errno));
+            return -1;
         }
+
+        g_mutex_lock (lr->queue_mutex);
+        if (!lr->num_due) {
+            // end of the log.  Leave notify_pipe readable, so that the next
+            // call fails as well.
+            g_mutex_unlock (lr->queue_mutex);
+            if(lcm_internal_pipe_write(lr->notify_pipe[1], "+", 1) < 0) {
+                perror(__FILE__ " - write(notify)");
+            }
+            return -1;
+        }
+        int i = lr->queue_head;
+        le = lr->queue[i];
+        rbuf.recv_utime = lr->start_clock_time +
+            (lr->queue_deadline[i] - lr->start_monotonic);
+        lr->queue_head = (i + 1) % READ_AHEAD_EVENTS;
+        lr->queue_len--;
+        lr->num_due--;
+        lr->queue_bytes -= le->datalen;
+        g_cond_signal (lr->queue_cond);
+        g_mutex_unlock (lr->queue_mutex);
     }
 
+    rbuf.data = (uint8_t*) le->data;
+    rbuf.data_size = le->datalen;
+    rbuf.lcm = lr->lcm;
+
+    if(lcm_try_enqueue_message(lr->lcm, le->channel))
+        lcm_dispatch_handlers (lr->lcm, &rbuf, le->channel);
+
+    // the timer thread, or the next call, reads the rest
+    lcm_eventlog_free_event (le);
+    if (le == lr->event)
+        lr->event = NULL;
+
     return 0;
 }
 
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#ifndef WIN32
+#include <sys/time.h>
+#include <sys/select.h>
+#else
+#include "windows/WinPorting.h"
+#include <Winsock2.h>
+#endif
+
+#include "lcm_internal.h"
+#include "dbg.h"
+
+// A published message.  It is shared, read-only, by every LCM instance on
+// the bus that has a subscriber for its channel, and freed once the last of
+// them has dispatched it.
+typedef struct _inproc_msg inproc_msg_t;
+struct _inproc_msg {
+    volatile gint refcount;
+    int64_t utime;
+    uint32_t data_size;
+    char* channel;      // stored right after the data
+    lcm_loan_hdr_t loan;    // so that data can be loaned out
+    uint8_t data[];
+};
+
+// All the LCM instances in this process that were created with the same
+// inproc:// name
+typedef struct _inproc_bus inproc_bus_t;
+struct _inproc_bus {
+    char* name;
+    GPtrArray* members;
+};
+
+typedef struct _lcm_provider_t lcm_inproc_t;
+struct _lcm_provider_t {
+    lcm_t* lcm;
+    inproc_bus_t* bus;
+
+    // messages waiting to be dispatched by this instance
+    GQueue* queue;
+    GMutex* mutex;
+
+    // holds one byte for as long as queue is not empty
+    int notify_pipe[2];
+};
+
+// guards buses, and the members of each bus
+static GStaticMutex _buses_lock = G_STATIC_MUTEX_INIT;
+static GHashTable* _buses = NULL;
+
+static int64_t
+timestamp_now (void)
+{
+    GTimeVal tv;
+    g_get_current_time(&tv);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Allocates a message with room for data_size bytes of data
+static inproc_msg_t*
+inproc_msg_new(const char* channel, unsigned int data_size)
+{
+    size_t channel_len = strlen(channel) + 1;
+    inproc_msg_t* msg =
+        (inproc_msg_t*) malloc(sizeof(inproc_msg_t) + data_size + channel_len);
+    if(!msg)
+        return NULL;
+    msg->refcount = 1;
+    msg->utime = timestamp_now();
+    msg->data_size = data_size;
+    msg->channel = (char*) msg->data + data_size;
+    memcpy(msg->channel, channel, channel_len);
+    return msg;
+}
+
+static void
+inproc_msg_unref(inproc_msg_t* msg)
+{
+    if(g_atomic_int_dec_and_test(&msg->refcount))
+        free(msg);
+}
+
+static void
+_retained_unref(void* owner)
+{
+    inproc_msg_unref((inproc_msg_t*) owner);
+}
+
+// Messages are shared already, so a retained one just keeps a reference
+static lcm_retained_t*
+_retain_msg(const lcm_recv_buf_t* rbuf, void* user)
+{
+    inproc_msg_t* msg = (inproc_msg_t*) user;
+    lcm_retained_t* r = lcm_retained_new(rbuf, msg, _retained_unref);
+    if(r)
+        g_atomic_int_inc(&msg->refcount);
+    return r;
+}
+
+static void
+lcm_inproc_destroy (lcm_inproc_t *self)
+{
+    dbg(DBG_LCM, "destroying LCM inproc provider context\n");
+
+    if(self->bus) {
+        g_static_mutex_lock(&_buses_lock);
+        g_ptr_array_remove(self->bus->members, self);
+        if(self->bus->members->len == 0) {
+            g_hash_table_remove(_buses, self->bus->name);
+            g_ptr_array_free(self->bus->members, TRUE);
+            free(self->bus->name);
+            free(self->bus);
+        }
+        g_static_mutex_unlock(&_buses_lock);
+    }
+
+    if(self->notify_pipe[0] >= 0) lcm_internal_pipe_close(self->notify_pipe[0]);
+    if(self->notify_pipe[1] >= 0) lcm_internal_pipe_close(self->notify_pipe[1]);
+
+    while (!g_queue_is_empty(self->queue)) {
+        inproc_msg_t* msg = (inproc_msg_t*) g_queue_pop_head(self->queue);
+        inproc_msg_unref(msg);
+    }
+    g_queue_free(self->queue);
+    g_mutex_free(self->mutex);
+    memset(self, 0, sizeof(lcm_inproc_t));
+    free(self);
+}
+
+static lcm_provider_t*
+lcm_inproc_create (lcm_t* parent, const char* target, const GHashTable* args)
+{
+    lcm_inproc_t * self = (lcm_inproc_t*) calloc(1, sizeof(lcm_inproc_t));
+    self->lcm = parent;
+    self->queue = g_queue_new();
+    self->mutex = g_mutex_new();
+    self->notify_pipe[0] = -1;
+    self->notify_pipe[1] = -1;
+
+    const char* name = target ? target : "";
+    dbg(DBG_LCM, "Initializing LCM inproc provider context [%s]...\n", name);
+
+    if(lcm_internal_pipe_create(self->notify_pipe) != 0) {
+        perror(__FILE__ " - pipe (notify)");
+        lcm_inproc_destroy (self);
+        return NULL;
+    }
+
+    g_static_mutex_lock(&_buses_lock);
+    if(!_buses)
+        _buses = g_hash_table_new(g_str_hash, g_str_equal);
+    inproc_bus_t* bus = (inproc_bus_t*) g_hash_table_lookup(_buses, name);
+    if(!bus) {
+        bus = (inproc_bus_t*) calloc(1, sizeof(inproc_bus_t));
+        bus->name = strdup(name);
+        bus->members = g_ptr_array_new();
+        g_hash_table_insert(_buses, bus->name, bus);
+    }
+    g_ptr_array_add(bus->members, self);
+    self->bus = bus;
+    g_static_mutex_unlock(&_buses_lock);
+
+    return self;
+}
+
+static int
+lcm_inproc_get_fileno(lcm_inproc_t* self)
+{
+    return self->notify_pipe[0];
+}
+
+static int
+lcm_inproc_handle(lcm_inproc_t* self)
+{
+    g_mutex_lock(self->mutex);
+    int is_empty = g_queue_is_empty(self->queue);
+    g_mutex_unlock(self->mutex);
+
+    if(is_empty) {
+        // wait for a message, without consuming the notification
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(self->notify_pipe[0], &fds);
+        int status = select(self->notify_pipe[0] + 1, &fds, NULL, NULL, NULL);
+        if (status < 0) {
+            if (errno == EINTR)
+                return 0;
+            perror(__FILE__ " - select (lcm_inproc_handle)");
+            return -1;
+        }
+    }
+
+    g_mutex_lock(self->mutex);
+    inproc_msg_t* msg = (inproc_msg_t*) g_queue_pop_head(self->queue);
+    int now_empty = g_queue_is_empty(self->queue);
+    g_mutex_unlock(self->mutex);
+    if(!msg)
+        return 0;
+
+    if(now_empty) {
+        char ch;
+        int status = lcm_internal_pipe_read(self->notify_pipe[0], &ch, 1);
+        if (status == 0) {
+            fprintf(stderr,
+                "Error: lcm_inproc_handle read 0 bytes from notify_pipe\n");
+            return -1;
+        }
+    }
+
+    dbg(DBG_LCM, "Dispatching message on channel [%s], size [%d]\n",
+        msg->channel, msg->data_size);
+
+    if (lcm_try_enqueue_message(self->lcm, msg->channel)) {
+        lcm_recv_buf_t rbuf;
+        rbuf.data = msg->data;
+        rbuf.data_size = msg->data_size;
+        rbuf.recv_utime = msg->utime;
+        rbuf.lcm = self->lcm;
+        lcm_dispatch_handlers_retainable(self->lcm, &rbuf, msg->channel,
+                _retain_msg, msg);
+    }
+
+    inproc_msg_unref(msg);
+    return 0;
+}
+
+// Queues a message on every instance of the bus that has a subscriber for
+// it.  If msg is NULL, it is made from data the first time it's needed.
+// Otherwise, the caller's reference to it is given up.
+static int
+_deliver (lcm_inproc_t *self, const char *channel, inproc_msg_t *msg,
+        const void *data, unsigned int datalen)
+{
+    g_static_mutex_lock(&_buses_lock);
+    for(unsigned int i = 0; i < self->bus->members->len; i++) {
+        lcm_inproc_t* member =
+            (lcm_inproc_t*) g_ptr_array_index(self->bus->members, i);
+        if(!lcm_has_handlers(member->lcm, channel))
+            continue;
+
+        // The message is only copied once, the first time somebody wants
+        // it.  The reference it starts with is ours, and keeps it alive
+        // until every member has been given its own.
+        if(!msg) {
+            msg = inproc_msg_new(channel, datalen);
+            if(!msg) {
+                g_static_mutex_unlock(&_buses_lock);
+                fprintf(stderr, "Memory allocation error\n");
+                return -1;
+            }
+            memcpy(msg->data, data, datalen);
+        }
+        g_atomic_int_inc(&msg->refcount);
+
+        g_mutex_lock(member->mutex);
+        int was_empty = g_queue_is_empty(member->queue);
+        g_queue_push_tail(member->queue, msg);
+        g_mutex_unlock(member->mutex);
+        if (was_empty) {
+            if(lcm_internal_pipe_write(member->notify_pipe[1], "+", 1) < 0) {
+                perror(__FILE__ " - write to notify pipe (lcm_inproc_publish)");
+            }
+        }
+    }
+    g_static_mutex_unlock(&_buses_lock);
+
+    if(msg) {
+        inproc_msg_unref(msg);
+    } else {
+        dbg(DBG_LCM,
+            "Publishing [%s] size [%d] - dropping (no subscribers)\n",
+            channel, datalen);
+    }
+    return 0;
+}
+
+static int
+lcm_inproc_publish (lcm_inproc_t *self, const char *channel, const void *data,
+        unsigned int datalen)
+{
+    dbg(DBG_LCM, "Publishing to [%s] message size [%d]\n", channel, datalen);
+    return _deliver(self, channel, NULL, data, datalen);
+}
+
+static void*
+lcm_inproc_publish_loan (lcm_inproc_t *self, const char *channel,
+        unsigned int datalen)
+{
+    inproc_msg_t* msg = inproc_msg_new(channel, datalen);
+    if(!msg)
+        return NULL;
+    msg->loan.owner = msg;
+    msg->loan.channel = msg->channel;
+    msg->loan.size = datalen;
+    return msg->data;
+}
+
+static int
+lcm_inproc_publish_commit (lcm_inproc_t *self, void *buf,
+        unsigned int datalen)
+{
+    inproc_msg_t* msg = (inproc_msg_t*) LCM_LOAN_HDR(buf)->owner;
+    dbg(DBG_LCM, "Publishing to [%s] message size [%d]\n", msg->channel,
+            datalen);
+    msg->data_size = datalen;
+    msg->utime = timestamp_now();
+    return _deliver(self, msg->channel, msg, NULL, 0);
+}
+
+static void
+lcm_inproc_publish_abort (lcm_inproc_t *self, void *buf)
+{
+    inproc_msg_unref((inproc_msg_t*) LCM_LOAN_HDR(buf)->owner);
+}
+
+static lcm_provider_vtable_t inproc_vtable;
+static lcm_provider_info_t inproc_info;
+
+void
+lcm_inproc_provider_init (GPtrArray * providers)
+{
+    inproc_vtable.create      = lcm_inproc_create;
+    inproc_vtable.destroy     = lcm_inproc_destroy;
+    inproc_vtable.subscribe   = NULL;
+    inproc_vtable.unsubscribe = NULL;
+    inproc_vtable.publish     = lcm_inproc_publish;
+    inproc_vtable.handle      = lcm_inproc_handle;
+    inproc_vtable.get_fileno  = lcm_inproc_get_fileno;
+    inproc_vtable.publish_loan   = lcm_inproc_publish_loan;
+    inproc_vtable.publish_commit = lcm_inproc_publish_commit;
+    inproc_vtable.publish_abort  = lcm_inproc_publish_abort;
+
+    inproc_info.name = "inproc";
+    inproc_info.vtable = &inproc_vtable;
+
+    g_ptr_array_add (providers, &inproc_info);
+}
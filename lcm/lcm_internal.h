@@ -42,12 +42,77 @@ struct _lcm_provider_vtable_t {
             unsigned int);
     int (*handle)(lcm_provider_t *);
     int (*get_fileno)(lcm_provider_t *);
+
+    // Optional.  Providers that can loan out their own memory for
+    // lcm_publish_loan() implement all three of these.  Otherwise, messages
+    // are encoded into heap loans, and published with publish().
+    void * (*publish_loan)(lcm_provider_t *, const char *channel,
+            unsigned int datalen);
+    int (*publish_commit)(lcm_provider_t *, void *buf, unsigned int datalen);
+    void (*publish_abort)(lcm_provider_t *, void *buf);
+
+    // Optional.  Publishes a message made of several buffers, without
+    // gathering them into one.  Otherwise, lcm_publishv() gathers them into
+    // a loan.
+    int (*publishv)(lcm_provider_t *, const char *channel,
+            const struct iovec *iov, int iovcnt, unsigned int datalen);
+};
+
+/**
+ * Every buffer returned by lcm_publish_loan() is immediately preceded by this
+ * header.  Providers that loan out their own memory reserve room for it.
+ */
+typedef struct _lcm_loan_hdr lcm_loan_hdr_t;
+struct _lcm_loan_hdr {
+    void *owner;            // provider specific.  NULL for heap loans
+    char *channel;
+    uint32_t size;          // size that was asked for
+    uint32_t capacity;      // bytes available, for heap loans
+    int64_t tag;            // provider specific
 };
 
+#define LCM_LOAN_HDR(buf) ((lcm_loan_hdr_t*) (buf) - 1)
+
+/**
+ * Heap loans are used by providers without their own loan implementation,
+ * and by the ones that have one, when they can't loan out their own memory
+ * for a message.  The channel is copied into the loan.  Buffers are recycled,
+ * so publishing with heap loans normally doesn't allocate memory.
+ */
+void *
+lcm_heap_loan_new (lcm_t * lcm, const char * channel, unsigned int datalen);
+
+void
+lcm_heap_loan_free (lcm_t * lcm, void * buf);
+
 int
 lcm_parse_url (const char * url, char ** provider, char ** target,
         GHashTable * args);
 
+/**
+ * Taps see the messages that an lcm_t dispatches to its subscribers
+ * (LCM_TAP_RECEIVED), or publishes (LCM_TAP_PUBLISHED), without subscribing
+ * to anything.  A tap is called from the thread dispatching or publishing
+ * the message, without the lcm_t locked, so taps can be called from several
+ * threads at once.  They shouldn't block, as publishing waits for them.  The
+ * recv_utime of a published message is the time it was published.
+ *
+ * Once lcm_remove_tap() returns, the tap is no longer being called, so it
+ * must not be called from within a tap.
+ */
+enum {
+    LCM_TAP_RECEIVED,
+    LCM_TAP_PUBLISHED,
+    LCM_NUM_TAPS
+};
+
+void
+lcm_add_tap (lcm_t * lcm, int tap, lcm_msg_handler_t handler, void *userdata);
+
+int
+lcm_remove_tap (lcm_t * lcm, int tap, lcm_msg_handler_t handler,
+        void *userdata);
+
 /**
  * Try to enqueue a message.  This may fail if there are no subscribers, or if
  * all the subscribers' queues are full.  The actual message contents are not
@@ -62,4 +127,38 @@ lcm_has_handlers (lcm_t * lcm, const char * channel);
 int
 lcm_dispatch_handlers (lcm_t * lcm, lcm_recv_buf_t * buf, const char *channel);
 
+/**
+ * A message kept with lcm_recv_buf_retain().  rbuf comes first, so that the
+ * buffer handed out is one of these.  owner is whatever rbuf.data points
+ * into, and is given to free_owner when the last reference is released.
+ */
+typedef struct _lcm_retained lcm_retained_t;
+struct _lcm_retained {
+    lcm_recv_buf_t rbuf;
+    volatile gint refcount;
+    void *owner;
+    void (*free_owner)(void *owner);
+};
+
+/**
+ * Makes a retained copy of rbuf without copying its data, normally by taking
+ * the memory it's in away from the provider.  Use lcm_retained_new() to
+ * create the result.  Returns NULL to have the data copied instead.
+ */
+typedef lcm_retained_t * (*lcm_retain_func_t) (const lcm_recv_buf_t *rbuf,
+        void *user);
+
+lcm_retained_t *
+lcm_retained_new (const lcm_recv_buf_t *rbuf, void *owner,
+        void (*free_owner)(void *owner));
+
+/**
+ * Same as lcm_dispatch_handlers(), for providers that can give up the memory
+ * a message was received into.  retain is called at most once, from a
+ * handler, the first time one of them retains the message.
+ */
+int
+lcm_dispatch_handlers_retainable (lcm_t * lcm, lcm_recv_buf_t * buf,
+        const char *channel, lcm_retain_func_t retain, void *user);
+
 #endif
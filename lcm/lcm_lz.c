@@ -0,0 +1,164 @@
+#include <string.h>
+
+#include "lcm_lz.h"
+
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+#define HASH_BITS 14
+
+// Matches don't start in the last bytes of the input, or extend into the
+// last few, so that the input always ends with literals.
+#define MATCH_START_LIMIT 12
+#define LAST_LITERALS 5
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t hash32(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static inline uint8_t *write_length(uint8_t *op, int len)
+{
+    for (len -= 15; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (uint8_t) len;
+    return op;
+}
+
+static uint8_t *write_literals(uint8_t *op, const uint8_t *lit, int nlit,
+        int token_low)
+{
+    uint8_t *token = op++;
+    if (nlit >= 15) {
+        *token = (uint8_t) ((15 << 4) | token_low);
+        op = write_length(op, nlit);
+    } else {
+        *token = (uint8_t) ((nlit << 4) | token_low);
+    }
+    memcpy(op, lit, nlit);
+    return op + nlit;
+}
+
+int lcm_lz_compress_bound(int srclen)
+{
+    return srclen + srclen / 255 + 16;
+}
+
+int lcm_lz_compress(const uint8_t *src, int srclen, uint8_t *dst)
+{
+    uint32_t table[1 << HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + srclen;
+    uint8_t *op = dst;
+
+    if (srclen > MATCH_START_LIMIT) {
+        const uint8_t *start_limit = end - MATCH_START_LIMIT;
+        const uint8_t *match_limit = end - LAST_LITERALS;
+        while (ip < start_limit) {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash32(seq);
+            const uint8_t *ref = src + table[h];
+            table[h] = (uint32_t) (ip - src);
+            if (ref >= ip || ip - ref > MAX_OFFSET || read32(ref) != seq) {
+                // skip faster through data that doesn't compress
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            const uint8_t *mend = ip + MIN_MATCH;
+            const uint8_t *rend = ref + MIN_MATCH;
+            while (mend < match_limit && *mend == *rend) {
+                mend++;
+                rend++;
+            }
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            int mlen = (int) (mend - ip) - MIN_MATCH;
+            op = write_literals(op, anchor, (int) (ip - anchor),
+                    mlen >= 15 ? 15 : mlen);
+            int offset = (int) (ip - ref);
+            *op++ = (uint8_t) offset;
+            *op++ = (uint8_t) (offset >> 8);
+            if (mlen >= 15)
+                op = write_length(op, mlen);
+
+            ip = anchor = mend;
+        }
+    }
+    op = write_literals(op, anchor, (int) (end - anchor), 0);
+    return (int) (op - dst);
+}
+
+// Reads the extra bytes of a length.  Returns -1 if the input ends first.
+static inline int read_length(const uint8_t **ip, const uint8_t *iend,
+        size_t *len)
+{
+    uint8_t b;
+    do {
+        if (*ip >= iend)
+            return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lcm_lz_decompress(const uint8_t *src, int srclen, uint8_t *dst,
+        int dstlen)
+{
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + srclen;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dstlen;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t nlit = token >> 4;
+        if (nlit == 15 && 0 != read_length(&ip, iend, &nlit))
+            return -1;
+        if (nlit > (size_t) (iend - ip) || nlit > (size_t) (oend - op))
+            return -1;
+        memcpy(op, ip, nlit);
+        op += nlit;
+        ip += nlit;
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t) (op - dst))
+            return -1;
+        size_t mlen = token & 15;
+        if (mlen == 15 && 0 != read_length(&ip, iend, &mlen))
+            return -1;
+        mlen += MIN_MATCH;
+        if (mlen > (size_t) (oend - op))
+            return -1;
+
+        const uint8_t *ref = op - offset;
+        if (offset >= mlen) {
+            memcpy(op, ref, mlen);
+            op += mlen;
+        } else {
+            // the match overlaps what it produces
+            while (mlen--)
+                *op++ = *ref++;
+        }
+    }
+    return op == oend ? 0 : -1;
+}
@@ -0,0 +1,42 @@
+#ifndef __LCM_LZ_H__
+#define __LCM_LZ_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A small and fast LZ77 codec, used to compress blocks of log events.
+//
+// A compressed block is a series of sequences.  Each one is a token byte,
+// whose high and low 4 bits are the number of literal bytes and the length of
+// the match minus 4, then the extra length bytes of the literals, the
+// literals, the 2-byte little-endian offset of the match, and the extra
+// length bytes of the match.  A length of 15 in the token means that extra
+// length bytes follow, each added to it, until one that isn't 255.  The last
+// sequence has only literals.
+
+/**
+ * Returns the largest size that compressing @c srclen bytes can produce.
+ */
+int lcm_lz_compress_bound(int srclen);
+
+/**
+ * Compresses @c srclen bytes from @c src into @c dst, which must have room for
+ * lcm_lz_compress_bound(srclen) bytes.  Returns the compressed size.
+ */
+int lcm_lz_compress(const uint8_t *src, int srclen, uint8_t *dst);
+
+/**
+ * Decompresses @c srclen bytes from @c src into exactly @c dstlen bytes at
+ * @c dst.  Returns 0 on success, or -1 if the compressed data is invalid.
+ */
+int lcm_lz_decompress(const uint8_t *src, int srclen, uint8_t *dst,
+        int dstlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
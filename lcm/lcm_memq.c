@@ -4,6 +4,7 @@
 #include <assert.h>
 #ifndef WIN32
 #include <sys/time.h>
+#include <sys/select.h>
 #else
 #include "windows/WinPorting.h"
 #include <Winsock2.h>
@@ -12,11 +13,53 @@
 #include "lcm_internal.h"
 #include "dbg.h"
 
+// default number of messages the ring holds before publish falls back to the
+// (slower) overflow queue
+#define DEFAULT_QUEUE_SIZE 256
+
+// Slot buffers are kept from one message to the next, so that publishing
+// doesn't allocate memory in steady state.  Buffers larger than this are
+// released once their message is dispatched.
+#define MAX_RETAINED_SLOT_SIZE (1024 * 1024)
+
+// A slot in the ring.  seq tells who owns it: a publisher may fill it when
+// seq == its position, and the reader may dispatch it when seq == position
+// + 1.  data is preceded by room for a loan header, so that it can be loaned
+// out by lcm_publish_loan().
+typedef struct _memq_slot memq_slot_t;
+struct _memq_slot {
+    volatile gint seq;
+    char* channel;
+    uint32_t channel_size;
+    uint8_t* data;
+    uint32_t data_size;
+    int aborted;            // the loan was aborted.  There is no message.
+    int dispatched;         // dispatched ahead of an older, loaned slot
+    lcm_recv_buf_t rbuf;
+};
+
 typedef struct _lcm_provider_t lcm_memq_t;
 struct _lcm_provider_t {
     lcm_t* lcm;
-    GQueue* queue;
+
+    // Messages are passed through a bounded multi-producer, single-consumer
+    // ring.  Publishers claim slots with a compare-and-swap on enqueue_pos,
+    // lcm_handle() is the only reader.
+    memq_slot_t* slots;
+    guint queue_size;
+    guint queue_mask;
+    volatile gint enqueue_pos;
+    guint dequeue_pos;
+
+    // When the ring is full, messages go to this queue instead.  Once
+    // anything is queued here, publishers keep using it until it drains, so
+    // that each thread's messages are dispatched in order.
+    GQueue* overflow;
     GMutex* mutex;
+    volatile gint num_overflow;
+
+    // number of messages published but not yet dispatched
+    volatile gint num_pending;
     int notify_pipe[2];
 };
 
@@ -24,28 +67,63 @@ typedef struct _memq_msg memq_msg_t;
 struct _memq_msg {
     char* channel;
     lcm_recv_buf_t rbuf;
+    int retained;           // rbuf.data belongs to a retained message
 };
 
 static memq_msg_t*
 memq_msg_new(lcm_t* lcm, const char* channel, const void* data, int data_size, int64_t utime) {
     memq_msg_t* msg = (memq_msg_t*)malloc(sizeof(memq_msg_t));
+    if(!msg)
+        return NULL;
     msg->rbuf.data = malloc(data_size);
+    if(!msg->rbuf.data && data_size) {
+        free(msg);
+        return NULL;
+    }
     msg->rbuf.data_size = data_size;
     memcpy(msg->rbuf.data, data, data_size);
     msg->rbuf.recv_utime = utime;
     msg->rbuf.lcm = lcm;
     msg->channel = g_strdup(channel);
+    msg->retained = 0;
     return msg;
 }
 
 static void
 memq_msg_destroy(memq_msg_t* msg) {
-    free(msg->rbuf.data);
+    if(!msg->retained)
+        free(msg->rbuf.data);
     g_free(msg->channel);
     memset(msg, 0, sizeof(memq_msg_t));
     free(msg);
 }
 
+// A retained message takes the slot's buffer.  The slot gets a new one the
+// next time it's filled.
+static lcm_retained_t*
+_retain_slot(const lcm_recv_buf_t* rbuf, void* user)
+{
+    memq_slot_t* slot = (memq_slot_t*) user;
+    lcm_retained_t* r = lcm_retained_new(rbuf, LCM_LOAN_HDR(slot->data), free);
+    if(r) {
+        slot->data = NULL;
+        slot->data_size = 0;
+    }
+    return r;
+}
+
+// rbuf is msg->rbuf, which the rest of the dispatch still reads, so the
+// buffer is only marked as handed over.
+static lcm_retained_t*
+_retain_msg(const lcm_recv_buf_t* rbuf, void* user)
+{
+    memq_msg_t* msg = (memq_msg_t*) user;
+    lcm_retained_t* r = lcm_retained_new(rbuf, msg->rbuf.data, free);
+    if(r)
+        msg->retained = 1;
+    return r;
+}
+
 static void
 lcm_memq_destroy (lcm_memq_t *self)
 {
@@ -53,11 +131,19 @@ lcm_memq_destroy (lcm_memq_t *self)
     if(self->notify_pipe[0] >= 0) lcm_internal_pipe_close(self->notify_pipe[0]);
     if(self->notify_pipe[1] >= 0) lcm_internal_pipe_close(self->notify_pipe[1]);
 
-    while (!g_queue_is_empty(self->queue)) {
-        memq_msg_t* msg = (memq_msg_t*) g_queue_pop_head(self->queue);
+    if(self->slots) {
+        for(guint i = 0; i < self->queue_size; i++) {
+            free(self->slots[i].channel);
+            if(self->slots[i].data)
+                free(LCM_LOAN_HDR(self->slots[i].data));
+        }
+        free(self->slots);
+    }
+    while (!g_queue_is_empty(self->overflow)) {
+        memq_msg_t* msg = (memq_msg_t*) g_queue_pop_head(self->overflow);
         memq_msg_destroy(msg);
     }
-    g_queue_free(self->queue);
+    g_queue_free(self->overflow);
     g_mutex_free(self->mutex);
     memset(self, 0, sizeof(lcm_memq_t));
     free(self);
@@ -71,16 +157,48 @@ timestamp_now (void)
     return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
+static void
+new_argument (gpointer key, gpointer value, gpointer user)
+{
+    lcm_memq_t * self = (lcm_memq_t *) user;
+    if (!strcmp ((char *) key, "queue_size")) {
+        char *endptr = NULL;
+        long queue_size = strtol ((char *) value, &endptr, 0);
+        if (endptr == value || queue_size <= 0 || queue_size > (1 << 24))
+            fprintf (stderr, "Warning: Invalid value for queue_size\n");
+        else
+            self->queue_size = queue_size;
+    }
+    else {
+        fprintf(stderr, "%s:%d -- unknown provider argument %s\n",
+                __FILE__, __LINE__, (char *)key);
+    }
+}
+
 static lcm_provider_t*
 lcm_memq_create (lcm_t* parent, const char* target, const GHashTable* args)
 {
     lcm_memq_t * self = (lcm_memq_t*) calloc(1, sizeof(lcm_memq_t));
     self->lcm = parent;
-    self->queue = g_queue_new();
+    self->overflow = g_queue_new();
     self->mutex = g_mutex_new();
+    self->notify_pipe[0] = -1;
+    self->notify_pipe[1] = -1;
+    self->queue_size = DEFAULT_QUEUE_SIZE;
+    g_hash_table_foreach ((GHashTable*) args, new_argument, self);
 
     dbg(DBG_LCM, "Initializing LCM memq provider context...\n");
 
+    // round the ring up to a power of two, so positions can be masked
+    guint queue_size = 1;
+    while(queue_size < self->queue_size)
+        queue_size <<= 1;
+    self->queue_size = queue_size;
+    self->queue_mask = queue_size - 1;
+    self->slots = (memq_slot_t*) calloc(queue_size, sizeof(memq_slot_t));
+    for(guint i = 0; i < queue_size; i++)
+        self->slots[i].seq = i;
+
     if(lcm_internal_pipe_create(self->notify_pipe) != 0) {
         perror(__FILE__ " - pipe (notify)");
         lcm_memq_destroy (self);
@@ -89,6 +207,148 @@ lcm_memq_create (lcm_t* parent, const char* target, const GHashTable* args)
     return self;
 }
 
+// Counts a newly published message, and wakes up the reader if nothing else
+// was pending
+static void
+_notify_published(lcm_memq_t* self)
+{
+    if(g_atomic_int_add(&self->num_pending, 1) == 0) {
+        if(lcm_internal_pipe_write(self->notify_pipe[1], "+", 1) < 0) {
+            perror(__FILE__ " - write to notify pipe (lcm_memq_publish)");
+        }
+    }
+}
+
+// Claims the next free slot of the ring.  Returns NULL if the ring is full.
+static memq_slot_t*
+_ring_claim(lcm_memq_t* self, guint* pos_out)
+{
+    memq_slot_t* slot;
+    guint pos = (guint) g_atomic_int_get(&self->enqueue_pos);
+    for(;;) {
+        slot = &self->slots[pos & self->queue_mask];
+        gint diff = (gint) ((guint) g_atomic_int_get(&slot->seq) - pos);
+        if(diff == 0) {
+            if(g_atomic_int_compare_and_exchange(&self->enqueue_pos,
+                        (gint) pos, (gint) (pos + 1)))
+                break;
+        } else if(diff < 0) {
+            // the reader hasn't dispatched the message a full lap ago yet
+            return NULL;
+        }
+        pos = (guint) g_atomic_int_get(&self->enqueue_pos);
+    }
+    *pos_out = pos;
+    return slot;
+}
+
+// Makes room for a message in a claimed slot, and copies the channel in.
+// Returns -1 if memory couldn't be allocated.
+static int
+_slot_reserve(memq_slot_t* slot, const char* channel, unsigned int datalen)
+{
+    slot->aborted = 0;
+    slot->dispatched = 0;
+    uint32_t channel_len = strlen(channel) + 1;
+    if(slot->channel_size < channel_len) {
+        free(slot->channel);
+        slot->channel = (char*) malloc(channel_len);
+        slot->channel_size = slot->channel ? channel_len : 0;
+        if(!slot->channel)
+            return -1;
+    }
+    memcpy(slot->channel, channel, channel_len);
+    if(slot->data_size < datalen || !slot->data) {
+        if(slot->data)
+            free(LCM_LOAN_HDR(slot->data));
+        lcm_loan_hdr_t* hdr =
+            (lcm_loan_hdr_t*) malloc(sizeof(lcm_loan_hdr_t) + datalen);
+        slot->data = hdr ? (uint8_t*) (hdr + 1) : NULL;
+        slot->data_size = hdr ? datalen : 0;
+        if(!hdr)
+            return -1;
+    }
+    return 0;
+}
+
+// Hands a filled slot to the reader.
+static void
+_ring_commit(lcm_memq_t* self, memq_slot_t* slot, guint pos,
+        unsigned int datalen, int64_t utime)
+{
+    slot->rbuf.data = slot->data;
+    slot->rbuf.data_size = datalen;
+    slot->rbuf.recv_utime = utime;
+    slot->rbuf.lcm = self->lcm;
+    g_atomic_int_set(&slot->seq, (gint) (pos + 1));
+}
+
+// Gives back a claimed slot without a message in it.  Slots can't be skipped
+// by publishers, so it's passed on to the reader, which just releases it.
+static void
+_ring_abort(lcm_memq_t* self, memq_slot_t* slot, guint pos)
+{
+    slot->aborted = 1;
+    _ring_commit(self, slot, pos, 0, 0);
+}
+
+// Copies a message into a free slot of the ring.  Returns 0 on success, 1 if
+// the ring is full, or -1 if memory couldn't be allocated.
+static int
+_ring_push(lcm_memq_t* self, const char* channel, const void* data,
+        unsigned int datalen, int64_t utime)
+{
+    guint pos;
+    memq_slot_t* slot = _ring_claim(self, &pos);
+    if(!slot)
+        return 1;
+
+    // The slot is ours until it's committed.
+    if(_slot_reserve(slot, channel, datalen)) {
+        _ring_abort(self, slot, pos);
+        return -1;
+    }
+    memcpy(slot->data, data, datalen);
+    _ring_commit(self, slot, pos, datalen, utime);
+    return 0;
+}
+
+// Hands slots at the head of the ring that have been dealt with back to
+// publishers for the next lap
+static void
+_ring_release(lcm_memq_t* self)
+{
+    for(;;) {
+        memq_slot_t* head = &self->slots[self->dequeue_pos & self->queue_mask];
+        if((guint) g_atomic_int_get(&head->seq) != self->dequeue_pos + 1 ||
+           !(head->aborted || head->dispatched))
+            return;
+        head->aborted = 0;
+        head->dispatched = 0;
+        g_atomic_int_set(&head->seq,
+                (gint) (self->dequeue_pos + self->queue_size));
+        self->dequeue_pos++;
+    }
+}
+
+// Returns the oldest committed slot that hasn't been dispatched yet, or NULL.
+// Slots claimed before it may still be filled in by their publishers, or
+// loaned out, possibly to the thread calling lcm_handle().  Messages count as
+// published when they're committed, so it goes ahead of them.
+static memq_slot_t*
+_ring_next(lcm_memq_t* self)
+{
+    _ring_release(self);
+    guint end = (guint) g_atomic_int_get(&self->enqueue_pos);
+    for(guint pos = self->dequeue_pos; pos != end; pos++) {
+        memq_slot_t* slot = &self->slots[pos & self->queue_mask];
+        if((guint) g_atomic_int_get(&slot->seq) == pos + 1 &&
+           !slot->aborted && !slot->dispatched)
+            return slot;
+    }
+    return NULL;
+}
+
 static int
 lcm_memq_get_fileno(lcm_memq_t* self)
 {
@@ -98,31 +358,79 @@ lcm_memq_get_fileno(lcm_memq_t* self)
 static int
 lcm_memq_handle(lcm_memq_t* self)
 {
-    char ch;
-    int status = lcm_internal_pipe_read(self->notify_pipe[0], &ch, 1);
-    if (status == 0) {
-        fprintf(stderr,
-            "Error: lcm_memq_handle read 0 bytes from notify_pipe\n");
-        return -1;
+    // The notify pipe holds one byte for as long as messages are pending.
+    // It's written when num_pending goes from 0 to 1, and read when it goes
+    // back to 0, so a burst of messages costs two system calls rather than
+    // two per message.
+    if (g_atomic_int_get(&self->num_pending) == 0) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(self->notify_pipe[0], &fds);
+        int status = select(self->notify_pipe[0] + 1, &fds, NULL, NULL, NULL);
+        if (status < 0) {
+            if (errno == EINTR)
+                return 0;
+            perror(__FILE__ " - select (lcm_memq_handle)");
+            return -1;
+        }
     }
 
-    g_mutex_lock(self->mutex);
-    memq_msg_t* msg = (memq_msg_t*)g_queue_pop_head(self->queue);
-    if (!g_queue_is_empty(self->queue)) {
-        if(lcm_internal_pipe_write(self->notify_pipe[1], "+", 1) < 0) {
-            perror(__FILE__ " - write to notify pipe (lcm_memq_handle)");
+    // A message was counted in num_pending, so it's either committed to the
+    // ring, or in the overflow queue.  The overflow queue is only used once
+    // the ring is full, so the ring goes first.
+    memq_slot_t* slot = NULL;
+    memq_msg_t* msg = NULL;
+    for(;;) {
+        slot = _ring_next(self);
+        if(slot)
+            break;
+        if(g_atomic_int_get(&self->num_overflow) > 0) {
+            g_mutex_lock(self->mutex);
+            msg = (memq_msg_t*)g_queue_pop_head(self->overflow);
+            g_mutex_unlock(self->mutex);
+            if(msg)
+                break;
         }
+        g_thread_yield();
     }
-    g_mutex_unlock(self->mutex);
+
+    const char* channel = slot ? slot->channel : msg->channel;
+    lcm_recv_buf_t* rbuf = slot ? &slot->rbuf : &msg->rbuf;
 
     dbg(DBG_LCM, "Dispatching message on channel [%s], size [%d]\n",
-        msg->channel, msg->rbuf.data_size);
+        channel, rbuf->data_size);
 
-    if (lcm_try_enqueue_message(self->lcm, msg->channel)) {
-      lcm_dispatch_handlers(self->lcm, &msg->rbuf, msg->channel);
+    if (lcm_try_enqueue_message(self->lcm, channel)) {
+      if(slot)
+        lcm_dispatch_handlers_retainable(self->lcm, rbuf, channel,
+                _retain_slot, slot);
+      else
+        lcm_dispatch_handlers_retainable(self->lcm, rbuf, channel,
+                _retain_msg, msg);
     }
 
-    memq_msg_destroy(msg);
+    if(slot) {
+        if(slot->data && slot->data_size > MAX_RETAINED_SLOT_SIZE) {
+            free(LCM_LOAN_HDR(slot->data));
+            slot->data = NULL;
+            slot->data_size = 0;
+        }
+        slot->dispatched = 1;
+        _ring_release(self);
+    } else {
+        memq_msg_destroy(msg);
+        g_atomic_int_add(&self->num_overflow, -1);
+    }
+
+    if(g_atomic_int_dec_and_test(&self->num_pending)) {
+        char ch;
+        int status = lcm_internal_pipe_read(self->notify_pipe[0], &ch, 1);
+        if (status == 0) {
+            fprintf(stderr,
+                "Error: lcm_memq_handle read 0 bytes from notify_pipe\n");
+            return -1;
+        }
+    }
     return 0;
 }
 
@@ -138,21 +446,89 @@ lcm_memq_publish (lcm_memq_t *self, const char *channel, const void *data,
       return 0;
     }
     dbg(DBG_LCM, "Publishing to [%s] message size [%d]\n", channel, datalen);
-    memq_msg_t* msg =
-      memq_msg_new(self->lcm, channel, data, datalen, timestamp_now());
+    int64_t utime = timestamp_now();
 
-    g_mutex_lock(self->mutex);
-    int was_empty = g_queue_is_empty(self->queue);
-    g_queue_push_tail(self->queue, msg);
-    if (was_empty) {
-        if(lcm_internal_pipe_write(self->notify_pipe[1], "+", 1) < 0) {
-            perror(__FILE__ " - write to notify pipe (lcm_memq_publish)");
-        }
+    int status = 1;
+    if(g_atomic_int_get(&self->num_overflow) == 0)
+        status = _ring_push(self, channel, data, datalen, utime);
+    if(status == 0) {
+        _notify_published(self);
+        return 0;
+    }
+
+    // The ring is full, or older messages are still in the overflow queue.
+    memq_msg_t* msg = NULL;
+    if(status > 0)
+        msg = memq_msg_new(self->lcm, channel, data, datalen, utime);
+    if(!msg) {
+        fprintf(stderr, "LCM memq: Memory allocation error\n");
+        return -1;
     }
+    g_mutex_lock(self->mutex);
+    g_queue_push_tail(self->overflow, msg);
+    g_atomic_int_add(&self->num_overflow, 1);
     g_mutex_unlock(self->mutex);
+    _notify_published(self);
+    return 0;
+}
+
+static void*
+lcm_memq_publish_loan (lcm_memq_t *self, const char *channel,
+        unsigned int datalen)
+{
+    guint pos;
+    memq_slot_t* slot = NULL;
+    // Without subscribers, the message will be dropped.  If the ring is full
+    // or being bypassed, it goes through the overflow queue.  Either way, it
+    // needs a buffer of its own.
+    if(lcm_has_handlers(self->lcm, channel) &&
+       g_atomic_int_get(&self->num_overflow) == 0)
+        slot = _ring_claim(self, &pos);
+    if(!slot)
+        return lcm_heap_loan_new(self->lcm, channel, datalen);
+
+    if(_slot_reserve(slot, channel, datalen)) {
+        fprintf(stderr, "LCM memq: Memory allocation error\n");
+        _ring_abort(self, slot, pos);
+        return NULL;
+    }
+    lcm_loan_hdr_t* hdr = LCM_LOAN_HDR(slot->data);
+    hdr->owner = slot;
+    hdr->channel = slot->channel;
+    hdr->size = datalen;
+    hdr->tag = pos;
+    return slot->data;
+}
+
+static int
+lcm_memq_publish_commit (lcm_memq_t *self, void *buf, unsigned int datalen)
+{
+    lcm_loan_hdr_t* hdr = LCM_LOAN_HDR(buf);
+    if(!hdr->owner) {
+        int status = lcm_memq_publish(self, hdr->channel, buf, datalen);
+        lcm_heap_loan_free(self->lcm, buf);
+        return status;
+    }
+
+    dbg(DBG_LCM, "Publishing to [%s] message size [%d]\n", hdr->channel,
+            datalen);
+    _ring_commit(self, (memq_slot_t*) hdr->owner, (guint) hdr->tag, datalen,
+            timestamp_now());
+    _notify_published(self);
     return 0;
 }
 
+static void
+lcm_memq_publish_abort (lcm_memq_t *self, void *buf)
+{
+    lcm_loan_hdr_t* hdr = LCM_LOAN_HDR(buf);
+    if(!hdr->owner) {
+        lcm_heap_loan_free(self->lcm, buf);
+        return;
+    }
+    _ring_abort(self, (memq_slot_t*) hdr->owner, (guint) hdr->tag);
+}
+
 static lcm_provider_vtable_t memq_vtable;
 static lcm_provider_info_t memq_info;
 
@@ -166,6 +542,9 @@ lcm_memq_provider_init (GPtrArray * providers)
     memq_vtable.publish     = lcm_memq_publish;
     memq_vtable.handle      = lcm_memq_handle;
     memq_vtable.get_fileno  = lcm_memq_get_fileno;
+    memq_vtable.publish_loan   = lcm_memq_publish_loan;
+    memq_vtable.publish_commit = lcm_memq_publish_commit;
+    memq_vtable.publish_abort  = lcm_memq_publish_abort;
 
     memq_info.name = "memq";
     memq_info.vtable = &memq_vtable;
@@ -17,6 +17,11 @@
 #include <sys/select.h>
 #endif
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#define USE_EPOLL
+#endif
+
 #include <glib.h>
 
 #include "lcm.h"
@@ -26,25 +31,64 @@
 #include "udpm_util.h"
 
 #include "lcmtypes/channel_port_map_update_t.h"
+#include "lcmtypes/channel_port_map_delta_t.h"
 
 // Lets reserve channels starting with #! for internal use
 #define RESERVED_CHANNEL_PREFIX "#!"
 // The number of LCM channels that we use internally for stuff.
 // Updating the channel to port map efficiently depends on this number
 // being correct
-#define NUM_INTERNAL_CHANNELS 3
+#define NUM_INTERNAL_CHANNELS 4
 #define SELF_TEST_CHANNEL RESERVED_CHANNEL_PREFIX "mpudpm_SELF_TEST"
+// full channel to port maps (channel_port_map_update_t), which every version
+// sends and understands
 #define CHANNEL_TO_PORT_MAP_UPDATE_CHANNEL \
     RESERVED_CHANNEL_PREFIX "mpudpm_CH2PRT_UPD"
+// versioned updates that can also move channels (channel_port_map_delta_t)
+#define CHANNEL_TO_PORT_MAP_DELTA_CHANNEL \
+    RESERVED_CHANNEL_PREFIX "mpudpm_CH2PRT_DELTA"
 #define CHANNEL_TO_PORT_MAP_REQUEST_CHANNEL \
     RESERVED_CHANNEL_PREFIX "mpudpm_CH2PRT_REQ"
 
 // regex to check with the channel is a string literal
 #define REGEX_FINDER_RE "[^\\\\][\\.\\[\\{\\(\\)\\\\\\*\\+\\?\\|\\^\\$]"
 
-// broadcast channel to port mapping this frequently
+// broadcast channel to port mapping updates (or an empty heartbeat if there
+// is nothing new) this frequently.  The full map is broadcast this often too,
+// unless someone else has just sent the same one.
 #define CHANNEL_TO_PORT_MAP_UPDATE_NOMINAL_PERIOD 5e6
 
+// don't ask the same process for a snapshot of its channel to port mapping
+// more often than this
+#define CHANNEL_TO_PORT_MAP_SNAPSHOT_REQUEST_PERIOD 1e6
+
+// in port_assign=traffic mode, publish rates are measured over windows of
+// this length
+#define CHANNEL_RATE_WINDOW_USEC 1e6
+
+// publishers keep sending a moved channel on its old port for this long
+// after announcing the move, so that subscribers can open the new port first
+#define CHANNEL_MOVE_SWITCH_DELAY_USEC 500000
+
+// subscribers keep listening on a moved channel's old port for this long
+// after publishers have switched, to pick up packets still in flight
+#define CHANNEL_MOVE_RELEASE_DELAY_USEC 1000000
+
+// in port_assign=traffic mode, how often to check whether regex subscribers
+// are on ports that mostly carry channels they don't want
+#define REGEX_CONSOLIDATE_PERIOD_USEC 5e6
+
+// don't bother moving channels off of a port unless at least this many
+// unwanted bytes arrived on it since the last check
+#define REGEX_CONSOLIDATE_MIN_UNMATCHED_BYTES 100000
+
+// maximum number of packets read from one socket before moving on to the
+// next ready socket
+#define MAX_PACKETS_PER_SOCKET_READ 64
+
+// maximum number of ready sockets returned by a single epoll_wait()
+#define MAX_EPOLL_EVENTS 64
+
 
 /**
  * mpudpm_socket_t:
@@ -52,28 +96,87 @@
  * @port                multicast port
  * @num_subscribers     the number of subscribers to enable closing this socket
  *                             when it's no longer in use
+ * @bytes_received      bytes received on the socket since the last
+ *                      consolidation check
+ * @bytes_unmatched     bytes of those that were discarded because no
+ *                      subscriber wanted the channel
  */
 typedef struct _mpudpm_socket_t {
     SOCKET fd;
     uint16_t port;
     int num_subscribers;
+    uint64_t bytes_received;
+    uint64_t bytes_unmatched;
 } mpudpm_socket_t;
 
 
+/**
+ * mpudpm_sub_channel_t:
+ * @sock                socket that the channel is received on
+ * @old_sock            socket that the channel was received on before it was
+ *                      moved to another port, or NULL
+ * @old_release_utime   when to stop listening on old_sock
+ */
+typedef struct _mpudpm_sub_channel_t {
+    mpudpm_socket_t* sock;
+    mpudpm_socket_t* old_sock;
+    int64_t old_release_utime;
+} mpudpm_sub_channel_t;
+
 /**
  * mpudpm_subscriber_t:
  * @channel_string  The channel string this subscriber is subscribed to
  * @regex           Compiled regex to match explicit channels to this subscriber
  * @sockets         The list of sockets that are used for this subscription
- * @channel_set     Set of active channels that the channel_regex matches
+ * @channel_set     Active channels that the channel_regex matches
  */
 typedef struct _mpudpm_subscriber_t {
     char * channel_string;
     GRegex * regex;   // compiled regex for the channel_string (if it's a regex)
     GSList* sockets;  //type: mpudpm_socket_t
-    GHashTable* channel_set; //GHashTable used as a set (value points to key)
+    GHashTable* channel_set; //type: char* -> mpudpm_sub_channel_t
 } mpudpm_subscriber_t;
 
+/**
+ * mpudpm_channel_move_t:
+ * @port            dedicated port that the channel has been moved to
+ * @generation      incremented each time the channel is moved.  When two
+ *                  nodes disagree, the higher generation (then the lower
+ *                  port) wins.
+ * @switch_utime    local time at which publishers start sending on port
+ * @local           1 if this process decided the move, 0 if it heard about
+ *                  it in a mapping update
+ */
+typedef struct _mpudpm_channel_move_t {
+    uint16_t port;
+    int32_t generation;
+    int64_t switch_utime;
+    int8_t local;
+} mpudpm_channel_move_t;
+
+/**
+ * mpudpm_peer_t:
+ * @sender_id           id that the peer puts in its mapping updates
+ * @version             last version of the peer's mapping that we're sure
+ *                      we have all of
+ * @last_request_utime  last time we asked the peer for a snapshot
+ */
+typedef struct _mpudpm_peer_t {
+    int64_t sender_id;
+    int32_t version;
+    int64_t last_request_utime;
+} mpudpm_peer_t;
+
+/**
+ * mpudpm_channel_rate_t:
+ * @window_start_utime  start of the current measurement window
+ * @window_bytes        bytes published on the channel during the window
+ */
+typedef struct _mpudpm_channel_rate_t {
+    int64_t window_start_utime;
+    int64_t window_bytes;
+} mpudpm_channel_rate_t;
+
 /**
  * mpudpm_params_t:
  * @mc_addr:              multicast address
@@ -85,6 +188,12 @@ typedef struct _mpudpm_subscriber_t {
  *                        don't use > 1.  that's just rude.
  * @recv_buf_size:        requested size of the kernel receive buffer, set with
  *                        SO_RCVBUF.  0 indicates to use the default settings.
+ * @num_dedicated_ports:  number of ports at the end of the range that are
+ *                        handed out to busy channels.  Only non-zero when
+ *                        port_assign=traffic.  The remaining ports are shared
+ *                        by hashing channel names as usual.
+ * @heavy_channel_rate:   publish rate (bytes/sec) above which a channel is
+ *                        moved to a dedicated port
  *
  */
 typedef struct _mpudpm_params_t mpudpm_params_t;
@@ -94,6 +203,9 @@ struct _mpudpm_params_t {
     uint16_t num_mc_ports;
     uint8_t mc_ttl; 
     int recv_buf_size;
+    int8_t traffic_aware;
+    uint16_t num_dedicated_ports;
+    int64_t heavy_channel_rate;
 };
 
 typedef struct _lcm_provider_t lcm_mpudpm_t;
@@ -134,6 +246,11 @@ struct _lcm_provider_t {
     /* Indicates whether the receive thread was successfully created */
     int8_t recv_thread_created;
 
+#ifdef USE_EPOLL
+    /* epoll set containing thread_msg_pipe[0] and every receive socket */
+    int epoll_fd;
+#endif
+
     /* END VARIABLES GUARDED BY receive_lock
      **************************************************************/
 
@@ -153,8 +270,38 @@ struct _lcm_provider_t {
      * type: char* -> uint16_t (via GUINT_TO_POINTER macro)*/
     GHashTable* channel_to_port_map;
 
+    /* Channels that have been moved off of their hashed port, either by this
+     * process or by a mapping update from someone else.
+     * type: char* -> mpudpm_channel_move_t */
+    GHashTable* channel_moves;
+
+    /* Publish rates of channels published by this process.  Only used when
+     * port_assign=traffic.
+     * type: char* -> mpudpm_channel_rate_t */
+    GHashTable* channel_rates;
+
     /* Last time the channel_to_port mapping was broadcast by someone */
     int64_t last_mapping_update_utime;
+    /* Last time the full channel_to_port mapping, which older versions rely
+     * on, was broadcast by someone */
+    int64_t last_full_mapping_utime;
+    /* Last time we sent a full snapshot of the channel_to_port mapping */
+    int64_t last_mapping_snapshot_utime;
+
+    /* Identifies our mapping updates, and the version of the last one sent.
+     * The version is bumped each time we send mappings we haven't sent
+     * before. */
+    int64_t mapping_sender_id;
+    int32_t mapping_version;
+
+    /* Channels that we've added to channel_to_port_map (or moved) since our
+     * last mapping update.
+     * type: char* -> char* (used as a set) */
+    GHashTable* unsent_mappings;
+
+    /* Other processes that we've received mapping updates from
+     * type: int64_t* -> mpudpm_peer_t */
+    GHashTable* mapping_peers;
 
     /* rolling counter of how many messages transmitted */
     uint32_t     msg_seqno;
@@ -180,6 +327,10 @@ struct _lcm_provider_t {
     lcm_frag_buf_store  *frag_bufs;
 
     uint32_t     udp_rx;            // packets received and processed
+    uint64_t     udp_bytes_unmatched; // bytes discarded because no
+    // subscriber wanted the channel
+    int64_t      last_consolidate_utime; // last check for regex
+    // subscribers on noisy ports
     uint32_t     udp_discarded_bad; // packets discarded because they were bad 
     // somehow
     double       udp_low_watermark; // least buffer available
@@ -197,8 +348,15 @@ int lcm_mpudpm_unsubscribe(lcm_mpudpm_t *lcm, const char *channel);
 static int publish_message_internal(lcm_mpudpm_t *lcm, const char *channel,
         const void *data, unsigned int datalen);
 static void publish_channel_mapping_update(lcm_mpudpm_t *lcm);
+static void publish_channel_mapping_snapshot(lcm_mpudpm_t *lcm);
+static void publish_channel_mapping_full(lcm_mpudpm_t *lcm);
 static void channel_port_mapping_update_handler(lcm_mpudpm_t *lcm,
+        const channel_port_map_delta_t *msg, int64_t recv_time);
+static void channel_port_mapping_full_handler(lcm_mpudpm_t *lcm,
         const channel_port_map_update_t *msg, int64_t recv_time);
+static int apply_channel_move(lcm_mpudpm_t *lcm,
+        const channel_to_port_move_t *mapping, int64_t recv_utime);
+static int resolve_port_collisions(lcm_mpudpm_t *lcm, int64_t now);
 static void update_subscription_ports(lcm_mpudpm_t* lcm);
 static void add_channel_to_subscriber(lcm_mpudpm_t* lcm,
         mpudpm_subscriber_t * sub, const char * channel, uint16_t port);
@@ -246,18 +404,24 @@ destroy_recv_parts (lcm_mpudpm_t *lcm)
         lcm->recv_thread_created = 0;
     }
 
+#ifdef USE_EPOLL
+    if (lcm->epoll_fd >= 0) {
+        close(lcm->epoll_fd);
+        lcm->epoll_fd = -1;
+    }
+#endif
+
     if (lcm->thread_msg_pipe[0] >= 0) {
         lcm_internal_pipe_close(lcm->thread_msg_pipe[0]);
         lcm_internal_pipe_close(lcm->thread_msg_pipe[1]);
         lcm->thread_msg_pipe[0] = lcm->thread_msg_pipe[1] = -1;
     }
 
-    if (lcm->subscribers) {
-        for (GSList* it = lcm->subscribers; it != NULL ; it = it->next) {
-            mpudpm_subscriber_t * sub = (mpudpm_subscriber_t *) it->data;
-            lcm_mpudpm_unsubscribe(lcm, sub->channel_string);
-        }
-        g_slist_free(lcm->subscribers);
+    // lcm_mpudpm_unsubscribe() removes the subscriber from the list
+    while (lcm->subscribers) {
+        mpudpm_subscriber_t * sub =
+                (mpudpm_subscriber_t *) lcm->subscribers->data;
+        lcm_mpudpm_unsubscribe(lcm, sub->channel_string);
     }
 
     if (lcm->frag_bufs) {
@@ -290,6 +454,18 @@ lcm_mpudpm_destroy (lcm_mpudpm_t *lcm)
     if (lcm->channel_to_port_map != NULL) {
         g_hash_table_destroy(lcm->channel_to_port_map);
     }
+    if (lcm->channel_moves != NULL) {
+        g_hash_table_destroy(lcm->channel_moves);
+    }
+    if (lcm->channel_rates != NULL) {
+        g_hash_table_destroy(lcm->channel_rates);
+    }
+    if (lcm->unsent_mappings != NULL) {
+        g_hash_table_destroy(lcm->unsent_mappings);
+    }
+    if (lcm->mapping_peers != NULL) {
+        g_hash_table_destroy(lcm->mapping_peers);
+    }
 
     lcm_internal_pipe_close(lcm->notify_pipe[0]);
     lcm_internal_pipe_close(lcm->notify_pipe[1]);
@@ -320,13 +496,23 @@ static uint32_t mpudpm_str_hash(const char* str) {
     return hash;
 }
 
+// dedicated ports (if any) are at the end of the range and are never handed
+// out by hashing
 static uint16_t
 map_channel_to_port(lcm_mpudpm_t* lcm, const char * channel) {
     uint32_t channel_hash = mpudpm_str_hash(channel);
     return lcm->params.mc_port_range_start
-            + channel_hash % lcm->params.num_mc_ports;
+            + channel_hash % (lcm->params.num_mc_ports -
+                    lcm->params.num_dedicated_ports);
 }
 
+// This function assumes that the caller is holding the transmit_lock
+// Queues the channel's mapping to go out with our next mapping update
+static void
+mark_mapping_unsent(lcm_mpudpm_t* lcm, const char * channel) {
+    char* key = strdup(channel);
+    g_hash_table_replace(lcm->unsent_mappings, key, key);
+}
 
 static int
 parse_mc_addr_and_port (const char *str, mpudpm_params_t * params)
@@ -386,6 +572,33 @@ new_argument (gpointer key, gpointer value, gpointer user)
             params->num_mc_ports = 1;
         }
     }
+    else if (!strcmp ((char *) key, "port_assign")) {
+        if (!strcmp ((char *) value, "traffic")) {
+            params->traffic_aware = 1;
+        } else if (!strcmp ((char *) value, "hash")) {
+            params->traffic_aware = 0;
+        } else {
+            fprintf(stderr, "Warning: Invalid value (%s) for port_assign\n",
+                    (char*) value);
+        }
+    }
+    else if (!strcmp ((char *) key, "dedicated_ports")) {
+        char *endptr = NULL;
+        params->num_dedicated_ports = strtol ((char *) value, &endptr, 0);
+        if (endptr == value) {
+            fprintf(stderr, "Warning: Invalid value (%s) for dedicated_ports\n",
+                    (char*) value);
+        }
+    }
+    else if (!strcmp ((char *) key, "heavy_rate")) {
+        char *endptr = NULL;
+        params->heavy_channel_rate = strtoll ((char *) value, &endptr, 0);
+        if (endptr == value || params->heavy_channel_rate <= 0) {
+            fprintf(stderr, "Warning: Invalid value (%s) for heavy_rate\n",
+                    (char*) value);
+            params->heavy_channel_rate = 0;
+        }
+    }
     else {
         fprintf(stderr, "%s:%d -- unknown provider argument %s\n",
                 __FILE__, __LINE__, (char *)key);
@@ -398,8 +611,11 @@ is_reserved_channel(const char * channel){
             strlen(RESERVED_CHANNEL_PREFIX)) == 0);
 }
 
+// sets *unmatched if the packet was dropped because no one subscribes to
+// its channel
 static int 
-recv_message_fragment (lcm_mpudpm_t *lcm, lcm_buf_t *lcmb, uint32_t sz)
+recv_message_fragment (lcm_mpudpm_t *lcm, lcm_buf_t *lcmb, uint32_t sz,
+        int *unmatched)
 {
     lcm2_header_long_t *hdr = (lcm2_header_long_t*) lcmb->buf;
 
@@ -442,8 +658,10 @@ recv_message_fragment (lcm_mpudpm_t *lcm, lcm_buf_t *lcmb, uint32_t sz)
 
         // if the packet has no subscribers, drop the message now.
         if (!lcm_has_handlers(lcm->lcm, channel)
-                && !is_reserved_channel(channel))
+                && !is_reserved_channel(channel)) {
+            *unmatched = 1;
             return 0;
+        }
 
         fbuf = lcm_frag_buf_new (*((struct sockaddr_in*) &lcmb->from),
                 channel, msg_seqno, data_size, fragments_in_msg,
@@ -457,6 +675,7 @@ recv_message_fragment (lcm_mpudpm_t *lcm, lcm_buf_t *lcmb, uint32_t sz)
         // received fragment for message we dropped (hopefully intentionally)
         //TODO(abachrac): is there a way to distinguish between intentionally
         // dropped, and packets being dropped due to out of order packet 0?
+        *unmatched = 1;
         return 0;
     }
 
@@ -527,8 +746,11 @@ recv_message_fragment (lcm_mpudpm_t *lcm, lcm_buf_t *lcmb, uint32_t sz)
     return 0;
 }
 
+// sets *unmatched if the packet was dropped because no one subscribes to
+// its channel
 static int
-recv_short_message (lcm_mpudpm_t *lcm, lcm_buf_t *lcmb, int sz)
+recv_short_message (lcm_mpudpm_t *lcm, lcm_buf_t *lcmb, int sz,
+        int *unmatched)
 {
     lcm2_header_short_t *hdr2 = (lcm2_header_short_t*) lcmb->buf;
 
@@ -552,6 +774,8 @@ recv_short_message (lcm_mpudpm_t *lcm, lcm_buf_t *lcmb, int sz)
     if (!is_reserved_channel(pkt_channel_str)
             || strcmp(pkt_channel_str, SELF_TEST_CHANNEL) == 0) {
         if (!lcm_try_enqueue_message(lcm->lcm, pkt_channel_str)) {
+            // distinguish between full queues and unwanted channels
+            *unmatched = !lcm_has_handlers(lcm->lcm, pkt_channel_str);
             return 0;
         }
     }
@@ -570,8 +794,21 @@ static void dispatch_complete_message(lcm_mpudpm_t * lcm, lcm_buf_t * lcmb,
         int actual_size) {
     int handled_internal_message = 0;
     if (strcmp(lcmb->channel_name, CHANNEL_TO_PORT_MAP_REQUEST_CHANNEL) == 0) {
+        // requests are either "r", which asks everyone for their mapping,
+        // or "r <sender_id>", which asks a single process.  Older versions
+        // only send "r", and expect the full map in reply.
+        char req[64];
+        int req_len = MIN((int) lcmb->data_size, (int) sizeof(req) - 1);
+        memcpy(req, lcmb->buf + lcmb->data_offset, req_len);
+        req[req_len] = 0;
         g_static_mutex_lock(&lcm->transmit_lock);
-        publish_channel_mapping_update(lcm);
+        if (req_len <= 2) {
+            publish_channel_mapping_snapshot(lcm);
+            publish_channel_mapping_full(lcm);
+        } else if (g_ascii_strtoll(req + 2, NULL, 10) ==
+                lcm->mapping_sender_id) {
+            publish_channel_mapping_snapshot(lcm);
+        }
         g_static_mutex_unlock(&lcm->transmit_lock);
         // discard the received message
         handled_internal_message = 1;
@@ -584,12 +821,27 @@ static void dispatch_complete_message(lcm_mpudpm_t * lcm, lcm_buf_t * lcmb,
             fprintf(stderr, "error %d decoding channel_port_map_update_t!!!\n",
                     status);
         } else {
-            channel_port_mapping_update_handler(lcm, &upd_msg,
+            channel_port_mapping_full_handler(lcm, &upd_msg,
                     lcmb->recv_utime);
             channel_port_map_update_t_decode_cleanup(&upd_msg);
         }
         // discard the received message
         handled_internal_message = 1;
+    } else if (strcmp(lcmb->channel_name, CHANNEL_TO_PORT_MAP_DELTA_CHANNEL)
+            == 0) {
+        channel_port_map_delta_t delta_msg;
+        int status = channel_port_map_delta_t_decode(lcmb->buf,
+                lcmb->data_offset, lcmb->data_size, &delta_msg);
+        if (status < 0) {
+            fprintf(stderr, "error %d decoding channel_port_map_delta_t!!!\n",
+                    status);
+        } else {
+            channel_port_mapping_update_handler(lcm, &delta_msg,
+                    lcmb->recv_utime);
+            channel_port_map_delta_t_decode_cleanup(&delta_msg);
+        }
+        // discard the received message
+        handled_internal_message = 1;
     }
 
     if (handled_internal_message) {
@@ -624,6 +876,167 @@ static void dispatch_complete_message(lcm_mpudpm_t * lcm, lcm_buf_t * lcmb,
     }
 }
 
+// Reads packets from a socket until recvmsg would block, a read fails, or
+// MAX_PACKETS_PER_SOCKET_READ packets have been read, so that one busy port
+// can't starve the others.  Complete messages are dispatched.  *lcmb_ptr holds
+// the partially used receive buffer between calls.
+//
+// This function assumes that the caller is holding the lcm->receive_lock, and
+// returns with it held.
+static void
+recv_socket_packets(lcm_mpudpm_t *lcm, mpudpm_socket_t *sub_socket,
+        lcm_buf_t **lcmb_ptr)
+{
+    SOCKET recv_fd = sub_socket->fd;
+    uint16_t recv_port = sub_socket->port;
+    lcm_buf_t *lcmb = *lcmb_ptr;
+    uint64_t bytes_received = 0;
+    uint64_t bytes_unmatched = 0;
+
+    for (int npackets = 0; npackets < MAX_PACKETS_PER_SOCKET_READ;
+            npackets++) {
+        // We should be holding receive_lock at the start of this loop
+        if (lcmb == NULL ) {
+            lcmb = lcm_buf_allocate_data(lcm->inbufs_empty,
+                    &lcm->ringbuf);
+        }
+
+        // unlock while we actually receive the incoming message
+        g_static_mutex_unlock(&lcm->receive_lock);
+        struct iovec vec;
+        vec.iov_base = lcmb->buf;
+        vec.iov_len = 65535;
+
+        struct msghdr msg;
+        msg.msg_name = &lcmb->from;
+        msg.msg_namelen = sizeof(struct sockaddr);
+        msg.msg_iov = &vec;
+        msg.msg_iovlen = 1;
+#ifdef MSG_EXT_HDR
+        // operating systems that provide SO_TIMESTAMP allow us to
+        // obtain more accurate timestamps by having the kernel produce
+        // timestamps as soon as packets are received.
+        char controlbuf[64];
+        msg.msg_control = controlbuf;
+        msg.msg_controllen = sizeof(controlbuf);
+        msg.msg_flags = 0;
+#endif
+        int sz = recvmsg(recv_fd, &msg, 0);
+
+        if (sz < 0) {
+#ifndef WIN32
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+#else
+            if (WSAGetLastError() != WSAEWOULDBLOCK) {
+#endif
+                perror("udp_read_packet -- recvmsg");
+                lcm->udp_discarded_bad++;
+            }
+            g_static_mutex_lock(&lcm->receive_lock);
+            break;
+        }
+
+        if (sz < sizeof(lcm2_header_short_t)) {
+            // packet too short to be LCM
+            lcm->udp_discarded_bad++;
+            g_static_mutex_lock(&lcm->receive_lock);
+            continue;
+        }
+
+        lcmb->fromlen = msg.msg_namelen;
+        // overwrite upper 16 bits of the address in lcmb->from with the
+        // recv_port since all channels are sent from the same port, and
+        // the from address is used to retrieve fragment buffers. If
+        // there is an existing fragment buffer with a different seqno
+        // the message would get dropped. This ensures that messages on
+        // different channels will appear as though they are coming from
+        // different senders
+        struct sockaddr_in *from_addr =
+                (struct sockaddr_in*) &lcmb->from;
+        // s_addr is network order, so we actually modify lower 16
+        from_addr->sin_addr.s_addr &= 0xFFFF0000;
+        from_addr->sin_addr.s_addr |= htons(recv_port);
+
+        int got_utime = 0;
+#ifdef SO_TIMESTAMP
+        struct cmsghdr * cmsg = CMSG_FIRSTHDR (&msg);
+        // Get the receive timestamp out of the packet headers
+        // (if possible)
+        while (!lcmb->recv_utime && cmsg) {
+            if (cmsg->cmsg_level == SOL_SOCKET
+                    && cmsg->cmsg_type == SCM_TIMESTAMP) {
+                struct timeval * t = (struct timeval*) CMSG_DATA (cmsg);
+                lcmb->recv_utime = (int64_t) t->tv_sec * 1000000
+                        + t->tv_usec;
+                got_utime = 1;
+                break;
+            }
+            cmsg = CMSG_NXTHDR (&msg, cmsg);
+        }
+#endif
+        if (!got_utime)
+            lcmb->recv_utime = lcm_timestamp_now();
+
+        lcm2_header_short_t *hdr2 = (lcm2_header_short_t*) lcmb->buf;
+        uint32_t rcvd_magic = ntohl(hdr2->magic);
+        int got_complete_message = 0;
+        int unmatched = 0;
+        bytes_received += sz;
+        if (rcvd_magic == LCM2_MAGIC_SHORT)
+            got_complete_message = recv_short_message(lcm, lcmb, sz,
+                    &unmatched);
+        else if (rcvd_magic == LCM2_MAGIC_LONG)
+            got_complete_message = recv_message_fragment(lcm, lcmb, sz,
+                    &unmatched);
+        else {
+            dbg(DBG_LCM, "LCM: bad magic\n");
+            lcm->udp_discarded_bad++;
+            g_static_mutex_lock(&lcm->receive_lock);
+            continue;
+        }
+
+        if (unmatched)
+            bytes_unmatched += sz;
+
+        // dispatch internal messages
+        if (got_complete_message) {
+            dispatch_complete_message(lcm, lcmb, sz);
+            lcmb = NULL;
+        }
+        // lock to go back around the loop
+        g_static_mutex_lock(&lcm->receive_lock);
+    }
+    *lcmb_ptr = lcmb;
+
+    lcm->udp_bytes_unmatched += bytes_unmatched;
+    // sub_socket may have been removed (and freed) while we weren't holding
+    // the lock
+    if (!lcm->recv_sockets_changed) {
+        sub_socket->bytes_received += bytes_received;
+        sub_socket->bytes_unmatched += bytes_unmatched;
+    }
+}
+
+// Handles a message on the thread_msg_pipe.  Returns 1 if the read thread
+// should exit.
+static int
+handle_thread_msg(lcm_mpudpm_t *lcm)
+{
+    char ch;
+    int status = lcm_internal_pipe_read(lcm->thread_msg_pipe[0], &ch, 1);
+    if (status <= 0) {
+        fprintf(stderr, "Error: Problem reading from thread_msg_pipe\n");
+        return 1;
+    }
+    if (ch == 'c') {
+        dbg(DBG_LCM, "Aborted select due to changed receive sockets\n");
+        return 0;
+    }
+    // received an exit message.
+    dbg(DBG_LCM, "read thread received exit command\n");
+    return 1;
+}
+
 /* This is the receiver thread that runs continuously to retrieve any incoming
  * LCM packets from the network and queues them locally. */
 static void *
@@ -640,7 +1053,44 @@ recv_thread(void * user) {
     lcm_buf_t *lcmb = NULL;
     // loop until we get an exit message on the thread_msg_pipe
     while (1) {
+#ifdef USE_EPOLL
+        // The epoll set is kept up to date by add_recv_socket() and
+        // remove_recv_socket(), so there is nothing to rebuild here.
+        g_static_mutex_lock(&lcm->receive_lock);
+        lcm->recv_sockets_changed = 0;
+        g_static_mutex_unlock(&lcm->receive_lock);
+
+        struct epoll_event events[MAX_EPOLL_EVENTS];
+        int nevents = epoll_wait(lcm->epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+        if (nevents < 0) {
+            if (errno != EINTR)
+                perror("udp_read_packet -- epoll_wait() failed:");
+            continue;
+        }
+
+        // check for a signaling message
+        int quit = 0;
+        for (int i = 0; i < nevents; i++) {
+            if (events[i].data.ptr == NULL)
+                quit = handle_thread_msg(lcm);
+        }
+        if (quit)
+            break;
 
+        g_static_mutex_lock(&lcm->receive_lock);
+        for (int i = 0; i < nevents && !lcm->recv_sockets_changed; i++) {
+            // a socket removed since epoll_wait() returned may already be
+            // freed.  In that case recv_sockets_changed is set, and the
+            // remaining events are dropped.  Sockets that are still ready
+            // will be reported again by the next epoll_wait().
+            mpudpm_socket_t * sub_socket =
+                    (mpudpm_socket_t *) events[i].data.ptr;
+            if (sub_socket == NULL)
+                continue;
+            recv_socket_packets(lcm, sub_socket, &lcmb);
+        }
+        g_static_mutex_unlock(&lcm->receive_lock);
+#else
         // lock subscription lists so things don't change on us
         g_static_mutex_lock(&lcm->receive_lock);
 
@@ -671,173 +1121,34 @@ recv_thread(void * user) {
 
         // check for a signaling message
         if (FD_ISSET(lcm->thread_msg_pipe[0], &fds)) {
-            char ch;
-            int status = lcm_internal_pipe_read(lcm->thread_msg_pipe[0], &ch,
-                    1);
-            if (status <= 0) {
-                fprintf(stderr,
-                        "Error: Problem reading from thread_msg_pipe\n");
+            if (handle_thread_msg(lcm))
                 break;
-            }
-            if (ch == 'c') {
-                dbg(DBG_LCM, "Aborted select due to changed receive sockets\n");
-                continue;
-            } else {
-                // received an exit message.
-                dbg(DBG_LCM, "read thread received exit command\n");
-                if (lcmb) {
-                    // lcmb is not on one of the memory managed buffer queues.
-                    // We could either put it back on one of the queues, or
-                    // just free it here.  Do the latter.
-                    //
-                    // Can also just free its lcm_buf_t here.  Its data buffer
-                    // is managed either by the ring buffer or the fragment
-                    // buffer, so we can ignore it.
-                    free(lcmb);
-                }
-                break;
-            }
-        }
-        g_static_mutex_lock(&lcm->receive_lock);
-        if (lcm->recv_sockets_changed) {
-            // the set of receive sockets has changed, so we need to start
-            // over
-            g_static_mutex_unlock(&lcm->receive_lock);
             continue;
         }
+        g_static_mutex_lock(&lcm->receive_lock);
 
         // there is incoming UDP data ready on at least one of our sockets.
         // loop over sockets and receive data on all the ones that have data
-        SOCKET recv_fd = -1;
-        uint16_t recv_port = -1;
-        int poll_i = 1;
-        for (GSList* it = lcm->recv_sockets; it != NULL ;
-                it = it->next, ++poll_i) {
+        for (GSList* it = lcm->recv_sockets;
+                it != NULL && !lcm->recv_sockets_changed; it = it->next) {
             // We should be holding receive_lock at the start of this loop
             mpudpm_socket_t * sub_socket = (mpudpm_socket_t *) it->data;
-            if (!FD_ISSET(sub_socket->fd, &fds)) {
-                continue;
-            } else {
-                recv_fd = sub_socket->fd;
-                recv_port = sub_socket->port;
-            }
-
-            // loop until recvmsg would block (we've read all available data)
-            // or a read fails
-            while (1) {
-                // We should be holding receive_lock at the start of this loop
-                if (lcmb == NULL ) {
-                    lcmb = lcm_buf_allocate_data(lcm->inbufs_empty,
-                            &lcm->ringbuf);
-                }
-
-                // unlock while we actually receive the incoming message
-                g_static_mutex_unlock(&lcm->receive_lock);
-                struct iovec vec;
-                vec.iov_base = lcmb->buf;
-                vec.iov_len = 65535;
-
-                struct msghdr msg;
-                msg.msg_name = &lcmb->from;
-                msg.msg_namelen = sizeof(struct sockaddr);
-                msg.msg_iov = &vec;
-                msg.msg_iovlen = 1;
-#ifdef MSG_EXT_HDR
-                // operating systems that provide SO_TIMESTAMP allow us to
-                // obtain more accurate timestamps by having the kernel produce
-                // timestamps as soon as packets are received.
-                char controlbuf[64];
-                msg.msg_control = controlbuf;
-                msg.msg_controllen = sizeof(controlbuf);
-                msg.msg_flags = 0;
-#endif
-                int sz = recvmsg(recv_fd, &msg, 0);
-
-                if (sz < 0) {
-#ifndef WIN32
-                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
-#else
-                    if (WSAGetLastError() != WSAEWOULDBLOCK) {
-#endif
-                        perror("udp_read_packet -- recvmsg");
-                        lcm->udp_discarded_bad++;
-                    }
-                    break;
-                }
-
-                if (sz < sizeof(lcm2_header_short_t)) {
-                    // packet too short to be LCM
-                    lcm->udp_discarded_bad++;
-                    continue;
-                }
-
-                lcmb->fromlen = msg.msg_namelen;
-                // overwrite upper 16 bits of the address in lcmb->from with the
-                // recv_port since all channels are sent from the same port, and
-                // the from address is used to retrieve fragment buffers. If
-                // there is an existing fragment buffer with a different seqno
-                // the message would get dropped. This ensures that messages on
-                // different channels will appear as though they are coming from
-                // different senders
-                struct sockaddr_in *from_addr =
-                        (struct sockaddr_in*) &lcmb->from;
-                // s_addr is network order, so we actually modify lower 16
-                from_addr->sin_addr.s_addr &= 0xFFFF0000;
-                from_addr->sin_addr.s_addr |= htons(recv_port);
-
-                int got_utime = 0;
-#ifdef SO_TIMESTAMP
-                struct cmsghdr * cmsg = CMSG_FIRSTHDR (&msg);
-                // Get the receive timestamp out of the packet headers
-                // (if possible)
-                while (!lcmb->recv_utime && cmsg) {
-                    if (cmsg->cmsg_level == SOL_SOCKET
-                            && cmsg->cmsg_type == SCM_TIMESTAMP) {
-                        struct timeval * t = (struct timeval*) CMSG_DATA (cmsg);
-                        lcmb->recv_utime = (int64_t) t->tv_sec * 1000000
-                                + t->tv_usec;
-                        got_utime = 1;
-                        break;
-                    }
-                    cmsg = CMSG_NXTHDR (&msg, cmsg);
-                }
-#endif
-                if (!got_utime)
-                    lcmb->recv_utime = lcm_timestamp_now();
-
-                lcm2_header_short_t *hdr2 = (lcm2_header_short_t*) lcmb->buf;
-                uint32_t rcvd_magic = ntohl(hdr2->magic);
-                int got_complete_message = 0;
-                if (rcvd_magic == LCM2_MAGIC_SHORT)
-                    got_complete_message = recv_short_message(lcm, lcmb, sz);
-                else if (rcvd_magic == LCM2_MAGIC_LONG)
-                    got_complete_message = recv_message_fragment(lcm, lcmb, sz);
-                else {
-                    dbg(DBG_LCM, "LCM: bad magic\n");
-                    lcm->udp_discarded_bad++;
-                    continue;
-                }
-
-                // dispatch internal messages
-                if (got_complete_message) {
-                    dispatch_complete_message(lcm, lcmb, sz);
-                    lcmb = NULL;
-                }
-                // lock to go back around the while loop
-                g_static_mutex_lock(&lcm->receive_lock);
-            }
-
-            // we're done with this file descriptor
-            // lock the receive lock to check whether the receive sockets have
-            // changed and go back around the loop
-            g_static_mutex_lock(&lcm->receive_lock);
-            if (lcm->recv_sockets_changed) {
-                // the set of receive sockets may have changed, so we need to
-                // break and wait again on the appropriate set of sockets
-                break;
-            }
+            if (FD_ISSET(sub_socket->fd, &fds))
+                recv_socket_packets(lcm, sub_socket, &lcmb);
         }
         g_static_mutex_unlock(&lcm->receive_lock);
+#endif
+    }
+
+    if (lcmb) {
+        // lcmb is not on one of the memory managed buffer queues.
+        // We could either put it back on one of the queues, or
+        // just free it here.  Do the latter.
+        //
+        // Can also just free its lcm_buf_t here.  Its data buffer
+        // is managed either by the ring buffer or the fragment
+        // buffer, so we can ignore it.
+        free(lcmb);
     }
 
     dbg(DBG_LCM, "read thread exiting\n");
@@ -865,9 +1176,9 @@ lcm_mpudpm_subscribe (lcm_mpudpm_t *lcm, const char *channel)
     mpudpm_subscriber_t *sub = (mpudpm_subscriber_t *) calloc(1,
             sizeof(mpudpm_subscriber_t));
     sub->channel_string = strdup(channel);
-    // hashmap is used as a set. Will need to free keys, but not values
+    // keys are strdup'd channel names, values are mpudpm_sub_channel_t
     sub->channel_set = g_hash_table_new_full(g_str_hash, g_str_equal, free,
-            NULL );
+            free);
 
     if (g_regex_match(lcm->regex_finder_re, channel, (GRegexMatchFlags) 0,
             NULL )) {
@@ -904,8 +1215,11 @@ lcm_mpudpm_subscribe (lcm_mpudpm_t *lcm, const char *channel)
             g_hash_table_insert(lcm->channel_to_port_map, strdup(channel),
                     GUINT_TO_POINTER(port));
             // broadcast the updated channel map...
+            mark_mapping_unsent(lcm, channel);
             lcm->last_mapping_update_utime = 0;
             publish_channel_mapping_update(lcm);
+            lcm->last_full_mapping_utime = 0;
+            publish_channel_mapping_full(lcm);
         }
         else{
             port = GPOINTER_TO_UINT(lookup_value);
@@ -971,6 +1285,43 @@ lcm_mpudpm_unsubscribe (lcm_mpudpm_t *lcm, const char *channel)
 
 // This function assumes that the caller is holding the transmit_lock
 static void
+fill_channel_mapping(lcm_mpudpm_t *lcm, channel_to_port_move_t *mapping,
+        const char * channel, uint16_t port, int64_t now){
+    mapping->channel = strdup(channel);
+    mapping->port = (int16_t)port; // cast to int16_t for LCM
+    mpudpm_channel_move_t* move = (mpudpm_channel_move_t*)
+            g_hash_table_lookup(lcm->channel_moves, channel);
+    if (move != NULL) {
+        // advertise where the channel is going, and how long until
+        // publishers get there
+        mapping->port = (int16_t)move->port;
+        mapping->generation = move->generation;
+        if (move->switch_utime > now) {
+            mapping->switch_delay_usec = (int32_t)(move->switch_utime - now);
+        }
+    }
+}
+
+// This function assumes that the caller is holding the transmit_lock
+static void
+send_channel_mapping(lcm_mpudpm_t *lcm, channel_port_map_delta_t* msg){
+    int msg_sz = channel_port_map_delta_t_encoded_size(msg);
+    void* buf = malloc(msg_sz);
+    channel_port_map_delta_t_encode(buf, 0, msg_sz, msg);
+    dbg(DBG_LCM,
+            "Publishing a %dB channel_port_map %s (version %d) with %d "
+            "mappings\n", msg_sz, msg->is_snapshot ? "snapshot" : "update",
+            msg->version, msg->num_channels);
+    publish_message_internal(lcm, CHANNEL_TO_PORT_MAP_DELTA_CHANNEL, buf,
+            msg_sz);
+    free(buf);
+}
+
+// This function assumes that the caller is holding the transmit_lock
+// Sends only the mappings we've added since our last update.  If there are
+// none, the update is an empty heartbeat that lets everyone else check that
+// they haven't missed one of our updates.
+static void
 publish_channel_mapping_update(lcm_mpudpm_t *lcm){
     int64_t now = lcm_timestamp_now();
     if (now - lcm->last_mapping_update_utime < 1e4) {
@@ -982,6 +1333,107 @@ publish_channel_mapping_update(lcm_mpudpm_t *lcm){
     }
     lcm->last_mapping_update_utime = lcm_timestamp_now();
 
+    channel_port_map_delta_t* msg = (channel_port_map_delta_t*) calloc(1,
+            sizeof(channel_port_map_delta_t));
+    msg->num_ports = lcm->params.num_mc_ports;
+    msg->num_dedicated_ports = lcm->params.num_dedicated_ports;
+    msg->sender_id = lcm->mapping_sender_id;
+    int num_unsent = g_hash_table_size(lcm->unsent_mappings);
+    msg->mapping = (channel_to_port_move_t*) calloc(MAX(num_unsent, 1),
+            sizeof(channel_to_port_move_t));
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, lcm->unsent_mappings);
+    int ind=0;
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        const char * channel = (const char *) key;
+        void* lookup_value = g_hash_table_lookup(lcm->channel_to_port_map,
+                channel);
+        assert(lookup_value != NULL);
+        fill_channel_mapping(lcm, &msg->mapping[ind], channel,
+                GPOINTER_TO_UINT(lookup_value), now);
+        ind++;
+    }
+    msg->num_channels = ind;
+    g_hash_table_remove_all(lcm->unsent_mappings);
+
+    if (msg->num_channels > 0) {
+        lcm->mapping_version++;
+    }
+    msg->version = lcm->mapping_version;
+    send_channel_mapping(lcm, msg);
+    channel_port_map_delta_t_destroy(msg);
+}
+
+// This function assumes that the caller is holding the transmit_lock
+// Sends our entire channel to port map.  Used to answer other processes that
+// just joined or that missed one of our updates.
+static void
+publish_channel_mapping_snapshot(lcm_mpudpm_t *lcm){
+    int64_t now = lcm_timestamp_now();
+    if (now - lcm->last_mapping_snapshot_utime < 1e4) {
+        // several processes may ask for a snapshot at once.  One is enough.
+        return;
+    }
+    lcm->last_mapping_snapshot_utime = now;
+
+    // anything unsent is about to go out as part of the snapshot, but bump
+    // the version anyway so that everyone stays in sync with our updates
+    if (g_hash_table_size(lcm->unsent_mappings) > 0) {
+        g_hash_table_remove_all(lcm->unsent_mappings);
+        lcm->mapping_version++;
+    }
+
+    channel_port_map_delta_t* msg = (channel_port_map_delta_t*) calloc(1,
+            sizeof(channel_port_map_delta_t));
+    msg->num_ports = lcm->params.num_mc_ports;
+    msg->num_dedicated_ports = lcm->params.num_dedicated_ports;
+    msg->sender_id = lcm->mapping_sender_id;
+    msg->version = lcm->mapping_version;
+    msg->is_snapshot = 1;
+    int table_size = g_hash_table_size(lcm->channel_to_port_map);
+    msg->mapping = (channel_to_port_move_t*) calloc(table_size,
+            sizeof(channel_to_port_move_t));
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, lcm->channel_to_port_map);
+    int ind=0;
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const char * channel = (const char *) key;
+        // filter out reserved channels
+        if (is_reserved_channel(channel)) {
+            continue;
+        }
+        fill_channel_mapping(lcm, &msg->mapping[ind], channel,
+                GPOINTER_TO_UINT(value), now);
+        ind++;
+    }
+    msg->num_channels = ind;
+    assert(msg->num_channels == table_size - NUM_INTERNAL_CHANNELS);
+
+    if (msg->num_channels > 0) {
+        send_channel_mapping(lcm, msg);
+    }
+    channel_port_map_delta_t_destroy(msg);
+}
+
+// This function assumes that the caller is holding the transmit_lock
+// Sends our entire channel to port map as a channel_port_map_update_t, which
+// is all that processes running older versions understand.  Each channel is
+// listed on the port that publishers currently use, so moves that haven't
+// happened yet are left out.
+static void
+publish_channel_mapping_full(lcm_mpudpm_t *lcm){
+    int64_t now = lcm_timestamp_now();
+    if (now - lcm->last_full_mapping_utime < 1e4) {
+        // lets not publish updates too often.
+        // if we actually have new information (ie a new channel),
+        // last_full_mapping_utime will have been set to 0, so this check
+        // is bypassed
+        return;
+    }
+    lcm->last_full_mapping_utime = now;
+
     channel_port_map_update_t* msg = (channel_port_map_update_t*) calloc(1,
             sizeof(channel_port_map_update_t));
     msg->num_ports = lcm->params.num_mc_ports;
@@ -1021,9 +1473,53 @@ publish_channel_mapping_update(lcm_mpudpm_t *lcm){
     channel_port_map_update_t_destroy(msg);
 }
 
+// This function assumes that the caller is holding the transmit_lock
+// Checks the version of a mapping update against the last one we got from
+// the same process.  If it looks like we missed one, ask that process for a
+// snapshot.
+static void
+check_mapping_version(lcm_mpudpm_t *lcm,
+        const channel_port_map_delta_t *msg, int64_t recv_utime) {
+    if (msg->sender_id == lcm->mapping_sender_id) {
+        return;
+    }
+    mpudpm_peer_t* peer = (mpudpm_peer_t*) g_hash_table_lookup(
+            lcm->mapping_peers, &msg->sender_id);
+    if (peer == NULL) {
+        // a process we haven't heard from before starts out at version 0
+        peer = (mpudpm_peer_t*) calloc(1, sizeof(mpudpm_peer_t));
+        peer->sender_id = msg->sender_id;
+        g_hash_table_insert(lcm->mapping_peers, &peer->sender_id, peer);
+    }
+    if (msg->is_snapshot) {
+        peer->version = msg->version;
+        return;
+    }
+
+    int32_t expected_version = peer->version + (msg->num_channels > 0);
+    if (msg->version == expected_version) {
+        peer->version = msg->version;
+    } else if (msg->version > expected_version) {
+        // Missed an update.  Leave peer->version alone so that we keep asking
+        // until a snapshot arrives.
+        if (recv_utime - peer->last_request_utime <
+                CHANNEL_TO_PORT_MAP_SNAPSHOT_REQUEST_PERIOD) {
+            return;
+        }
+        peer->last_request_utime = recv_utime;
+        dbg(DBG_LCM, "Missed channel to port map updates %d..%d from %"
+                G_GINT64_FORMAT ", requesting a snapshot\n",
+                peer->version + 1, msg->version - 1, msg->sender_id);
+        char req[64];
+        snprintf(req, sizeof(req), "r %" G_GINT64_FORMAT, msg->sender_id);
+        publish_message_internal(lcm, CHANNEL_TO_PORT_MAP_REQUEST_CHANNEL,
+                (uint8_t*) req, strlen(req));
+    }
+}
+
 static void
 channel_port_mapping_update_handler(lcm_mpudpm_t *lcm,
-        const channel_port_map_update_t *msg, int64_t recv_utime) {
+        const channel_port_map_delta_t *msg, int64_t recv_utime) {
     if (msg->num_ports != lcm->params.num_mc_ports) {
         fprintf(stderr, "WARNING: received a channel to port mapping "
                 "update from a process with \n"
@@ -1031,14 +1527,30 @@ channel_port_mapping_update_handler(lcm_mpudpm_t *lcm,
                 lcm->params.num_mc_ports);
         return;
     }
+    if (msg->num_dedicated_ports != lcm->params.num_dedicated_ports) {
+        fprintf(stderr, "WARNING: received a channel to port mapping "
+                "update from a process with \n"
+                "dedicated_ports=%d instead of %d\n",
+                msg->num_dedicated_ports, lcm->params.num_dedicated_ports);
+        return;
+    }
     g_static_mutex_lock(&lcm->transmit_lock);
+    check_mapping_version(lcm, msg, recv_utime);
     int8_t updated_channel_to_port_map = FALSE;
     for (int i = 0; i < msg->num_channels; i++) {
+        if (msg->mapping[i].generation > 0 &&
+                apply_channel_move(lcm, &msg->mapping[i], recv_utime)) {
+            updated_channel_to_port_map = TRUE;
+        }
         void* lookup_value = g_hash_table_lookup(lcm->channel_to_port_map,
                 msg->mapping[i].channel);
         if (lookup_value == NULL ) {
             // cast back to uint16_t for LCM
             uint16_t port = (uint16_t)msg->mapping[i].port;
+            if (msg->mapping[i].switch_delay_usec > 0) {
+                // publishers are still using the old (hashed) port
+                port = map_channel_to_port(lcm, msg->mapping[i].channel);
+            }
             dbg(DBG_LCM, "Received mapping for new channel %s on port %d\n",
                     msg->mapping[i].channel,
                     port);
@@ -1051,7 +1563,7 @@ channel_port_mapping_update_handler(lcm_mpudpm_t *lcm,
         }
     }
     int channel_to_port_map_size = g_hash_table_size(lcm->channel_to_port_map);
-    if (!updated_channel_to_port_map
+    if (msg->is_snapshot && !updated_channel_to_port_map
             && channel_to_port_map_size
             - NUM_INTERNAL_CHANNELS == msg->num_channels) {
         // the broadcast message is identical to mine...
@@ -1059,6 +1571,64 @@ channel_port_mapping_update_handler(lcm_mpudpm_t *lcm,
         dbg(DBG_LCM, "Channel to port map is up to date\n");
         lcm->last_mapping_update_utime = recv_utime;
     }
+    if (updated_channel_to_port_map &&
+            resolve_port_collisions(lcm, recv_utime)) {
+        // tell everyone else right away, before they start switching over
+        lcm->last_mapping_update_utime = 0;
+        publish_channel_mapping_update(lcm);
+    }
+    int have_moves = g_hash_table_size(lcm->channel_moves) > 0;
+    g_static_mutex_unlock(&lcm->transmit_lock);
+
+    // when channels have been moved, subscriptions may also need to let go
+    // of old ports, so check them on every update.  The same goes for
+    // checking whether regex subscriptions are on noisy ports.
+    if (updated_channel_to_port_map || have_moves ||
+            lcm->params.traffic_aware){
+        update_subscription_ports(lcm);
+    }
+}
+
+// Full maps come from every process, including those running older versions.
+// They can only add channels we haven't heard of yet.  Moves and version
+// checks are left to channel_port_mapping_update_handler().
+static void
+channel_port_mapping_full_handler(lcm_mpudpm_t *lcm,
+        const channel_port_map_update_t *msg, int64_t recv_utime) {
+    if (msg->num_ports != lcm->params.num_mc_ports) {
+        fprintf(stderr, "WARNING: received a channel to port mapping "
+                "update from a process with \n"
+                "nports=%d instead of %d\n", msg->num_ports,
+                lcm->params.num_mc_ports);
+        return;
+    }
+    g_static_mutex_lock(&lcm->transmit_lock);
+    int8_t updated_channel_to_port_map = FALSE;
+    for (int i = 0; i < msg->num_channels; i++) {
+        void* lookup_value = g_hash_table_lookup(lcm->channel_to_port_map,
+                msg->mapping[i].channel);
+        if (lookup_value == NULL ) {
+            // cast back to uint16_t for LCM
+            uint16_t port = (uint16_t)msg->mapping[i].port;
+            dbg(DBG_LCM, "Received mapping for new channel %s on port %d\n",
+                    msg->mapping[i].channel,
+                    port);
+
+            // insert the new destination into the hash table
+            g_hash_table_insert(lcm->channel_to_port_map,
+                    strdup(msg->mapping[i].channel),
+                    GUINT_TO_POINTER(port));
+            updated_channel_to_port_map = TRUE;
+        }
+    }
+    int channel_to_port_map_size = g_hash_table_size(lcm->channel_to_port_map);
+    if (!updated_channel_to_port_map
+            && channel_to_port_map_size
+            - NUM_INTERNAL_CHANNELS == msg->num_channels) {
+        // the broadcast message is identical to mine...
+        // treat it as if I just published an update :-)
+        lcm->last_full_mapping_utime = recv_utime;
+    }
     g_static_mutex_unlock(&lcm->transmit_lock);
 
     if (updated_channel_to_port_map){
@@ -1066,9 +1636,189 @@ channel_port_mapping_update_handler(lcm_mpudpm_t *lcm,
     }
 }
 
-// This function assumes that the caller is holding the receive_lock
+// This function assumes that the caller is holding the transmit_lock
+// Returns 1 if the move was accepted, 0 if we already knew about it (or
+// something newer)
+static int
+apply_channel_move(lcm_mpudpm_t *lcm, const channel_to_port_move_t *mapping,
+        int64_t recv_utime)
+{
+    uint16_t port = (uint16_t)mapping->port;
+    mpudpm_channel_move_t* move = (mpudpm_channel_move_t*)
+            g_hash_table_lookup(lcm->channel_moves, mapping->channel);
+    if (move != NULL && (mapping->generation < move->generation ||
+            (mapping->generation == move->generation && port >= move->port))) {
+        return 0;
+    }
+    if (move == NULL) {
+        move = (mpudpm_channel_move_t*) calloc(1,
+                sizeof(mpudpm_channel_move_t));
+        g_hash_table_insert(lcm->channel_moves, strdup(mapping->channel),
+                move);
+    }
+    dbg(DBG_LCM, "Channel %s moving to port %d in %d usec\n",
+            mapping->channel, port, mapping->switch_delay_usec);
+    move->port = port;
+    move->generation = mapping->generation;
+    move->switch_utime = recv_utime + MAX(0, mapping->switch_delay_usec);
+    move->local = 0;
+    return 1;
+}
+
+// This function assumes that the caller is holding the transmit_lock
+// Picks the lowest dedicated port that no channel has been moved to yet.
+// Every node searches in the same order, so nodes that promote the same
+// channel at the same time will usually agree.
+static int
+find_free_dedicated_port(lcm_mpudpm_t *lcm, uint16_t *port)
+{
+    int num_dedicated = lcm->params.num_dedicated_ports;
+    uint16_t first_port = lcm->params.mc_port_range_start
+            + lcm->params.num_mc_ports - num_dedicated;
+    uint8_t *used = (uint8_t*) calloc(num_dedicated, 1);
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, lcm->channel_moves);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        mpudpm_channel_move_t* move = (mpudpm_channel_move_t*) value;
+        if (move->port >= first_port && move->port < first_port + num_dedicated)
+            used[move->port - first_port] = 1;
+    }
+    int status = -1;
+    for (int i = 0; i < num_dedicated; i++) {
+        if (!used[i]) {
+            *port = first_port + i;
+            status = 0;
+            break;
+        }
+    }
+    free(used);
+    return status;
+}
+
+// This function assumes that the caller is holding the transmit_lock
+// Two processes can move different channels to the same free dedicated port
+// before hearing about each other's moves.  When that happens, whoever moved
+// the channel with the lowest name keeps the port, and the other process
+// moves its channels on to another free port.  Every process compares the
+// same names, so they agree on which one yields.  If there are no free ports
+// left, the channels share the port.
+// Returns 1 if any of our channels were moved.
+static int
+resolve_port_collisions(lcm_mpudpm_t *lcm, int64_t now)
+{
+    int num_dedicated = lcm->params.num_dedicated_ports;
+    if (num_dedicated == 0)
+        return 0;
+    uint16_t first_port = lcm->params.mc_port_range_start
+            + lcm->params.num_mc_ports - num_dedicated;
+
+    // lowest channel name on each dedicated port, among the channels that we
+    // moved there, and among those that someone else did
+    const char **lowest_local = (const char**) calloc(num_dedicated,
+            sizeof(char*));
+    const char **lowest_remote = (const char**) calloc(num_dedicated,
+            sizeof(char*));
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, lcm->channel_moves);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        mpudpm_channel_move_t* move = (mpudpm_channel_move_t*) value;
+        if (move->port < first_port || move->port >= first_port + num_dedicated)
+            continue;
+        const char **lowest = move->local ? lowest_local : lowest_remote;
+        int i = move->port - first_port;
+        if (lowest[i] == NULL || strcmp((const char*) key, lowest[i]) < 0)
+            lowest[i] = (const char*) key;
+    }
+
+    int moved = 0;
+    for (int i = 0; i < num_dedicated; i++) {
+        if (lowest_local[i] == NULL || lowest_remote[i] == NULL ||
+                strcmp(lowest_local[i], lowest_remote[i]) < 0)
+            continue;
+        uint16_t old_port = first_port + i;
+        uint16_t port;
+        if (find_free_dedicated_port(lcm, &port) < 0) {
+            dbg(DBG_LCM, "Port %d was picked by two processes, and there are "
+                    "no free dedicated ports\n", old_port);
+            continue;
+        }
+        dbg(DBG_LCM, "Port %d was picked by two processes, moving our "
+                "channels to port %d\n", old_port, port);
+        g_hash_table_iter_init(&iter, lcm->channel_moves);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            mpudpm_channel_move_t* move = (mpudpm_channel_move_t*) value;
+            if (!move->local || move->port != old_port)
+                continue;
+            move->port = port;
+            move->generation++;
+            move->switch_utime = now + CHANNEL_MOVE_SWITCH_DELAY_USEC;
+            mark_mapping_unsent(lcm, (const char*) key);
+        }
+        moved = 1;
+    }
+    free(lowest_local);
+    free(lowest_remote);
+    return moved;
+}
+
+// This function assumes that the caller is holding the transmit_lock
+// Tracks how fast this process publishes on a channel, and moves the
+// channel to a dedicated port once it goes over heavy_channel_rate.
+// Channels are never moved back, to keep the mapping stable.
 static void
-add_channel_to_subscriber(lcm_mpudpm_t* lcm, mpudpm_subscriber_t * sub,
+update_channel_rate(lcm_mpudpm_t *lcm, const char *channel,
+        unsigned int datalen, int64_t now)
+{
+    mpudpm_channel_rate_t* rate = (mpudpm_channel_rate_t*)
+            g_hash_table_lookup(lcm->channel_rates, channel);
+    if (rate == NULL) {
+        rate = (mpudpm_channel_rate_t*) calloc(1,
+                sizeof(mpudpm_channel_rate_t));
+        rate->window_start_utime = now;
+        g_hash_table_insert(lcm->channel_rates, strdup(channel), rate);
+    }
+    rate->window_bytes += datalen;
+
+    int64_t elapsed = now - rate->window_start_utime;
+    if (elapsed < CHANNEL_RATE_WINDOW_USEC)
+        return;
+    double bytes_per_sec = rate->window_bytes * 1e6 / elapsed;
+    rate->window_start_utime = now;
+    rate->window_bytes = 0;
+
+    if (bytes_per_sec < lcm->params.heavy_channel_rate ||
+            g_hash_table_lookup(lcm->channel_moves, channel) != NULL) {
+        return;
+    }
+    uint16_t port;
+    if (find_free_dedicated_port(lcm, &port) < 0) {
+        dbg(DBG_LCM, "Channel %s is busy (%.0f B/s), but there are no "
+                "free dedicated ports\n", channel, bytes_per_sec);
+        return;
+    }
+    dbg(DBG_LCM, "Channel %s is busy (%.0f B/s), moving it to port %d\n",
+            channel, bytes_per_sec, port);
+
+    mpudpm_channel_move_t* move = (mpudpm_channel_move_t*) calloc(1,
+            sizeof(mpudpm_channel_move_t));
+    move->port = port;
+    move->generation = 1;
+    move->switch_utime = now + CHANNEL_MOVE_SWITCH_DELAY_USEC;
+    move->local = 1;
+    g_hash_table_insert(lcm->channel_moves, strdup(channel), move);
+    mark_mapping_unsent(lcm, channel);
+
+    // force an update to get sent.  Local subscribers pick up the move when
+    // the update loops back to our own receive thread.
+    lcm->last_mapping_update_utime = 0;
+}
+
+// This function assumes that the caller is holding the receive_lock
+static mpudpm_socket_t*
+acquire_recv_socket(lcm_mpudpm_t* lcm, mpudpm_subscriber_t * sub,
         const char * channel, uint16_t port) {
     mpudpm_socket_t* subscription_socket = NULL;
     for (GSList* sock_it = lcm->recv_sockets; sock_it != NULL ;
@@ -1093,8 +1843,154 @@ add_channel_to_subscriber(lcm_mpudpm_t* lcm, mpudpm_subscriber_t * sub,
     subscription_socket->num_subscribers++;
     sub->sockets = g_slist_prepend(sub->sockets,
             subscription_socket);
-    char* key = strdup(channel);
-    g_hash_table_replace(sub->channel_set, key, key);
+    return subscription_socket;
+}
+
+// This function assumes that the caller is holding the receive_lock
+static void
+release_recv_socket(lcm_mpudpm_t* lcm, mpudpm_subscriber_t * sub,
+        mpudpm_socket_t* sock) {
+    sub->sockets = g_slist_remove(sub->sockets, sock);
+    sock->num_subscribers--;
+    if (sock->num_subscribers == 0) {
+        dbg(DBG_LCM, "No more subscribers using port %d, closing it\n",
+                sock->port);
+        remove_recv_socket(lcm, sock);
+    }
+}
+
+// This function assumes that the caller is holding the receive_lock
+static void
+add_channel_to_subscriber(lcm_mpudpm_t* lcm, mpudpm_subscriber_t * sub,
+        const char * channel, uint16_t port) {
+    mpudpm_sub_channel_t* sub_chan = (mpudpm_sub_channel_t*) calloc(1,
+            sizeof(mpudpm_sub_channel_t));
+    sub_chan->sock = acquire_recv_socket(lcm, sub, channel, port);
+    g_hash_table_replace(sub->channel_set, strdup(channel), sub_chan);
+}
+
+// This function assumes that the caller is holding both the receive_lock
+// and the transmit_lock.
+// Follows channels that have been moved to another port.  The new port is
+// opened as soon as we hear about the move, and the old one is kept until
+// CHANNEL_MOVE_RELEASE_DELAY_USEC after publishers have switched over, so
+// no messages are lost during the switch.
+static void
+update_moved_channels(lcm_mpudpm_t* lcm, mpudpm_subscriber_t * sub,
+        int64_t now) {
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, sub->channel_set);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const char * channel = (const char *) key;
+        mpudpm_sub_channel_t* sub_chan = (mpudpm_sub_channel_t*) value;
+        mpudpm_channel_move_t* move = (mpudpm_channel_move_t*)
+                g_hash_table_lookup(lcm->channel_moves, channel);
+        if (move != NULL && sub_chan->sock->port != move->port) {
+            if (sub_chan->old_sock != NULL)
+                release_recv_socket(lcm, sub, sub_chan->old_sock);
+            sub_chan->old_sock = sub_chan->sock;
+            sub_chan->old_release_utime = move->switch_utime
+                    + CHANNEL_MOVE_RELEASE_DELAY_USEC;
+            sub_chan->sock = acquire_recv_socket(lcm, sub, channel,
+                    move->port);
+        }
+        if (sub_chan->old_sock != NULL && now > sub_chan->old_release_utime) {
+            dbg(DBG_LCM, "Subscriber (%s) done with port %d for channel "
+                    "[%s]\n", sub->channel_string, sub_chan->old_sock->port,
+                    channel);
+            release_recv_socket(lcm, sub, sub_chan->old_sock);
+            sub_chan->old_sock = NULL;
+        }
+    }
+}
+
+static int
+is_dedicated_port(lcm_mpudpm_t* lcm, uint16_t port) {
+    return port >= lcm->params.mc_port_range_start + lcm->params.num_mc_ports
+            - lcm->params.num_dedicated_ports;
+}
+
+// This function assumes that the caller is holding both the receive_lock
+// and the transmit_lock.
+// A regex subscriber has to listen on every port that one of its channels
+// is on, and throw away everything else that arrives there.  Look for ports
+// where most of what arrives is thrown away, and ask publishers to move the
+// wanted channels on those ports together onto one dedicated port.  The
+// noisy ports are then let go by update_moved_channels().
+// Returns 1 if any channels were moved.
+static int
+consolidate_regex_subscriptions(lcm_mpudpm_t* lcm, int64_t now) {
+    if (!lcm->params.traffic_aware ||
+            now - lcm->last_consolidate_utime < REGEX_CONSOLIDATE_PERIOD_USEC)
+        return 0;
+    lcm->last_consolidate_utime = now;
+
+    dbg(DBG_LCM, "%"G_GUINT64_FORMAT" bytes discarded so far for channels "
+            "with no subscribers\n", lcm->udp_bytes_unmatched);
+    for (GSList* it = lcm->recv_sockets; it != NULL ; it = it->next) {
+        mpudpm_socket_t* sock = (mpudpm_socket_t*) it->data;
+        if (sock->bytes_received > 0) {
+            dbg(DBG_LCM, "Port %d: received %"G_GUINT64_FORMAT" bytes, "
+                    "discarded %"G_GUINT64_FORMAT" as unmatched\n",
+                    sock->port, sock->bytes_received, sock->bytes_unmatched);
+        }
+    }
+
+    int moved = 0;
+    for (GSList* it = lcm->subscribers; it != NULL ; it = it->next) {
+        mpudpm_subscriber_t * sub = (mpudpm_subscriber_t *) it->data;
+        if (sub->regex == NULL)
+            continue;
+
+        GPtrArray* to_move = g_ptr_array_new();
+        GHashTableIter iter;
+        gpointer key, value;
+        g_hash_table_iter_init(&iter, sub->channel_set);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            mpudpm_sub_channel_t* sub_chan = (mpudpm_sub_channel_t*) value;
+            mpudpm_socket_t* sock = sub_chan->sock;
+            // leave channels alone if they're in the middle of a move, or
+            // are already on a dedicated port
+            if (sub_chan->old_sock != NULL || is_dedicated_port(lcm, sock->port))
+                continue;
+            if (sock->bytes_unmatched >= REGEX_CONSOLIDATE_MIN_UNMATCHED_BYTES
+                    && sock->bytes_unmatched * 2 > sock->bytes_received) {
+                g_ptr_array_add(to_move, key);
+            }
+        }
+
+        uint16_t port;
+        if (to_move->len > 0 && find_free_dedicated_port(lcm, &port) == 0) {
+            dbg(DBG_LCM, "Subscriber (%s) moving %d channels to port %d\n",
+                    sub->channel_string, to_move->len, port);
+            for (unsigned int i = 0; i < to_move->len; i++) {
+                const char* channel = (const char*) g_ptr_array_index(to_move, i);
+                mpudpm_channel_move_t* move = (mpudpm_channel_move_t*)
+                        g_hash_table_lookup(lcm->channel_moves, channel);
+                if (move == NULL) {
+                    move = (mpudpm_channel_move_t*) calloc(1,
+                            sizeof(mpudpm_channel_move_t));
+                    g_hash_table_insert(lcm->channel_moves, strdup(channel),
+                            move);
+                }
+                move->port = port;
+                move->generation++;
+                move->switch_utime = now + CHANNEL_MOVE_SWITCH_DELAY_USEC;
+                move->local = 1;
+                mark_mapping_unsent(lcm, channel);
+            }
+            moved = 1;
+        }
+        g_ptr_array_free(to_move, TRUE);
+    }
+
+    for (GSList* it = lcm->recv_sockets; it != NULL ; it = it->next) {
+        mpudpm_socket_t* sock = (mpudpm_socket_t*) it->data;
+        sock->bytes_received = 0;
+        sock->bytes_unmatched = 0;
+    }
+    return moved;
 }
 
 static void
@@ -1103,6 +1999,7 @@ update_subscription_ports(lcm_mpudpm_t* lcm){
     g_static_mutex_lock(&lcm->receive_lock);
     g_static_mutex_lock (&lcm->transmit_lock);
 
+    int64_t now = lcm_timestamp_now();
     for (GSList* it = lcm->subscribers; it != NULL ; it = it->next) {
         mpudpm_subscriber_t * sub = (mpudpm_subscriber_t *) it->data;
         if (sub->regex==NULL){
@@ -1118,6 +2015,12 @@ update_subscription_ports(lcm_mpudpm_t* lcm){
             while (g_hash_table_iter_next(&iter, &key, &value)) {
                 char * channel = (char *) key;
                 uint16_t port = GPOINTER_TO_UINT(value);
+                mpudpm_channel_move_t* move = (mpudpm_channel_move_t*)
+                        g_hash_table_lookup(lcm->channel_moves, channel);
+                if (move != NULL && now >= move->switch_utime) {
+                    // don't bother joining the port it used to be on
+                    port = move->port;
+                }
                 if (g_regex_match(sub->regex, channel, (GRegexMatchFlags) 0,
                         NULL ) && !is_reserved_channel(channel)) {
                     if (g_hash_table_lookup_extended(sub->channel_set, channel,
@@ -1132,9 +2035,28 @@ update_subscription_ports(lcm_mpudpm_t* lcm){
             }
         }
     }
+
+    int consolidated = consolidate_regex_subscriptions(lcm, now);
+
+    // follow channels that have been moved to a dedicated port
+    if (g_hash_table_size(lcm->channel_moves) > 0) {
+        for (GSList* it = lcm->subscribers; it != NULL ; it = it->next) {
+            mpudpm_subscriber_t * sub = (mpudpm_subscriber_t *) it->data;
+            update_moved_channels(lcm, sub, now);
+        }
+    }
     // Release both locks in the proper order
     g_static_mutex_unlock (&lcm->transmit_lock);
     g_static_mutex_unlock(&lcm->receive_lock);
+
+    if (consolidated) {
+        // tell the publishers.  This can't be done while holding the
+        // receive_lock, since publishing may need to set up the receive thread
+        g_static_mutex_lock(&lcm->transmit_lock);
+        lcm->last_mapping_update_utime = 0;
+        publish_channel_mapping_update(lcm);
+        g_static_mutex_unlock(&lcm->transmit_lock);
+    }
 }
 
 
@@ -1168,6 +2090,18 @@ publish_message_internal (lcm_mpudpm_t *lcm, const char *channel, const void *da
     // get the port for this channel
     void* lookup_value = g_hash_table_lookup(lcm->channel_to_port_map, channel);
     uint16_t chan_port = GPOINTER_TO_UINT(lookup_value);
+    int64_t now = lcm_timestamp_now();
+    mpudpm_channel_move_t* move = (mpudpm_channel_move_t*)
+            g_hash_table_lookup(lcm->channel_moves, channel);
+    if (lookup_value != NULL && move != NULL && move->port != chan_port &&
+            now >= move->switch_utime) {
+        // subscribers have had time to open the new port.  switch over.
+        chan_port = move->port;
+        dbg(DBG_LCM, "Messages for channel %s will now be sent to port %d\n",
+                channel, chan_port);
+        g_hash_table_replace(lcm->channel_to_port_map, strdup(channel),
+                GUINT_TO_POINTER(chan_port));
+    }
     if (lookup_value==NULL){
         // we need to create a new destination address
         // setup destination multicast address
@@ -1179,13 +2113,22 @@ publish_message_internal (lcm_mpudpm_t *lcm, const char *channel, const void *da
         g_hash_table_insert(lcm->channel_to_port_map, strdup(channel),
                 GUINT_TO_POINTER(chan_port));
         // force an update to get sent
+        mark_mapping_unsent(lcm, channel);
         lcm->last_mapping_update_utime =0; 
+        lcm->last_full_mapping_utime = 0;
+    }
+    if (lcm->params.traffic_aware && !is_reserved_channel(channel)) {
+        update_channel_rate(lcm, channel, datalen, now);
     }
-    if (lcm_timestamp_now() - lcm->last_mapping_update_utime>
+    if (now - lcm->last_mapping_update_utime>
         lcm->channel_to_port_map_update_period) {
         // publish the mapping if no one has broadcast in a while
         publish_channel_mapping_update(lcm);
     }
+    if (now - lcm->last_full_mapping_utime >
+        lcm->channel_to_port_map_update_period) {
+        publish_channel_mapping_full(lcm);
+    }
     // set the destination port
     lcm->dest_addr.sin_port = htons(chan_port);
 
@@ -1365,9 +2308,11 @@ lcm_mpudpm_handle (lcm_mpudpm_t *lcm)
         // special case:  If we're creating the read thread and are in
         // self-test mode, then only dispatch the self-test message.
         if(!strcmp(lcmb->channel_name, SELF_TEST_CHANNEL))
-            lcm_dispatch_handlers (lcm->lcm, &rbuf, lcmb->channel_name);
+            lcm_dispatch_handlers_retainable (lcm->lcm, &rbuf,
+                    lcmb->channel_name, lcm_buf_retain, lcmb);
     } else {
-        lcm_dispatch_handlers (lcm->lcm, &rbuf, lcmb->channel_name);
+        lcm_dispatch_handlers_retainable (lcm->lcm, &rbuf,
+                lcmb->channel_name, lcm_buf_retain, lcmb);
     }
 
     g_static_mutex_lock (&lcm->receive_lock);
@@ -1554,6 +2499,17 @@ add_recv_socket(lcm_mpudpm_t *lcm, uint16_t port){
     subscriber_socket->port = port;
     subscriber_socket->num_subscribers =0;
     lcm->recv_sockets = g_slist_prepend(lcm->recv_sockets, subscriber_socket);
+
+#ifdef USE_EPOLL
+    // the read thread picks up the new socket on its next epoll_wait()
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = subscriber_socket;
+    if (epoll_ctl(lcm->epoll_fd, EPOLL_CTL_ADD, recv_fd, &ev) < 0) {
+        perror("epoll_ctl (EPOLL_CTL_ADD)");
+    }
+#else
     lcm->recv_sockets_changed = 1;
 
     // Tell read thread that a select should be canceled
@@ -1561,6 +2517,7 @@ add_recv_socket(lcm_mpudpm_t *lcm, uint16_t port){
     if (wstatus < 0) {
         perror(__FILE__ " thread_msg_pipe write: cancel_select");
     }
+#endif
     return subscriber_socket;
 
     add_recv_socket_fail:
@@ -1571,11 +2528,20 @@ add_recv_socket(lcm_mpudpm_t *lcm, uint16_t port){
 // This function assumes that the caller is holding the lcm->receive_lock
 static void
 remove_recv_socket(lcm_mpudpm_t *lcm, mpudpm_socket_t* sock){
+#ifdef USE_EPOLL
+    if (lcm->epoll_fd >= 0 &&
+            epoll_ctl(lcm->epoll_fd, EPOLL_CTL_DEL, sock->fd, NULL) < 0) {
+        perror("epoll_ctl (EPOLL_CTL_DEL)");
+    }
+#else
     // Tell read thread that a select should be canceled
     int wstatus = lcm_internal_pipe_write(lcm->thread_msg_pipe[1], "c", 1);
     if (wstatus < 0) {
         perror(__FILE__ " thread_msg_pipe write: cancel_select");
     }
+#endif
+    // the read thread may still hold a pointer to sock from before it was
+    // removed.  This tells it to drop that pointer.
     lcm->recv_sockets_changed = 1;
 
     lcm->recv_sockets = g_slist_remove(lcm->recv_sockets, sock);
@@ -1652,6 +2618,23 @@ setup_recv_parts (lcm_mpudpm_t *lcm)
     }
     fcntl (lcm->thread_msg_pipe[1], F_SETFL, O_NONBLOCK);
 
+#ifdef USE_EPOLL
+    lcm->epoll_fd = epoll_create(MAX_EPOLL_EVENTS);
+    if (lcm->epoll_fd < 0) {
+        perror("epoll_create");
+        goto setup_recv_thread_fail;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;  // NULL identifies the thread_msg_pipe
+    if (epoll_ctl(lcm->epoll_fd, EPOLL_CTL_ADD, lcm->thread_msg_pipe[0],
+                &ev) < 0) {
+        perror("epoll_ctl (EPOLL_CTL_ADD)");
+        goto setup_recv_thread_fail;
+    }
+#endif
+
     /* Start the reader thread */
     lcm->read_thread = g_thread_create (recv_thread, lcm, TRUE, NULL);
     if (!lcm->read_thread) {
@@ -1718,6 +2701,7 @@ lcm_mpudpm_create (lcm_t * parent, const char *network, const GHashTable *args)
     mpudpm_params_t params;
     memset (&params, 0, sizeof (mpudpm_params_t));
     params.num_mc_ports = 500;
+    params.heavy_channel_rate = 1000000;
 
     g_hash_table_foreach ((GHashTable*) args, new_argument, &params);
 
@@ -1725,6 +2709,27 @@ lcm_mpudpm_create (lcm_t * parent, const char *network, const GHashTable *args)
         return NULL;
     }
 
+    if (!params.traffic_aware) {
+        params.num_dedicated_ports = 0;
+    } else if (params.num_mc_ports < 2) {
+        fprintf(stderr, "Warning: port_assign=traffic needs nports >= 2. "
+                "Falling back to port_assign=hash\n");
+        params.traffic_aware = 0;
+        params.num_dedicated_ports = 0;
+    } else {
+        if (params.num_dedicated_ports == 0) {
+            params.num_dedicated_ports = MAX(1, params.num_mc_ports / 4);
+        }
+        if (params.num_dedicated_ports >= params.num_mc_ports) {
+            fprintf(stderr, "Warning: dedicated_ports must be < nports. "
+                    "Setting to %d\n", params.num_mc_ports - 1);
+            params.num_dedicated_ports = params.num_mc_ports - 1;
+        }
+        if (params.heavy_channel_rate <= 0) {
+            params.heavy_channel_rate = 1000000;
+        }
+    }
+
     lcm_mpudpm_t * lcm = (lcm_mpudpm_t *) calloc (1, sizeof (lcm_mpudpm_t));
 
     lcm->lcm = parent;
@@ -1732,6 +2737,9 @@ lcm_mpudpm_create (lcm_t * parent, const char *network, const GHashTable *args)
     lcm->recv_sockets = NULL;
     lcm->send_fd = -1;
     lcm->thread_msg_pipe[0] = lcm->thread_msg_pipe[1] = -1;
+#ifdef USE_EPOLL
+    lcm->epoll_fd = -1;
+#endif
     lcm->udp_low_watermark = 1.0;
 
     lcm->kernel_rbuf_sz = 0;
@@ -1759,12 +2767,27 @@ lcm_mpudpm_create (lcm_t * parent, const char *network, const GHashTable *args)
     dbg(DBG_LCM,"Multicast to %s on ports %d:%d\n", inet_ntoa(params.mc_addr),
             params.mc_port_range_start,
             params.mc_port_range_start+params.num_mc_ports-1);
+    if (params.traffic_aware) {
+        dbg(DBG_LCM, "Channels over %"G_GINT64_FORMAT" B/s get one of the "
+                "last %d ports to themselves\n", params.heavy_channel_rate,
+                params.num_dedicated_ports);
+    }
 
     // create the channel string to port number hash table
     // we strdup keys so pass free() as the destory function for keys,
     // but store shorts as pointers so no destroy function for values
     lcm->channel_to_port_map = g_hash_table_new_full(g_str_hash, g_str_equal,
             free, NULL );
+    lcm->channel_moves = g_hash_table_new_full(g_str_hash, g_str_equal,
+            free, free);
+    lcm->channel_rates = g_hash_table_new_full(g_str_hash, g_str_equal,
+            free, free);
+    lcm->unsent_mappings = g_hash_table_new_full(g_str_hash, g_str_equal,
+            free, NULL);
+    lcm->mapping_peers = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+            NULL, free);
+    lcm->mapping_sender_id = (int64_t) (((uint64_t) g_random_int() << 32) |
+            g_random_int());
 
     // Create a regex to find whether subscribers use a regex to get a set of
     // channels instead of just listening to a single channel.
@@ -1786,6 +2809,9 @@ lcm_mpudpm_create (lcm_t * parent, const char *network, const GHashTable *args)
     g_hash_table_insert(lcm->channel_to_port_map,
             strdup(CHANNEL_TO_PORT_MAP_REQUEST_CHANNEL),
             GUINT_TO_POINTER(lcm->params.mc_port_range_start));
+    g_hash_table_insert(lcm->channel_to_port_map,
+            strdup(CHANNEL_TO_PORT_MAP_DELTA_CHANNEL),
+            GUINT_TO_POINTER(lcm->params.mc_port_range_start));
     g_hash_table_insert(lcm->channel_to_port_map, strdup(SELF_TEST_CHANNEL),
             GUINT_TO_POINTER(map_channel_to_port(lcm, SELF_TEST_CHANNEL)));
 
@@ -0,0 +1,816 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include <glib.h>
+
+#include "lcm.h"
+#include "lcm_internal.h"
+#include "dbg.h"
+
+/*
+ * Shared memory provider.
+ *
+ * All LCM instances on a host that use the same shm:// name map the same
+ * POSIX shared memory segment.  The segment holds a ring of fixed-size slots,
+ * each of which carries one message.  Publishers claim a sequence number by
+ * atomically incrementing the ring head, copy the message into the slot
+ * seq % num_slots, and then mark it as committed.  Each subscribing instance
+ * runs a thread that follows the ring and notifies lcm_handle() through a
+ * pipe.  Handlers receive a pointer straight into the shared segment.
+ * With lcm_publish_loan(), publishers encode straight into the slot too, so
+ * the message is never copied.
+ *
+ * Readers pin a slot for as long as its handlers run.  A publisher that wraps
+ * around to a pinned slot waits for the pin to be released.  If that takes
+ * too long (e.g., the reader process died while pinned), the publisher marks
+ * the message as skipped instead of overwriting data in use.
+ *
+ * Publishers take ownership of a slot by swapping their sequence number into
+ * slot->claim.  A publisher that wraps around to a slot whose previous
+ * message still hasn't been committed after SHM_WRITE_TIMEOUT_USEC only takes
+ * the slot over if the process filling it has exited, or if the previous
+ * publisher never claimed it.  Otherwise the publish fails, since the slot is
+ * still being written to.  This also applies to loans, which must be
+ * committed before the ring wraps around to them.  Readers skip messages
+ * that stay uncommitted for SHM_STALL_TIMEOUT_USEC.
+ *
+ * Readers that fall more than num_slots messages behind lose messages.
+ *
+ * Each instance attached to the segment is counted in the ring header, and
+ * the last one to detach unlinks it.  Instances that exit without calling
+ * lcm_destroy() are never uncounted, and leave the segment behind.
+ */
+
+#define SHM_MAGIC 0x4c434d53    // hex repr of ascii "LCMS"
+#define SHM_VERSION 2
+
+#define SHM_DEFAULT_NUM_SLOTS 32
+#define SHM_DEFAULT_SLOT_SIZE (1024 * 1024)
+
+// how long a publisher will wait for a slot to become available
+#define SHM_WRITE_TIMEOUT_USEC 1000000
+
+// how long a reader waits for a claimed message to be committed before
+// skipping it.  Longer than a publisher can take to claim and fill a slot.
+#define SHM_STALL_TIMEOUT_USEC (3 * SHM_WRITE_TIMEOUT_USEC)
+
+// how long the reader thread sleeps between checks for new messages when it
+// can't be woken up by the kernel
+#define SHM_POLL_INTERVAL_USEC 1000
+
+#define SHM_ALIGN(x) (((x) + 63) & ~((size_t)63))
+
+// space taken by a slot's header.  The data follows it, preceded by room for
+// a loan header so that publishers can encode directly into the slot.
+#define SHM_SLOT_HDR_SIZE SHM_ALIGN (sizeof (shm_slot_t) + sizeof (lcm_loan_hdr_t))
+
+typedef struct _shm_ring_hdr shm_ring_hdr_t;
+struct _shm_ring_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t slot_size;
+    int64_t  head;          // next sequence number to be claimed
+    uint32_t wake_seq;      // incremented after each commit.  futex word.
+    uint32_t num_waiters;   // number of readers blocked on wake_seq
+    uint32_t num_attached;  // number of instances using the segment
+};
+
+typedef struct _shm_slot shm_slot_t;
+struct _shm_slot {
+    int64_t  seq;           // sequence number of the message in this slot
+    int64_t  claim;         // sequence number of the publisher that owns it
+    int32_t  writing;       // nonzero while a publisher is filling the slot
+    int32_t  pins;          // number of readers currently using the slot
+    int32_t  writer_pid;    // process of the publisher that owns the slot
+    int32_t  datalen;       // -1 if the publisher skipped this message
+    int64_t  utime;         // publish timestamp
+    char     channel[LCM_MAX_CHANNEL_NAME_LENGTH+1];
+};
+
+typedef struct _lcm_provider_t lcm_shm_t;
+struct _lcm_provider_t {
+    lcm_t *lcm;
+    pid_t pid;
+
+    char *shm_name;
+    int shm_fd;
+    size_t shm_size;
+    size_t slot_stride;
+    shm_ring_hdr_t *hdr;
+    char *slots;
+
+    GMutex *mutex;
+    GCond *cond;
+    int64_t rpos;               // sequence number of the next message to read
+    int notify_pending;         // a message is waiting for lcm_handle()
+    int quit;
+
+    int thread_created;
+    GThread *read_thread;
+    int notify_pipe[2];         // pipe to notify application when messages arrive
+};
+
+static inline shm_slot_t *
+slot_at (lcm_shm_t *lcm, int64_t seq)
+{
+    return (shm_slot_t*) (lcm->slots +
+            (seq % lcm->hdr->num_slots) * lcm->slot_stride);
+}
+
+static inline char *
+slot_data (shm_slot_t *slot)
+{
+    return (char*) slot + SHM_SLOT_HDR_SIZE;
+}
+
+static void
+_futex_wait (uint32_t *addr, uint32_t val)
+{
+#ifdef __linux__
+    struct timespec ts = { 0, 100000000 };
+    syscall (SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+#else
+    g_usleep (SHM_POLL_INTERVAL_USEC);
+#endif
+}
+
+static void
+_futex_wake (uint32_t *addr)
+{
+#ifdef __linux__
+    syscall (SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+/* Waits until *addr == val.  Returns 0 on success, -1 on timeout. */
+static int
+_wait_for_int64 (int64_t *addr, int64_t val)
+{
+    int64_t deadline = 0;
+    int spins = 0;
+    while (__atomic_load_n (addr, __ATOMIC_SEQ_CST) != val) {
+        if (++spins < 1000)
+            continue;
+        if (!deadline)
+            deadline = g_get_monotonic_time () + SHM_WRITE_TIMEOUT_USEC;
+        else if (g_get_monotonic_time () >= deadline)
+            return -1;
+        g_usleep (10);
+    }
+    return 0;
+}
+
+static int
+_wait_for_zero (int32_t *addr)
+{
+    int64_t deadline = 0;
+    int spins = 0;
+    while (__atomic_load_n (addr, __ATOMIC_SEQ_CST) != 0) {
+        if (++spins < 1000)
+            continue;
+        if (!deadline)
+            deadline = g_get_monotonic_time () + SHM_WRITE_TIMEOUT_USEC;
+        else if (g_get_monotonic_time () >= deadline)
+            return -1;
+        g_usleep (10);
+    }
+    return 0;
+}
+
+static void
+_destroy_recv_parts (lcm_shm_t *lcm)
+{
+    if (lcm->thread_created) {
+        g_mutex_lock (lcm->mutex);
+        lcm->quit = 1;
+        g_cond_broadcast (lcm->cond);
+        g_mutex_unlock (lcm->mutex);
+        _futex_wake (&lcm->hdr->wake_seq);
+        g_thread_join (lcm->read_thread);
+        lcm->read_thread = NULL;
+        lcm->thread_created = 0;
+    }
+}
+
+void
+lcm_shm_destroy (lcm_shm_t *lcm)
+{
+    dbg (DBG_LCM, "closing lcm context\n");
+    _destroy_recv_parts (lcm);
+
+    if (lcm->hdr) {
+        // the last instance to detach removes the segment
+        if (0 == __atomic_sub_fetch (&lcm->hdr->num_attached, 1,
+                    __ATOMIC_SEQ_CST))
+            shm_unlink (lcm->shm_name);
+        munmap (lcm->hdr, lcm->shm_size);
+    }
+    if (lcm->shm_fd >= 0)
+        close (lcm->shm_fd);
+
+    if (lcm->notify_pipe[0] >= 0) {
+        lcm_internal_pipe_close (lcm->notify_pipe[0]);
+        lcm_internal_pipe_close (lcm->notify_pipe[1]);
+    }
+
+    g_mutex_free (lcm->mutex);
+    g_cond_free (lcm->cond);
+    g_free (lcm->shm_name);
+    free (lcm);
+}
+
+/* This is the reader thread.  It follows the ring, skipping messages that
+ * nobody in this instance is subscribed to, and writes to the notify pipe when
+ * a message is ready for lcm_handle().  It then waits for lcm_handle() to
+ * consume the message before looking at the next one. */
+static void *
+recv_thread (void *user)
+{
+#ifdef G_OS_UNIX
+    // Mask out all signals on this thread.
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+#endif
+
+    lcm_shm_t *lcm = (lcm_shm_t *) user;
+    shm_ring_hdr_t *hdr = lcm->hdr;
+    int64_t num_slots = hdr->num_slots;
+    int64_t stalled_seq = -1;       // claimed message we're waiting on
+    int64_t stalled_since = 0;
+
+    while (1) {
+        g_mutex_lock (lcm->mutex);
+        while (lcm->notify_pending && !lcm->quit)
+            g_cond_wait (lcm->cond, lcm->mutex);
+        int64_t r = lcm->rpos;
+        int quit = lcm->quit;
+        g_mutex_unlock (lcm->mutex);
+        if (quit)
+            break;
+
+        shm_slot_t *slot = slot_at (lcm, r);
+        int64_t seq = __atomic_load_n (&slot->seq, __ATOMIC_SEQ_CST);
+        int32_t writing = __atomic_load_n (&slot->writing, __ATOMIC_SEQ_CST);
+
+        if (seq == r && !writing) {
+            char channel[LCM_MAX_CHANNEL_NAME_LENGTH+1];
+            memcpy (channel, slot->channel, sizeof (channel));
+            channel[LCM_MAX_CHANNEL_NAME_LENGTH] = 0;
+            int32_t datalen = slot->datalen;
+            int valid = !__atomic_load_n (&slot->writing, __ATOMIC_SEQ_CST) &&
+                __atomic_load_n (&slot->seq, __ATOMIC_SEQ_CST) == r;
+
+            int wanted = valid && datalen >= 0 &&
+                lcm_has_handlers (lcm->lcm, channel);
+
+            g_mutex_lock (lcm->mutex);
+            if (wanted) {
+                lcm->notify_pending = 1;
+                if (lcm_internal_pipe_write (lcm->notify_pipe[1], "+", 1) < 0)
+                    perror ("write to notify");
+            } else if (valid) {
+                lcm->rpos = r + 1;
+            }
+            // if the slot was overwritten while reading it, the next pass
+            // through the loop takes care of it.
+            g_mutex_unlock (lcm->mutex);
+        } else if (seq > r || (seq == r && writing)) {
+            // publishers have lapped us.  skip ahead to the oldest message
+            // still available.
+            int64_t head = __atomic_load_n (&hdr->head, __ATOMIC_SEQ_CST);
+            int64_t next = MAX (r + 1, head - num_slots + 1);
+            dbg (DBG_LCM, "shm: reader overrun, dropped %" G_GINT64_FORMAT
+                    " messages\n", next - r);
+            g_mutex_lock (lcm->mutex);
+            lcm->rpos = next;
+            g_mutex_unlock (lcm->mutex);
+        } else {
+            // nothing new.  If message r was claimed long ago but is still
+            // not committed, its publisher has stalled or exited, so give up
+            // on it.
+            int64_t head = __atomic_load_n (&hdr->head, __ATOMIC_SEQ_CST);
+            if (head <= r) {
+                stalled_seq = -1;
+            } else if (r != stalled_seq) {
+                stalled_seq = r;
+                stalled_since = g_get_monotonic_time ();
+            } else if (g_get_monotonic_time () - stalled_since >
+                    SHM_STALL_TIMEOUT_USEC) {
+                dbg (DBG_LCM, "shm: message %" G_GINT64_FORMAT " was never "
+                        "committed, skipping it\n", r);
+                g_mutex_lock (lcm->mutex);
+                lcm->rpos = r + 1;
+                g_mutex_unlock (lcm->mutex);
+                continue;
+            }
+
+            // sleep until a publisher commits a message.
+            __atomic_add_fetch (&hdr->num_waiters, 1, __ATOMIC_SEQ_CST);
+            uint32_t wake_seq = __atomic_load_n (&hdr->wake_seq,
+                    __ATOMIC_SEQ_CST);
+            if (__atomic_load_n (&slot->seq, __ATOMIC_SEQ_CST) < r &&
+                    !lcm->quit)
+                _futex_wait (&hdr->wake_seq, wake_seq);
+            __atomic_sub_fetch (&hdr->num_waiters, 1, __ATOMIC_SEQ_CST);
+        }
+    }
+    dbg (DBG_LCM, "read thread exiting\n");
+    return NULL;
+}
+
+static int
+_setup_recv_parts (lcm_shm_t *lcm)
+{
+    g_mutex_lock (lcm->mutex);
+    if (lcm->thread_created) {
+        g_mutex_unlock (lcm->mutex);
+        return 0;
+    }
+
+    // only messages published from now on are received
+    lcm->rpos = __atomic_load_n (&lcm->hdr->head, __ATOMIC_SEQ_CST);
+    lcm->notify_pending = 0;
+    lcm->quit = 0;
+
+    lcm->read_thread = g_thread_create (recv_thread, lcm, TRUE, NULL);
+    if (!lcm->read_thread) {
+        fprintf (stderr, "Error: LCM failed to start reader thread\n");
+        g_mutex_unlock (lcm->mutex);
+        return -1;
+    }
+    lcm->thread_created = 1;
+    g_mutex_unlock (lcm->mutex);
+    return 0;
+}
+
+static int
+lcm_shm_get_fileno (lcm_shm_t *lcm)
+{
+    if (_setup_recv_parts (lcm) < 0)
+        return -1;
+    return lcm->notify_pipe[0];
+}
+
+static int
+lcm_shm_subscribe (lcm_shm_t *lcm, const char *channel)
+{
+    return _setup_recv_parts (lcm);
+}
+
+static int
+_check_message_size (lcm_shm_t *lcm, const char *channel, unsigned int datalen)
+{
+    if (strlen (channel) > LCM_MAX_CHANNEL_NAME_LENGTH) {
+        fprintf (stderr, "LCM Error: channel name too long [%s]\n", channel);
+        return -1;
+    }
+    if (datalen > lcm->hdr->slot_size) {
+        fprintf (stderr, "LCM Error: %u byte message on [%s] is larger than "
+                "the shm slot size (%u bytes)\n", datalen, channel,
+                lcm->hdr->slot_size);
+        return -1;
+    }
+    return 0;
+}
+
+/* Makes the slot for message seq visible to readers, and wakes them up. */
+static void
+_commit_slot (lcm_shm_t *lcm, shm_slot_t *slot, int64_t seq)
+{
+    shm_ring_hdr_t *hdr = lcm->hdr;
+    __atomic_store_n (&slot->seq, seq, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&slot->writing, 0, __ATOMIC_SEQ_CST);
+
+    // wake up any waiting readers
+    __atomic_add_fetch (&hdr->wake_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&hdr->num_waiters, __ATOMIC_SEQ_CST) > 0)
+        _futex_wake (&hdr->wake_seq);
+}
+
+/* Returns nonzero if the slot was left behind by a publisher that can no
+ * longer commit it, given that owner is the sequence number that last claimed
+ * it. */
+static int
+_slot_abandoned (shm_slot_t *slot, int64_t owner, int64_t prev)
+{
+    if (!__atomic_load_n (&slot->writing, __ATOMIC_SEQ_CST)) {
+        // the publisher of message prev never got to claim the slot
+        return owner < prev;
+    }
+    // the process filling the slot has exited
+    pid_t pid = __atomic_load_n (&slot->writer_pid, __ATOMIC_SEQ_CST);
+    return pid > 0 && kill (pid, 0) < 0 && errno == ESRCH;
+}
+
+/* Claims the slot for the next message, and prepares it to be filled in.
+ * Returns NULL if the slot can't be used.  Either the previous publisher of
+ * the slot has stalled, or a reader is still using the slot, in which case
+ * the message has already been skipped. */
+static shm_slot_t *
+_claim_slot (lcm_shm_t *lcm, const char *channel, int64_t *seq_out)
+{
+    int64_t num_slots = lcm->hdr->num_slots;
+    int64_t seq = __atomic_fetch_add (&lcm->hdr->head, 1, __ATOMIC_SEQ_CST);
+    shm_slot_t *slot = slot_at (lcm, seq);
+    int64_t prev = seq - num_slots;
+
+    // wait for the publisher of the previous message in this slot to commit
+    // it, then take the slot over
+    int64_t owner = prev;
+    if (0 != _wait_for_int64 (&slot->seq, prev) ||
+            !__atomic_compare_exchange_n (&slot->claim, &owner, seq, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        // It's still filling in the slot, or it never claimed it.  Only take
+        // the slot over if nobody can be writing to it anymore.
+        owner = __atomic_load_n (&slot->claim, __ATOMIC_SEQ_CST);
+        if (owner >= seq || !_slot_abandoned (slot, owner, prev) ||
+                !__atomic_compare_exchange_n (&slot->claim, &owner, seq, 0,
+                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            fprintf (stderr, "LCM Error: shm publisher on slot %d has "
+                    "stalled.  Dropping message on [%s]\n",
+                    (int) (seq % num_slots), channel);
+            return NULL;
+        }
+        fprintf (stderr, "LCM Warning: taking over shm slot %d from a "
+                "publisher that exited\n", (int) (seq % num_slots));
+    }
+
+    // keep new readers out of the slot, and wait for current readers to
+    // finish
+    __atomic_store_n (&slot->writer_pid, lcm->pid, __ATOMIC_SEQ_CST);
+    __atomic_store_n (&slot->writing, 1, __ATOMIC_SEQ_CST);
+    if (0 != _wait_for_zero (&slot->pins)) {
+        // a reader is still using the old data.  Don't touch it, and tell
+        // everybody to skip this message.
+        fprintf (stderr, "LCM Warning: shm slot %d is pinned by a reader. "
+                "Dropping message on [%s]\n", (int) (seq % num_slots),
+                channel);
+        slot->datalen = -1;
+        _commit_slot (lcm, slot, seq);
+        return NULL;
+    }
+
+    strcpy (slot->channel, channel);
+    GTimeVal tv;
+    g_get_current_time (&tv);
+    slot->utime = (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+    *seq_out = seq;
+    return slot;
+}
+
+static int
+lcm_shm_publish (lcm_shm_t *lcm, const char *channel, const void *data,
+        unsigned int datalen)
+{
+    if (0 != _check_message_size (lcm, channel, datalen))
+        return -1;
+
+    int64_t seq;
+    shm_slot_t *slot = _claim_slot (lcm, channel, &seq);
+    if (!slot)
+        return -1;
+    slot->datalen = datalen;
+    memcpy (slot_data (slot), data, datalen);
+    _commit_slot (lcm, slot, seq);
+    return 0;
+}
+
+static void *
+lcm_shm_publish_loan (lcm_shm_t *lcm, const char *channel,
+        unsigned int datalen)
+{
+    if (0 != _check_message_size (lcm, channel, datalen))
+        return NULL;
+
+    int64_t seq;
+    shm_slot_t *slot = _claim_slot (lcm, channel, &seq);
+    if (!slot) {
+        // The message is already lost, but the caller still needs somewhere
+        // to encode it.
+        return lcm_heap_loan_new (lcm->lcm, channel, datalen);
+    }
+    lcm_loan_hdr_t *loan = LCM_LOAN_HDR (slot_data (slot));
+    loan->owner = slot;
+    loan->channel = slot->channel;
+    loan->size = datalen;
+    loan->tag = seq;
+    return slot_data (slot);
+}
+
+static int
+lcm_shm_publish_commit (lcm_shm_t *lcm, void *buf, unsigned int datalen)
+{
+    lcm_loan_hdr_t *loan = LCM_LOAN_HDR (buf);
+    if (!loan->owner) {
+        lcm_heap_loan_free (lcm->lcm, buf);
+        return -1;
+    }
+    shm_slot_t *slot = (shm_slot_t*) loan->owner;
+    slot->datalen = datalen;
+    _commit_slot (lcm, slot, loan->tag);
+    return 0;
+}
+
+static void
+lcm_shm_publish_abort (lcm_shm_t *lcm, void *buf)
+{
+    lcm_loan_hdr_t *loan = LCM_LOAN_HDR (buf);
+    if (!loan->owner) {
+        lcm_heap_loan_free (lcm->lcm, buf);
+        return;
+    }
+    // readers skip it
+    shm_slot_t *slot = (shm_slot_t*) loan->owner;
+    slot->datalen = -1;
+    _commit_slot (lcm, slot, loan->tag);
+}
+
+static int
+lcm_shm_handle (lcm_shm_t *lcm)
+{
+    char ch;
+    if (0 != _setup_recv_parts (lcm))
+        return -1;
+
+    /* Read one byte from the notify pipe.  This will block if no messages are
+     * available yet and wake up when they are. */
+    int status = lcm_internal_pipe_read (lcm->notify_pipe[0], &ch, 1);
+    if (status == 0) {
+        fprintf (stderr, "Error: lcm_handle read 0 bytes from notify_pipe\n");
+        return -1;
+    }
+    else if (status < 0) {
+        fprintf (stderr, "Error: lcm_handle read: %s\n", strerror (errno));
+        return -1;
+    }
+
+    g_mutex_lock (lcm->mutex);
+    int64_t r = lcm->rpos;
+    g_mutex_unlock (lcm->mutex);
+
+    // pin the slot so that publishers don't overwrite it while the handlers
+    // are running, then make sure it still holds the message we want.
+    shm_slot_t *slot = slot_at (lcm, r);
+    __atomic_add_fetch (&slot->pins, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n (&slot->writing, __ATOMIC_SEQ_CST) &&
+            __atomic_load_n (&slot->seq, __ATOMIC_SEQ_CST) == r) {
+        char channel[LCM_MAX_CHANNEL_NAME_LENGTH+1];
+        memcpy (channel, slot->channel, sizeof (channel));
+        channel[LCM_MAX_CHANNEL_NAME_LENGTH] = 0;
+
+        if (slot->datalen >= 0 && lcm_try_enqueue_message (lcm->lcm, channel)) {
+            lcm_recv_buf_t rbuf;
+            rbuf.data = slot_data (slot);
+            rbuf.data_size = slot->datalen;
+            rbuf.recv_utime = slot->utime;
+            rbuf.lcm = lcm->lcm;
+            lcm_dispatch_handlers (lcm->lcm, &rbuf, channel);
+        }
+    } else {
+        dbg (DBG_LCM, "shm: message overwritten before it was handled\n");
+    }
+    __atomic_sub_fetch (&slot->pins, 1, __ATOMIC_SEQ_CST);
+
+    // let the reader thread look for the next message
+    g_mutex_lock (lcm->mutex);
+    lcm->rpos = r + 1;
+    lcm->notify_pending = 0;
+    g_cond_broadcast (lcm->cond);
+    g_mutex_unlock (lcm->mutex);
+
+    return 0;
+}
+
+/* Counts this instance as a user of the segment.  Returns -1 if the last
+ * user has already detached, in which case the segment is being unlinked. */
+static int
+_attach (shm_ring_hdr_t *hdr)
+{
+    uint32_t n = __atomic_load_n (&hdr->num_attached, __ATOMIC_SEQ_CST);
+    do {
+        if (n == 0)
+            return -1;
+    } while (!__atomic_compare_exchange_n (&hdr->num_attached, &n, n + 1, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+    return 0;
+}
+
+/* Opens the shared memory segment, creating and initializing it if this is
+ * the first instance to use it.  Returns 1 if the segment was being removed,
+ * in which case it should be opened again. */
+static int
+_open_segment (lcm_shm_t *lcm, uint32_t num_slots, uint32_t slot_size)
+{
+    size_t slot_stride = SHM_SLOT_HDR_SIZE + SHM_ALIGN (slot_size);
+    size_t size = SHM_ALIGN (sizeof (shm_ring_hdr_t)) + num_slots * slot_stride;
+    int created = 0;
+
+    lcm->shm_fd = shm_open (lcm->shm_name, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (lcm->shm_fd >= 0) {
+        created = 1;
+        fchmod (lcm->shm_fd, 0666);
+        if (ftruncate (lcm->shm_fd, size) < 0) {
+            perror ("shm ftruncate");
+            shm_unlink (lcm->shm_name);
+            return -1;
+        }
+    } else if (errno == EEXIST) {
+        lcm->shm_fd = shm_open (lcm->shm_name, O_RDWR, 0666);
+    }
+    if (lcm->shm_fd < 0) {
+        perror ("shm_open");
+        return -1;
+    }
+
+    if (!created) {
+        // another instance created the segment.  wait for it to finish
+        // initializing, then use its ring geometry.
+        shm_ring_hdr_t *hdr = NULL;
+        int i;
+        for (i = 0; i < 1000; i++) {
+            struct stat st;
+            if (fstat (lcm->shm_fd, &st) < 0) {
+                perror ("shm fstat");
+                return -1;
+            }
+            if (!hdr && st.st_size >= sizeof (shm_ring_hdr_t)) {
+                hdr = (shm_ring_hdr_t*) mmap (NULL, sizeof (shm_ring_hdr_t),
+                        PROT_READ, MAP_SHARED, lcm->shm_fd, 0);
+                if (hdr == MAP_FAILED) {
+                    perror ("shm mmap");
+                    return -1;
+                }
+            }
+            if (hdr && __atomic_load_n (&hdr->magic, __ATOMIC_SEQ_CST) ==
+                    SHM_MAGIC)
+                break;
+            g_usleep (1000);
+        }
+        if (!hdr || hdr->magic != SHM_MAGIC || hdr->version != SHM_VERSION) {
+            fprintf (stderr, "Error: shared memory segment %s is not a "
+                    "valid LCM ring\n", lcm->shm_name);
+            if (hdr)
+                munmap (hdr, sizeof (shm_ring_hdr_t));
+            return -1;
+        }
+        if (hdr->num_slots != num_slots || hdr->slot_size != slot_size) {
+            dbg (DBG_LCM, "shm: using existing ring geometry %u x %u\n",
+                    hdr->num_slots, hdr->slot_size);
+        }
+        num_slots = hdr->num_slots;
+        slot_size = hdr->slot_size;
+        munmap (hdr, sizeof (shm_ring_hdr_t));
+        slot_stride = SHM_SLOT_HDR_SIZE + SHM_ALIGN (slot_size);
+        size = SHM_ALIGN (sizeof (shm_ring_hdr_t)) + num_slots * slot_stride;
+    }
+
+    void *addr = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            lcm->shm_fd, 0);
+    if (addr == MAP_FAILED) {
+        perror ("shm mmap");
+        return -1;
+    }
+    if (!created && 0 != _attach ((shm_ring_hdr_t*) addr)) {
+        munmap (addr, size);
+        close (lcm->shm_fd);
+        lcm->shm_fd = -1;
+        return 1;
+    }
+    lcm->hdr = (shm_ring_hdr_t*) addr;
+    lcm->shm_size = size;
+    lcm->slot_stride = slot_stride;
+    lcm->slots = (char*) addr + SHM_ALIGN (sizeof (shm_ring_hdr_t));
+
+    if (created) {
+        lcm->hdr->version = SHM_VERSION;
+        lcm->hdr->num_slots = num_slots;
+        lcm->hdr->slot_size = slot_size;
+        lcm->hdr->head = 0;
+        lcm->hdr->wake_seq = 0;
+        lcm->hdr->num_waiters = 0;
+        lcm->hdr->num_attached = 1;
+        int64_t i;
+        for (i = 0; i < num_slots; i++) {
+            shm_slot_t *slot = slot_at (lcm, i);
+            slot->seq = i - num_slots;
+            slot->claim = i - num_slots;
+            slot->writing = 0;
+            slot->writer_pid = 0;
+            slot->pins = 0;
+            slot->datalen = -1;
+        }
+        // publish the segment to other instances
+        __atomic_store_n (&lcm->hdr->magic, SHM_MAGIC, __ATOMIC_SEQ_CST);
+    }
+    return 0;
+}
+
+static int
+_parse_uint_arg (GHashTable *args, const char *key, uint32_t *result)
+{
+    const char *value = (const char*) g_hash_table_lookup (args, key);
+    if (!value)
+        return 0;
+    char *endptr = NULL;
+    long v = strtol (value, &endptr, 0);
+    if (endptr == value || *endptr || v <= 0 || v > INT_MAX) {
+        fprintf (stderr, "Error: Invalid value for %s\n", key);
+        return -1;
+    }
+    *result = v;
+    return 0;
+}
+
+lcm_provider_t *
+lcm_shm_create (lcm_t * parent, const char *target, const GHashTable *args)
+{
+    uint32_t num_slots = SHM_DEFAULT_NUM_SLOTS;
+    uint32_t slot_size = SHM_DEFAULT_SLOT_SIZE;
+
+    if (!target || !strlen (target))
+        target = "lcm";
+    const char *c;
+    for (c = target; *c; c++) {
+        if (!g_ascii_isalnum (*c) && *c != '_' && *c != '-' && *c != '.') {
+            fprintf (stderr, "Error: invalid shm name \"%s\"\n", target);
+            return NULL;
+        }
+    }
+
+    if (_parse_uint_arg ((GHashTable*) args, "slots", &num_slots) < 0 ||
+        _parse_uint_arg ((GHashTable*) args, "slot_size", &slot_size) < 0)
+        return NULL;
+
+    lcm_shm_t *lcm = (lcm_shm_t *) calloc (1, sizeof (lcm_shm_t));
+    lcm->lcm = parent;
+    lcm->pid = getpid ();
+    lcm->shm_fd = -1;
+    lcm->notify_pipe[0] = lcm->notify_pipe[1] = -1;
+    lcm->mutex = g_mutex_new ();
+    lcm->cond = g_cond_new ();
+    lcm->shm_name = g_strdup_printf ("/lcm-shm-%s", target);
+
+    dbg (DBG_LCM, "Initializing LCM SHM context (%s)...\n", lcm->shm_name);
+
+    int status;
+    int tries = 0;
+    while (1 == (status = _open_segment (lcm, num_slots, slot_size)) &&
+            ++tries < 1000)
+        g_usleep (1000);
+    if (0 != status) {
+        lcm_shm_destroy (lcm);
+        return NULL;
+    }
+
+    // internal notification pipe
+    if (0 != lcm_internal_pipe_create (lcm->notify_pipe)) {
+        perror (__FILE__ " pipe(create)");
+        lcm_shm_destroy (lcm);
+        return NULL;
+    }
+    fcntl (lcm->notify_pipe[1], F_SETFL, O_NONBLOCK);
+
+    // don't start the reader thread yet.  Only allocate resources for
+    // receiving messages when a subscription is made.
+    return lcm;
+}
+
+static lcm_provider_vtable_t shm_vtable;
+static lcm_provider_info_t shm_info;
+
+void
+lcm_shm_provider_init (GPtrArray * providers)
+{
+    shm_vtable.create      = lcm_shm_create;
+    shm_vtable.destroy     = lcm_shm_destroy;
+    shm_vtable.subscribe   = lcm_shm_subscribe;
+    shm_vtable.unsubscribe = NULL;
+    shm_vtable.publish     = lcm_shm_publish;
+    shm_vtable.handle      = lcm_shm_handle;
+    shm_vtable.get_fileno  = lcm_shm_get_fileno;
+    shm_vtable.publish_loan   = lcm_shm_publish_loan;
+    shm_vtable.publish_commit = lcm_shm_publish_commit;
+    shm_vtable.publish_abort  = lcm_shm_publish_abort;
+
+    shm_info.name = "shm";
+    shm_info.vtable = &shm_vtable;
+
+    g_ptr_array_add (providers, &shm_info);
+}
@@ -11,6 +11,7 @@
 #include <netdb.h>
 #include <sys/time.h>
 #include <signal.h>
+#include <netinet/tcp.h>
 #else
 #include "windows/WinPorting.h"
 #include <winsock2.h>
@@ -28,6 +29,16 @@
 #define MESSAGE_TYPE_SUBSCRIBE   2
 #define MESSAGE_TYPE_UNSUBSCRIBE 3
 
+// initial size of the receive buffer.  It grows if a single frame doesn't fit.
+#define RECV_BUF_SIZE (256 * 1024)
+
+// default for how long a coalesced frame may wait before it is sent
+#define DEFAULT_COALESCE_USEC 1000
+
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
 typedef struct _lcm_provider_t lcm_tcpq_t;
 struct _lcm_provider_t {
     lcm_t * lcm;
@@ -35,16 +46,46 @@ struct _lcm_provider_t {
 
     char *recv_channel_buf;
     uint32_t recv_channel_buf_len;
-    void *data_buf;
-    uint32_t data_buf_len;
+
+    // Bytes received from the server.  Frames are parsed out of
+    // [recv_buf_pos, recv_buf_len), and new data is appended at recv_buf_len.
+    uint8_t *recv_buf;
+    uint32_t recv_buf_size;
+    uint32_t recv_buf_pos;
+    uint32_t recv_buf_len;
 
     char *server_addr_str;
     struct in_addr server_addr;
     uint16_t server_port;
     GSList* subs;
+
+    // socket options
+    int nodelay;
+    int cork;
+
+    // If coalesce_bytes is non-zero, published frames are collected in
+    // send_buf and sent together once coalesce_bytes have accumulated, or
+    // coalesce_usec after the oldest one was published, whichever is first.
+    // With cork, frames are written to the socket right away, and the
+    // kernel holds them back until coalesce_usec after the oldest one.
+    uint32_t coalesce_bytes;
+    int64_t coalesce_usec;
+
+    // guards send_buf and all writes to the socket
+    GMutex *send_lock;
+    GCond *send_cond;
+    uint8_t *send_buf;
+    uint32_t send_buf_size;
+    uint32_t send_buf_len;
+    int corked_len;             // bytes held back by TCP_CORK
+    int64_t send_buf_deadline;
+
+    GThread *flush_thread;
+    int flush_thread_exit;
 };
 
-static int _sub_unsub_helper(lcm_tcpq_t *self, const char *channel, uint32_t msg_type);
+static int _send_sub_unsub(lcm_tcpq_t *self, const char *channel, uint32_t msg_type);
+static int _flush(lcm_tcpq_t *self);
 
 static int
 _close_socket(int fd)
@@ -106,6 +147,56 @@ _send_fully(int fd, const void *b, int len)
     return cnt;
 }
 
+// Sends all the data in iov, which is modified along the way.  flags is
+// MSG_MORE if more data is about to be sent.
+static int
+_send_iov_fully(int fd, struct iovec *iov, int iovcnt, int flags)
+{
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+
+    while(iovcnt > 0) {
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        int thiscnt = sendmsg(fd, &msg, flags);
+        if(thiscnt<0) {
+            if(errno == EINTR)
+                continue;
+            perror("_send_iov_fully");
+            return -1;
+        }
+        if(thiscnt == 0) {
+            return -1;
+        }
+        // skip over whatever was sent
+        while(iovcnt > 0 && thiscnt >= (int) iov->iov_len) {
+            thiscnt -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if(iovcnt > 0) {
+            iov->iov_base = (char*) iov->iov_base + thiscnt;
+            iov->iov_len -= thiscnt;
+        }
+    }
+    return 0;
+}
+
+// Pushes out anything the kernel is holding back because of TCP_CORK
+static void
+_uncork(lcm_tcpq_t *self)
+{
+#ifdef TCP_CORK
+    if(self->corked_len) {
+        int opt = 0;
+        setsockopt(self->socket, IPPROTO_TCP, TCP_CORK, &opt, sizeof(opt));
+        opt = 1;
+        setsockopt(self->socket, IPPROTO_TCP, TCP_CORK, &opt, sizeof(opt));
+    }
+#endif
+    self->corked_len = 0;
+}
+
 static int
 _recv_uint32(int fd, uint32_t *result)
 {
@@ -126,13 +217,30 @@ _send_uint32(int fd, uint32_t v)
 static void
 lcm_tcpq_destroy (lcm_tcpq_t *self)
 {
+    if(self->flush_thread) {
+        g_mutex_lock(self->send_lock);
+        self->flush_thread_exit = 1;
+        g_cond_broadcast(self->send_cond);
+        g_mutex_unlock(self->send_lock);
+        g_thread_join(self->flush_thread);
+    }
+    if(self->socket >= 0) {
+        g_mutex_lock(self->send_lock);
+        _flush(self);
+        g_mutex_unlock(self->send_lock);
+    }
     g_slist_free(self->subs);
     if(self->socket >= 0)
         _close_socket(self->socket);
     if(self->server_addr_str)
         g_free(self->server_addr_str);
     free(self->recv_channel_buf);
-    free(self->data_buf);
+    free(self->recv_buf);
+    free(self->send_buf);
+    if(self->send_cond)
+        g_cond_free(self->send_cond);
+    if(self->send_lock)
+        g_mutex_free(self->send_lock);
     free(self);
 }
 
@@ -141,12 +249,20 @@ _connect_to_server(lcm_tcpq_t *self)
 {
     fprintf(stderr, "LCM tcpq: connecting...\n");
 
+    g_mutex_lock(self->send_lock);
     if(self->socket)
         _close_socket(self->socket);
 
+    // anything left over from a previous connection is garbage now
+    self->recv_buf_pos = 0;
+    self->recv_buf_len = 0;
+    self->send_buf_len = 0;
+    self->corked_len = 0;
+
     self->socket=socket(AF_INET,SOCK_STREAM,0);
     if(self->socket < 0) {
         perror("lcm_tcpq socket");
+        g_mutex_unlock(self->send_lock);
         return -1;
     }
 
@@ -177,25 +293,149 @@ _connect_to_server(lcm_tcpq_t *self)
         goto fail;
     }
 
+    // every frame goes out in a single write, so there's no need for Nagle's
+    // algorithm to wait for the rest of it
+    int opt = self->nodelay;
+    if(setsockopt(self->socket, IPPROTO_TCP, TCP_NODELAY, (char*) &opt,
+                sizeof(opt)) < 0) {
+        perror("lcm_tcpq setsockopt(TCP_NODELAY)");
+    }
+#ifdef TCP_CORK
+    if(self->cork) {
+        opt = 1;
+        if(setsockopt(self->socket, IPPROTO_TCP, TCP_CORK, &opt,
+                    sizeof(opt)) < 0) {
+            perror("lcm_tcpq setsockopt(TCP_CORK)");
+        }
+    }
+#endif
+
     for(GSList* elem=self->subs; elem; elem=elem->next) {
         gchar* channel = (char*)elem->data;
-        if(0 != _sub_unsub_helper(self, channel, MESSAGE_TYPE_SUBSCRIBE))
+        if(0 != _send_sub_unsub(self, channel, MESSAGE_TYPE_SUBSCRIBE))
         {
             fprintf(stderr, "LCM tcpq: error while subscribing to %s\n", channel);
             goto fail;
         }
     }
+    _uncork(self);
 
     dbg(DBG_LCM, "LCM tcpq: connected (%d)\n", self->socket);
+    g_mutex_unlock(self->send_lock);
     return 0;
 
 fail:
         fprintf(stderr, "LCM tcpq: Unable to connect to server\n");
         _close_socket(self->socket);
         self->socket = -1;
+        g_mutex_unlock(self->send_lock);
         return -1;
 }
 
+// Writes published frames that are waiting in send_buf to the socket.
+// flags is MSG_MORE if another frame is about to follow them.
+// This function assumes that the caller is holding the send_lock
+static int
+_write_send_buf(lcm_tcpq_t *self, int flags)
+{
+    if(!self->send_buf_len)
+        return 0;
+    struct iovec iov;
+    iov.iov_base = (char*) self->send_buf;
+    iov.iov_len = self->send_buf_len;
+    self->send_buf_len = 0;
+    if(self->socket < 0 || _send_iov_fully(self->socket, &iov, 1, flags))
+        return -1;
+    if(self->cork)
+        self->corked_len += iov.iov_len;
+    return 0;
+}
+
+// Sends every published frame that is being held back, either in send_buf
+// or by TCP_CORK.
+// This function assumes that the caller is holding the send_lock
+static int
+_flush(lcm_tcpq_t *self)
+{
+    int status = _write_send_buf(self, 0);
+    if(self->socket >= 0)
+        _uncork(self);
+    else
+        self->corked_len = 0;
+    return status;
+}
+
+// Sends coalesced frames once they reach their deadline
+static gpointer
+_flush_thread(gpointer user_data)
+{
+    lcm_tcpq_t *self = (lcm_tcpq_t*) user_data;
+    g_mutex_lock(self->send_lock);
+    while(!self->flush_thread_exit) {
+        if(!self->send_buf_len && !self->corked_len) {
+            g_cond_wait(self->send_cond, self->send_lock);
+            continue;
+        }
+        if(timestamp_now() < self->send_buf_deadline) {
+            GTimeVal deadline;
+            deadline.tv_sec = self->send_buf_deadline / 1000000;
+            deadline.tv_usec = self->send_buf_deadline % 1000000;
+            g_cond_timed_wait(self->send_cond, self->send_lock, &deadline);
+            continue;
+        }
+        if(_flush(self) && self->socket >= 0) {
+            // The application's thread may be blocked on the socket, so
+            // don't close it out from under it.  Shutting it down makes the
+            // next call on that thread notice, and reconnect.
+            dbg(DBG_LCM, "LCM tcpq: send failed, shutting down socket\n");
+            shutdown(self->socket, 2);
+        }
+    }
+    g_mutex_unlock(self->send_lock);
+    return NULL;
+}
+
+static void
+new_argument (gpointer key, gpointer value, gpointer user)
+{
+    lcm_tcpq_t *self = (lcm_tcpq_t *) user;
+    char *endptr = NULL;
+    if (!strcmp ((char *) key, "nodelay")) {
+        self->nodelay = strtol ((char *) value, &endptr, 0);
+        if (endptr == value)
+            fprintf (stderr, "Warning: Invalid value for nodelay\n");
+    }
+    else if (!strcmp ((char *) key, "cork")) {
+        self->cork = strtol ((char *) value, &endptr, 0);
+        if (endptr == value)
+            fprintf (stderr, "Warning: Invalid value for cork\n");
+#ifndef TCP_CORK
+        if (self->cork)
+            fprintf (stderr, "Warning: cork is not supported on this "
+                    "platform\n");
+        self->cork = 0;
+#endif
+    }
+    else if (!strcmp ((char *) key, "coalesce_bytes")) {
+        long v = strtol ((char *) value, &endptr, 0);
+        if (endptr == value || v < 0)
+            fprintf (stderr, "Warning: Invalid value for coalesce_bytes\n");
+        else
+            self->coalesce_bytes = v;
+    }
+    else if (!strcmp ((char *) key, "coalesce_usec")) {
+        long v = strtol ((char *) value, &endptr, 0);
+        if (endptr == value || v < 0)
+            fprintf (stderr, "Warning: Invalid value for coalesce_usec\n");
+        else
+            self->coalesce_usec = v;
+    }
+    else {
+        fprintf(stderr, "%s:%d -- unknown provider argument %s\n",
+                __FILE__, __LINE__, (char *)key);
+    }
+}
+
 static lcm_provider_t *
 lcm_tcpq_create(lcm_t * parent, const char *network, const GHashTable *args)
 {
@@ -211,10 +451,16 @@ lcm_tcpq_create(lcm_t * parent, const char *network, const GHashTable *args)
     self->recv_channel_buf_len = 64;
     self->recv_channel_buf = (char*) calloc(1, self->recv_channel_buf_len);
 
-    self->data_buf_len = 1024;
-    self->data_buf = calloc(1, self->data_buf_len);
+    self->recv_buf_size = RECV_BUF_SIZE;
+    self->recv_buf = (uint8_t*) malloc(self->recv_buf_size);
     self->subs = NULL;
 
+    self->nodelay = 1;
+    self->coalesce_usec = DEFAULT_COALESCE_USEC;
+    self->send_lock = g_mutex_new();
+    self->send_cond = g_cond_new();
+    g_hash_table_foreach ((GHashTable*) args, new_argument, self);
+
     // parse server address and port
     if (!network || !strlen(network)) {
         network = "127.0.0.1:7700";
@@ -253,6 +499,17 @@ lcm_tcpq_create(lcm_t * parent, const char *network, const GHashTable *args)
 
     _connect_to_server(self);
 
+    if(self->coalesce_bytes || self->cork) {
+        dbg(DBG_LCM, "Coalescing up to %d bytes for up to %d usec\n",
+                (int) self->coalesce_bytes, (int) self->coalesce_usec);
+        self->flush_thread = g_thread_create(_flush_thread, self, TRUE, NULL);
+        if(!self->flush_thread) {
+            fprintf(stderr, "LCM tcpq: failed to start flush thread\n");
+            lcm_tcpq_destroy(self);
+            return NULL;
+        }
+    }
+
     return self;
 }
 
@@ -262,6 +519,24 @@ lcm_tcpq_get_fileno(lcm_tcpq_t *self)
     return self->socket;
 }
 
+// This function assumes that the caller is holding the send_lock
+static int
+_send_sub_unsub(lcm_tcpq_t *self, const char *channel, uint32_t msg_type)
+{
+    uint32_t channel_len = strlen(channel);
+    uint32_t header[2] = { htonl(msg_type), htonl(channel_len) };
+    struct iovec iov[2];
+    iov[0].iov_base = (char*) header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (char*) channel;
+    iov[1].iov_len = channel_len;
+    if(_send_iov_fully(self->socket, iov, 2, 0))
+        return -1;
+    if(self->cork)
+        self->corked_len += sizeof(header) + channel_len;
+    return 0;
+}
+
 static int
 _sub_unsub_helper(lcm_tcpq_t *self, const char *channel, uint32_t msg_type)
 {
@@ -270,17 +545,21 @@ _sub_unsub_helper(lcm_tcpq_t *self, const char *channel, uint32_t msg_type)
         return -1;
     }
 
-    uint32_t channel_len = strlen(channel);
-    if(_send_uint32(self->socket, msg_type) ||
-       _send_uint32(self->socket, channel_len) ||
-       (channel_len != _send_fully(self->socket, channel, channel_len)))
+    g_mutex_lock(self->send_lock);
+    // keep (un)subscriptions in order with messages that were published
+    // before them
+    if(_write_send_buf(self, MSG_MORE) ||
+       _send_sub_unsub(self, channel, msg_type) ||
+       _flush(self))
     {
         perror("LCM tcpq");
         dbg(DBG_LCM, "Disconnected!\n");
         _close_socket(self->socket);
         self->socket = -1;
+        g_mutex_unlock(self->send_lock);
         return -1;
     }
+    g_mutex_unlock(self->send_lock);
 
     return 0;
 }
@@ -338,83 +617,230 @@ _ensure_buf_capacity(void **buf, uint32_t *cur_size, int req_size)
     return 0;
 }
 
+// Checks whether a complete frame (type, channel length, channel, data
+// length, data) is buffered.  Returns 1 if it is, 0 if more data is needed,
+// and -1 if the frame is garbage.  In the first two cases *frame_len is set to
+// the number of bytes needed for the frame, as far as is known so far.
 static int
-lcm_tcpq_handle(lcm_tcpq_t * self)
+_buffered_frame_len(lcm_tcpq_t *self, uint32_t *frame_len)
 {
-    if(self->socket < 0 && 0 != _connect_to_server(self)) {
+    const uint8_t *p = self->recv_buf + self->recv_buf_pos;
+    uint32_t avail = self->recv_buf_len - self->recv_buf_pos;
+    uint32_t v;
+
+    *frame_len = 8;
+    if(avail < *frame_len)
+        return 0;
+    memcpy(&v, p + 4, 4);
+    uint32_t channel_len = ntohl(v);
+    if(channel_len > LCM_MAX_MESSAGE_SIZE)
         return -1;
-    }
 
-    // read, ignore message type
-    uint32_t msg_type;
-    if(_recv_uint32(self->socket, &msg_type))
-        goto disconnected;
+    *frame_len = 12 + channel_len;
+    if(avail < *frame_len)
+        return 0;
+    memcpy(&v, p + 8 + channel_len, 4);
+    uint32_t data_len = ntohl(v);
+    if(data_len > LCM_MAX_MESSAGE_SIZE)
+        return -1;
 
-    // read channel length, channel
-    uint32_t channel_len;
-    if(_recv_uint32(self->socket, &channel_len))
-        goto disconnected;
-    if(_ensure_buf_capacity((void**)&self->recv_channel_buf,
-                &self->recv_channel_buf_len, channel_len+1)) {
+    *frame_len = 12 + channel_len + data_len;
+    return avail >= *frame_len;
+}
+
+// Reads whatever the socket has available (blocking if there's nothing), after
+// making sure that there's room in the buffer for a frame of frame_len bytes.
+static int
+_fill_recv_buf(lcm_tcpq_t *self, uint32_t frame_len)
+{
+    if(self->recv_buf_pos + frame_len > self->recv_buf_size) {
+        // move the partial frame to the front of the buffer
+        uint32_t avail = self->recv_buf_len - self->recv_buf_pos;
+        memmove(self->recv_buf, self->recv_buf + self->recv_buf_pos, avail);
+        self->recv_buf_pos = 0;
+        self->recv_buf_len = avail;
+    }
+    if(_ensure_buf_capacity((void**)&self->recv_buf, &self->recv_buf_size,
+                frame_len)) {
         fprintf(stderr, "Memory allocation error\n");
         return -1;
     }
-    if(channel_len != _recv_fully(self->socket, self->recv_channel_buf,
-                channel_len))
-        goto disconnected;
-    self->recv_channel_buf[channel_len] = 0;
 
-    // read payload size, payload
-    uint32_t data_len;
-    if(_recv_uint32(self->socket, &data_len))
-        goto disconnected;
-    if(_ensure_buf_capacity(&self->data_buf, &self->data_buf_len, data_len)) {
-        fprintf(stderr, "Memory allocation error\n");
+    int status = recv(self->socket, (char*) self->recv_buf + self->recv_buf_len,
+            self->recv_buf_size - self->recv_buf_len, 0);
+    if(status < 0) {
+        perror("LCM tcpq recv");
         return -1;
     }
-    if(data_len != _recv_fully(self->socket, self->data_buf, data_len))
+    if(status == 0)
+        return -1;
+    self->recv_buf_len += status;
+    return 0;
+}
+
+static int
+lcm_tcpq_handle(lcm_tcpq_t * self)
+{
+    if(self->socket < 0 && 0 != _connect_to_server(self)) {
+        return -1;
+    }
+
+    // Wait until at least one full frame is buffered.  Every complete frame
+    // is dispatched below, so the buffer never holds a complete frame when
+    // we return, and the socket becoming readable is what signals that more
+    // messages may be on the way.
+    uint32_t frame_len;
+    int status;
+    while((status = _buffered_frame_len(self, &frame_len)) == 0) {
+        if(_fill_recv_buf(self, frame_len))
+            goto disconnected;
+    }
+    if(status < 0) {
+        fprintf(stderr, "LCM tcpq: received an invalid frame\n");
         goto disconnected;
+    }
+
+    // dispatch all the frames that came in
+    int64_t recv_utime = timestamp_now();
+    while(_buffered_frame_len(self, &frame_len) > 0) {
+        const uint8_t *p = self->recv_buf + self->recv_buf_pos;
+        uint32_t v;
+
+        // ignore message type
+        memcpy(&v, p + 4, 4);
+        uint32_t channel_len = ntohl(v);
+        if(_ensure_buf_capacity((void**)&self->recv_channel_buf,
+                    &self->recv_channel_buf_len, channel_len+1)) {
+            fprintf(stderr, "Memory allocation error\n");
+            return -1;
+        }
+        memcpy(self->recv_channel_buf, p + 8, channel_len);
+        self->recv_channel_buf[channel_len] = 0;
 
-    lcm_recv_buf_t rbuf;
-    rbuf.data = self->data_buf;
-    rbuf.data_size = data_len;
-    rbuf.recv_utime = timestamp_now();
-    rbuf.lcm = self->lcm;
+        lcm_recv_buf_t rbuf;
+        rbuf.data = (void*) (p + 12 + channel_len);
+        rbuf.data_size = frame_len - 12 - channel_len;
+        rbuf.recv_utime = recv_utime;
+        rbuf.lcm = self->lcm;
 
-    if(lcm_try_enqueue_message(self->lcm, self->recv_channel_buf))
-        lcm_dispatch_handlers(self->lcm, &rbuf, self->recv_channel_buf);
+        // advance before dispatching, in case a handler calls back into us
+        self->recv_buf_pos += frame_len;
+
+        if(lcm_try_enqueue_message(self->lcm, self->recv_channel_buf))
+            lcm_dispatch_handlers(self->lcm, &rbuf, self->recv_channel_buf);
+    }
+    if(self->recv_buf_pos == self->recv_buf_len) {
+        self->recv_buf_pos = 0;
+        self->recv_buf_len = 0;
+    }
     return 0;
 
 disconnected:
+    g_mutex_lock(self->send_lock);
     _close_socket(self->socket);
     self->socket = -1;
+    g_mutex_unlock(self->send_lock);
     return -1;
 }
 
 static int
-lcm_tcpq_publish(lcm_tcpq_t *self, const char *channel, const void *data,
-        unsigned int datalen)
+lcm_tcpq_publishv(lcm_tcpq_t *self, const char *channel,
+        const struct iovec *data_iov, int data_iovcnt, unsigned int datalen)
 {
     if(self->socket < 0 && 0 != _connect_to_server(self)) {
             return -1;
     }
 
     uint32_t channel_len = strlen(channel);
+    uint32_t header[2] = { htonl(MESSAGE_TYPE_PUBLISH), htonl(channel_len) };
+    uint32_t ndatalen = htonl(datalen);
+    uint32_t frame_len = sizeof(header) + channel_len + 4 + datalen;
+    int status = 0;
+
+    g_mutex_lock(self->send_lock);
+    if(frame_len < self->coalesce_bytes) {
+        // add the frame to the pending ones
+        uint32_t needed = self->send_buf_len + frame_len;
+        if(_ensure_buf_capacity((void**)&self->send_buf, &self->send_buf_size,
+                    needed)) {
+            fprintf(stderr, "Memory allocation error\n");
+            g_mutex_unlock(self->send_lock);
+            return -1;
+        }
+        uint8_t *p = self->send_buf + self->send_buf_len;
+        memcpy(p, header, sizeof(header));
+        memcpy(p + sizeof(header), channel, channel_len);
+        memcpy(p + sizeof(header) + channel_len, &ndatalen, 4);
+        p += sizeof(header) + channel_len + 4;
+        for(int i = 0; i < data_iovcnt; i++) {
+            // empty pieces may have a NULL iov_base
+            if(data_iov[i].iov_len)
+                memcpy(p, data_iov[i].iov_base, data_iov[i].iov_len);
+            p += data_iov[i].iov_len;
+        }
+        if(!self->send_buf_len && !self->corked_len) {
+            self->send_buf_deadline = timestamp_now() + self->coalesce_usec;
+            g_cond_signal(self->send_cond);
+        }
+        self->send_buf_len = needed;
 
-    if(_send_uint32(self->socket, MESSAGE_TYPE_PUBLISH) ||
-       _send_uint32(self->socket, channel_len) ||
-       (channel_len != _send_fully(self->socket, channel, channel_len)) ||
-       _send_uint32(self->socket, datalen) ||
-       (datalen != _send_fully(self->socket, data, datalen)))
-    {
+        if(self->send_buf_len >= self->coalesce_bytes)
+            status = _flush(self);
+    } else {
+        // send the frame right away, after anything that was published
+        // before it, straight from the caller's buffers.
+        struct iovec stack_iov[8];
+        struct iovec *iov = stack_iov;
+        int iovcnt = 3 + data_iovcnt;
+        if(iovcnt > 8) {
+            iov = (struct iovec*) malloc(iovcnt * sizeof(struct iovec));
+            if(!iov) {
+                fprintf(stderr, "Memory allocation error\n");
+                g_mutex_unlock(self->send_lock);
+                return -1;
+            }
+        }
+        iov[0].iov_base = (char*) header;
+        iov[0].iov_len = sizeof(header);
+        iov[1].iov_base = (char*) channel;
+        iov[1].iov_len = channel_len;
+        iov[2].iov_base = (char*) &ndatalen;
+        iov[2].iov_len = 4;
+        memcpy(iov + 3, data_iov, data_iovcnt * sizeof(struct iovec));
+        status = _write_send_buf(self, MSG_MORE);
+        if(!status)
+            status = _send_iov_fully(self->socket, iov, iovcnt, 0);
+        if(!status && self->cork) {
+            // the flush thread uncorks once the burst is over
+            if(!self->corked_len) {
+                self->send_buf_deadline = timestamp_now() +
+                    self->coalesce_usec;
+                g_cond_signal(self->send_cond);
+            }
+            self->corked_len += frame_len;
+        }
+        if(iov != stack_iov)
+            free(iov);
+    }
+
+    if(status) {
         perror("LCM tcpq send");
         dbg(DBG_LCM, "Disconnected!\n");
         _close_socket(self->socket);
         self->socket = -1;
-        return -1;
     }
+    g_mutex_unlock(self->send_lock);
+    return status;
+}
 
-    return 0;
+static int
+lcm_tcpq_publish(lcm_tcpq_t *self, const char *channel, const void *data,
+        unsigned int datalen)
+{
+    struct iovec iov;
+    iov.iov_base = (char*) data;
+    iov.iov_len = datalen;
+    return lcm_tcpq_publishv(self, channel, &iov, 1, datalen);
 }
 
 static lcm_provider_vtable_t tcpq_vtable;
@@ -428,6 +854,7 @@ lcm_tcpq_provider_init (GPtrArray * providers)
     tcpq_vtable.subscribe   = lcm_tcpq_subscribe;
     tcpq_vtable.unsubscribe = lcm_tcpq_unsubscribe;
     tcpq_vtable.publish     = lcm_tcpq_publish;
+    tcpq_vtable.publishv    = lcm_tcpq_publishv;
     tcpq_vtable.handle      = lcm_tcpq_handle;
     tcpq_vtable.get_fileno  = lcm_tcpq_get_fileno;
 
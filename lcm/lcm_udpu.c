@@ -0,0 +1,420 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// for sendmmsg()
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef WIN32
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#endif
+
+#ifdef WIN32
+#include "windows/WinPorting.h"
+#include <winsock2.h>
+#include <Ws2tcpip.h>
+#endif
+
+#include <glib.h>
+
+#include "lcm.h"
+#include "lcm_internal.h"
+#include "dbg.h"
+#include "udpm_util.h"
+
+/* Maximum number of datagrams handed to the kernel in a single sendmmsg()
+ * call. */
+#define UDPU_MAX_BATCH 64
+
+/**
+ * udpu_params_t:
+ * @bind_addr:      local address to receive on
+ * @bind_port:      local port to receive on
+ * @peers:          array of struct sockaddr_in.  Every published message is
+ *                  sent to each peer.
+ * @recv_buf_size:  requested size of the kernel receive buffer, set with
+ *                  SO_RCVBUF.  0 indicates to use the default settings.
+ *
+ */
+typedef struct _udpu_params_t udpu_params_t;
+struct _udpu_params_t {
+    struct in_addr bind_addr;
+    uint16_t bind_port;
+    GArray *peers;
+    int recv_buf_size;
+};
+
+typedef struct _lcm_provider_t lcm_udpu_t;
+struct _lcm_provider_t {
+    SOCKET sendfd;
+
+    lcm_t * lcm;
+
+    udpu_params_t params;
+
+    /* the receive socket, its read thread, and the received messages */
+    lcm_udp_receiver_t recv;
+
+    GStaticMutex transmit_lock; // so that only thread at a time can transmit
+
+    uint32_t     msg_seqno; // rolling counter of how many messages transmitted
+};
+
+void
+lcm_udpu_destroy (lcm_udpu_t *lcm)
+{
+    dbg (DBG_LCM, "closing lcm context\n");
+    lcm_udp_receiver_destroy (&lcm->recv);
+
+    if (lcm->sendfd >= 0)
+        lcm_close_socket(lcm->sendfd);
+
+    if (lcm->params.peers)
+        g_array_free (lcm->params.peers, TRUE);
+
+    g_static_mutex_free (&lcm->transmit_lock);
+    free (lcm);
+}
+
+/* Parses "host:port" into @addr.  If the port is omitted, @default_port
+ * (network byte order) is used. */
+static int
+parse_addr_and_port (const char *str, uint16_t default_port,
+        struct sockaddr_in *addr)
+{
+    memset (addr, 0, sizeof (struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    addr->sin_port = default_port;
+
+    char **words = g_strsplit (str, ":", 2);
+    if (!words[0] || !strlen (words[0])) {
+        addr->sin_addr.s_addr = INADDR_ANY;
+    } else if (inet_aton (words[0], &addr->sin_addr) == 0) {
+        // not a dotted quad.  try resolving it as a host name
+        struct addrinfo hints;
+        struct addrinfo *res = NULL;
+        memset (&hints, 0, sizeof (hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        if (getaddrinfo (words[0], NULL, &hints, &res) != 0 || !res) {
+            fprintf (stderr, "Error: Bad address \"%s\"\n", words[0]);
+            goto fail;
+        }
+        addr->sin_addr = ((struct sockaddr_in*) res->ai_addr)->sin_addr;
+        freeaddrinfo (res);
+    }
+    if (words[1]) {
+        char *st = NULL;
+        int port = strtol (words[1], &st, 0);
+        if (st == words[1] || port <= 0 || port > 65535) {
+            fprintf (stderr, "Error: Bad port \"%s\"\n", words[1]);
+            goto fail;
+        }
+        addr->sin_port = htons (port);
+    }
+    g_strfreev (words);
+    return 0;
+fail:
+    g_strfreev (words);
+    return -1;
+}
+
+static int
+parse_peers (const char *str, udpu_params_t *params)
+{
+    char **peers = g_strsplit (str, ",", -1);
+    int i;
+    for (i = 0; peers[i]; i++) {
+        char *peer = g_strstrip (peers[i]);
+        if (!strlen (peer))
+            continue;
+        struct sockaddr_in addr;
+        if (parse_addr_and_port (peer, params->bind_port, &addr) < 0 ||
+                addr.sin_addr.s_addr == INADDR_ANY) {
+            fprintf (stderr, "Error: Bad peer \"%s\"\n", peer);
+            g_strfreev (peers);
+            return -1;
+        }
+        g_array_append_val (params->peers, addr);
+    }
+    g_strfreev (peers);
+    return 0;
+}
+
+static void
+new_argument (gpointer key, gpointer value, gpointer user)
+{
+    udpu_params_t * params = (udpu_params_t *) user;
+    if (!strcmp ((char *) key, "recv_buf_size")) {
+        char *endptr = NULL;
+        params->recv_buf_size = strtol ((char *) value, &endptr, 0);
+        if (endptr == value)
+            fprintf (stderr, "Warning: Invalid value for recv_buf_size\n");
+    }
+    else if (!strcmp ((char *) key, "peers")) {
+        // handled separately, once the bind port is known
+    }
+    else {
+        fprintf(stderr, "%s:%d -- unknown provider argument %s\n",
+                __FILE__, __LINE__, (char *)key);
+    }
+}
+
+static int
+_setup_recv_parts (lcm_udpu_t *lcm)
+{
+    g_static_rec_mutex_lock(&lcm->recv.mutex);
+
+    if (lcm->recv.thread_created) {
+        g_static_rec_mutex_unlock(&lcm->recv.mutex);
+        return 0;
+    }
+
+    lcm->recv.recvfd = socket (AF_INET, SOCK_DGRAM, 0);
+    if (lcm->recv.recvfd < 0) {
+        perror ("allocating LCM recv socket");
+        goto setup_recv_thread_fail;
+    }
+
+    struct sockaddr_in addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr = lcm->params.bind_addr;
+    addr.sin_port = lcm->params.bind_port;
+
+    if (bind (lcm->recv.recvfd, (struct sockaddr*)&addr, sizeof (addr)) < 0) {
+        perror ("bind");
+        goto setup_recv_thread_fail;
+    }
+
+    if (lcm_udp_receiver_start (&lcm->recv, lcm->params.recv_buf_size) < 0)
+        goto setup_recv_thread_fail;
+    g_static_rec_mutex_unlock(&lcm->recv.mutex);
+    return 0;
+
+setup_recv_thread_fail:
+    lcm_udp_receiver_stop (&lcm->recv);
+    g_static_rec_mutex_unlock(&lcm->recv.mutex);
+    return -1;
+}
+
+static int
+lcm_udpu_get_fileno (lcm_udpu_t *lcm)
+{
+    if (_setup_recv_parts (lcm) < 0) {
+        return -1;
+    }
+    return lcm->recv.notify_pipe[0];
+}
+
+static int
+lcm_udpu_subscribe (lcm_udpu_t *lcm, const char *channel)
+{
+    return _setup_recv_parts (lcm);
+}
+
+/* Transmits one datagram, made up of @iovlen buffers, to every peer.  On
+ * Linux, all of the copies are handed to the kernel with as few sendmmsg()
+ * calls as possible.  Must be called with the transmit lock held.
+ *
+ * Returns 0 if the datagram was sent to every peer, -1 otherwise. */
+static int
+_send_to_peers (void *user, struct iovec *iov, int iovlen, int packet_size)
+{
+    lcm_udpu_t *lcm = (lcm_udpu_t *) user;
+    struct sockaddr_in *peers = (struct sockaddr_in*) lcm->params.peers->data;
+    int npeers = lcm->params.peers->len;
+    int result = 0;
+    int i;
+
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+    struct mmsghdr msgs[UDPU_MAX_BATCH];
+    int start;
+    for (start = 0; start < npeers; start += UDPU_MAX_BATCH) {
+        int nmsgs = MIN (UDPU_MAX_BATCH, npeers - start);
+        memset (msgs, 0, nmsgs * sizeof (struct mmsghdr));
+        for (i = 0; i < nmsgs; i++) {
+            msgs[i].msg_hdr.msg_name = (struct sockaddr*) &peers[start + i];
+            msgs[i].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = iov;
+            msgs[i].msg_hdr.msg_iovlen = iovlen;
+        }
+        int sent = 0;
+        while (sent < nmsgs) {
+            int status = sendmmsg (lcm->sendfd, msgs + sent, nmsgs - sent, 0);
+            if (status < 0) {
+                if (errno == EINTR)
+                    continue;
+                // skip the peer that failed and keep going with the rest
+                dbg (DBG_LCM, "udpu: sendmmsg: %s\n", strerror (errno));
+                result = -1;
+                sent++;
+                continue;
+            }
+            for (i = sent; i < sent + status; i++) {
+                if (msgs[i].msg_len != packet_size)
+                    result = -1;
+            }
+            sent += status;
+        }
+    }
+#else
+    struct msghdr msg;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_namelen = sizeof (struct sockaddr_in);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovlen;
+    for (i = 0; i < npeers; i++) {
+        msg.msg_name = (struct sockaddr*) &peers[i];
+        int status = sendmsg (lcm->sendfd, &msg, 0);
+        if (status != packet_size) {
+            dbg (DBG_LCM, "udpu: sendmsg: %s\n", strerror (errno));
+            result = -1;
+        }
+    }
+#endif
+    return result;
+}
+
+static int
+lcm_udpu_publishv (lcm_udpu_t *lcm, const char *channel,
+        const struct iovec *iov, int iovcnt, unsigned int datalen)
+{
+    int channel_size = strlen (channel);
+    if (channel_size > LCM_MAX_CHANNEL_NAME_LENGTH) {
+        fprintf (stderr, "LCM Error: channel name too long [%s]\n",
+                channel);
+        return -1;
+    }
+
+    // acquire transmit lock so that all fragments are transmitted
+    // together, and so that no other message uses the same sequence number
+    // (at least until the sequence # rolls over)
+    g_static_mutex_lock (&lcm->transmit_lock);
+    int status = lcm_udp_send_message (lcm->msg_seqno, channel, iov, iovcnt,
+            datalen, _send_to_peers, lcm);
+    lcm->msg_seqno ++;
+    g_static_mutex_unlock (&lcm->transmit_lock);
+    return status;
+}
+
+static int
+lcm_udpu_publish (lcm_udpu_t *lcm, const char *channel, const void *data,
+        unsigned int datalen)
+{
+    struct iovec iov;
+    iov.iov_base = (char *) data;
+    iov.iov_len = datalen;
+    return lcm_udpu_publishv (lcm, channel, &iov, 1, datalen);
+}
+
+static int
+lcm_udpu_handle (lcm_udpu_t *lcm)
+{
+    if(0 != _setup_recv_parts (lcm))
+        return -1;
+
+    lcm_buf_t * lcmb = lcm_udp_receiver_next (&lcm->recv);
+    if (!lcmb)
+        return -1;
+
+    lcm_udp_receiver_dispatch (&lcm->recv, lcmb);
+    lcm_udp_receiver_release (&lcm->recv, lcmb);
+    return 0;
+}
+
+lcm_provider_t *
+lcm_udpu_create (lcm_t * parent, const char *network, const GHashTable *args)
+{
+    udpu_params_t params;
+    memset (&params, 0, sizeof (udpu_params_t));
+
+    g_hash_table_foreach ((GHashTable*) args, new_argument, &params);
+
+    struct sockaddr_in bind_addr;
+    if (parse_addr_and_port ((network && strlen (network)) ? network : ":7667",
+                htons (7667), &bind_addr) < 0) {
+        return NULL;
+    }
+    params.bind_addr = bind_addr.sin_addr;
+    params.bind_port = bind_addr.sin_port;
+
+    params.peers = g_array_new (FALSE, TRUE, sizeof (struct sockaddr_in));
+    const char *peers = g_hash_table_lookup ((GHashTable*) args, "peers");
+    if (peers && parse_peers (peers, &params) < 0) {
+        g_array_free (params.peers, TRUE);
+        return NULL;
+    }
+    if (!params.peers->len) {
+        fprintf (stderr, "Warning: udpu provider has no peers.  Published "
+                "messages will not be sent anywhere.\n");
+    }
+
+    lcm_udpu_t * lcm = (lcm_udpu_t *) calloc (1, sizeof (lcm_udpu_t));
+
+    lcm->lcm = parent;
+    lcm->params = params;
+    lcm->sendfd = -1;
+
+    g_static_mutex_init (&lcm->transmit_lock);
+
+    if (lcm_udp_receiver_init (&lcm->recv, parent) < 0) {
+        lcm_udpu_destroy (lcm);
+        return NULL;
+    }
+
+    dbg (DBG_LCM, "Initializing LCM UDPU context...\n");
+    dbg (DBG_LCM, "Unicast %s:%d, %d peers\n", inet_ntoa(params.bind_addr),
+            ntohs (params.bind_port), params.peers->len);
+
+    // create a transmit socket.  It is left unconnected so that a single
+    // socket can address every peer.
+    lcm->sendfd = socket (AF_INET, SOCK_DGRAM, 0);
+    if (lcm->sendfd < 0) {
+        perror ("allocating LCM send socket");
+        lcm_udpu_destroy (lcm);
+        return NULL;
+    }
+
+#ifdef WIN32
+    // Windows has small (8k) buffer by default
+    // increase the send buffer to a reasonable amount.
+    int send_buf_size = 256 * 1024;
+    setsockopt(lcm->sendfd, SOL_SOCKET, SO_SNDBUF,
+            (char*)&send_buf_size, sizeof(send_buf_size));
+#endif
+
+    // don't start the receive thread yet.  Only allocate resources for
+    // receiving messages when a subscription is made.
+    return lcm;
+}
+
+static lcm_provider_vtable_t udpu_vtable;
+static lcm_provider_info_t udpu_info;
+
+void
+lcm_udpu_provider_init (GPtrArray * providers)
+{
+// Because of Microsoft Visual Studio compiler
+// difficulties, do this now, not statically
+    udpu_vtable.create      = lcm_udpu_create;
+    udpu_vtable.destroy     = lcm_udpu_destroy;
+    udpu_vtable.subscribe   = lcm_udpu_subscribe;
+    udpu_vtable.unsubscribe = NULL;
+    udpu_vtable.publish     = lcm_udpu_publish;
+    udpu_vtable.publishv    = lcm_udpu_publishv;
+    udpu_vtable.handle      = lcm_udpu_handle;
+    udpu_vtable.get_fileno  = lcm_udpu_get_fileno;
+
+    udpu_info.name = "udpu";
+    udpu_info.vtable = &udpu_vtable;
+
+    g_ptr_array_add (providers, &udpu_info);
+}
@@ -0,0 +1,225 @@
+#ifndef WIN32
+
+#ifdef __linux__
+#define _GNU_SOURCE /* O_DIRECT, fallocate */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "log_writer.h"
+
+// how much disk space is reserved at a time, ahead of the writes
+#define PREALLOCATE_SIZE (64 << 20)
+
+struct log_writer
+{
+    int fd;
+    int direct;         // fd was opened with O_DIRECT
+    int preallocate;    // the file system supports fallocate
+
+    int64_t size;       // size of the log, including the tail
+    int64_t allocated;  // disk space reserved so far
+
+    // The last partial block of the log, which starts at
+    // size - size % LOG_WRITER_ALIGN.
+    uint8_t *tail;
+};
+
+static void preallocate(log_writer_t *w, int64_t size)
+{
+#ifdef __linux__
+    if (!w->preallocate || size <= w->allocated)
+        return;
+    int64_t len = size - w->allocated;
+    if (len < PREALLOCATE_SIZE)
+        len = PREALLOCATE_SIZE;
+    // Reserve the space without changing the file size, so that readers
+    // never see the unwritten part.
+    if (0 == fallocate(w->fd, FALLOC_FL_KEEP_SIZE, w->allocated, len))
+        w->allocated += len;
+    else
+        w->preallocate = 0;
+#endif
+}
+
+static int set_direct(log_writer_t *w, int direct)
+{
+#ifdef O_DIRECT
+    int flags = fcntl(w->fd, F_GETFL);
+    flags = direct ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    return fcntl(w->fd, F_SETFL, flags);
+#else
+    return 0;
+#endif
+}
+
+static int write_all(log_writer_t *w, const uint8_t *data, int64_t len,
+        int64_t offset)
+{
+    while (len > 0) {
+        ssize_t status = pwrite(w->fd, data, len, offset);
+        if (status < 0 && errno == EINTR)
+            continue;
+        if (status < 0 && errno == EINVAL && w->direct) {
+            // Some file systems accept O_DIRECT at open, and then refuse the
+            // writes.  Carry on through the page cache.
+            set_direct(w, 0);
+            w->direct = 0;
+            continue;
+        }
+        if (status < 0)
+            return -1;
+        data += status;
+        len -= status;
+        offset += status;
+    }
+    return 0;
+}
+
+// Writes the tail through the page cache, since it is not a whole block
+static int write_tail(log_writer_t *w)
+{
+    int64_t tail_size = w->size % LOG_WRITER_ALIGN;
+    if (!tail_size)
+        return 0;
+    if (w->direct && 0 != set_direct(w, 0))
+        return -1;
+    int status = write_all(w, w->tail, tail_size, w->size - tail_size);
+    if (w->direct)
+        set_direct(w, 1);
+    return status;
+}
+
+log_writer_t *log_writer_open(const char *path, int append)
+{
+    log_writer_t *w = (log_writer_t*) calloc(1, sizeof(log_writer_t));
+    if (!w)
+        return NULL;
+    if (0 != posix_memalign((void**) &w->tail, LOG_WRITER_ALIGN,
+                LOG_WRITER_ALIGN)) {
+        free(w);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    int flags = O_RDWR | O_CREAT | (append ? 0 : O_TRUNC);
+    w->fd = -1;
+#ifdef O_DIRECT
+    w->fd = open(path, flags | O_DIRECT, 0644);
+    w->direct = w->fd >= 0;
+#endif
+    if (w->fd < 0)
+        w->fd = open(path, flags, 0644);
+    if (w->fd < 0) {
+        int saved_errno = errno;
+        free(w->tail);
+        free(w);
+        errno = saved_errno;
+        return NULL;
+    }
+#ifdef F_NOCACHE
+    // the closest macOS has to O_DIRECT
+    fcntl(w->fd, F_NOCACHE, 1);
+#endif
+
+    w->size = lseek(w->fd, 0, SEEK_END);
+    w->allocated = w->size;
+    w->preallocate = 1;
+
+    // pick up the partial block at the end of the log we're appending to
+    int64_t tail_size = w->size % LOG_WRITER_ALIGN;
+    if (tail_size) {
+        set_direct(w, 0);
+        if (tail_size != pread(w->fd, w->tail, tail_size, w->size - tail_size)) {
+            int saved_errno = errno;
+            log_writer_close(w);
+            errno = saved_errno;
+            return NULL;
+        }
+        if (w->direct)
+            set_direct(w, 1);
+    }
+    return w;
+}
+
+int log_writer_write(log_writer_t *w, uint8_t *buf, int64_t start,
+        int64_t end, int64_t capacity)
+{
+    int64_t tail_size = w->size % LOG_WRITER_ALIGN;
+    int64_t len = end - start;
+
+    // Line the data up with the blocks it will be written to.  It's moved
+    // back if there is room, otherwise forward, over the start of whatever
+    // follows it in buf, which is put back afterwards.
+    uint8_t saved[LOG_WRITER_ALIGN];
+    int64_t saved_size = 0;
+    if (start % LOG_WRITER_ALIGN != tail_size) {
+        int64_t to = start -
+            (start - tail_size + LOG_WRITER_ALIGN) % LOG_WRITER_ALIGN;
+        if (to < 0) {
+            to += LOG_WRITER_ALIGN;
+            if (to + len > capacity) {
+                errno = EINVAL;
+                return -1;
+            }
+            saved_size = to - start;
+            memcpy(saved, buf + end, saved_size);
+        }
+        memmove(buf + to, buf + start, len);
+        start = to;
+    }
+    uint8_t *data = buf + start - tail_size;
+    memcpy(data, w->tail, tail_size);
+
+    preallocate(w, w->size + len);
+
+    int status = 0;
+    int64_t whole = (tail_size + len) & ~(int64_t)(LOG_WRITER_ALIGN - 1);
+    if (whole)
+        status = write_all(w, data, whole, w->size - tail_size);
+    if (0 == status) {
+        memcpy(w->tail, data + whole, tail_size + len - whole);
+        w->size += len;
+    }
+
+    if (saved_size)
+        memcpy(buf + end, saved, saved_size);
+    return status;
+}
+
+int log_writer_sync(log_writer_t *w)
+{
+    if (0 != write_tail(w))
+        return -1;
+#ifdef __APPLE__
+    return fsync(w->fd);
+#else
+    return fdatasync(w->fd);
+#endif
+}
+
+int64_t log_writer_size(const log_writer_t *w)
+{
+    return w->size;
+}
+
+int log_writer_close(log_writer_t *w)
+{
+    int status = write_tail(w);
+    // Truncating to the current size gives back the preallocated space
+    if (w->allocated > w->size && 0 != ftruncate(w->fd, w->size))
+        status = -1;
+    if (0 != close(w->fd))
+        status = -1;
+    free(w->tail);
+    free(w);
+    return status;
+}
+
+#endif
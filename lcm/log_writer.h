@@ -0,0 +1,56 @@
+#ifndef __lcm_log_writer_h__
+#define __lcm_log_writer_h__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Writes an uncompressed log file straight from the buffers that events were
+// queued in, bypassing stdio and, where the platform and file system allow
+// it, the page cache (O_DIRECT).  Disk space is preallocated ahead of the
+// writes, so that the file system can keep the log contiguous.
+//
+// O_DIRECT requires the memory written from, and the offset written to, to
+// be aligned to LOG_WRITER_ALIGN.  The last partial block of the log is kept
+// in memory until more data completes it, or until log_writer_sync() or
+// log_writer_close() write it out through the page cache.
+
+#define LOG_WRITER_ALIGN 4096
+
+typedef struct log_writer log_writer_t;
+
+// Opens path for writing.  If append is nonzero, data is added to the end of
+// an existing file, otherwise the file is truncated.  Returns NULL and sets
+// errno on failure.
+log_writer_t *log_writer_open(const char *path, int append);
+
+// Writes the bytes [start, end) of buf.  buf must be aligned to
+// LOG_WRITER_ALIGN, and capacity bytes long, with at least LOG_WRITER_ALIGN
+// bytes past end.  The data is written without being copied if
+//
+//     start % LOG_WRITER_ALIGN == log_writer_size(w) % LOG_WRITER_ALIGN
+//
+// otherwise it is moved within buf first.  Either way, the bytes of buf
+// before end are overwritten, and the ones after it are left as they were.
+// Returns 0 on success, or -1 and sets errno.
+int log_writer_write(log_writer_t *w, uint8_t *buf, int64_t start,
+        int64_t end, int64_t capacity);
+
+// Writes out everything written so far, and waits for it to reach the disk.
+int log_writer_sync(log_writer_t *w);
+
+// Returns the size of the log, including data not yet on disk.
+int64_t log_writer_size(const log_writer_t *w);
+
+// Writes out any remaining data, releases the space preallocated past the
+// end of the log, and closes it.  Returns 0 on success, or -1 if any of that
+// failed.
+int log_writer_close(log_writer_t *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#ifdef WIN32
+#define __STDC_FORMAT_MACROS            // Enable integer types
+#include "windows/WinPorting.h"
+#else
+#include <unistd.h> /* fdatasync */
+#endif
+
+#include <inttypes.h>
+
+#include "lcm_internal.h"
+#include "eventlog.h"
+#include "logger.h"
+#include "log_writer.h"
+
+#define DEFAULT_MAX_WRITE_QUEUE_SIZE_MB 100
+
+// Received messages are copied, already in the log file format, into slabs
+// of memory that the write thread writes out whole.  The unwritten message
+// memory (max_unwritten_mb) is divided into at least MIN_SLABS slabs of up to
+// SLAB_SIZE bytes each.  An event too big for a slab is given one of its own,
+// in place of as many regular slabs as it needs.
+#define SLAB_SIZE (4 << 20)
+#define MIN_SLABS 4
+
+// the event record of the log file format, see eventlog.c
+#define EVENT_MAGIC 0xEDA1DA01
+#define EVENT_HEADER_SIZE 28
+
+// how often an event is added to the index, with write_index
+#define INDEX_EVERY_EVENTS 1000
+#define INDEX_EVERY_MS 1000
+
+// guards the manifest of a sharded log, which each shard adds its files to
+static GStaticMutex _manifest_lock = G_STATIC_MUTEX_INIT;
+
+static inline int64_t timestamp_seconds(int64_t v)
+{
+    return v/1000000;
+}
+
+static inline int64_t timestamp_now(void)
+{
+    GTimeVal tv;
+    g_get_current_time(&tv);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static inline void put32(uint8_t *p, int32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static inline void put64(uint8_t *p, int64_t v)
+{
+    put32(p, v >> 32);
+    put32(p + 4, v);
+}
+
+static inline int32_t get32(const uint8_t *p)
+{
+    return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline int64_t get64(const uint8_t *p)
+{
+    return ((int64_t) get32(p) << 32) | (uint32_t) get32(p + 4);
+}
+
+typedef struct slab slab_t;
+struct slab
+{
+    uint8_t *data;  // aligned to LOG_WRITER_ALIGN
+    int64_t capacity;
+
+    // The events are at [start, end).  start is chosen so that the events
+    // are aligned in memory the way they will be in the log file.
+    int64_t start;
+    int64_t end;
+
+    int64_t nevents;
+    int64_t first_utime;    // when the oldest event was received
+    // If non-zero, the slab was made for a single big event, in place of
+    // this many regular slabs.  Those are made again once it's written.
+    int64_t oversize;
+};
+
+struct _lcm_logger_t
+{
+    // Plain logs are written with log_writer, other kinds with lcm_eventlog.
+    // Only one of them is open.
+    lcm_eventlog_t *log;
+    log_writer_t *writer;
+
+    char    input_fname[PATH_MAX];
+    char    fname[PATH_MAX];
+    char    fname_prefix[PATH_MAX];
+
+    lcm_t   *lcm;
+    int     record;
+    lcm_subscription_t *subscription;
+
+    int64_t max_write_queue_size;
+    int auto_increment;
+    int next_increment_num;
+    double auto_split_mb;
+    int force_overwrite;
+    int use_strftime;
+    int fflush_interval_ms;
+    int rotate;
+    int quiet;
+    int append;
+    int write_index;
+    int compress;
+
+    // With sharding, the channels are divided among several loggers, each
+    // writing its own log files, and a manifest lists the files of them all.
+    lcm_logger_t *shards;
+    int num_shards;
+    GPtrArray *shard_regexes;   // shard i logs the channels matching regex i
+    int num_hash_shards;        // the other channels are hashed among these
+    GHashTable *channel_shards; // channel -> shard number + 1
+    char manifest[PATH_MAX];    // set in each shard
+
+    GThread *write_thread;
+    GAsyncQueue *write_queue;   // full slabs, waiting to be written
+    GAsyncQueue *free_slabs;
+    int64_t slab_size;
+
+    // Messages can be logged from several threads at once, when published
+    // ones are.  This serializes them, along with the write thread taking
+    // the slab being filled, and guards channel_shards.
+    GMutex * handler_mutex;
+
+    // the channels to log, or with invert_channels, the ones not to
+    int invert_channels;
+    GRegex * regex;
+
+    // queued after the last slab, to stop the write thread
+    int write_thread_exit_flag;
+
+    // How far the position of an event in the log file is from its position
+    // in the stream of received events, modulo LOG_WRITER_ALIGN.  Set by
+    // open_logfile(), read by log_message().
+    volatile gint align_skew;
+
+    // incremented by lcm_logger_split()
+    volatile gint split_count;
+
+    // set once logging has stopped for good
+    volatile gint failed;
+
+    // these members controlled by handler_mutex
+    slab_t *slab;           // being filled
+    int64_t queued_bytes;
+
+    // these members controlled by write thread
+    int64_t nevents;
+    int64_t logsize;
+    int64_t events_since_last_report;
+    int64_t last_report_time;
+    int64_t last_report_logsize;
+    int64_t time0;
+    int64_t last_fflush_time;
+    int64_t eventcount;     // events in the current log file
+    int reset_logfile_count;
+    int64_t written_bytes;  // of the stream of received events
+    int64_t last_spew_utime;
+
+    // write statistics, since the last report
+    int64_t write_busy_utime;
+    double latency_sum;
+    int64_t latency_max;
+    int64_t latency_events;
+
+    int64_t dropped_packets_count;
+    int64_t last_drop_report_utime;
+    int64_t last_drop_report_count;
+};
+
+static void
+rotate_logfiles(lcm_logger_t* logger)
+{
+    if(!logger->quiet) {
+        printf("Rotating log files\n");
+    }
+    // delete log files that have fallen off the end of the rotation
+    gchar* tomove = g_strdup_printf("%s.%d", logger->fname_prefix,
+            logger->rotate-1);
+    if(g_file_test(tomove, G_FILE_TEST_EXISTS)) {
+        if(0 != g_unlink(tomove)) {
+            fprintf(stderr, "ERROR! Unable to delete [%s]\n", tomove);
+        }
+    }
+    g_free(tomove);
+    tomove = g_strdup_printf("%s.%d.idx", logger->fname_prefix,
+            logger->rotate-1);
+    if(g_file_test(tomove, G_FILE_TEST_EXISTS))
+        g_unlink(tomove);
+    g_free(tomove);
+
+    // Rotate away any existing log files, and their indexes
+    for(int file_num = logger->rotate-1; file_num>=0; file_num--) {
+        gchar* newname = g_strdup_printf("%s.%d", logger->fname_prefix, file_num);
+        tomove = g_strdup_printf("%s.%d", logger->fname_prefix, file_num-1);
+        if(g_file_test(tomove, G_FILE_TEST_EXISTS)) {
+            if(0 != g_rename(tomove, newname)) {
+                fprintf(stderr, "ERROR!  Unable to rotate [%s]\n", tomove);
+            }
+        }
+        g_free(newname);
+        g_free(tomove);
+
+        newname = g_strdup_printf("%s.%d.idx", logger->fname_prefix, file_num);
+        tomove = g_strdup_printf("%s.%d.idx", logger->fname_prefix, file_num-1);
+        if(g_file_test(tomove, G_FILE_TEST_EXISTS))
+            g_rename(tomove, newname);
+        g_free(newname);
+        g_free(tomove);
+    }
+}
+
+// Picks the name of the next log file
+static int
+choose_filename(lcm_logger_t* logger)
+{
+    // maybe run the filename through strftime
+    if (logger->use_strftime) {
+        char new_prefix[PATH_MAX];
+        time_t now = time (NULL);
+        strftime(new_prefix, sizeof(new_prefix),
+                logger->input_fname, localtime(&now));
+
+        // If auto-increment is enabled and the strftime-formatted filename
+        // prefix has changed, then reset the auto-increment counter.
+        if(logger->auto_increment && strcmp(new_prefix, logger->fname_prefix))
+            logger->next_increment_num = 0;
+        strcpy(logger->fname_prefix, new_prefix);
+    } else {
+        strcpy(logger->fname_prefix, logger->input_fname);
+    }
+
+    if (logger->auto_increment) {
+        /* Loop through possible file names until we find one that doesn't
+         * already exist.  This way, we never overwrite an existing file. */
+        do {
+            snprintf(logger->fname, sizeof(logger->fname), "%s.%02d",
+                    logger->fname_prefix, logger->next_increment_num);
+            logger->next_increment_num++;
+        } while(g_file_test(logger->fname, G_FILE_TEST_EXISTS));
+    } else if(logger->rotate > 0) {
+        snprintf(logger->fname, sizeof(logger->fname), "%s.0", logger->fname_prefix);
+    } else {
+        strcpy(logger->fname, logger->fname_prefix);
+        if (! (logger->force_overwrite || logger->append)) {
+            if (g_file_test(logger->fname, G_FILE_TEST_EXISTS))
+            {
+                fprintf (stderr, "Refusing to overwrite existing file \"%s\"\n",
+                        logger->fname);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int
+create_log(lcm_logger_t* logger)
+{
+    // open output file in append mode if we're rotating log files or appending
+    // use write mode if not.
+    const char* logmode = (logger->rotate > 0 || logger->append) ? "a" : "w";
+    logger->eventcount = 0;
+#ifndef WIN32
+    if (!logger->compress && !logger->write_index) {
+        logger->writer = log_writer_open(logger->fname, *logmode == 'a');
+        if (logger->writer == NULL) {
+            perror ("Error: open failed");
+            return 1;
+        }
+        int64_t skew = (log_writer_size(logger->writer) -
+                logger->written_bytes) % LOG_WRITER_ALIGN;
+        g_atomic_int_set(&logger->align_skew,
+                (int) (skew + LOG_WRITER_ALIGN) % LOG_WRITER_ALIGN);
+        return 0;
+    }
+#endif
+    if (logger->compress)
+        logger->log = lcm_eventlog_create_compressed(logger->fname, logmode);
+    else
+        logger->log = lcm_eventlog_create(logger->fname, logmode);
+    if (logger->log == NULL) {
+        perror ("Error: fopen failed");
+        return 1;
+    }
+
+    if (logger->write_index) {
+        char *index_fname = g_strdup_printf("%s.idx", logger->fname);
+        if (0 != lcm_eventlog_write_index(logger->log, index_fname,
+                    INDEX_EVERY_EVENTS, INDEX_EVERY_MS)) {
+            fprintf(stderr, "Unable to write index \"%s\": %s\n", index_fname,
+                    strerror(errno));
+        }
+        g_free(index_fname);
+    }
+    return 0;
+}
+
+static int
+open_logfile(lcm_logger_t* logger)
+{
+    if (0 != choose_filename(logger))
+        return 1;
+
+    // create directories if needed
+    char *dirpart = g_path_get_dirname (logger->fname);
+    if (! g_file_test (dirpart, G_FILE_TEST_IS_DIR)) {
+        g_mkdir_with_parents (dirpart, 0755);
+    }
+    g_free (dirpart);
+
+    if(!logger->quiet) {
+        printf("Opening log file \"%s\"\n", logger->fname);
+    }
+
+    if (0 != create_log(logger))
+        return 1;
+
+    // list the new file in the manifest of a sharded log
+    if (logger->manifest[0]) {
+        g_static_mutex_lock(&_manifest_lock);
+        int status = lcm_eventlog_manifest_add(logger->manifest, logger->fname);
+        g_static_mutex_unlock(&_manifest_lock);
+        if (0 != status) {
+            fprintf(stderr, "Unable to add \"%s\" to manifest \"%s\": %s\n",
+                    logger->fname, logger->manifest, strerror(errno));
+        }
+    }
+    return 0;
+}
+
+static void
+close_logfile(lcm_logger_t* logger)
+{
+#ifndef WIN32
+    if (logger->writer) {
+        if (0 != log_writer_close(logger->writer))
+            perror("Error: closing log file failed");
+        logger->writer = NULL;
+    } else
+#endif
+    if (logger->log) {
+        lcm_eventlog_destroy(logger->log);
+        logger->log = NULL;
+    }
+}
+
+static slab_t*
+slab_new(int64_t size)
+{
+    slab_t *slab = (slab_t*) calloc(1, sizeof(slab_t));
+    if (!slab)
+        return NULL;
+    // leave room for log_writer to line the events up with the log file
+    slab->capacity = size + LOG_WRITER_ALIGN;
+#ifdef WIN32
+    slab->data = (uint8_t*) malloc(slab->capacity);
+#else
+    if (0 != posix_memalign((void**) &slab->data, LOG_WRITER_ALIGN,
+                slab->capacity))
+        slab->data = NULL;
+#endif
+    if (!slab->data) {
+        free(slab);
+        return NULL;
+    }
+    return slab;
+}
+
+static void
+slab_free(slab_t *slab)
+{
+    free(slab->data);
+    free(slab);
+}
+
+// Reports a failed write, at most twice a second.  Stops logging if the disk
+// is full.
+static void
+write_failed(lcm_logger_t *logger, const char *what)
+{
+    int saved_errno = errno;
+    int64_t now = timestamp_now();
+    if(now - logger->last_spew_utime > 500000 || saved_errno == ENOSPC) {
+        fprintf(stderr, "%s: %s\n", what, strerror(saved_errno));
+        logger->last_spew_utime = now;
+    }
+    if(saved_errno == ENOSPC)
+        g_atomic_int_set(&logger->failed, 1);
+}
+
+// Writes the events at [start, end) of a slab to the current log file
+static void
+write_events(lcm_logger_t *logger, slab_t *slab, int64_t start, int64_t end)
+{
+    if (start == end || g_atomic_int_get(&logger->failed))
+        return;
+    int64_t t0 = timestamp_now();
+#ifndef WIN32
+    if (logger->writer) {
+        if (0 != log_writer_write(logger->writer, slab->data, start, end,
+                    slab->capacity))
+            write_failed(logger, "log_writer_write");
+    } else
+#endif
+    {
+        for (int64_t pos = start; pos < end; ) {
+            uint8_t *p = slab->data + pos;
+            lcm_eventlog_event_t le;
+            le.timestamp = get64(p + 12);
+            le.channellen = get32(p + 20);
+            le.datalen = get32(p + 24);
+            le.channel = (char*) p + EVENT_HEADER_SIZE;
+            le.data = le.channel + le.channellen;
+            // lcm_eventlog_write_event will handle le.eventnum.
+            if (0 != lcm_eventlog_write_event(logger->log, &le))
+                write_failed(logger, "lcm_eventlog_write_event");
+            pos += EVENT_HEADER_SIZE + le.channellen + le.datalen;
+        }
+    }
+    logger->write_busy_utime += timestamp_now() - t0;
+}
+
+static void
+write_slab(lcm_logger_t *logger, slab_t *slab)
+{
+    int64_t start = slab->start;
+    int64_t timestamp = slab->first_utime;
+    int64_t since_first_sum = 0;
+
+    for (int64_t pos = slab->start; pos < slab->end; ) {
+        uint8_t *p = slab->data + pos;
+        int64_t size = EVENT_HEADER_SIZE + get32(p + 20) + get32(p + 24);
+        timestamp = get64(p + 12);
+
+        // Is it time to start a new logfile?
+        int split_log = 0;
+        if(logger->auto_split_mb) {
+          double logsize_mb = (double)logger->logsize / (1 << 20);
+          split_log = (logsize_mb > logger->auto_split_mb);
+        }
+        int split_count = g_atomic_int_get(&logger->split_count);
+        if(logger->reset_logfile_count != split_count) {
+            split_log = 1;
+            logger->reset_logfile_count = split_count;
+        }
+
+        if(split_log && !g_atomic_int_get(&logger->failed)) {
+            // Yes.  Finish off this one, and open up a new log file
+            write_events(logger, slab, start, pos);
+            start = pos;
+            close_logfile(logger);
+            if(logger->rotate > 0)
+                rotate_logfiles(logger);
+            if(0 != open_logfile(logger))
+                g_atomic_int_set(&logger->failed, 1);
+            logger->logsize = 0;
+            logger->last_report_logsize = 0;
+        }
+
+        // number the events the way lcm_eventlog_write_event would
+        put64(p + 4, logger->eventcount++);
+
+        logger->nevents++;
+        logger->events_since_last_report ++;
+        logger->logsize += size;
+        logger->written_bytes += size;
+        since_first_sum += timestamp - slab->first_utime;
+        pos += size;
+    }
+    write_events(logger, slab, start, slab->end);
+    if (g_atomic_int_get(&logger->failed))
+        return;
+
+    if (logger->fflush_interval_ms >= 0 &&
+        (timestamp - logger->last_fflush_time) > logger->fflush_interval_ms*1000) {
+        int64_t t0 = timestamp_now();
+#ifndef WIN32
+        if (logger->writer) {
+            if (0 != log_writer_sync(logger->writer))
+                write_failed(logger, "log_writer_sync");
+        } else
+#endif
+        {
+            lcm_eventlog_flush(logger->log);
+            // Perform a full fsync operation after flush
+#ifndef WIN32
+            fdatasync(fileno(logger->log->f));
+#endif
+        }
+        logger->write_busy_utime += timestamp_now() - t0;
+        logger->last_fflush_time = timestamp;
+    }
+
+    // how long the events waited between being received and written
+    int64_t now = timestamp_now();
+    logger->latency_sum += (double) slab->nevents * (now - slab->first_utime) -
+        since_first_sum;
+    logger->latency_events += slab->nevents;
+    if (now - slab->first_utime > logger->latency_max)
+        logger->latency_max = now - slab->first_utime;
+
+    int64_t offset_utime = timestamp - logger->time0;
+    if (!logger->quiet && (offset_utime - logger->last_report_time > 1000000)) {
+        double dt = (offset_utime - logger->last_report_time)/1000000.0;
+
+        double tps =  logger->events_since_last_report / dt;
+        double kbps = (logger->logsize - logger->last_report_logsize) / dt / 1024.0;
+        printf("Summary: %s ti:%4"PRIi64"sec Events: %-9"PRIi64" ( %4"PRIi64" MB )      TPS: %8.2f       KB/s: %8.2f\n",
+                logger->fname,
+                timestamp_seconds(offset_utime),
+                logger->nevents, logger->logsize/1048576,
+                tps, kbps);
+
+        // Headroom is how many times faster than the messages are arriving
+        // they could be written, at the rate the disk has been taking them.
+        double busy = logger->write_busy_utime / 1000000.0;
+        printf("Writes: %5.1f%% busy  Headroom: %7.1fx  "
+                "Latency: avg %8.2f ms  max %8.2f ms\n",
+                100 * busy / dt, dt / MAX(busy, 1e-6),
+                logger->latency_sum / 1000.0 / MAX(logger->latency_events, 1),
+                logger->latency_max / 1000.0);
+
+        logger->last_report_time = offset_utime;
+        logger->events_since_last_report = 0;
+        logger->last_report_logsize = logger->logsize;
+        logger->write_busy_utime = 0;
+        logger->latency_sum = 0;
+        logger->latency_max = 0;
+        logger->latency_events = 0;
+    }
+}
+
+// Hands the slab being filled over to the write thread.  The caller holds
+// handler_mutex.
+static void
+queue_slab(lcm_logger_t *logger)
+{
+    slab_t *slab = logger->slab;
+    if (!slab)
+        return;
+    if (slab->nevents)
+        g_async_queue_push(logger->write_queue, slab);
+    else
+        g_async_queue_push(logger->free_slabs, slab);
+    logger->slab = NULL;
+}
+
+static void*
+write_thread(void *user_data)
+{
+    lcm_logger_t *logger = (lcm_logger_t*) user_data;
+    int64_t next_flush_utime = timestamp_now() +
+        logger->fflush_interval_ms * 1000;
+
+    while(1) {
+        GTimeVal until;
+        until.tv_sec = next_flush_utime / 1000000;
+        until.tv_usec = next_flush_utime % 1000000;
+        void *msg = g_async_queue_timed_pop(logger->write_queue, &until);
+
+        // Keep events from waiting in a partly filled slab for longer than
+        // the flush interval
+        int64_t now = timestamp_now();
+        if(now >= next_flush_utime) {
+            g_mutex_lock(logger->handler_mutex);
+            queue_slab(logger);
+            g_mutex_unlock(logger->handler_mutex);
+            next_flush_utime = now + logger->fflush_interval_ms * 1000;
+        }
+        if(!msg)
+            continue;
+
+        // Should the write thread exit?  Everything queued before that has
+        // been written by now.
+        if(msg == &logger->write_thread_exit_flag)
+            return NULL;
+
+        slab_t *slab = (slab_t*) msg;
+        write_slab(logger, slab);
+
+        if(slab->oversize) {
+            // give back the memory that it was made from
+            int64_t num_slabs = slab->oversize;
+            slab_free(slab);
+            for(int64_t i = 0; i < num_slabs; i++) {
+                slab = slab_new(logger->slab_size);
+                if(!slab) {
+                    fprintf(stderr, "Unable to allocate memory for "
+                            "messages\n");
+                    break;
+                }
+                memset(slab->data, 0, slab->capacity);
+                g_async_queue_push(logger->free_slabs, slab);
+            }
+        } else {
+            g_async_queue_push(logger->free_slabs, slab);
+        }
+    }
+}
+
+// Returns a slab with room for an event of size bytes, or NULL if the write
+// thread has too much left to write.
+static slab_t*
+get_slab(lcm_logger_t *logger, int64_t size)
+{
+    slab_t *slab = logger->slab;
+    if (slab && slab->end + size <= slab->capacity - LOG_WRITER_ALIGN)
+        return slab;
+    queue_slab(logger);
+
+    // where the event will be within a block of the log file
+    int64_t offset = (logger->queued_bytes +
+            g_atomic_int_get(&logger->align_skew)) % LOG_WRITER_ALIGN;
+
+    if (offset + size > logger->slab_size) {
+        // Too big for a slab, give the event one of its own.  It's made from
+        // the memory of as many free slabs as it needs, so that unwritten
+        // events never take up more than max_write_queue_size.
+        int64_t num_slabs = (offset + size + logger->slab_size - 1) /
+            logger->slab_size;
+        slab_t **taken = (slab_t**) calloc(num_slabs, sizeof(slab_t*));
+        int64_t ntaken = 0;
+        while (taken && ntaken < num_slabs &&
+                (taken[ntaken] = (slab_t*) g_async_queue_try_pop(
+                    logger->free_slabs)))
+            ntaken++;
+        slab = ntaken == num_slabs ? slab_new(offset + size) : NULL;
+        for (int64_t i = 0; i < ntaken; i++) {
+            if (slab)
+                slab_free(taken[i]);
+            else
+                g_async_queue_push(logger->free_slabs, taken[i]);
+        }
+        free(taken);
+        if (!slab)
+            return NULL;
+        slab->oversize = num_slabs;
+    } else {
+        slab = (slab_t*) g_async_queue_try_pop(logger->free_slabs);
+        if (!slab)
+            return NULL;
+    }
+
+    slab->start = slab->end = offset;
+    slab->nevents = 0;
+    logger->slab = slab;
+    return slab;
+}
+
+// Copies a message into the slab being filled, for the write thread
+static void
+log_message (lcm_logger_t *logger, const lcm_recv_buf_t *rbuf,
+        const char *channel)
+{
+    if(g_atomic_int_get(&logger->failed))
+        return;
+
+    int channellen = strlen(channel);
+    int64_t size = EVENT_HEADER_SIZE + channellen + rbuf->data_size;
+
+    g_mutex_lock(logger->handler_mutex);
+
+    // check if the backlog of unwritten messages is too big.  If so, then
+    // ignore this event
+    slab_t *slab = get_slab(logger, size);
+    if(!slab) {
+        // can't write to logfile fast enough.  drop packet.
+
+        // maybe print an informational message to stdout
+        int64_t now = timestamp_now();
+        logger->dropped_packets_count ++;
+        int rc = logger->dropped_packets_count - logger->last_drop_report_count;
+
+        if(now - logger->last_drop_report_utime > 1000000 && rc > 0) {
+            if(!logger->quiet)
+                printf("Can't write to log fast enough.  Dropped %d packet%s\n",
+                        rc, rc==1?"":"s");
+            logger->last_drop_report_utime = now;
+            logger->last_drop_report_count = logger->dropped_packets_count;
+        }
+        g_mutex_unlock(logger->handler_mutex);
+        return;
+    }
+
+    // append the event, as it will be in the log file, for the write thread
+    uint8_t *p = slab->data + slab->end;
+    put32(p, EVENT_MAGIC);
+    put64(p + 4, 0);    // numbered by the write thread
+    put64(p + 12, rbuf->recv_utime);
+    put32(p + 20, channellen);
+    put32(p + 24, rbuf->data_size);
+    memcpy(p + EVENT_HEADER_SIZE, channel, channellen);
+    memcpy(p + EVENT_HEADER_SIZE + channellen, rbuf->data, rbuf->data_size);
+
+    if(!slab->nevents)
+        slab->first_utime = rbuf->recv_utime;
+    slab->nevents++;
+    slab->end += size;
+    logger->queued_bytes += size;
+
+    g_mutex_unlock(logger->handler_mutex);
+}
+
+// Logs a message, in the shard for its channel if the log is sharded
+static void
+route_message (lcm_logger_t *logger, const lcm_recv_buf_t *rbuf,
+        const char *channel)
+{
+    if(!logger->shards) {
+        log_message(logger, rbuf, channel);
+        return;
+    }
+
+    g_mutex_lock(logger->handler_mutex);
+    int shard = GPOINTER_TO_INT(
+            g_hash_table_lookup(logger->channel_shards, channel)) - 1;
+    if(shard < 0) {
+        int num_regexes = logger->shard_regexes->len;
+        for(shard = 0; shard < num_regexes; shard++) {
+            GRegex *regex = (GRegex*) g_ptr_array_index(logger->shard_regexes,
+                    shard);
+            if(g_regex_match(regex, channel, (GRegexMatchFlags) 0, NULL))
+                break;
+        }
+        if(shard == num_regexes)
+            shard += g_str_hash(channel) % logger->num_hash_shards;
+        g_hash_table_insert(logger->channel_shards, g_strdup(channel),
+                GINT_TO_POINTER(shard + 1));
+    }
+    g_mutex_unlock(logger->handler_mutex);
+
+    log_message(&logger->shards[shard], rbuf, channel);
+}
+
+// The handler of the logger's own subscription.  When inverting the channels,
+// that's to everything, and the channels are filtered here.  Otherwise, LCM
+// has filtered them already.
+static void
+subscription_handler (const lcm_recv_buf_t *rbuf, const char *channel,
+        void *u)
+{
+    lcm_logger_t *logger = (lcm_logger_t*) u;
+
+    if(logger->invert_channels) {
+        if(g_regex_match(logger->regex, channel, (GRegexMatchFlags) 0, NULL))
+            return;
+    }
+    route_message(logger, rbuf, channel);
+}
+
+// The handler of the taps, which see the messages on every channel
+static void
+tap_handler (const lcm_recv_buf_t *rbuf, const char *channel, void *u)
+{
+    lcm_logger_t *logger = (lcm_logger_t*) u;
+
+    int matches = g_regex_match(logger->regex, channel, (GRegexMatchFlags) 0,
+            NULL);
+    if(matches == logger->invert_channels)
+        return;
+    route_message(logger, rbuf, channel);
+}
+
+static void stop_logger(lcm_logger_t* logger);
+
+// Opens the first log file, sets aside the memory for unwritten messages, and
+// starts the write thread
+static int
+start_logger(lcm_logger_t* logger)
+{
+    if(0 != open_logfile(logger))
+        return 1;
+
+    int64_t num_slabs = MAX(logger->max_write_queue_size / SLAB_SIZE, MIN_SLABS);
+    logger->slab_size = MAX(logger->max_write_queue_size / num_slabs,
+            LOG_WRITER_ALIGN) & ~(int64_t)(LOG_WRITER_ALIGN - 1);
+    logger->free_slabs = g_async_queue_new();
+    logger->write_queue = g_async_queue_new();
+    logger->handler_mutex = g_mutex_new();
+    for(int64_t i = 0; i < num_slabs; i++) {
+        slab_t *slab = slab_new(logger->slab_size);
+        if(!slab) {
+            fprintf(stderr, "Unable to allocate %.0f MB for messages\n",
+                    (double) logger->max_write_queue_size / (1 << 20));
+            stop_logger(logger);
+            return 1;
+        }
+        // touch the memory now, rather than while logging
+        memset(slab->data, 0, slab->capacity);
+        g_async_queue_push(logger->free_slabs, slab);
+    }
+
+    logger->write_thread = g_thread_create(write_thread, logger, TRUE, NULL);
+    return 0;
+}
+
+// Lets the write thread finish what has been received, then stops it and
+// closes the log file
+static void
+stop_logger(lcm_logger_t* logger)
+{
+    if(logger->write_thread) {
+        g_mutex_lock(logger->handler_mutex);
+        queue_slab(logger);
+        g_mutex_unlock(logger->handler_mutex);
+        g_async_queue_push(logger->write_queue,
+                &logger->write_thread_exit_flag);
+        g_thread_join(logger->write_thread);
+        logger->write_thread = NULL;
+    }
+    g_mutex_free(logger->handler_mutex);
+    logger->handler_mutex = NULL;
+
+    close_logfile(logger);
+
+    for(void *slab = g_async_queue_try_pop(logger->free_slabs); slab;
+            slab=g_async_queue_try_pop(logger->free_slabs)) {
+        slab_free((slab_t*) slab);
+    }
+    g_async_queue_unref(logger->free_slabs);
+    g_async_queue_unref(logger->write_queue);
+    logger->free_slabs = NULL;
+}
+
+// Frees a logger, stopping whatever parts of it were started
+static void
+logger_free(lcm_logger_t *logger)
+{
+    if (logger->shards) {
+        for(int i = 0; i < logger->num_shards; i++) {
+            if (logger->shards[i].free_slabs)
+                stop_logger(&logger->shards[i]);
+        }
+        free(logger->shards);
+        g_hash_table_destroy(logger->channel_shards);
+        g_mutex_free(logger->handler_mutex);
+    } else if (logger->free_slabs) {
+        stop_logger(logger);
+    }
+    for(unsigned int i = 0; i < logger->shard_regexes->len; i++)
+        g_regex_unref((GRegex*) g_ptr_array_index(logger->shard_regexes, i));
+    g_ptr_array_free(logger->shard_regexes, TRUE);
+    if (logger->regex)
+        g_regex_unref(logger->regex);
+    free(logger);
+}
+
+// Compiles a regex that matches whole channel names
+static GRegex *
+channel_regex_new(const char *channel)
+{
+    char *regexbuf = g_strdup_printf("^%s$", channel);
+    GError *rerr = NULL;
+    GRegex *regex = g_regex_new(regexbuf, (GRegexCompileFlags) 0,
+            (GRegexMatchFlags) 0, &rerr);
+    g_free(regexbuf);
+    if(rerr) {
+        fprintf(stderr, "%s\n", rerr->message);
+        g_error_free(rerr);
+        return NULL;
+    }
+    return regex;
+}
+
+// Starts a logger for each shard.  The log file name is that of the manifest,
+// and shard i is written to FILE.si, in the same directory or in one of the
+// shard directories.
+static int
+start_shards(lcm_logger_t *logger, const char *const *shard_dirs)
+{
+    if(0 != choose_filename(logger))
+        return 1;
+    if(!logger->append)
+        g_unlink(logger->fname);
+
+    int num_dirs = 0;
+    while(shard_dirs && shard_dirs[num_dirs])
+        num_dirs++;
+
+    logger->handler_mutex = g_mutex_new();
+    logger->channel_shards = g_hash_table_new_full(g_str_hash, g_str_equal,
+            g_free, NULL);
+    logger->shards = (lcm_logger_t*) calloc(logger->num_shards,
+            sizeof(lcm_logger_t));
+    for(int i = 0; i < logger->num_shards; i++) {
+        lcm_logger_t *shard = &logger->shards[i];
+        memcpy(shard, logger, sizeof(lcm_logger_t));
+        shard->shards = NULL;
+        shard->channel_shards = NULL;
+        shard->handler_mutex = NULL;
+        shard->shard_regexes = NULL;
+        shard->regex = NULL;
+        shard->invert_channels = 0;
+        shard->use_strftime = 0;
+        shard->next_increment_num = 0;
+        shard->max_write_queue_size /= logger->num_shards;
+        strcpy(shard->manifest, logger->fname);
+        if(num_dirs) {
+            const char *dir = shard_dirs[i % num_dirs];
+            char *base = g_path_get_basename(logger->fname);
+            char *path = g_strdup_printf("%s/%s.s%d", dir, base, i);
+            // absolute, so that the manifest can be read from anywhere
+            if(g_path_is_absolute(path)) {
+                strcpy(shard->input_fname, path);
+            } else {
+                char *cwd = g_get_current_dir();
+                snprintf(shard->input_fname, sizeof(shard->input_fname),
+                        "%s/%s", cwd, path);
+                g_free(cwd);
+            }
+            g_free(path);
+            g_free(base);
+        } else {
+            snprintf(shard->input_fname, sizeof(shard->input_fname),
+                    "%s.s%d", logger->fname, i);
+        }
+        if(0 != start_logger(shard))
+            return 1;
+    }
+    return 0;
+}
+
+void
+lcm_logger_options_init(lcm_logger_options_t *options)
+{
+    memset(options, 0, sizeof(lcm_logger_options_t));
+    options->record = LCM_LOGGER_SUBSCRIBE;
+    options->channel = ".*";
+    options->max_unwritten_mb = DEFAULT_MAX_WRITE_QUEUE_SIZE_MB;
+    options->flush_interval_ms = 100;
+    options->rotate = -1;
+    options->num_hash_shards = 1;
+}
+
+lcm_logger_t *
+lcm_logger_attach(lcm_t *lcm, const lcm_logger_options_t *options)
+{
+    lcm_logger_options_t defaults;
+    if(!options) {
+        lcm_logger_options_init(&defaults);
+        options = &defaults;
+    }
+
+    int subscribe = options->record & LCM_LOGGER_SUBSCRIBE;
+    int received = options->record & LCM_LOGGER_RECEIVED;
+    int published = options->record & LCM_LOGGER_PUBLISHED;
+    if(!(subscribe || received || published)) {
+        fprintf(stderr, "lcm_logger: nothing to record\n");
+        return NULL;
+    }
+    if(subscribe && received) {
+        fprintf(stderr, "lcm_logger: LCM_LOGGER_SUBSCRIBE and "
+                "LCM_LOGGER_RECEIVED can't both be used\n");
+        return NULL;
+    }
+    if(options->max_unwritten_mb <= 0 || options->flush_interval_ms <= 0 ||
+            options->num_hash_shards <= 0) {
+        fprintf(stderr, "lcm_logger: invalid options\n");
+        return NULL;
+    }
+    if(options->split_mb > 0 &&
+            !(options->auto_increment || options->rotate > 0)) {
+        fprintf(stderr, "lcm_logger: split_mb requires either auto_increment "
+                "or rotate\n");
+        return NULL;
+    }
+    if(options->rotate > 0 && options->auto_increment) {
+        fprintf(stderr, "lcm_logger: auto_increment and rotate can't both be "
+                "used\n");
+        return NULL;
+    }
+    if(options->compress && options->write_index) {
+        fprintf(stderr, "lcm_logger: compress and write_index can't both be "
+                "used\n");
+        return NULL;
+    }
+
+    lcm_logger_t *logger = (lcm_logger_t*) calloc(1, sizeof(lcm_logger_t));
+    logger->lcm = lcm;
+    logger->record = options->record;
+    logger->max_write_queue_size =
+        (int64_t)(options->max_unwritten_mb * (1 << 20));
+    logger->auto_increment = options->auto_increment;
+    logger->auto_split_mb = options->split_mb;
+    logger->force_overwrite = options->force_overwrite;
+    logger->use_strftime = options->use_strftime;
+    logger->fflush_interval_ms = options->flush_interval_ms;
+    logger->rotate = options->rotate;
+    logger->quiet = options->quiet;
+    logger->append = options->append;
+    logger->write_index = options->write_index;
+    logger->compress = options->compress;
+    logger->invert_channels = options->invert_channels;
+    logger->num_hash_shards = options->num_hash_shards;
+    logger->shard_regexes = g_ptr_array_new();
+
+    if(options->filename) {
+        strncpy(logger->input_fname, options->filename,
+                sizeof(logger->input_fname) - 1);
+    } else {
+        strcpy(logger->input_fname, "lcmlog-%Y-%m-%d");
+        logger->auto_increment = 1;
+        logger->use_strftime = 1;
+    }
+
+    const char *channel = options->channel ? options->channel : ".*";
+    logger->regex = channel_regex_new(channel);
+    if(!logger->regex)
+        goto fail;
+    for(int i = 0; options->shards && options->shards[i]; i++) {
+        GRegex *regex = channel_regex_new(options->shards[i]);
+        if(!regex)
+            goto fail;
+        g_ptr_array_add(logger->shard_regexes, regex);
+    }
+
+    logger->num_shards = logger->shard_regexes->len + logger->num_hash_shards;
+    if(logger->num_shards > 1 && logger->rotate > 0) {
+        fprintf(stderr, "lcm_logger: rotate can't be used with sharding\n");
+        goto fail;
+    }
+    if(logger->num_shards == 1 && options->shard_dirs &&
+            options->shard_dirs[0]) {
+        fprintf(stderr, "lcm_logger: shard_dirs requires sharding\n");
+        goto fail;
+    }
+
+    logger->time0 = timestamp_now();
+    if(logger->num_shards == 1) {
+        if(0 != start_logger(logger))
+            goto fail;
+    } else {
+        if(0 != start_shards(logger, options->shard_dirs))
+            goto fail;
+    }
+
+    if(subscribe) {
+        // when inverting the channels, subscribe to everything and invert in
+        // the handler.  Otherwise, let LCM handle the regex.
+        logger->subscription = lcm_subscribe(lcm,
+                logger->invert_channels ? ".*" : channel,
+                subscription_handler, logger);
+        if(!logger->subscription)
+            goto fail;
+    }
+    if(received)
+        lcm_add_tap(lcm, LCM_TAP_RECEIVED, tap_handler, logger);
+    if(published)
+        lcm_add_tap(lcm, LCM_TAP_PUBLISHED, tap_handler, logger);
+    return logger;
+
+fail:
+    logger_free(logger);
+    return NULL;
+}
+
+void
+lcm_logger_split(lcm_logger_t *logger)
+{
+    if(logger->shards) {
+        for(int i = 0; i < logger->num_shards; i++)
+            g_atomic_int_inc(&logger->shards[i].split_count);
+    } else {
+        g_atomic_int_inc(&logger->split_count);
+    }
+}
+
+int
+lcm_logger_failed(const lcm_logger_t *logger)
+{
+    if(logger->shards) {
+        for(int i = 0; i < logger->num_shards; i++) {
+            if(g_atomic_int_get(&logger->shards[i].failed))
+                return 1;
+        }
+        return 0;
+    }
+    return g_atomic_int_get(&logger->failed);
+}
+
+void
+lcm_logger_detach(lcm_logger_t *logger)
+{
+    if(logger->subscription)
+        lcm_unsubscribe(logger->lcm, logger->subscription);
+    if(logger->record & LCM_LOGGER_RECEIVED)
+        lcm_remove_tap(logger->lcm, LCM_TAP_RECEIVED, tap_handler, logger);
+    if(logger->record & LCM_LOGGER_PUBLISHED)
+        lcm_remove_tap(logger->lcm, LCM_TAP_PUBLISHED, tap_handler, logger);
+    logger_free(logger);
+}
@@ -0,0 +1,187 @@
+#ifndef _LCM_LOGGER_H_
+#define _LCM_LOGGER_H_
+
+#include "lcm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup LcmC_lcm_logger_t lcm_logger_t
+ * @ingroup LcmC
+ * @brief Log messages from within a process
+ *
+ * @code
+ * #include <lcm/logger.h>
+ * @endcode
+ *
+ * Linking: <tt> `pkg-config --libs lcm` </tt>
+ *
+ * An lcm_logger_t records the messages of an existing lcm_t to a log file,
+ * the way lcm-logger does, without receiving every message a second time.
+ * Messages are copied into memory set aside when the logger is attached, and
+ * written out by a thread of the logger's own.  Log files are split, rotated
+ * and sharded exactly as lcm-logger does it, and if messages arrive faster
+ * than they can be written, they are dropped and reported the same way.
+ *
+ * @{
+ */
+
+/**
+ * Which messages a logger records.  These can be combined.
+ */
+enum {
+    /**
+     * The logger subscribes to the channels to be logged, so that the lcm_t
+     * receives them whether or not anything else subscribes to them.  This
+     * is what lcm-logger does.
+     */
+    LCM_LOGGER_SUBSCRIBE = 1,
+
+    /**
+     * Messages that the lcm_t receives for the subscriptions it already
+     * has, without subscribing to anything.  Can't be combined with
+     * LCM_LOGGER_SUBSCRIBE.
+     */
+    LCM_LOGGER_RECEIVED = 2,
+
+    /**
+     * Messages published with the lcm_t.  Their timestamps are the times
+     * they were published.  If the lcm_t also receives what it publishes,
+     * combining this with one of the others logs those messages twice.
+     */
+    LCM_LOGGER_PUBLISHED = 4
+};
+
+/**
+ * Options for lcm_logger_attach().  Initialize them with
+ * lcm_logger_options_init(), which sets the same defaults as lcm-logger.
+ * The lcm-logger option each one corresponds to is given in brackets.
+ */
+typedef struct _lcm_logger_options_t lcm_logger_options_t;
+struct _lcm_logger_options_t {
+    /**
+     * The log file [FILE].  Defaults to "lcmlog-%Y-%m-%d", with use_strftime
+     * and auto_increment.
+     */
+    const char *filename;
+
+    /**
+     * A combination of LCM_LOGGER_SUBSCRIBE, LCM_LOGGER_RECEIVED and
+     * LCM_LOGGER_PUBLISHED.  Defaults to LCM_LOGGER_SUBSCRIBE.
+     */
+    int record;
+
+    /**
+     * A regular expression for the channels to log [-c].  Defaults to ".*".
+     */
+    const char *channel;
+
+    /**
+     * Log the channels that don't match channel, instead of the ones that
+     * do [-v].
+     */
+    int invert_channels;
+
+    /**
+     * Memory set aside for messages that haven't been written yet, in MB
+     * [-m].  Defaults to 100.
+     */
+    double max_unwritten_mb;
+
+    /**
+     * How often to flush the log file to disk, in milliseconds
+     * [--flush-interval].  Defaults to 100.
+     */
+    int flush_interval_ms;
+
+    int force_overwrite;    /**< [-f] */
+    int auto_increment;     /**< [-i] */
+    int use_strftime;       /**< [-s] */
+    int rotate;             /**< [--rotate].  Defaults to -1, for none. */
+    double split_mb;        /**< [--split-mb] */
+    int append;             /**< [-a] */
+    int write_index;        /**< [-x] */
+    int compress;           /**< [-z] */
+    int quiet;              /**< [-q] */
+
+    /**
+     * NULL, or a NULL-terminated list of regular expressions.  The channels
+     * matching each one are logged to a shard of their own [--shard].
+     */
+    const char *const *shards;
+
+    /**
+     * The number of shards to divide the other channels among [--shards].
+     * Defaults to 1.
+     */
+    int num_hash_shards;
+
+    /**
+     * NULL, or a NULL-terminated list of directories to spread the shards
+     * across [--shard-dir].
+     */
+    const char *const *shard_dirs;
+};
+
+typedef struct _lcm_logger_t lcm_logger_t;
+
+/**
+ * @brief Sets options to their defaults.
+ */
+LCM_EXPORT
+void lcm_logger_options_init(lcm_logger_options_t *options);
+
+/**
+ * @brief Starts logging the messages of an lcm_t.
+ *
+ * Opens the first log file, allocates the memory for unwritten messages, and
+ * starts the write thread.  Messages are copied by the thread that receives
+ * or publishes them, and never wait for the disk.
+ *
+ * @param lcm The lcm_t to log.  It must outlive the logger.
+ * @param options The options, or NULL for the defaults.
+ *
+ * @return a new logger, or NULL on failure.
+ */
+LCM_EXPORT
+lcm_logger_t *lcm_logger_attach(lcm_t *lcm,
+        const lcm_logger_options_t *options);
+
+/**
+ * @brief Starts a new log file, as SIGHUP does to lcm-logger.
+ *
+ * Can be called from a signal handler.
+ */
+LCM_EXPORT
+void lcm_logger_split(lcm_logger_t *logger);
+
+/**
+ * @brief Checks whether the logger has stopped because a log file could not
+ * be opened, or the disk is full.
+ *
+ * @return 1 if it has stopped, 0 if it is still logging.
+ */
+LCM_EXPORT
+int lcm_logger_failed(const lcm_logger_t *logger);
+
+/**
+ * @brief Stops logging, writes out the messages logged so far, and frees the
+ * logger.
+ *
+ * With LCM_LOGGER_SUBSCRIBE, this must not be called while another thread
+ * is in lcm_handle().
+ */
+LCM_EXPORT
+void lcm_logger_detach(lcm_logger_t *logger);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
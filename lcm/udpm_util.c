@@ -1,10 +1,17 @@
 #include "udpm_util.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <assert.h>
 
+#ifndef WIN32
+#include <signal.h>
+#include <sys/select.h>
+#endif
+
 #include "dbg.h"
 
 #define LCM_MAX_UNFRAGMENTED_PACKET_SIZE 65536
@@ -177,6 +184,21 @@ lcm_buf_free_data(lcm_buf_t *lcmb, lcm_ringbuf_t *ringbuf)
     lcmb->ringbuf = NULL;
 }
 
+lcm_retained_t *
+lcm_buf_retain(const lcm_recv_buf_t *rbuf, void *user)
+{
+    lcm_buf_t *lcmb = (lcm_buf_t *) user;
+    // chunks of the ringbuffer have to be released in order
+    if (lcmb->ringbuf || !lcmb->buf)
+        return NULL;
+    lcm_retained_t *r = lcm_retained_new(rbuf, lcmb->buf, free);
+    if (r) {
+        lcmb->buf = NULL;
+        lcmb->buf_size = 0;
+    }
+    return r;
+}
+
 lcm_buf_t *
 lcm_buf_allocate_data(lcm_buf_queue_t * inbufs_empty, lcm_ringbuf_t **ringbuf) {
      lcm_buf_t * lcmb = NULL;
@@ -239,6 +261,680 @@ lcm_buf_queue_is_empty (lcm_buf_queue_t * q)
 
 
 
+/******************** receiver **********************/
+int
+lcm_udp_receiver_init (lcm_udp_receiver_t *recv, lcm_t *lcm)
+{
+    memset (recv, 0, sizeof (lcm_udp_receiver_t));
+    recv->lcm = lcm;
+    recv->recvfd = -1;
+    recv->notify_pipe[0] = recv->notify_pipe[1] = -1;
+    recv->thread_msg_pipe[0] = recv->thread_msg_pipe[1] = -1;
+    g_static_rec_mutex_init (&recv->mutex);
+
+    // internal notification pipe
+    if(0 != lcm_internal_pipe_create(recv->notify_pipe)) {
+        perror(__FILE__ " pipe(create)");
+        recv->notify_pipe[0] = recv->notify_pipe[1] = -1;
+        return -1;
+    }
+    fcntl (recv->notify_pipe[1], F_SETFL, O_NONBLOCK);
+    return 0;
+}
+
+void
+lcm_udp_receiver_destroy (lcm_udp_receiver_t *recv)
+{
+    lcm_udp_receiver_stop (recv);
+    if (recv->notify_pipe[0] >= 0) {
+        lcm_internal_pipe_close(recv->notify_pipe[0]);
+        lcm_internal_pipe_close(recv->notify_pipe[1]);
+        recv->notify_pipe[0] = recv->notify_pipe[1] = -1;
+    }
+    g_static_rec_mutex_free (&recv->mutex);
+}
+
+void
+lcm_udp_receiver_stop (lcm_udp_receiver_t *recv)
+{
+    if (recv->thread_created) {
+        // send the read thread an exit command
+        int wstatus = lcm_internal_pipe_write(recv->thread_msg_pipe[1], "\0", 1);
+        if(wstatus < 0) {
+            perror(__FILE__ " write(destroy)");
+        } else {
+            g_thread_join (recv->read_thread);
+        }
+        recv->read_thread = NULL;
+        recv->thread_created = 0;
+    }
+
+    if (recv->thread_msg_pipe[0] >= 0) {
+        lcm_internal_pipe_close(recv->thread_msg_pipe[0]);
+        lcm_internal_pipe_close(recv->thread_msg_pipe[1]);
+        recv->thread_msg_pipe[0] = recv->thread_msg_pipe[1] = -1;
+    }
+
+    if (recv->recvfd >= 0) {
+        lcm_close_socket(recv->recvfd);
+        recv->recvfd = -1;
+    }
+
+    if (recv->frag_bufs) {
+        lcm_frag_buf_store_destroy(recv->frag_bufs);
+        recv->frag_bufs = NULL;
+    }
+
+    if (recv->inbufs_empty) {
+        lcm_buf_queue_free (recv->inbufs_empty, recv->ringbuf);
+        recv->inbufs_empty = NULL;
+    }
+    if (recv->inbufs_filled) {
+        lcm_buf_queue_free (recv->inbufs_filled, recv->ringbuf);
+        recv->inbufs_filled = NULL;
+    }
+    if (recv->ringbuf) {
+        lcm_ringbuf_free (recv->ringbuf);
+        recv->ringbuf = NULL;
+    }
+}
+
+static int
+_recv_message_fragment (lcm_udp_receiver_t *recv, lcm_buf_t *lcmb, uint32_t sz)
+{
+    lcm2_header_long_t *hdr = (lcm2_header_long_t*) lcmb->buf;
+
+    // any existing fragment buffer for this message source?
+    lcm_frag_buf_t *fbuf = lcm_frag_buf_store_lookup(recv->frag_bufs,
+            &lcmb->from);
+
+    uint32_t msg_seqno = ntohl (hdr->msg_seqno);
+    uint32_t data_size = ntohl (hdr->msg_size);
+    uint32_t fragment_offset = ntohl (hdr->fragment_offset);
+    uint16_t fragments_in_msg = ntohs (hdr->fragments_in_msg);
+    uint32_t frag_size = sz - sizeof (lcm2_header_long_t);
+    char *data_start = (char*) (hdr + 1);
+
+    // discard any stale fragments from previous messages
+    if (fbuf && ((fbuf->msg_seqno != msg_seqno) ||
+                 (fbuf->data_size != data_size))) {
+        lcm_frag_buf_store_remove (recv->frag_bufs, fbuf);
+        dbg(DBG_LCM, "Dropping message (missing %d fragments)\n",
+            fbuf->fragments_remaining);
+        fbuf = NULL;
+    }
+
+    if (data_size > LCM_MAX_MESSAGE_SIZE) {
+        dbg (DBG_LCM, "rejecting huge message (%d bytes)\n", data_size);
+        return 0;
+    }
+
+    // create a new fragment buffer if necessary
+    if (!fbuf && hdr->fragment_no == 0) {
+        char *channel = (char*) (hdr + 1);
+        int channel_sz = strlen (channel);
+        if (channel_sz > LCM_MAX_CHANNEL_NAME_LENGTH) {
+            dbg (DBG_LCM, "bad channel name length\n");
+            recv->udp_discarded_bad++;
+            return 0;
+        }
+
+        // if the packet has no subscribers, drop the message now.
+        if(!lcm_has_handlers(recv->lcm, channel))
+            return 0;
+
+        fbuf = lcm_frag_buf_new (*((struct sockaddr_in*) &lcmb->from),
+                channel, msg_seqno, data_size, fragments_in_msg,
+                lcmb->recv_utime);
+        lcm_frag_buf_store_add (recv->frag_bufs, fbuf);
+        data_start += channel_sz + 1;
+        frag_size -= (channel_sz + 1);
+    }
+
+    if (!fbuf) return 0;
+
+#ifdef __linux__
+    if(recv->kernel_rbuf_sz < 262145 &&
+       data_size > recv->kernel_rbuf_sz &&
+       ! recv->warned_about_small_kernel_buf) {
+        fprintf(stderr,
+"==== LCM Warning ===\n"
+"LCM detected that large packets are being received, but the kernel UDP\n"
+"receive buffer is very small.  The possibility of dropping packets due to\n"
+"insufficient buffer space is very high.\n"
+"\n"
+"For more information, visit:\n"
+"   http://lcm-proj.github.io/multicast_setup.html\n\n");
+        recv->warned_about_small_kernel_buf = 1;
+    }
+#endif
+
+    if (fragment_offset + frag_size > fbuf->data_size) {
+        dbg (DBG_LCM, "dropping invalid fragment (off: %d, %d / %d)\n",
+                fragment_offset, frag_size, fbuf->data_size);
+        lcm_frag_buf_store_remove (recv->frag_bufs, fbuf);
+        return 0;
+    }
+
+    // copy data
+    memcpy (fbuf->data + fragment_offset, data_start, frag_size);
+    fbuf->last_packet_utime = lcmb->recv_utime;
+
+    fbuf->fragments_remaining --;
+
+    if (0 == fbuf->fragments_remaining) {
+        // complete message received.  Is there a subscriber that still
+        // wants it?  (i.e., does any subscriber have space in its queue?)
+        if(!lcm_try_enqueue_message(recv->lcm, fbuf->channel)) {
+            // no... sad... free the fragment buffer and return
+            lcm_frag_buf_store_remove (recv->frag_bufs, fbuf);
+            return 0;
+        }
+
+        // yes, transfer the message into the lcm_buf_t
+
+        // deallocate the ringbuffer-allocated buffer
+        g_static_rec_mutex_lock (&recv->mutex);
+        lcm_buf_free_data(lcmb, recv->ringbuf);
+        g_static_rec_mutex_unlock (&recv->mutex);
+
+        // transfer ownership of the message's payload buffer
+        lcmb->buf = fbuf->data;
+        fbuf->data = NULL;
+
+        strcpy (lcmb->channel_name, fbuf->channel);
+        lcmb->channel_size = strlen (lcmb->channel_name);
+        lcmb->data_offset = 0;
+        lcmb->data_size = fbuf->data_size;
+        lcmb->recv_utime = fbuf->last_packet_utime;
+
+        // don't need the fragment buffer anymore
+        lcm_frag_buf_store_remove (recv->frag_bufs, fbuf);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static int
+_recv_short_message (lcm_udp_receiver_t *recv, lcm_buf_t *lcmb, int sz)
+{
+    lcm2_header_short_t *hdr2 = (lcm2_header_short_t*) lcmb->buf;
+
+    // shouldn't have to worry about buffer overflow here because we
+    // zeroed out byte #65536, which is never written to by recv
+    const char *pkt_channel_str = (char*) (hdr2 + 1);
+
+    lcmb->channel_size = strlen (pkt_channel_str);
+
+    if (lcmb->channel_size > LCM_MAX_CHANNEL_NAME_LENGTH) {
+        dbg (DBG_LCM, "bad channel name length\n");
+        recv->udp_discarded_bad++;
+        return 0;
+    }
+
+    recv->udp_rx++;
+
+    // if the packet has no subscribers, drop the message now.
+    if(!lcm_try_enqueue_message(recv->lcm, pkt_channel_str))
+        return 0;
+
+    strcpy (lcmb->channel_name, pkt_channel_str);
+
+    lcmb->data_offset =
+        sizeof (lcm2_header_short_t) + lcmb->channel_size + 1;
+
+    lcmb->data_size = sz - lcmb->data_offset;
+    return 1;
+}
+
+// read continuously until a complete message arrives
+static lcm_buf_t *
+udp_read_packet (lcm_udp_receiver_t *recv)
+{
+    lcm_buf_t *lcmb = NULL;
+
+    int sz = 0;
+
+    // TODO warn about message loss somewhere else.
+
+    int got_complete_message = 0;
+
+    while (!got_complete_message) {
+        // wait for either incoming UDP data, or for an abort message
+        fd_set fds;
+        FD_ZERO (&fds);
+        FD_SET (recv->recvfd, &fds);
+        FD_SET (recv->thread_msg_pipe[0], &fds);
+        SOCKET maxfd = MAX(recv->recvfd, recv->thread_msg_pipe[0]);
+
+        if (select (maxfd + 1, &fds, NULL, NULL, NULL) <= 0) {
+            perror ("udp_read_packet -- select:");
+            continue;
+        }
+
+        if (FD_ISSET (recv->thread_msg_pipe[0], &fds)) {
+            // received an exit command.
+            dbg (DBG_LCM, "read thread received exit command\n");
+            if (lcmb) {
+                // lcmb is not on one of the memory managed buffer queues.  We could
+                // either put it back on one of the queues, or just free it here.  Do the
+                // latter.
+                //
+                // Can also just free its lcm_buf_t here.  Its data buffer is
+                // managed either by the ring buffer or the fragment buffer, so
+                // we can ignore it.
+                free (lcmb);
+            }
+            return NULL;
+        }
+
+        // there is incoming UDP data ready.
+        assert (FD_ISSET (recv->recvfd, &fds));
+
+        if (!lcmb) {
+            g_static_rec_mutex_lock (&recv->mutex);
+            lcmb = lcm_buf_allocate_data(recv->inbufs_empty, &recv->ringbuf);
+            g_static_rec_mutex_unlock (&recv->mutex);
+        }
+        struct iovec        vec;
+        vec.iov_base = lcmb->buf;
+        vec.iov_len = 65535;
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(struct msghdr));
+        msg.msg_name = &lcmb->from;
+        msg.msg_namelen = sizeof (struct sockaddr);
+        msg.msg_iov = &vec;
+        msg.msg_iovlen = 1;
+#ifdef MSG_EXT_HDR
+        // operating systems that provide SO_TIMESTAMP allow us to obtain more
+        // accurate timestamps by having the kernel produce timestamps as soon
+        // as packets are received.
+        char controlbuf[64];
+        msg.msg_control = controlbuf;
+        msg.msg_controllen = sizeof (controlbuf);
+        msg.msg_flags = 0;
+#endif
+        sz = recvmsg (recv->recvfd, &msg, 0);
+
+        if (sz < 0) {
+            perror ("udp_read_packet -- recvmsg");
+            recv->udp_discarded_bad++;
+            continue;
+        }
+
+        if (sz < sizeof(lcm2_header_short_t)) {
+            // packet too short to be LCM
+            recv->udp_discarded_bad++;
+            continue;
+        }
+
+        lcmb->fromlen = msg.msg_namelen;
+
+        if (recv->drop_packet && recv->drop_packet (recv->drop_packet_user, lcmb))
+            continue;
+
+        int got_utime = 0;
+#ifdef SO_TIMESTAMP
+        struct cmsghdr * cmsg = CMSG_FIRSTHDR (&msg);
+        /* Get the receive timestamp out of the packet headers if possible */
+        while (!lcmb->recv_utime && cmsg) {
+            if (cmsg->cmsg_level == SOL_SOCKET &&
+                    cmsg->cmsg_type == SCM_TIMESTAMP) {
+                struct timeval * t = (struct timeval*) CMSG_DATA (cmsg);
+                lcmb->recv_utime = (int64_t) t->tv_sec * 1000000 + t->tv_usec;
+                got_utime = 1;
+                break;
+            }
+            cmsg = CMSG_NXTHDR (&msg, cmsg);
+        }
+#endif
+        if (!got_utime)
+            lcmb->recv_utime = lcm_timestamp_now ();
+
+        lcm2_header_short_t *hdr2 = (lcm2_header_short_t*) lcmb->buf;
+        uint32_t rcvd_magic = ntohl(hdr2->magic);
+        if (rcvd_magic == LCM2_MAGIC_SHORT)
+            got_complete_message = _recv_short_message (recv, lcmb, sz);
+        else if (rcvd_magic == LCM2_MAGIC_LONG)
+            got_complete_message = _recv_message_fragment (recv, lcmb, sz);
+        else {
+            dbg (DBG_LCM, "LCM: bad magic\n");
+            recv->udp_discarded_bad++;
+            continue;
+        }
+    }
+
+    // if the newly received packet is a short packet, then resize the space
+    // allocated to it on the ringbuffer to exactly match the amount of space
+    // required.  That way, we do not use 64k of the ringbuffer for every
+    // incoming message.
+    if (lcmb->ringbuf) {
+        g_static_rec_mutex_lock (&recv->mutex);
+        lcm_ringbuf_shrink_last(lcmb->ringbuf, lcmb->buf, sz);
+        g_static_rec_mutex_unlock (&recv->mutex);
+    }
+
+    return lcmb;
+}
+
+/* This is the receiver thread that runs continuously to retrieve any incoming
+ * LCM packets from the network and queues them locally. */
+static void *
+recv_thread (void * user)
+{
+#ifdef G_OS_UNIX
+    // Mask out all signals on this thread.
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, NULL);
+#endif
+
+    lcm_udp_receiver_t * recv = (lcm_udp_receiver_t *) user;
+
+    while (1) {
+
+        lcm_buf_t *lcmb = udp_read_packet(recv);
+        if (!lcmb) break;
+
+        /* Queue the packet for future retrieval by lcm_handle (). */
+        lcm_udp_receiver_enqueue (recv, lcmb);
+    }
+    dbg (DBG_LCM, "read thread exiting\n");
+    return NULL;
+}
+
+int
+lcm_udp_receiver_start (lcm_udp_receiver_t *recv, int recv_buf_size)
+{
+    dbg (DBG_LCM, "allocating resources for receiving messages\n");
+
+    // allocate the fragment buffer hashtable
+    recv->frag_bufs = lcm_frag_buf_store_new(MAX_FRAG_BUF_TOTAL_SIZE,
+            MAX_NUM_FRAG_BUFS);
+
+#ifdef WIN32
+    // Windows has small (8k) buffer by default
+    // Increase it to a default reasonable amount
+    int default_recv_buf_size = 2048 * 1024;
+    setsockopt(recv->recvfd, SOL_SOCKET, SO_RCVBUF,
+            (char*)&default_recv_buf_size, sizeof(default_recv_buf_size));
+#endif
+
+    // debugging... how big is the receive buffer?
+    unsigned int retsize = sizeof (int);
+    getsockopt (recv->recvfd, SOL_SOCKET, SO_RCVBUF,
+            (char*)&recv->kernel_rbuf_sz, (socklen_t *) &retsize);
+    dbg (DBG_LCM, "LCM: receive buffer is %d bytes\n", recv->kernel_rbuf_sz);
+    if (recv_buf_size) {
+        if (setsockopt (recv->recvfd, SOL_SOCKET, SO_RCVBUF,
+                (char *) &recv_buf_size, sizeof (recv_buf_size)) < 0) {
+            perror ("setsockopt(SOL_SOCKET, SO_RCVBUF)");
+            fprintf (stderr, "Warning: Unable to set recv buffer size\n");
+        }
+        getsockopt (recv->recvfd, SOL_SOCKET, SO_RCVBUF,
+                (char*)&recv->kernel_rbuf_sz, (socklen_t *) &retsize);
+        dbg (DBG_LCM, "LCM: receive buffer is %d bytes\n", recv->kernel_rbuf_sz);
+
+        if (recv_buf_size > recv->kernel_rbuf_sz) {
+            g_warning ("LCM UDP receive buffer size (%d) \n"
+                    "       is smaller than reqested (%d). "
+                    "For more info:\n"
+                    "       http://lcm-proj.github.io/multicast_setup.html\n",
+                    recv->kernel_rbuf_sz, recv_buf_size);
+        }
+    }
+
+    /* Enable per-packet timestamping by the kernel, if available */
+#ifdef SO_TIMESTAMP
+    int opt = 1;
+    setsockopt (recv->recvfd, SOL_SOCKET, SO_TIMESTAMP, &opt, sizeof (opt));
+#endif
+
+    recv->inbufs_empty = lcm_buf_queue_new ();
+    recv->inbufs_filled = lcm_buf_queue_new ();
+    recv->ringbuf = lcm_ringbuf_new (LCM_RINGBUF_SIZE);
+
+    int i;
+    for (i = 0; i < LCM_DEFAULT_RECV_BUFS; i++) {
+        /* We don't set the receive buffer's data pointer yet because it
+         * will be taken from the ringbuffer at receive time. */
+        lcm_buf_t * lcmb = (lcm_buf_t *) calloc (1, sizeof (lcm_buf_t));
+        lcm_buf_enqueue (recv->inbufs_empty, lcmb);
+    }
+
+    // setup a pipe for notifying the reader thread when to quit
+    if(0 != lcm_internal_pipe_create(recv->thread_msg_pipe)) {
+        perror(__FILE__ " pipe(setup)");
+        recv->thread_msg_pipe[0] = recv->thread_msg_pipe[1] = -1;
+        return -1;
+    }
+    fcntl (recv->thread_msg_pipe[1], F_SETFL, O_NONBLOCK);
+
+    /* Start the reader thread */
+    recv->read_thread = g_thread_create (recv_thread, recv, TRUE, NULL);
+    if (!recv->read_thread) {
+        fprintf (stderr, "Error: LCM failed to start reader thread\n");
+        return -1;
+    }
+    recv->thread_created = 1;
+    return 0;
+}
+
+void
+lcm_udp_receiver_enqueue (lcm_udp_receiver_t *recv, lcm_buf_t *lcmb)
+{
+    /* If necessary, notify the reading thread by writing to a pipe.  We
+     * only want one character in the pipe at a time to avoid blocking
+     * writes, so we only do this when the queue transitions from empty to
+     * non-empty. */
+    g_static_rec_mutex_lock (&recv->mutex);
+
+    if (lcm_buf_queue_is_empty (recv->inbufs_filled))
+        if (lcm_internal_pipe_write(recv->notify_pipe[1], "+", 1) < 0)
+            perror ("write to notify");
+
+    lcm_buf_enqueue (recv->inbufs_filled, lcmb);
+
+    g_static_rec_mutex_unlock (&recv->mutex);
+}
+
+lcm_buf_t *
+lcm_udp_receiver_next (lcm_udp_receiver_t *recv)
+{
+    /* Read one byte from the notify pipe.  This will block if no packets are
+     * available yet and wake up when they are. */
+    char ch;
+    int status = lcm_internal_pipe_read(recv->notify_pipe[0], &ch, 1);
+    if (status == 0) {
+        fprintf (stderr, "Error: lcm_handle read 0 bytes from notify_pipe\n");
+        return NULL;
+    }
+    else if (status < 0) {
+        fprintf (stderr, "Error: lcm_handle read: %s\n", strerror (errno));
+        return NULL;
+    }
+
+    /* Dequeue the next received packet */
+    g_static_rec_mutex_lock (&recv->mutex);
+    lcm_buf_t * lcmb = lcm_buf_dequeue (recv->inbufs_filled);
+
+    if (!lcmb) {
+        fprintf (stderr,
+                "Error: no packet available despite getting notification.\n");
+        g_static_rec_mutex_unlock (&recv->mutex);
+        return NULL;
+    }
+
+    /* If there are still packets in the queue, put something back in the pipe
+     * so that future invocations will get called. */
+    if (!lcm_buf_queue_is_empty (recv->inbufs_filled))
+        if (lcm_internal_pipe_write(recv->notify_pipe[1], "+", 1) < 0)
+            perror ("write to notify");
+    g_static_rec_mutex_unlock (&recv->mutex);
+    return lcmb;
+}
+
+void
+lcm_udp_receiver_dispatch (lcm_udp_receiver_t *recv, lcm_buf_t *lcmb)
+{
+    lcm_recv_buf_t rbuf;
+    rbuf.data = (uint8_t*) lcmb->buf + lcmb->data_offset;
+    rbuf.data_size = lcmb->data_size;
+    rbuf.recv_utime = lcmb->recv_utime;
+    rbuf.lcm = recv->lcm;
+
+    lcm_dispatch_handlers_retainable (recv->lcm, &rbuf,
+            lcmb->channel_name, lcm_buf_retain, lcmb);
+}
+
+void
+lcm_udp_receiver_release (lcm_udp_receiver_t *recv, lcm_buf_t *lcmb)
+{
+    g_static_rec_mutex_lock (&recv->mutex);
+    lcm_buf_free_data(lcmb, recv->ringbuf);
+    lcm_buf_enqueue (recv->inbufs_empty, lcmb);
+    g_static_rec_mutex_unlock (&recv->mutex);
+}
+
+
+/******************** sending **********************/
+// Points dst at the next len bytes of the message described by src, starting
+// at (*src_idx, *src_off), and advances that position past them.  Returns
+// the number of entries used in dst.
+static int
+_iov_take (struct iovec *dst, const struct iovec *src, int *src_idx,
+        size_t *src_off, size_t len)
+{
+    int n = 0;
+    while (len > 0) {
+        size_t avail = src[*src_idx].iov_len - *src_off;
+        if (avail == 0) {
+            (*src_idx)++;
+            *src_off = 0;
+            continue;
+        }
+        size_t chunk = MIN (avail, len);
+        dst[n].iov_base = (char *) src[*src_idx].iov_base + *src_off;
+        dst[n].iov_len = chunk;
+        n++;
+        *src_off += chunk;
+        len -= chunk;
+    }
+    return n;
+}
+
+// Each packet is sent straight from the caller's buffers: the payload of a
+// packet is described by as many iovecs as it spans, so a message is never
+// copied in user space, however many pieces it is made of.
+int
+lcm_udp_send_message (uint32_t msg_seqno, const char *channel,
+        const struct iovec *iov, int iovcnt, unsigned int datalen,
+        lcm_udp_send_packet_t send_packet, void *user)
+{
+    int channel_size = strlen (channel);
+    int payload_size = channel_size + 1 + datalen;
+
+    // number of packets, if the message has to be fragmented
+    int fragment_size = LCM_FRAGMENT_MAX_PAYLOAD;
+    int nfragments = payload_size / fragment_size +
+        !!(payload_size % fragment_size);
+    if (payload_size > LCM_SHORT_MESSAGE_MAX_SIZE && nfragments > 65535) {
+        fprintf (stderr, "LCM error: too much data for a single message\n");
+        return -1;
+    }
+
+    // header, channel, and the pieces of the payload of one packet
+    struct iovec stack_sendbufs[16];
+    struct iovec *sendbufs = stack_sendbufs;
+    if (iovcnt + 2 > 16) {
+        sendbufs = (struct iovec *) malloc ((iovcnt + 2) *
+                sizeof (struct iovec));
+        if (!sendbufs) {
+            fprintf (stderr, "Memory allocation error\n");
+            return -1;
+        }
+    }
+    int src_idx = 0;
+    size_t src_off = 0;
+
+    int status;
+    if (payload_size <= LCM_SHORT_MESSAGE_MAX_SIZE) {
+        // message is short.  send in a single packet
+        lcm2_header_short_t hdr;
+        hdr.magic = htonl (LCM2_MAGIC_SHORT);
+        hdr.msg_seqno = htonl (msg_seqno);
+
+        sendbufs[0].iov_base = (char *) &hdr;
+        sendbufs[0].iov_len = sizeof (hdr);
+        sendbufs[1].iov_base = (char *) channel;
+        sendbufs[1].iov_len = channel_size + 1;
+        int nbufs = 2 + _iov_take (sendbufs + 2, iov, &src_idx, &src_off,
+                datalen);
+
+        int packet_size = datalen + sizeof (hdr) + channel_size + 1;
+        dbg (DBG_LCM_MSG, "transmitting %d byte [%s] payload (%d byte pkt)\n",
+                datalen, channel, packet_size);
+
+        status = send_packet (user, sendbufs, nbufs, packet_size);
+    } else {
+        dbg (DBG_LCM_MSG, "transmitting %d byte [%s] payload in %d fragments\n",
+                payload_size, channel, nfragments);
+
+        uint32_t fragment_offset = 0;
+
+        lcm2_header_long_t hdr;
+        hdr.magic = htonl (LCM2_MAGIC_LONG);
+        hdr.msg_seqno = htonl (msg_seqno);
+        hdr.msg_size = htonl (datalen);
+        hdr.fragment_offset = 0;
+        hdr.fragment_no = 0;
+        hdr.fragments_in_msg = htons (nfragments);
+
+        // first fragment is special.  insert channel before data
+        int firstfrag_datasize = fragment_size - (channel_size + 1);
+        assert (firstfrag_datasize <= datalen);
+
+        sendbufs[0].iov_base = (char *) &hdr;
+        sendbufs[0].iov_len = sizeof (hdr);
+        sendbufs[1].iov_base = (char *) channel;
+        sendbufs[1].iov_len = channel_size + 1;
+        int nbufs = 2 + _iov_take (sendbufs + 2, iov, &src_idx, &src_off,
+                firstfrag_datasize);
+
+        int packet_size = sizeof (hdr) + channel_size + 1 + firstfrag_datasize;
+        fragment_offset += firstfrag_datasize;
+        status = send_packet (user, sendbufs, nbufs, packet_size);
+
+        // transmit the rest of the fragments
+        for (uint16_t frag_no=1; 0 == status && frag_no<nfragments; frag_no++) {
+            hdr.fragment_offset = htonl (fragment_offset);
+            hdr.fragment_no = htons (frag_no);
+
+            int fraglen = MIN (fragment_size, datalen - fragment_offset);
+
+            nbufs = 1 + _iov_take (sendbufs + 1, iov, &src_idx, &src_off,
+                    fraglen);
+            status = send_packet (user, sendbufs, nbufs,
+                    sizeof (hdr) + fraglen);
+
+            fragment_offset += fraglen;
+        }
+
+        // sanity check
+        if (0 == status) {
+            assert (fragment_offset == datalen);
+        }
+    }
+
+    if (sendbufs != stack_sendbufs)
+        free (sendbufs);
+    return status;
+}
+
+
 #ifdef __linux__
 static inline int _parse_inaddr(const char *addr_str, struct in_addr *addr)
 {
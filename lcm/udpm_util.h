@@ -10,6 +10,8 @@ extern "C" {
 
 #ifndef WIN32
 #include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <sys/time.h>
@@ -30,6 +32,7 @@ typedef int SOCKET;
 #include <glib.h>
 
 #include "lcm.h"
+#include "lcm_internal.h"
 #include "ringbuffer.h"
 
 /************************* Important Defines *******************/
@@ -182,6 +185,12 @@ lcm_buf_allocate_data(lcm_buf_queue_t * inbufs_empty, lcm_ringbuf_t **ringbuf);
 
 void lcm_buf_free_data(lcm_buf_t *lcmb, lcm_ringbuf_t *ringbuf);
 
+// lcm_retain_func_t for messages received into an lcm_buf_t.  Messages that
+// were reassembled from fragments are in their own buffer, which is taken
+// from the lcm_buf_t.  Messages in the ringbuffer are copied.
+lcm_retained_t *
+lcm_buf_retain(const lcm_recv_buf_t *rbuf, void *lcmb);
+
 /******************** fragment buffer **********************/
 typedef struct _lcm_frag_buf {
     char      channel[LCM_MAX_CHANNEL_NAME_LENGTH+1];
@@ -217,6 +226,89 @@ void lcm_frag_buf_store_remove(lcm_frag_buf_store *store, lcm_frag_buf_t *fbuf);
 void lcm_frag_buf_store_add(lcm_frag_buf_store *store, lcm_frag_buf_t *fbuf);
 
 
+/******************** receiver **********************/
+// Receives LCM packets on a single UDP socket.  A thread reads packets from
+// the socket, reassembles fragmented messages, and queues complete messages
+// for lcm_udp_receiver_next().
+typedef struct _lcm_udp_receiver {
+    lcm_t * lcm;
+
+    SOCKET recvfd;
+
+    /* size of the kernel UDP receive buffer */
+    int kernel_rbuf_sz;
+    int warned_about_small_kernel_buf;
+
+    /* Packet structures available for sending or receiving use are
+     * stored in the *_empty queues. */
+    lcm_buf_queue_t * inbufs_empty;
+    /* Received packets that are filled with data are queued here. */
+    lcm_buf_queue_t * inbufs_filled;
+
+    /* Memory for received small packets is taken from a fixed-size ring buffer
+     * so we don't have to do any mallocs */
+    lcm_ringbuf_t * ringbuf;
+
+    GStaticRecMutex mutex; /* Must be locked when reading/writing to the
+                              above three queues */
+
+    int thread_created;
+    GThread *read_thread;
+    int notify_pipe[2];         // pipe to notify application when messages arrive
+    int thread_msg_pipe[2];     // pipe to notify read thread when to quit
+
+    lcm_frag_buf_store * frag_bufs;
+
+    uint32_t     udp_rx;            // packets received and processed
+    uint32_t     udp_discarded_bad; // packets discarded because they were bad
+                                    // somehow
+
+    // if set, called with each packet as it's received.  Packets for which
+    // it returns nonzero are dropped.
+    int (*drop_packet) (void *user, lcm_buf_t *lcmb);
+    void *drop_packet_user;
+} lcm_udp_receiver_t;
+
+// Sets up the parts of a receiver that are needed before it's started,
+// including the notify pipe.  Returns 0 on success, -1 on failure.
+int lcm_udp_receiver_init(lcm_udp_receiver_t *recv, lcm_t *lcm);
+void lcm_udp_receiver_destroy(lcm_udp_receiver_t *recv);
+
+// Starts receiving on recv->recvfd, which the caller has created and bound.
+// recv_buf_size is the requested size of the kernel receive buffer, or 0 for
+// the default.  The caller holds recv->mutex.  On failure, returns -1 and the
+// caller should call lcm_udp_receiver_stop().
+int lcm_udp_receiver_start(lcm_udp_receiver_t *recv, int recv_buf_size);
+
+// Stops the read thread, closes recv->recvfd, and frees the receive buffers.
+void lcm_udp_receiver_stop(lcm_udp_receiver_t *recv);
+
+// Queues a complete message for lcm_udp_receiver_next(), and notifies the
+// application if the queue was empty.
+void lcm_udp_receiver_enqueue(lcm_udp_receiver_t *recv, lcm_buf_t *lcmb);
+
+// Blocks until a message is available, and returns it.  Returns NULL on
+// error.  The message is passed to lcm_udp_receiver_release() when done.
+lcm_buf_t * lcm_udp_receiver_next(lcm_udp_receiver_t *recv);
+void lcm_udp_receiver_dispatch(lcm_udp_receiver_t *recv, lcm_buf_t *lcmb);
+void lcm_udp_receiver_release(lcm_udp_receiver_t *recv, lcm_buf_t *lcmb);
+
+
+/******************** sending **********************/
+// Sends one packet made up of iovlen buffers.  Returns 0 if all packet_size
+// bytes were sent, -1 otherwise.
+typedef int (*lcm_udp_send_packet_t) (void *user, struct iovec *iov,
+        int iovlen, int packet_size);
+
+// Splits a message into LC02/LC03 packets, fragmenting it if it doesn't fit
+// in one, and passes each to send_packet.  The caller holds a lock so that
+// no other message is sent with the same msg_seqno.  Returns 0 on success,
+// -1 on failure.
+int lcm_udp_send_message(uint32_t msg_seqno, const char *channel,
+        const struct iovec *iov, int iovcnt, unsigned int datalen,
+        lcm_udp_send_packet_t send_packet, void *user);
+
+
 /************************* Linux Specific Functions *******************/
 #ifdef __linux__
 void linux_check_routing_table(struct in_addr lcm_mcaddr);
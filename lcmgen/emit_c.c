@@ -895,16 +895,14 @@ static void emit_c_struct_publish(lcmgen_t *lcm, FILE *f, lcm_struct_t *lr)
             "int %s_publish(lcm_t *lc, const char *channel, const %s *p)\n"
             "{\n"
             "      int max_data_size = %s_encoded_size (p);\n"
-            "      uint8_t *buf = (uint8_t*) malloc (max_data_size);\n"
+            "      void *buf = lcm_publish_loan (lc, channel, max_data_size);\n"
             "      if (!buf) return -1;\n"
             "      int data_size = %s_encode (buf, 0, max_data_size, p);\n"
             "      if (data_size < 0) {\n"
-            "          free (buf);\n"
+            "          lcm_publish_abort (lc, buf);\n"
             "          return data_size;\n"
             "      }\n"
-            "      int status = lcm_publish (lc, channel, buf, data_size);\n"
-            "      free (buf);\n"
-            "      return status;\n"
+            "      return lcm_publish_commit (lc, buf, data_size);\n"
             "}\n\n", tn_, tn_, tn_, tn_);
 }
 
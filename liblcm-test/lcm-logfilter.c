@@ -1,14 +1,48 @@
 // file: lcm-logfilter.c
 // desc: utility to selectively extract channels from a logfile into a new one
+//
+// The source logfile is split into chunks that are filtered in parallel, each
+// into a temporary logfile.  Those are then concatenated, in order, into the
+// destination logfile.  Compressed logfiles can't be split, and are filtered
+// in a single pass instead.
 
 #include <stdio.h>
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
 
 #include <glib.h>
 
 #include <lcm/lcm.h>
 
+// Chunks per thread, so that threads that get faster chunks take more
+#define CHUNKS_PER_THREAD 4
+
+typedef struct {
+    const char *source_fname;
+    GRegex *regex;
+    int invert_regex;
+    int64_t start_utime;
+    int64_t end_utime;
+    int have_end_utime;
+    int64_t first_event_timestamp;
+
+    int nchunks;
+    int64_t *offsets;
+    char **chunk_fnames;
+
+    GMutex *mutex;
+    int next_chunk;
+    // the first chunk with an event after the end time.  No chunk after it
+    // needs to be filtered.
+    int stop_chunk;
+    int failed;
+} filter_t;
+
 static void 
 usage()
 {
@@ -30,6 +64,8 @@ usage()
            "            after the first message in the logfile will not be\n"
            "            extracted.\n"
            "  -v        verbose mode. Prints a summary of channels extracted\n"
+           "  -j N      number of threads to filter with.  Defaults to the\n"
+           "            number of processors.\n"
            );
     exit(1);
 }
@@ -40,6 +76,157 @@ _verbose_entry_summary(gpointer key, gpointer value, gpointer user_data)
     printf("%20s: %d\n", (char*)key, *((int*)value));
 }
 
+static int
+_num_processors(void)
+{
+#ifndef WIN32
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0)
+        return (int) n;
+#endif
+    return 1;
+}
+
+// Returns 1 if an event passes the filter, 0 if it doesn't, and -1 if it's
+// past the end time, so that no later event passes either.
+static int
+_filter_event(filter_t *f, const lcm_eventlog_event_t *event)
+{
+    int64_t elapsed = event->timestamp - f->first_event_timestamp;
+    if(elapsed < f->start_utime)
+        return 0;
+    if(f->have_end_utime && elapsed > f->end_utime)
+        return -1;
+
+    int regmatch = g_regex_match(f->regex, event->channel,
+            (GRegexMatchFlags) 0, NULL);
+    return (regmatch && !f->invert_regex) ||
+           (!regmatch && f->invert_regex);
+}
+
+static void
+_count_event(GHashTable *counts, const char *channel)
+{
+    int *count = (int *) g_hash_table_lookup(counts, channel);
+    if (!count) {
+        count = (int*) malloc(sizeof(int));
+        *count = 1;
+        g_hash_table_insert(counts, g_strdup(channel), count);
+        printf("matched channel %s\n", channel);
+    } else {
+        *count += 1;
+    }
+}
+
+// Copies the events of a chunk of the source logfile that pass the filter
+// into the temporary logfile of the chunk.
+static int
+_filter_chunk(filter_t *f, lcm_eventlog_reader_t *reader, int chunk)
+{
+    if (0 != lcm_eventlog_reader_set_range(reader, f->offsets[chunk],
+                f->offsets[chunk + 1]))
+        return -1;
+    lcm_eventlog_t *chunk_log =
+        lcm_eventlog_create(f->chunk_fnames[chunk], "w");
+    if (!chunk_log) {
+        perror("Unable to open temporary logfile");
+        return -1;
+    }
+
+    int status = 0;
+    const lcm_eventlog_event_t *event;
+    while ((event = lcm_eventlog_reader_next(reader))) {
+        int copy_to_dest = _filter_event(f, event);
+        if (copy_to_dest < 0) {
+            g_mutex_lock(f->mutex);
+            if (chunk < f->stop_chunk)
+                f->stop_chunk = chunk;
+            g_mutex_unlock(f->mutex);
+            break;
+        }
+        if (copy_to_dest) {
+            lcm_eventlog_event_t le = *event;
+            if (0 != lcm_eventlog_write_event(chunk_log, &le)) {
+                perror("Unable to write temporary logfile");
+                status = -1;
+                break;
+            }
+        }
+    }
+    lcm_eventlog_destroy(chunk_log);
+    return status;
+}
+
+static gpointer
+_filter_thread(gpointer user)
+{
+    filter_t *f = (filter_t *) user;
+    lcm_eventlog_reader_t *reader =
+        lcm_eventlog_reader_create(f->source_fname);
+    if (!reader) {
+        perror("Unable to open source logfile");
+        g_mutex_lock(f->mutex);
+        f->failed = 1;
+        g_mutex_unlock(f->mutex);
+        return NULL;
+    }
+
+    while (1) {
+        g_mutex_lock(f->mutex);
+        int chunk = f->next_chunk++;
+        int done = chunk >= f->nchunks || chunk > f->stop_chunk || f->failed;
+        g_mutex_unlock(f->mutex);
+        if (done)
+            break;
+
+        if (0 != _filter_chunk(f, reader, chunk)) {
+            g_mutex_lock(f->mutex);
+            f->failed = 1;
+            g_mutex_unlock(f->mutex);
+            break;
+        }
+    }
+    lcm_eventlog_reader_destroy(reader);
+    return NULL;
+}
+
+// Filters a logfile that can't be split straight into the destination
+// logfile.  Writing the events again numbers them.
+static int
+_filter_sequential(filter_t *f, lcm_eventlog_t *src_log,
+        lcm_eventlog_t *dst_log, GHashTable *counts, int verbose,
+        int *nwritten)
+{
+    int status = 0;
+    int first = 1;
+    lcm_eventlog_event_t *event;
+    while ((event = lcm_eventlog_read_next_event(src_log))) {
+        // times are relative to the first event in the source logfile
+        if (first) {
+            f->first_event_timestamp = event->timestamp;
+            first = 0;
+        }
+        int copy_to_dest = _filter_event(f, event);
+        if (copy_to_dest < 0) {
+            lcm_eventlog_free_event(event);
+            break;
+        }
+        if (copy_to_dest) {
+            if (0 != lcm_eventlog_write_event(dst_log, event)) {
+                perror("Unable to write destination logfile");
+                lcm_eventlog_free_event(event);
+                status = 1;
+                break;
+            }
+            (*nwritten)++;
+            if (verbose)
+                _count_event(counts, event->channel);
+        }
+        lcm_eventlog_free_event(event);
+    }
+    return status;
+}
+
 int main(int argc, char **argv)
 {
     int verbose = 0;
@@ -50,8 +237,9 @@ int main(int argc, char **argv)
     int64_t end_utime = -1;
     int have_end_utime = 0;
     int invert_regex = 0;
+    int nthreads = _num_processors();
 
-    char *optstring = "hc:vs:e:i";
+    char *optstring = "hc:vs:e:ij:";
     char c;
 
     while ((c = getopt(argc, argv, optstring)) >= 0)
@@ -88,6 +276,14 @@ int main(int argc, char **argv)
             case 'v':
                 verbose = 1;
                 break;
+            case 'j':
+                {
+                    char *eptr = NULL;
+                    nthreads = strtol(optarg, &eptr, 10);
+                    if(*eptr != 0 || nthreads <= 0)
+                        usage();
+                }
+                break;
             default:
                 usage();
                 break;
@@ -106,6 +302,7 @@ int main(int argc, char **argv)
     GRegex * regex;
     GError *rerr = NULL;
     regex = g_regex_new(pattern, (GRegexCompileFlags) 0, (GRegexMatchFlags) 0, &rerr);
+    g_free(pattern);
     if(rerr) {
         fprintf(stderr, "bad regex\n");
         exit(1);
@@ -114,8 +311,12 @@ int main(int argc, char **argv)
     source_fname = argv[argc - 2];
     dest_fname = argv[argc - 1];
 
-    lcm_eventlog_t *src_log = lcm_eventlog_create(source_fname, "r");
-    if (!src_log) {
+    // compressed logfiles can't be mapped, and are read from start to end
+    lcm_eventlog_t *seq_src_log = NULL;
+    lcm_eventlog_reader_t *src_log = lcm_eventlog_reader_create(source_fname);
+    if (!src_log && errno == EINVAL)
+        seq_src_log = lcm_eventlog_create(source_fname, "r");
+    if (!src_log && !seq_src_log) {
         perror("Unable to open source logfile");
 		g_regex_unref(regex);
         return 1;
@@ -123,57 +324,94 @@ int main(int argc, char **argv)
     lcm_eventlog_t *dst_log = lcm_eventlog_create(dest_fname, "w");
     if (!dst_log) {
         perror("Unable to open destination logfile");
-        lcm_eventlog_destroy(src_log);
+        if (src_log)
+            lcm_eventlog_reader_destroy(src_log);
+        else
+            lcm_eventlog_destroy(seq_src_log);
 		g_regex_unref(regex);
         return 1;
     }
 
+    filter_t f;
+    memset(&f, 0, sizeof(f));
+    f.source_fname = source_fname;
+    f.regex = regex;
+    f.invert_regex = invert_regex;
+    f.start_utime = start_utime;
+    f.end_utime = end_utime;
+    f.have_end_utime = have_end_utime;
+
     GHashTable *counts = g_hash_table_new_full(g_str_hash, g_str_equal,
             g_free, free);
     int nwritten = 0;
-    int have_first_event_timestamp = 0;
-    int64_t first_event_timestamp = 0;
-
-    for (lcm_eventlog_event_t *event = lcm_eventlog_read_next_event(src_log);
-            event != NULL;
-            event = lcm_eventlog_read_next_event(src_log)) {
-        if(!have_first_event_timestamp) {
-            first_event_timestamp = event->timestamp;
-            have_first_event_timestamp = 1;
-        }
+    int status = 0;
+    if (seq_src_log) {
+        status = _filter_sequential(&f, seq_src_log, dst_log, counts, verbose,
+                &nwritten);
+        lcm_eventlog_destroy(seq_src_log);
+        goto done;
+    }
 
-        int64_t elapsed = event->timestamp - first_event_timestamp;
-        if(elapsed < start_utime) {
-            lcm_eventlog_free_event(event);
+    // times are relative to the first event in the source logfile
+    const lcm_eventlog_event_t *first_event = lcm_eventlog_reader_next(src_log);
+    f.first_event_timestamp = first_event ? first_event->timestamp : 0;
+
+    f.nchunks = nthreads > 1 ? nthreads * CHUNKS_PER_THREAD : 1;
+    f.offsets = (int64_t *) calloc(f.nchunks + 1, sizeof(int64_t));
+    f.chunk_fnames = (char **) calloc(f.nchunks, sizeof(char *));
+    for (int i = 0; i < f.nchunks; i++)
+        f.chunk_fnames[i] = g_strdup_printf("%s.chunk%d", dest_fname, i);
+    lcm_eventlog_reader_split(src_log, f.nchunks, f.offsets);
+    lcm_eventlog_reader_destroy(src_log);
+    f.mutex = g_mutex_new();
+    f.stop_chunk = f.nchunks;
+
+    if (nthreads > f.nchunks)
+        nthreads = f.nchunks;
+    GThread **threads = (GThread **) calloc(nthreads, sizeof(GThread *));
+    for (int i = 0; i < nthreads; i++)
+        threads[i] = g_thread_create(_filter_thread, &f, TRUE, NULL);
+    for (int i = 0; i < nthreads; i++)
+        g_thread_join(threads[i]);
+    free(threads);
+
+    // Concatenate the chunks.  Writing the events again numbers them.
+    status = f.failed;
+    for (int i = 0; i < f.nchunks; i++) {
+        if (status || i > f.stop_chunk) {
+            remove(f.chunk_fnames[i]);
             continue;
         }
-        if(have_end_utime && elapsed > end_utime) {
-            lcm_eventlog_free_event(event);
-            break;
+        lcm_eventlog_reader_t *chunk_log =
+            lcm_eventlog_reader_create(f.chunk_fnames[i]);
+        if (!chunk_log) {
+            perror("Unable to open temporary logfile");
+            status = 1;
+            continue;
         }
-
-		int regmatch =  g_regex_match(regex, event->channel, (GRegexMatchFlags) 0, NULL);
-        int copy_to_dest = (regmatch == 0 && !invert_regex) ||
-                           (regmatch != 0 && invert_regex);
-        if (copy_to_dest) {
-            lcm_eventlog_write_event(dst_log, event);
+        const lcm_eventlog_event_t *event;
+        while ((event = lcm_eventlog_reader_next(chunk_log))) {
+            lcm_eventlog_event_t le = *event;
+            if (0 != lcm_eventlog_write_event(dst_log, &le)) {
+                perror("Unable to write destination logfile");
+                status = 1;
+                break;
+            }
             nwritten++;
 
-            if (verbose)  {
-                int *count = (int *) g_hash_table_lookup(counts, event->channel);
-                if (!count) {
-                    count = (int*) malloc(sizeof(int));
-                    *count = 1;
-                    g_hash_table_insert(counts, g_strdup(event->channel), count);
-                    printf("matched channel %s\n", event->channel);
-                } else {
-                    *count += 1;
-                }
-            }
+            if (verbose)
+                _count_event(counts, event->channel);
         }
-        lcm_eventlog_free_event(event);
+        lcm_eventlog_reader_destroy(chunk_log);
+        remove(f.chunk_fnames[i]);
     }
+    for (int i = 0; i < f.nchunks; i++)
+        g_free(f.chunk_fnames[i]);
+    free(f.chunk_fnames);
+    free(f.offsets);
+    g_mutex_free(f.mutex);
 
+done:
     if (verbose) {
         g_hash_table_foreach(counts, _verbose_entry_summary, NULL);
         printf("=====\n");
@@ -181,8 +419,7 @@ int main(int argc, char **argv)
     }
     
 	g_regex_unref(regex);
-    lcm_eventlog_destroy(src_log);
     lcm_eventlog_destroy(dst_log);
     g_hash_table_destroy(counts);
-    return 0;
+    return status;
 }
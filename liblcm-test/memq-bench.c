@@ -0,0 +1,144 @@
+// Measures how fast messages can be published to, and dispatched from, a
+// memq:// instance.
+//
+// Two patterns are timed:
+//   burst     one thread publishes a batch of messages, then handles them all
+//   threaded  several threads publish while the main thread handles
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <glib.h>
+#include <lcm/lcm.h>
+
+typedef struct {
+    lcm_t *lcm;
+    int num_messages;
+    int msg_size;
+} publisher_t;
+
+static void
+handler (const lcm_recv_buf_t *rbuf, const char *channel, void *user)
+{
+    int64_t *count = (int64_t*) user;
+    (*count)++;
+}
+
+static gpointer
+publisher_thread (gpointer user)
+{
+    publisher_t *pub = (publisher_t*) user;
+    uint8_t *data = (uint8_t*) calloc (1, pub->msg_size);
+    for (int i = 0; i < pub->num_messages; i++)
+        lcm_publish (pub->lcm, "BENCH", data, pub->msg_size);
+    free (data);
+    return NULL;
+}
+
+static double
+now_sec (void)
+{
+    GTimeVal tv;
+    g_get_current_time (&tv);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void
+report (const char *name, int64_t count, int msg_size, double elapsed)
+{
+    printf ("%-10s %10" G_GINT64_FORMAT " msgs  %8.3f s  %12.0f msgs/s  %10.1f MB/s\n",
+            name, count, elapsed, count / elapsed,
+            count * (double) msg_size / elapsed / (1024 * 1024));
+}
+
+static void
+usage (void)
+{
+    fprintf (stderr, "usage: lcm-memq-bench [options]\n"
+            "\n"
+            "  -n, --messages=N   Number of messages per test (default: 1000000)\n"
+            "  -s, --size=BYTES   Message size (default: 100)\n"
+            "  -b, --burst=N      Messages published before each round of handling\n"
+            "                     in the burst test (default: 100)\n"
+            "  -t, --threads=N    Publisher threads in the threaded test (default: 4)\n"
+            "  -u, --url=URL      LCM URL to use (default: memq://)\n"
+            "  -h, --help         Shows this help text and exits\n");
+}
+
+int main (int argc, char **argv)
+{
+    int num_messages = 1000000;
+    int msg_size = 100;
+    int burst = 100;
+    int num_threads = 4;
+    const char *url = "memq://";
+
+    struct option long_opts[] = {
+        { "messages", required_argument, 0, 'n' },
+        { "size", required_argument, 0, 's' },
+        { "burst", required_argument, 0, 'b' },
+        { "threads", required_argument, 0, 't' },
+        { "url", required_argument, 0, 'u' },
+        { "help", no_argument, 0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+    int c;
+    while ((c = getopt_long (argc, argv, "n:s:b:t:u:h", long_opts, 0)) >= 0) {
+        switch (c) {
+            case 'n': num_messages = atoi (optarg); break;
+            case 's': msg_size = atoi (optarg); break;
+            case 'b': burst = atoi (optarg); break;
+            case 't': num_threads = atoi (optarg); break;
+            case 'u': url = optarg; break;
+            case 'h':
+            default:
+                usage ();
+                return 1;
+        }
+    }
+    if (num_messages <= 0 || msg_size < 0 || burst <= 0 || num_threads <= 0) {
+        usage ();
+        return 1;
+    }
+
+    lcm_t *lcm = lcm_create (url);
+    if (!lcm) {
+        fprintf (stderr, "Couldn't initialize LCM with %s\n", url);
+        return 1;
+    }
+    int64_t count = 0;
+    lcm_subscribe (lcm, "BENCH", handler, &count);
+    uint8_t *data = (uint8_t*) calloc (1, msg_size);
+
+    // burst
+    double start = now_sec ();
+    for (int sent = 0; sent < num_messages; ) {
+        int n = MIN (burst, num_messages - sent);
+        for (int i = 0; i < n; i++)
+            lcm_publish (lcm, "BENCH", data, msg_size);
+        for (int i = 0; i < n; i++)
+            lcm_handle (lcm);
+        sent += n;
+    }
+    report ("burst", count, msg_size, now_sec () - start);
+
+    // threaded
+    count = 0;
+    publisher_t pub = { lcm, num_messages / num_threads, msg_size };
+    int64_t expected = (int64_t) pub.num_messages * num_threads;
+    GThread **threads = (GThread**) calloc (num_threads, sizeof (GThread*));
+    start = now_sec ();
+    for (int i = 0; i < num_threads; i++)
+        threads[i] = g_thread_create (publisher_thread, &pub, TRUE, NULL);
+    while (count < expected)
+        lcm_handle (lcm);
+    for (int i = 0; i < num_threads; i++)
+        g_thread_join (threads[i]);
+    report ("threaded", count, msg_size, now_sec () - start);
+
+    free (threads);
+    free (data);
+    lcm_destroy (lcm);
+    return 0;
+}
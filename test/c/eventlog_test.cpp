@@ -1,5 +1,7 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
 #include <gtest/gtest.h>
 
 #include <lcm/lcm.h>
@@ -128,3 +130,379 @@ TEST(LCM_C, EventLogCorrupt) {
     lcm_eventlog_destroy(rlog);
     free_tmpnam(fname);
 }
+
+TEST(LCM_C, EventLogIndexSeek) {
+    // Seek by timestamp in a log that has an index, written while logging
+    // and built afterwards.
+    char* fname = make_tmpnam();
+    std::string index_fname = std::string(fname) + ".idx";
+
+    lcm_eventlog_t* wlog = lcm_eventlog_create(fname, "w");
+    ASSERT_NE((void*)NULL, wlog);
+    ASSERT_EQ(0, lcm_eventlog_write_index(wlog, index_fname.c_str(), 10, 0));
+
+    char channel[32];
+    char data[100];
+    memset(data, 0, sizeof(data));
+    const int num_events = 1000;
+    for (int event_num = 0; event_num < num_events; ++event_num) {
+        lcm_eventlog_event_t event;
+        snprintf(channel, sizeof(channel), "CHANNEL_%d", event_num % 7);
+        event.channellen = strlen(channel);
+        event.channel = channel;
+        event.datalen = event_num % sizeof(data);
+        event.data = data;
+        event.timestamp = 1000 + event_num * 10;
+        EXPECT_EQ(0, lcm_eventlog_write_event(wlog, &event));
+    }
+    lcm_eventlog_destroy(wlog);
+
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) {
+            EXPECT_EQ(num_events, lcm_eventlog_build_index(fname,
+                        index_fname.c_str(), 100, 0));
+        }
+        lcm_eventlog_t* rlog = lcm_eventlog_create(fname, "r");
+        ASSERT_NE((void*)NULL, rlog);
+        ASSERT_NE((void*)NULL, rlog->index);
+
+        for (int event_num = 0; event_num < num_events; event_num += 37) {
+            // between two events, and exactly on one
+            EXPECT_EQ(0, lcm_eventlog_seek_to_timestamp(rlog,
+                        1000 + event_num * 10 - 5));
+            lcm_eventlog_event_t* revent = lcm_eventlog_read_next_event(rlog);
+            ASSERT_NE((void*)NULL, revent);
+            EXPECT_EQ(event_num, revent->eventnum);
+            lcm_eventlog_free_event(revent);
+
+            EXPECT_EQ(0, lcm_eventlog_seek_to_timestamp(rlog,
+                        1000 + event_num * 10));
+            revent = lcm_eventlog_read_next_event(rlog);
+            ASSERT_NE((void*)NULL, revent);
+            EXPECT_EQ(event_num, revent->eventnum);
+            lcm_eventlog_free_event(revent);
+        }
+
+        // past the end of the log
+        EXPECT_EQ(0, lcm_eventlog_seek_to_timestamp(rlog, 1000000));
+        EXPECT_EQ((void*)NULL, lcm_eventlog_read_next_event(rlog));
+        lcm_eventlog_destroy(rlog);
+    }
+
+    remove(index_fname.c_str());
+    free_tmpnam(fname);
+}
+
+TEST(LCM_C, EventLogReader) {
+    // Read a log through a memory mapping, and seek in it with and without
+    // an index.
+    char* fname = make_tmpnam();
+    std::string index_fname = std::string(fname) + ".idx";
+    const int num_events = 5000;
+
+    lcm_eventlog_t* wlog = lcm_eventlog_create(fname, "w");
+    ASSERT_NE((void*)NULL, wlog);
+    char channel[32];
+    char data[100];
+    for (int event_num = 0; event_num < num_events; ++event_num) {
+        lcm_eventlog_event_t event;
+        snprintf(channel, sizeof(channel), "CHANNEL_%d", event_num % 7);
+        memset(data, event_num & 0xff, sizeof(data));
+        event.channellen = strlen(channel);
+        event.channel = channel;
+        event.datalen = event_num % sizeof(data);
+        event.data = data;
+        event.timestamp = 1000 + event_num * 10;
+        EXPECT_EQ(0, lcm_eventlog_write_event(wlog, &event));
+    }
+    lcm_eventlog_destroy(wlog);
+
+    for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) {
+            EXPECT_EQ(num_events, lcm_eventlog_build_index(fname,
+                        index_fname.c_str(), 100, 0));
+        }
+        lcm_eventlog_reader_t* reader = lcm_eventlog_reader_create(fname);
+        ASSERT_NE((void*)NULL, reader);
+
+        const lcm_eventlog_event_t* event;
+        int event_num = 0;
+        while ((event = lcm_eventlog_reader_next(reader))) {
+            snprintf(channel, sizeof(channel), "CHANNEL_%d", event_num % 7);
+            EXPECT_EQ(event_num, event->eventnum);
+            EXPECT_STREQ(channel, event->channel);
+            ASSERT_EQ(event_num % (int)sizeof(data), event->datalen);
+            for (int i = 0; i < event->datalen; ++i)
+                ASSERT_EQ(event_num & 0xff, ((uint8_t*)event->data)[i]);
+            ++event_num;
+        }
+        EXPECT_EQ(num_events, event_num);
+        EXPECT_EQ(lcm_eventlog_reader_size(reader),
+                lcm_eventlog_reader_tell(reader));
+
+        for (event_num = 0; event_num < num_events; event_num += 37) {
+            EXPECT_EQ(0, lcm_eventlog_reader_seek_to_timestamp(reader,
+                        1000 + event_num * 10 - 5));
+            event = lcm_eventlog_reader_next(reader);
+            ASSERT_NE((void*)NULL, event);
+            EXPECT_EQ(event_num, event->eventnum);
+        }
+
+        // past the end of the log
+        EXPECT_EQ(0, lcm_eventlog_reader_seek_to_timestamp(reader, 1000000));
+        EXPECT_EQ((void*)NULL, lcm_eventlog_reader_next(reader));
+
+        EXPECT_EQ(0, lcm_eventlog_reader_seek(reader, 0));
+        event = lcm_eventlog_reader_next(reader);
+        ASSERT_NE((void*)NULL, event);
+        EXPECT_EQ(0, event->eventnum);
+        lcm_eventlog_reader_destroy(reader);
+    }
+
+    remove(index_fname.c_str());
+    free_tmpnam(fname);
+}
+
+static int channel_is_odd(const char* channel, void* user)
+{
+    int* num_filtered = (int*) user;
+    (*num_filtered)++;
+    return channel[strlen(channel) - 1] % 2;
+}
+
+TEST(LCM_C, EventLogReadFiltered) {
+    // Only read the events on some channels.
+    char* fname = make_tmpnam();
+    const int num_events = 1000;
+
+    lcm_eventlog_t* wlog = lcm_eventlog_create(fname, "w");
+    ASSERT_NE((void*)NULL, wlog);
+    char channel[32];
+    char data[100];
+    for (int event_num = 0; event_num < num_events; ++event_num) {
+        lcm_eventlog_event_t event;
+        snprintf(channel, sizeof(channel), "CHANNEL_%d", event_num % 10);
+        memset(data, event_num & 0xff, sizeof(data));
+        event.channellen = strlen(channel);
+        event.channel = channel;
+        event.datalen = event_num % sizeof(data);
+        event.data = data;
+        event.timestamp = event_num;
+        EXPECT_EQ(0, lcm_eventlog_write_event(wlog, &event));
+    }
+    lcm_eventlog_destroy(wlog);
+
+    lcm_eventlog_t* rlog = lcm_eventlog_create(fname, "r");
+    ASSERT_NE((void*)NULL, rlog);
+    int num_filtered = 0;
+    int event_num = 1;
+    lcm_eventlog_event_t* event;
+    while ((event = lcm_eventlog_read_next_event_filtered(rlog,
+                    channel_is_odd, &num_filtered))) {
+        snprintf(channel, sizeof(channel), "CHANNEL_%d", event_num % 10);
+        EXPECT_EQ(event_num, event->eventnum);
+        EXPECT_STREQ(channel, event->channel);
+        ASSERT_EQ(event_num % (int)sizeof(data), event->datalen);
+        for (int i = 0; i < event->datalen; ++i)
+            ASSERT_EQ(event_num & 0xff, ((uint8_t*)event->data)[i]);
+        lcm_eventlog_free_event(event);
+        event_num += 2;
+    }
+    EXPECT_EQ(num_events + 1, event_num);
+    EXPECT_EQ(num_events, num_filtered);
+    lcm_eventlog_destroy(rlog);
+
+    free_tmpnam(fname);
+}
+
+TEST(LCM_C, EventLogReaderSplit) {
+    // Split a log into ranges, and check that reading all of them reads every
+    // event once.
+    char* fname = make_tmpnam();
+    const int num_events = 2000;
+
+    lcm_eventlog_t* wlog = lcm_eventlog_create(fname, "w");
+    ASSERT_NE((void*)NULL, wlog);
+    char data[300];
+    for (int event_num = 0; event_num < num_events; ++event_num) {
+        lcm_eventlog_event_t event;
+        // data that looks like the start of an event
+        memset(data, 0, sizeof(data));
+        memcpy(data, "\xed\xa1\xda\x01", 4);
+        event.channellen = strlen("CHANNEL");
+        event.channel = const_cast<char*>("CHANNEL");
+        event.datalen = event_num % sizeof(data);
+        event.data = data;
+        event.timestamp = event_num;
+        EXPECT_EQ(0, lcm_eventlog_write_event(wlog, &event));
+    }
+    lcm_eventlog_destroy(wlog);
+
+    lcm_eventlog_reader_t* reader = lcm_eventlog_reader_create(fname);
+    ASSERT_NE((void*)NULL, reader);
+    const int nchunks = 7;
+    int64_t offsets[nchunks + 1];
+    EXPECT_EQ(0, lcm_eventlog_reader_split(reader, nchunks, offsets));
+    EXPECT_EQ(0, offsets[0]);
+    EXPECT_EQ(lcm_eventlog_reader_size(reader), offsets[nchunks]);
+
+    int event_num = 0;
+    for (int i = 0; i < nchunks; ++i) {
+        EXPECT_LE(offsets[i], offsets[i + 1]);
+        EXPECT_EQ(0, lcm_eventlog_reader_set_range(reader, offsets[i],
+                    offsets[i + 1]));
+        const lcm_eventlog_event_t* event;
+        while ((event = lcm_eventlog_reader_next(reader))) {
+            EXPECT_EQ(event_num, event->eventnum);
+            ++event_num;
+        }
+    }
+    EXPECT_EQ(num_events, event_num);
+    lcm_eventlog_reader_destroy(reader);
+
+    free_tmpnam(fname);
+}
+
+TEST(LCM_C, EventLogCompressed) {
+    // Write a compressed log, append to it, and read it back.
+    char* fname = make_tmpnam();
+    const int num_events = 3000;
+    char channel[32];
+    char data[1000];
+
+    for (int pass = 0; pass < 2; ++pass) {
+        lcm_eventlog_t* wlog = pass == 0 ?
+            lcm_eventlog_create_compressed(fname, "w") :
+            lcm_eventlog_create(fname, "a");
+        ASSERT_NE((void*)NULL, wlog);
+        wlog->eventcount = pass * num_events / 2;
+        for (int event_num = pass * num_events / 2;
+             event_num < (pass + 1) * num_events / 2; ++event_num) {
+            lcm_eventlog_event_t event;
+            snprintf(channel, sizeof(channel), "CHANNEL_%d", event_num % 7);
+            for (int i = 0; i < (int)sizeof(data); ++i)
+                data[i] = (i / 10 + event_num) & 0xff;
+            event.channellen = strlen(channel);
+            event.channel = channel;
+            event.datalen = event_num % sizeof(data);
+            event.data = data;
+            event.timestamp = 1000 + event_num * 10;
+            EXPECT_EQ(0, lcm_eventlog_write_event(wlog, &event));
+            if (event_num % 100 == 0)
+                EXPECT_EQ(0, lcm_eventlog_flush(wlog));
+        }
+        lcm_eventlog_destroy(wlog);
+    }
+
+    lcm_eventlog_t* rlog = lcm_eventlog_create(fname, "r");
+    ASSERT_NE((void*)NULL, rlog);
+    lcm_eventlog_event_t* event;
+    int event_num = 0;
+    while ((event = lcm_eventlog_read_next_event(rlog))) {
+        snprintf(channel, sizeof(channel), "CHANNEL_%d", event_num % 7);
+        EXPECT_EQ(event_num, event->eventnum);
+        EXPECT_EQ(1000 + event_num * 10, event->timestamp);
+        EXPECT_STREQ(channel, event->channel);
+        ASSERT_EQ(event_num % (int)sizeof(data), event->datalen);
+        for (int i = 0; i < event->datalen; ++i)
+            ASSERT_EQ((i / 10 + event_num) & 0xff, ((uint8_t*)event->data)[i]);
+        lcm_eventlog_free_event(event);
+        ++event_num;
+    }
+    EXPECT_EQ(num_events, event_num);
+
+    for (event_num = 0; event_num < num_events; event_num += 37) {
+        EXPECT_EQ(0, lcm_eventlog_seek_to_timestamp(rlog,
+                    1000 + event_num * 10 - 5));
+        event = lcm_eventlog_read_next_event(rlog);
+        ASSERT_NE((void*)NULL, event);
+        EXPECT_EQ(event_num, event->eventnum);
+        lcm_eventlog_free_event(event);
+    }
+    lcm_eventlog_destroy(rlog);
+
+    // compressed logs are smaller
+    FILE* f = fopen(fname, "rb");
+    fseek(f, 0, SEEK_END);
+    EXPECT_LT(ftell(f), num_events * (int)sizeof(data) / 4);
+    fclose(f);
+
+    free_tmpnam(fname);
+}
+
+TEST(LCM_C, EventLogMerge) {
+    // Write events to shards by channel, and read them back in order from
+    // the manifest.
+    char* fname = make_tmpnam();
+    std::string manifest = fname;
+    free_tmpnam(fname);
+    const int num_shards = 3;
+    const int num_events = 3000;
+    std::string shard_fnames[num_shards];
+    lcm_eventlog_t* wlogs[num_shards];
+    for (int i = 0; i < num_shards; ++i) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), ".s%d", i);
+        shard_fnames[i] = manifest + suffix;
+        wlogs[i] = lcm_eventlog_create(shard_fnames[i].c_str(), "w");
+        ASSERT_NE((void*)NULL, wlogs[i]);
+        EXPECT_EQ(0, lcm_eventlog_manifest_add(manifest.c_str(),
+                    shard_fnames[i].c_str()));
+    }
+    // listed once, however often it's added
+    EXPECT_EQ(0, lcm_eventlog_manifest_add(manifest.c_str(),
+                shard_fnames[0].c_str()));
+    EXPECT_TRUE(lcm_eventlog_is_manifest(manifest.c_str()));
+    EXPECT_FALSE(lcm_eventlog_is_manifest(shard_fnames[0].c_str()));
+
+    char channel[32];
+    char data[100];
+    for (int event_num = 0; event_num < num_events; ++event_num) {
+        lcm_eventlog_event_t event;
+        snprintf(channel, sizeof(channel), "CHANNEL_%d", event_num % 7);
+        memset(data, event_num & 0xff, sizeof(data));
+        event.channellen = strlen(channel);
+        event.channel = channel;
+        event.datalen = event_num % sizeof(data);
+        event.data = data;
+        event.timestamp = event_num * 10;
+        EXPECT_EQ(0, lcm_eventlog_write_event(
+                    wlogs[(event_num % 7) % num_shards], &event));
+    }
+    for (int i = 0; i < num_shards; ++i)
+        lcm_eventlog_destroy(wlogs[i]);
+
+    lcm_eventlog_merge_t* merge =
+        lcm_eventlog_merge_create_from_manifest(manifest.c_str());
+    ASSERT_NE((void*)NULL, merge);
+    lcm_eventlog_event_t* event;
+    int event_num = 0;
+    while ((event = lcm_eventlog_merge_read_next_event(merge))) {
+        snprintf(channel, sizeof(channel), "CHANNEL_%d", event_num % 7);
+        EXPECT_EQ(event_num * 10, event->timestamp);
+        EXPECT_STREQ(channel, event->channel);
+        ASSERT_EQ(event_num % (int)sizeof(data), event->datalen);
+        lcm_eventlog_free_event(event);
+        ++event_num;
+    }
+    EXPECT_EQ(num_events, event_num);
+
+    // seek, then read only odd channels
+    int num_filtered = 0;
+    EXPECT_EQ(0, lcm_eventlog_merge_seek_to_timestamp(merge, 10005));
+    event_num = 1001;
+    while ((event = lcm_eventlog_merge_read_next_event_filtered(merge,
+                    channel_is_odd, &num_filtered))) {
+        while ((event_num % 7) % 2 == 0)
+            ++event_num;
+        EXPECT_EQ(event_num * 10, event->timestamp);
+        lcm_eventlog_free_event(event);
+        ++event_num;
+    }
+    EXPECT_EQ(num_events, event_num);
+    lcm_eventlog_merge_destroy(merge);
+
+    for (int i = 0; i < num_shards; ++i)
+        remove(shard_fnames[i].c_str());
+    remove(manifest.c_str());
+}
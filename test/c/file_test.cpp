@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm.h>
+#include "common.h"
+
+static int64_t NowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Events 5ms apart, alternating between the channels A and B.  The data of
+// each event is its number.
+static std::string WriteLog(int num_events) {
+    char* tmp = make_tmpnam();
+    std::string fname(tmp);
+    free_tmpnam(tmp);
+
+    lcm_eventlog_t* log = lcm_eventlog_create(fname.c_str(), "w");
+    EXPECT_TRUE(log != NULL);
+    for (int i = 0; i < num_events; i++) {
+        lcm_eventlog_event_t event;
+        event.timestamp = 1000000 + i * 5000;
+        event.channel = const_cast<char*>((i % 2) ? "B" : "A");
+        event.channellen = 1;
+        event.data = &i;
+        event.datalen = sizeof(i);
+        lcm_eventlog_write_event(log, &event);
+    }
+    lcm_eventlog_destroy(log);
+    return fname;
+}
+
+struct Received {
+    std::vector<int> events;
+    std::vector<int64_t> recv_utimes;
+};
+
+static void OnEvent(const lcm_recv_buf_t* rbuf, const char* channel,
+        void* user) {
+    Received* received = (Received*) user;
+    int i;
+    memcpy(&i, rbuf->data, sizeof(i));
+    received->events.push_back(i);
+    received->recv_utimes.push_back(rbuf->recv_utime);
+}
+
+// Plays back a log, and checks that each call to lcm_handle() dispatches one
+// event, until the end of the log
+static Received PlayBack(const std::string& url, int num_events) {
+    Received received;
+    lcm_t* lcm = lcm_create(url.c_str());
+    EXPECT_TRUE(lcm != NULL);
+    if (!lcm)
+        return received;
+    lcm_subscribe(lcm, ".*", OnEvent, &received);
+    for (int i = 0; i < num_events; i++) {
+        EXPECT_EQ(0, lcm_handle(lcm));
+        EXPECT_EQ(i + 1, (int) received.events.size());
+    }
+    EXPECT_EQ(-1, lcm_handle(lcm));
+    EXPECT_EQ(-1, lcm_handle(lcm));
+    lcm_destroy(lcm);
+    return received;
+}
+
+TEST(LCM_C, FilePlayback) {
+    const int num_events = 40;
+    std::string fname = WriteLog(num_events);
+
+    int64_t start = NowMicros();
+    Received received = PlayBack("file://" + fname + "?speed=1", num_events);
+    int64_t elapsed = NowMicros() - start;
+
+    // the events are played back in real time, 5ms apart
+    EXPECT_GE(elapsed, (num_events - 1) * 5000);
+    ASSERT_EQ(num_events, (int) received.events.size());
+    for (int i = 0; i < num_events; i++) {
+        EXPECT_EQ(i, received.events[i]);
+        EXPECT_EQ(received.recv_utimes[0] + i * 5000, received.recv_utimes[i]);
+    }
+    remove(fname.c_str());
+}
+
+TEST(LCM_C, FilePlaybackSpeed) {
+    const int num_events = 40;
+    std::string fname = WriteLog(num_events);
+
+    Received received = PlayBack("file://" + fname + "?speed=2&spin=200",
+            num_events);
+    ASSERT_EQ(num_events, (int) received.events.size());
+    for (int i = 0; i < num_events; i++)
+        EXPECT_EQ(received.recv_utimes[0] + i * 2500, received.recv_utimes[i]);
+    remove(fname.c_str());
+}
+
+TEST(LCM_C, FilePlaybackFast) {
+    const int num_events = 10000;
+    std::string fname = WriteLog(num_events);
+
+    // 50 seconds of log
+    int64_t start = NowMicros();
+    Received received = PlayBack("file://" + fname + "?speed=0", num_events);
+    EXPECT_LT(NowMicros() - start, 10000000);
+    ASSERT_EQ(num_events, (int) received.events.size());
+    for (int i = 0; i < num_events; i++)
+        EXPECT_EQ(i, received.events[i]);
+    remove(fname.c_str());
+}
+
+TEST(LCM_C, FilePlaybackUnsubscribed) {
+    // Events on channels without handlers are skipped, and don't need an
+    // lcm_handle() call
+    const int num_events = 20;
+    std::string fname = WriteLog(num_events);
+
+    Received received;
+    lcm_t* lcm = lcm_create(("file://" + fname + "?speed=4").c_str());
+    ASSERT_TRUE(lcm != NULL);
+    lcm_subscribe(lcm, "A", OnEvent, &received);
+    while (0 == lcm_handle(lcm))
+        ;
+    lcm_destroy(lcm);
+
+    ASSERT_EQ(num_events / 2, (int) received.events.size());
+    for (int i = 0; i < num_events / 2; i++)
+        EXPECT_EQ(2 * i, received.events[i]);
+    remove(fname.c_str());
+}
+
+TEST(LCM_C, FilePlaybackDestroy) {
+    // Destroying the lcm_t doesn't wait for the next event to be due
+    std::string fname = WriteLog(2);
+    lcm_eventlog_t* log = lcm_eventlog_create(fname.c_str(), "a");
+    ASSERT_TRUE(log != NULL);
+    lcm_eventlog_event_t event;
+    event.timestamp = 1000000 + 3600 * 1000000LL;
+    event.channel = const_cast<char*>("A");
+    event.channellen = 1;
+    int i = 2;
+    event.data = &i;
+    event.datalen = sizeof(i);
+    lcm_eventlog_write_event(log, &event);
+    lcm_eventlog_destroy(log);
+
+    Received received;
+    lcm_t* lcm = lcm_create(("file://" + fname).c_str());
+    ASSERT_TRUE(lcm != NULL);
+    lcm_subscribe(lcm, ".*", OnEvent, &received);
+    EXPECT_EQ(0, lcm_handle(lcm));
+    EXPECT_EQ(0, lcm_handle(lcm));
+    EXPECT_EQ(0, lcm_handle_timeout(lcm, 50));
+    int64_t start = NowMicros();
+    lcm_destroy(lcm);
+    EXPECT_LT(NowMicros() - start, 1000000);
+    EXPECT_EQ(2, (int) received.events.size());
+    remove(fname.c_str());
+}
+
+TEST(LCM_C, FilePlaybackStartTimestamp) {
+    // The log is seeked before the first event is read, so playback starts
+    // right away at start_timestamp, rather than at the start of the log
+    const int num_events = 40;
+    std::string fname = WriteLog(num_events);
+
+    int64_t start = NowMicros();
+    Received received = PlayBack("file://" + fname +
+            "?start_timestamp=1100000", num_events - 20);
+    int64_t elapsed = NowMicros() - start;
+
+    EXPECT_LT(elapsed, num_events * 5000);
+    ASSERT_EQ(num_events - 20, (int) received.events.size());
+    for (int i = 0; i < num_events - 20; i++) {
+        EXPECT_EQ(20 + i, received.events[i]);
+        EXPECT_EQ(received.recv_utimes[0] + i * 5000, received.recv_utimes[i]);
+    }
+
+    // past the end of the log, there's nothing to play back
+    lcm_t* lcm = lcm_create(("file://" + fname +
+                "?start_timestamp=2000000").c_str());
+    ASSERT_TRUE(lcm != NULL);
+    EXPECT_EQ(-1, lcm_handle(lcm));
+    lcm_destroy(lcm);
+    remove(fname.c_str());
+}
+
+TEST(LCM_C, FilePlaybackLateSubscribe) {
+    // Events on a channel that's subscribed to during playback are played
+    // back from then on, even though they may have been read ahead already
+    const int num_events = 40;
+    std::string fname = WriteLog(num_events);
+
+    const char* options[] = { "?speed=1", "?speed=0" };
+    for (int j = 0; j < 2; j++) {
+        Received received;
+        lcm_t* lcm = lcm_create(("file://" + fname + options[j]).c_str());
+        ASSERT_TRUE(lcm != NULL);
+        lcm_subscribe(lcm, "A", OnEvent, &received);
+        while (received.events.size() < 4)
+            ASSERT_EQ(0, lcm_handle(lcm));
+        lcm_subscribe(lcm, "B", OnEvent, &received);
+        while (0 == lcm_handle(lcm))
+            ;
+        lcm_destroy(lcm);
+
+        // with speed=1, event 7 is due 5ms after event 6, and may be missed
+        ASSERT_LE(num_events - 4, (int) received.events.size()) << options[j];
+        for (int i = 0; i < 4; i++)
+            EXPECT_EQ(2 * i, received.events[i]) << options[j];
+        int first_late = received.events.size() - (num_events - 8);
+        for (int i = 8; i < num_events; i++)
+            EXPECT_EQ(i, received.events[first_late + i - 8]) << options[j];
+        if (j == 1)
+            EXPECT_EQ(num_events - 3, (int) received.events.size());
+    }
+    remove(fname.c_str());
+}
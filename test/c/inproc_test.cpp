@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <string.h>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm.h>
+
+static void InprocHandler(const lcm_recv_buf_t* rbuf, const char* channel,
+        void* user_data) {
+    std::vector<std::vector<uint8_t> >* received_buffers =
+        (std::vector<std::vector<uint8_t> >*)user_data;
+    uint8_t* data = (uint8_t*)rbuf->data;
+    received_buffers->push_back(std::vector<uint8_t>(data,
+                data + rbuf->data_size));
+}
+
+TEST(LCM_C, InprocConstructDestroy) {
+    lcm_t* lcm = lcm_create("inproc://");
+    EXPECT_TRUE(lcm != NULL);
+    lcm_destroy(lcm);
+}
+
+TEST(LCM_C, InprocSharedBus) {
+    // Messages published by one instance reach every instance on the same
+    // bus, and none on other buses.
+    lcm_t* a = lcm_create("inproc://bus");
+    lcm_t* b = lcm_create("inproc://bus");
+    lcm_t* other = lcm_create("inproc://other");
+    ASSERT_TRUE(a != NULL && b != NULL && other != NULL);
+
+    std::vector<std::vector<uint8_t> > received_a, received_b, received_other;
+    lcm_subscribe(a, "channel", InprocHandler, &received_a);
+    lcm_subscribe(b, "channel", InprocHandler, &received_b);
+    lcm_subscribe(other, "channel", InprocHandler, &received_other);
+
+    std::vector<std::vector<uint8_t> > buffers;
+    for (int buf_num = 0; buf_num < 20; ++buf_num) {
+        std::vector<uint8_t> buf(1 + rand() % 100);
+        for (size_t byte_index = 0; byte_index < buf.size(); ++byte_index) {
+            buf[byte_index] = rand() % 255;
+        }
+        lcm_publish(a, "channel", &buf[0], buf.size());
+        buffers.push_back(buf);
+    }
+
+    while (lcm_handle_timeout(a, 0) > 0) {
+    }
+    while (lcm_handle_timeout(b, 0) > 0) {
+    }
+    EXPECT_EQ(0, lcm_handle_timeout(other, 0));
+
+    EXPECT_EQ(buffers, received_a);
+    EXPECT_EQ(buffers, received_b);
+    EXPECT_TRUE(received_other.empty());
+
+    lcm_destroy(a);
+    lcm_destroy(other);
+
+    // the bus keeps working for the remaining instance
+    received_b.clear();
+    lcm_publish(b, "channel", "x", 1);
+    EXPECT_LT(0, lcm_handle_timeout(b, 1000));
+    EXPECT_EQ(1u, received_b.size());
+
+    lcm_destroy(b);
+}
+
+static void InprocPointerHandler(const lcm_recv_buf_t* rbuf,
+        const char* channel, void* user_data) {
+    *(const void**)user_data = rbuf->data;
+}
+
+TEST(LCM_C, InprocLoan) {
+    // Every instance on the bus receives the loaned buffer itself, and
+    // aborted loans are never delivered.
+    lcm_t* a = lcm_create("inproc://loan");
+    lcm_t* b = lcm_create("inproc://loan");
+    ASSERT_TRUE(a != NULL && b != NULL);
+
+    std::vector<std::vector<uint8_t> > received_a, received_b;
+    const void* data_b = NULL;
+    lcm_subscribe(a, "channel", InprocHandler, &received_a);
+    lcm_subscribe(b, "channel", InprocHandler, &received_b);
+    lcm_subscribe(b, "channel", InprocPointerHandler, &data_b);
+
+    std::vector<std::vector<uint8_t> > buffers;
+    for (int buf_num = 0; buf_num < 10; ++buf_num) {
+        std::vector<uint8_t> buf(1 + rand() % 200);
+        for (size_t byte_index = 0; byte_index < buf.size(); ++byte_index) {
+            buf[byte_index] = rand() % 255;
+        }
+        uint8_t* loan = (uint8_t*) lcm_publish_loan(a, "channel", 256);
+        ASSERT_TRUE(loan != NULL);
+        if (buf_num % 3 == 2) {
+            lcm_publish_abort(a, loan);
+            continue;
+        }
+        memcpy(loan, &buf[0], buf.size());
+        EXPECT_EQ(0, lcm_publish_commit(a, loan, buf.size()));
+        buffers.push_back(buf);
+
+        EXPECT_LT(0, lcm_handle_timeout(b, 1000));
+        EXPECT_EQ(loan, data_b);
+    }
+    while (lcm_handle_timeout(a, 0) > 0) {
+    }
+    EXPECT_EQ(0, lcm_handle_timeout(b, 0));
+
+    EXPECT_EQ(buffers, received_a);
+    EXPECT_EQ(buffers, received_b);
+
+    lcm_destroy(a);
+    lcm_destroy(b);
+}
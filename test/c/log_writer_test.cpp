@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <lcm/log_writer.h>
+#include "common.h"
+
+// A buffer laid out the way lcm-logger's slabs are
+struct AlignedBuffer {
+    AlignedBuffer(int64_t capacity) : capacity(capacity) {
+        void* p = NULL;
+        EXPECT_EQ(0, posix_memalign(&p, LOG_WRITER_ALIGN, capacity));
+        data = (uint8_t*) p;
+    }
+    ~AlignedBuffer() { free(data); }
+    uint8_t* data;
+    int64_t capacity;
+};
+
+static std::vector<uint8_t> ReadFile(const char* path) {
+    std::vector<uint8_t> contents;
+    FILE* f = fopen(path, "rb");
+    EXPECT_TRUE(f != NULL);
+    if (!f)
+        return contents;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        contents.insert(contents.end(), buf, buf + n);
+    fclose(f);
+    return contents;
+}
+
+// Writes len bytes that start at offset start of buf, and adds them to
+// expected.  Checks that what follows them in buf is left alone.
+static void Write(log_writer_t* w, AlignedBuffer& buf, int64_t start,
+        int64_t len, std::vector<uint8_t>* expected) {
+    for (int64_t i = 0; i < len; i++) {
+        buf.data[start + i] = rand() % 256;
+        expected->push_back(buf.data[start + i]);
+    }
+    int64_t end = start + len;
+    std::vector<uint8_t> after(buf.data + end,
+            buf.data + end + LOG_WRITER_ALIGN);
+
+    ASSERT_EQ(0, log_writer_write(w, buf.data, start, end, buf.capacity));
+    EXPECT_EQ((int64_t) expected->size(), log_writer_size(w));
+    EXPECT_EQ(0, memcmp(&after[0], buf.data + end, after.size()));
+}
+
+TEST(LCM_C, LogWriter) {
+    char* tmp = make_tmpnam();
+    std::string fname(tmp);
+    free_tmpnam(tmp);
+
+    AlignedBuffer buf(16 * LOG_WRITER_ALIGN);
+    std::vector<uint8_t> expected;
+
+    log_writer_t* w = log_writer_open(fname.c_str(), 0);
+    ASSERT_TRUE(w != NULL);
+    // lined up with the blocks of the file
+    Write(w, buf, 0, 3 * LOG_WRITER_ALIGN, &expected);
+    // ranges that have to be moved back, and forward, within buf
+    Write(w, buf, LOG_WRITER_ALIGN + 100, 5000, &expected);
+    Write(w, buf, 10, LOG_WRITER_ALIGN + 7, &expected);
+    // lined up with the partial block left at the end of the file
+    int64_t tail = expected.size() % LOG_WRITER_ALIGN;
+    Write(w, buf, 2 * LOG_WRITER_ALIGN + tail, 300, &expected);
+
+    // the partial block reaches the file when it's synced
+    ASSERT_EQ(0, log_writer_sync(w));
+    EXPECT_EQ(expected, ReadFile(fname.c_str()));
+
+    Write(w, buf, 123, 2 * LOG_WRITER_ALIGN, &expected);
+    ASSERT_EQ(0, log_writer_close(w));
+    EXPECT_EQ(expected, ReadFile(fname.c_str()));
+
+    // appending picks up the partial block at the end of the file
+    w = log_writer_open(fname.c_str(), 1);
+    ASSERT_TRUE(w != NULL);
+    EXPECT_EQ((int64_t) expected.size(), log_writer_size(w));
+    Write(w, buf, 4 * LOG_WRITER_ALIGN + 1, 4000, &expected);
+    Write(w, buf, 0, 10, &expected);
+    ASSERT_EQ(0, log_writer_close(w));
+    EXPECT_EQ(expected, ReadFile(fname.c_str()));
+
+    // without append, the file is truncated
+    w = log_writer_open(fname.c_str(), 0);
+    ASSERT_TRUE(w != NULL);
+    expected.clear();
+    Write(w, buf, 77, 50, &expected);
+    ASSERT_EQ(0, log_writer_close(w));
+    EXPECT_EQ(expected, ReadFile(fname.c_str()));
+
+    remove(fname.c_str());
+}
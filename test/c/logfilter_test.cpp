@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm.h>
+#include "common.h"
+
+static std::string TmpName() {
+    char* tmp = make_tmpnam();
+    std::string fname(tmp);
+    free_tmpnam(tmp);
+    return fname;
+}
+
+// Events 10ms apart, cycling through the channels A, B and C.  The data of
+// each event is its number.
+static void WriteLog(lcm_eventlog_t* log, int num_events) {
+    ASSERT_TRUE(log != NULL);
+    for (int i = 0; i < num_events; i++) {
+        lcm_eventlog_event_t event;
+        event.timestamp = 1000000 + i * 10000;
+        event.channel = const_cast<char*>(i % 3 == 0 ? "A" :
+                (i % 3 == 1 ? "B" : "C"));
+        event.channellen = 1;
+        event.data = &i;
+        event.datalen = sizeof(i);
+        ASSERT_EQ(0, lcm_eventlog_write_event(log, &event));
+    }
+    lcm_eventlog_destroy(log);
+}
+
+struct Event {
+    int64_t eventnum;
+    std::string channel;
+    int data;
+};
+
+static std::vector<Event> ReadLog(const std::string& fname) {
+    std::vector<Event> events;
+    lcm_eventlog_t* log = lcm_eventlog_create(fname.c_str(), "r");
+    EXPECT_TRUE(log != NULL);
+    if (!log)
+        return events;
+    lcm_eventlog_event_t* event;
+    while ((event = lcm_eventlog_read_next_event(log))) {
+        Event e;
+        e.eventnum = event->eventnum;
+        e.channel = event->channel;
+        memcpy(&e.data, event->data, sizeof(e.data));
+        events.push_back(e);
+        lcm_eventlog_free_event(event);
+    }
+    lcm_eventlog_destroy(log);
+    return events;
+}
+
+// Runs lcm-logfilter on src, and returns the events it wrote
+static std::vector<Event> Filter(const std::string& options,
+        const std::string& src) {
+    std::string dst = TmpName();
+    std::string cmd = std::string(LOGFILTER) + " " + options + " " + src +
+        " " + dst;
+    EXPECT_EQ(0, system(cmd.c_str())) << cmd;
+    std::vector<Event> events = ReadLog(dst);
+    remove(dst.c_str());
+    return events;
+}
+
+// Checks that the events are those of the given numbers, renumbered from 0
+static void CheckEvents(const std::vector<Event>& events,
+        const std::vector<int>& expected, const char* what) {
+    ASSERT_EQ(expected.size(), events.size()) << what;
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ((int64_t) i, events[i].eventnum) << what;
+        EXPECT_EQ(expected[i], events[i].data) << what;
+    }
+}
+
+TEST(LCM_C, LogFilter) {
+    const int num_events = 3000;
+    std::string plain = TmpName();
+    std::string compressed = TmpName();
+    WriteLog(lcm_eventlog_create(plain.c_str(), "w"), num_events);
+    WriteLog(lcm_eventlog_create_compressed(compressed.c_str(), "w"),
+            num_events);
+
+    // compressed logs are filtered in a single pass, and give the same
+    // result as a plain log filtered by several threads
+    const std::string srcs[] = { plain, compressed };
+    for (int i = 0; i < 2; i++) {
+        const char* what = i ? "compressed" : "plain";
+
+        std::vector<int> expected;
+        for (int j = 0; j < num_events; j += 3)
+            expected.push_back(j);
+        CheckEvents(Filter("-j 4 -c A", srcs[i]), expected, what);
+
+        // events on B or C, from 5 to 10 seconds into the log
+        expected.clear();
+        for (int j = 500; j <= 1000; j++) {
+            if (j % 3)
+                expected.push_back(j);
+        }
+        CheckEvents(Filter("-j 4 -i -c A -s 5 -e 10", srcs[i]), expected,
+                what);
+    }
+
+    remove(plain.c_str());
+    remove(compressed.c_str());
+}
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <string.h>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm.h>
+#include <lcm/logger.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Reads the channels of the events in a log file, and checks that each
+// event's data is its own channel name
+static std::vector<std::string> ReadChannels(const char* path) {
+    std::vector<std::string> channels;
+    lcm_eventlog_t* log = lcm_eventlog_create(path, "r");
+    EXPECT_TRUE(log != NULL);
+    if (!log)
+        return channels;
+    for (lcm_eventlog_event_t* event = lcm_eventlog_read_next_event(log);
+            event; event = lcm_eventlog_read_next_event(log)) {
+        std::string channel(event->channel, event->channellen);
+        EXPECT_EQ(channel, std::string((char*) event->data, event->datalen));
+        channels.push_back(channel);
+        lcm_eventlog_free_event(event);
+    }
+    lcm_eventlog_destroy(log);
+    return channels;
+}
+
+// Reads the data sizes of the events in a log file
+static std::vector<int> ReadSizes(const char* path) {
+    std::vector<int> sizes;
+    lcm_eventlog_t* log = lcm_eventlog_create(path, "r");
+    EXPECT_TRUE(log != NULL);
+    if (!log)
+        return sizes;
+    for (lcm_eventlog_event_t* event = lcm_eventlog_read_next_event(log);
+            event; event = lcm_eventlog_read_next_event(log)) {
+        sizes.push_back(event->datalen);
+        lcm_eventlog_free_event(event);
+    }
+    lcm_eventlog_destroy(log);
+    return sizes;
+}
+
+static void Publish(lcm_t* lcm, const char* channel) {
+    lcm_publish(lcm, channel, channel, strlen(channel));
+}
+
+static void NoopHandler(const lcm_recv_buf_t* rbuf, const char* channel,
+        void* user_data) {
+}
+
+static lcm_logger_options_t Options(const char* path, int record) {
+    lcm_logger_options_t options;
+    lcm_logger_options_init(&options);
+    options.filename = path;
+    options.record = record;
+    options.force_overwrite = 1;
+    options.quiet = 1;
+    options.max_unwritten_mb = 1;
+    return options;
+}
+
+TEST(LCM_C, LoggerSubscribe) {
+    // The logger subscribes to the channels to log, like lcm-logger
+    const char* path = "lcm_logger_test_subscribe.log";
+    lcm_t* lcm = lcm_create("memq://");
+    lcm_logger_options_t options = Options(path, LCM_LOGGER_SUBSCRIBE);
+    options.channel = "A.*";
+    lcm_logger_t* logger = lcm_logger_attach(lcm, &options);
+    ASSERT_TRUE(logger != NULL);
+
+    std::vector<std::string> expected;
+    for (int i = 0; i < 100; i++) {
+        const char* channel = (i % 3) ? "A1" : "A2";
+        Publish(lcm, channel);
+        Publish(lcm, "B");
+        lcm_handle(lcm);
+        expected.push_back(channel);
+    }
+    lcm_logger_detach(logger);
+    lcm_destroy(lcm);
+
+    EXPECT_EQ(expected, ReadChannels(path));
+    remove(path);
+}
+
+TEST(LCM_C, LoggerReceivedAndPublished) {
+    // Taps record what is received for the existing subscriptions, and what
+    // is published, without subscribing to anything
+    const char* received_path = "lcm_logger_test_received.log";
+    const char* published_path = "lcm_logger_test_published.log";
+    lcm_t* lcm = lcm_create("memq://");
+    lcm_subscribe(lcm, "B", NoopHandler, NULL);
+
+    lcm_logger_options_t options = Options(received_path,
+            LCM_LOGGER_RECEIVED);
+    lcm_logger_t* received = lcm_logger_attach(lcm, &options);
+    ASSERT_TRUE(received != NULL);
+    options = Options(published_path, LCM_LOGGER_PUBLISHED);
+    options.channel = "B";
+    options.invert_channels = 1;
+    lcm_logger_t* published = lcm_logger_attach(lcm, &options);
+    ASSERT_TRUE(published != NULL);
+
+    // nobody subscribes to A, so it's only published
+    for (int i = 0; i < 10; i++) {
+        Publish(lcm, "A");
+        Publish(lcm, "B");
+        lcm_handle(lcm);
+    }
+    lcm_logger_detach(published);
+    lcm_logger_detach(received);
+    lcm_destroy(lcm);
+
+    EXPECT_EQ(std::vector<std::string>(10, "B"), ReadChannels(received_path));
+    EXPECT_EQ(std::vector<std::string>(10, "A"), ReadChannels(published_path));
+    remove(received_path);
+    remove(published_path);
+}
+
+TEST(LCM_C, LoggerPublishedFromThreads) {
+    // Taps are called from each publishing thread, while another thread
+    // dispatches, and a logger can be detached while they're publishing
+    const char* path = "lcm_logger_test_threads.log";
+    const char* detached_path = "lcm_logger_test_threads_detached.log";
+    const char* channels[] = { "T0", "T1", "T2", "T3" };
+    const int num_messages = 500;
+    lcm_t* lcm = lcm_create("inproc://logger_test_threads");
+    ASSERT_TRUE(lcm != NULL);
+    lcm_subscribe(lcm, ".*", NoopHandler, NULL);
+
+    std::atomic<bool> stop(false);
+    std::thread dispatcher([&] {
+        while (!stop)
+            lcm_handle_timeout(lcm, 10);
+    });
+
+    lcm_logger_options_t options = Options(path, LCM_LOGGER_PUBLISHED);
+    lcm_logger_t* logger = lcm_logger_attach(lcm, &options);
+    ASSERT_TRUE(logger != NULL);
+    std::vector<std::thread> publishers;
+    for (int i = 0; i < 4; i++) {
+        publishers.push_back(std::thread([&, i] {
+            for (int j = 0; j < num_messages; j++)
+                Publish(lcm, channels[i]);
+        }));
+    }
+    for (size_t i = 0; i < publishers.size(); i++)
+        publishers[i].join();
+    lcm_logger_detach(logger);
+
+    options = Options(detached_path, LCM_LOGGER_PUBLISHED);
+    logger = lcm_logger_attach(lcm, &options);
+    ASSERT_TRUE(logger != NULL);
+    publishers.clear();
+    std::atomic<bool> stop_publishing(false);
+    for (int i = 0; i < 4; i++) {
+        publishers.push_back(std::thread([&, i] {
+            while (!stop_publishing)
+                Publish(lcm, channels[i]);
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    lcm_logger_detach(logger);
+    stop_publishing = true;
+    for (size_t i = 0; i < publishers.size(); i++)
+        publishers[i].join();
+
+    stop = true;
+    dispatcher.join();
+    lcm_destroy(lcm);
+
+    std::map<std::string, int> counts;
+    std::vector<std::string> logged = ReadChannels(path);
+    for (size_t i = 0; i < logged.size(); i++)
+        counts[logged[i]]++;
+    for (int i = 0; i < 4; i++)
+        EXPECT_EQ(num_messages, counts[channels[i]]) << channels[i];
+    EXPECT_LT(0u, ReadChannels(detached_path).size());
+    remove(path);
+    remove(detached_path);
+}
+
+TEST(LCM_C, LoggerOptions) {
+    lcm_t* lcm = lcm_create("memq://");
+    lcm_logger_options_t options = Options("lcm_logger_test_options.log",
+            LCM_LOGGER_SUBSCRIBE | LCM_LOGGER_RECEIVED);
+    EXPECT_TRUE(lcm_logger_attach(lcm, &options) == NULL);
+
+    options = Options("lcm_logger_test_options.log", LCM_LOGGER_SUBSCRIBE);
+    options.split_mb = 1;
+    EXPECT_TRUE(lcm_logger_attach(lcm, &options) == NULL);
+    lcm_destroy(lcm);
+}
+
+TEST(LCM_C, LoggerOversize) {
+    // With 4 MB for unwritten messages, there are 4 slabs of 1 MB.  Bigger
+    // events take the place of as many slabs as they need, and are dropped
+    // if they don't fit in what's free.
+    const char* path = "lcm_logger_test_oversize.log";
+    lcm_t* lcm = lcm_create("memq://");
+    lcm_logger_options_t options = Options(path, LCM_LOGGER_SUBSCRIBE);
+    options.max_unwritten_mb = 4;
+    lcm_logger_t* logger = lcm_logger_attach(lcm, &options);
+    ASSERT_TRUE(logger != NULL);
+
+    const int kSmall = 100;
+    const int kMB = 1 << 20;
+    std::vector<uint8_t> data(5 * kMB);
+    int sizes[] = {
+        // two slabs, leaving one for the small events after it
+        kSmall, 3 * kMB / 2, kSmall,
+        // more than all of the slabs together
+        5 * kMB,
+        kSmall,
+        // all of the slabs, once everything before it has been written
+        -1, 7 * kMB / 2,
+        -1, kSmall,
+    };
+    std::vector<int> expected;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (sizes[i] < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            continue;
+        }
+        lcm_publish(lcm, "A", &data[0], sizes[i]);
+        lcm_handle(lcm);
+        if (sizes[i] < 4 * kMB)
+            expected.push_back(sizes[i]);
+    }
+    EXPECT_FALSE(lcm_logger_failed(logger));
+    lcm_logger_detach(logger);
+    lcm_destroy(lcm);
+
+    EXPECT_EQ(expected, ReadSizes(path));
+    remove(path);
+}
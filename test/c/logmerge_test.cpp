@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm.h>
+#include "common.h"
+
+struct Event {
+    int64_t eventnum;
+    int64_t timestamp;
+    std::string channel;
+    std::string data;
+};
+
+static Event MakeEvent(int64_t timestamp, const char* channel,
+        const char* data) {
+    Event e;
+    e.eventnum = 0;
+    e.timestamp = timestamp;
+    e.channel = channel;
+    e.data = data;
+    return e;
+}
+
+static std::string TmpName() {
+    char* tmp = make_tmpnam();
+    std::string fname(tmp);
+    free_tmpnam(tmp);
+    return fname;
+}
+
+static std::string WriteLog(const std::vector<Event>& events, bool compress) {
+    std::string fname = TmpName();
+    lcm_eventlog_t* log = compress ?
+        lcm_eventlog_create_compressed(fname.c_str(), "w") :
+        lcm_eventlog_create(fname.c_str(), "w");
+    EXPECT_TRUE(log != NULL);
+    if (!log)
+        return fname;
+    for (size_t i = 0; i < events.size(); i++) {
+        lcm_eventlog_event_t event;
+        event.timestamp = events[i].timestamp;
+        event.channel = const_cast<char*>(events[i].channel.c_str());
+        event.channellen = events[i].channel.size();
+        event.data = const_cast<char*>(events[i].data.c_str());
+        event.datalen = events[i].data.size();
+        EXPECT_EQ(0, lcm_eventlog_write_event(log, &event));
+    }
+    lcm_eventlog_destroy(log);
+    return fname;
+}
+
+static std::vector<Event> ReadLog(const std::string& fname) {
+    std::vector<Event> events;
+    lcm_eventlog_t* log = lcm_eventlog_create(fname.c_str(), "r");
+    EXPECT_TRUE(log != NULL);
+    if (!log)
+        return events;
+    lcm_eventlog_event_t* event;
+    while ((event = lcm_eventlog_read_next_event(log))) {
+        Event e;
+        e.eventnum = event->eventnum;
+        e.timestamp = event->timestamp;
+        e.channel = std::string(event->channel, event->channellen);
+        e.data = std::string((char*) event->data, event->datalen);
+        events.push_back(e);
+        lcm_eventlog_free_event(event);
+    }
+    lcm_eventlog_destroy(log);
+    return events;
+}
+
+// Runs lcm-logmerge on the inputs, and returns the events it wrote
+static std::vector<Event> Merge(const std::string& options,
+        const std::vector<std::string>& inputs) {
+    std::string output = TmpName();
+    std::string cmd = std::string(LOGMERGE) + " -q -f " + options + " -o " +
+        output;
+    for (size_t i = 0; i < inputs.size(); i++)
+        cmd += " " + inputs[i];
+    EXPECT_EQ(0, system(cmd.c_str())) << cmd;
+    std::vector<Event> events = ReadLog(output);
+    remove(output.c_str());
+    return events;
+}
+
+// Checks that the events are the expected ones, in order, and numbered from 0
+static void CheckEvents(const std::vector<Event>& expected,
+        const std::vector<Event>& events) {
+    ASSERT_EQ(expected.size(), events.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ((int64_t) i, events[i].eventnum) << i;
+        EXPECT_EQ(expected[i].timestamp, events[i].timestamp) << i;
+        EXPECT_EQ(expected[i].channel, events[i].channel) << i;
+        EXPECT_EQ(expected[i].data, events[i].data) << i;
+    }
+}
+
+TEST(LCM_C, LogMerge) {
+    // Events are merged in timestamp order.  Events with the same timestamp
+    // are in the order of their logs on the command line.  The last log is
+    // compressed.
+    std::vector<Event> a, b, c;
+    a.push_back(MakeEvent(100, "A", "a0"));
+    a.push_back(MakeEvent(300, "A", "a1"));
+    a.push_back(MakeEvent(300, "A", "a2"));
+    a.push_back(MakeEvent(700, "A", "a3"));
+    b.push_back(MakeEvent(200, "B", "b0"));
+    b.push_back(MakeEvent(300, "B", "b1"));
+    b.push_back(MakeEvent(800, "B", "b2"));
+    c.push_back(MakeEvent(50, "C", "c0"));
+    c.push_back(MakeEvent(300, "C", "c1"));
+    c.push_back(MakeEvent(700, "C", "c2"));
+    c.push_back(MakeEvent(900, "C", "c3"));
+
+    std::vector<std::string> inputs;
+    inputs.push_back(WriteLog(a, false));
+    inputs.push_back(WriteLog(b, false));
+    inputs.push_back(WriteLog(c, true));
+
+    std::vector<Event> expected;
+    expected.push_back(c[0]);
+    expected.push_back(a[0]);
+    expected.push_back(b[0]);
+    expected.push_back(a[1]);
+    expected.push_back(a[2]);
+    expected.push_back(b[1]);
+    expected.push_back(c[1]);
+    expected.push_back(a[3]);
+    expected.push_back(c[2]);
+    expected.push_back(b[2]);
+    expected.push_back(c[3]);
+    CheckEvents(expected, Merge("", inputs));
+
+    for (size_t i = 0; i < inputs.size(); i++)
+        remove(inputs[i].c_str());
+}
+
+TEST(LCM_C, LogMergeDedup) {
+    // With --dedup, a copy of an event from another log within the window
+    // is dropped.  Copies from the same log are kept, as are copies from
+    // further apart, and events with the same channel but other data.
+    const int64_t ms = 1000;
+    std::vector<Event> a, b;
+    a.push_back(MakeEvent(0, "X", "x"));
+    a.push_back(MakeEvent(10 * ms, "X", "x"));        // same log
+    a.push_back(MakeEvent(20 * ms, "Y", "y1"));
+    a.push_back(MakeEvent(500 * ms, "Z", "z"));
+    b.push_back(MakeEvent(5 * ms, "X", "x"));         // copy
+    b.push_back(MakeEvent(20 * ms, "Y", "y2"));       // other data
+    b.push_back(MakeEvent(21 * ms, "Y", "y1"));       // copy
+    b.push_back(MakeEvent(700 * ms, "Z", "z"));       // outside the window
+
+    std::vector<std::string> inputs;
+    inputs.push_back(WriteLog(a, false));
+    inputs.push_back(WriteLog(b, false));
+
+    std::vector<Event> expected;
+    expected.push_back(a[0]);
+    expected.push_back(a[1]);
+    expected.push_back(a[2]);
+    expected.push_back(b[1]);
+    expected.push_back(a[3]);
+    expected.push_back(b[3]);
+    CheckEvents(expected, Merge("--dedup", inputs));
+
+    // without --dedup, nothing is dropped
+    EXPECT_EQ(a.size() + b.size(), Merge("", inputs).size());
+
+    // with a smaller window, the copy 5ms later is kept
+    expected.insert(expected.begin() + 1, b[0]);
+    CheckEvents(expected, Merge("--dedup --dedup-window=1", inputs));
+
+    for (size_t i = 0; i < inputs.size(); i++)
+        remove(inputs[i].c_str());
+}
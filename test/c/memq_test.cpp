@@ -113,3 +113,237 @@ TEST(LCM_C, MemqTimeout) {
 
   lcm_destroy(lcm);
 }
+
+TEST(LCM_C, MemqOverflow) {
+    // Publish more messages than the ring holds, and check that none are lost
+    // or reordered.
+    lcm_t* lcm = lcm_create("memq://?queue_size=4");
+    std::vector<std::vector<uint8_t> > received_buffers;
+
+    lcm_subscribe(lcm, "channel", MemqBufferedHandler, &received_buffers);
+
+    std::vector<std::vector<uint8_t> > buffers;
+    for (int round = 0; round < 3; ++round) {
+        int num_bufs = 10 * (round + 1);
+        for (int buf_num = 0; buf_num < num_bufs; ++buf_num) {
+            std::vector<uint8_t> buf(1 + rand() % 200);
+            for (size_t byte_index = 0; byte_index < buf.size(); ++byte_index) {
+                buf[byte_index] = rand() % 255;
+            }
+            lcm_publish(lcm, "channel", &buf[0], buf.size());
+            buffers.push_back(buf);
+        }
+        // handle some, but not all of the messages
+        for (int buf_num = 0; buf_num < num_bufs - 3; ++buf_num) {
+            lcm_handle(lcm);
+        }
+    }
+    while (lcm_handle_timeout(lcm, 0) > 0) {
+    }
+
+    EXPECT_EQ(buffers, received_buffers);
+
+    lcm_destroy(lcm);
+}
+
+TEST(LCM_C, MemqLoan) {
+    // Messages written into loaned buffers are received as committed, and
+    // aborted loans are never delivered.
+    lcm_t* lcm = lcm_create("memq://?queue_size=4");
+    std::vector<std::vector<uint8_t> > received_buffers;
+
+    lcm_subscribe(lcm, "channel", MemqBufferedHandler, &received_buffers);
+
+    std::vector<std::vector<uint8_t> > buffers;
+    for (int buf_num = 0; buf_num < 10; ++buf_num) {
+        std::vector<uint8_t> buf(1 + rand() % 200);
+        for (size_t byte_index = 0; byte_index < buf.size(); ++byte_index) {
+            buf[byte_index] = rand() % 255;
+        }
+        uint8_t* loan = (uint8_t*) lcm_publish_loan(lcm, "channel", 256);
+        ASSERT_TRUE(loan != NULL);
+        if (buf_num % 3 == 2) {
+            lcm_publish_abort(lcm, loan);
+            continue;
+        }
+        memcpy(loan, &buf[0], buf.size());
+        EXPECT_EQ(0, lcm_publish_commit(lcm, loan, buf.size()));
+        buffers.push_back(buf);
+    }
+    while (lcm_handle_timeout(lcm, 0) > 0) {
+    }
+
+    EXPECT_EQ(buffers, received_buffers);
+
+    // a commit can't be larger than the loan
+    void* loan = lcm_publish_loan(lcm, "channel", 4);
+    EXPECT_GT(0, lcm_publish_commit(lcm, loan, 5));
+
+    lcm_destroy(lcm);
+}
+
+TEST(LCM_C, MemqLoanHandle) {
+    // A thread holding a loan can still handle messages committed after it
+    // was made, even once they fill the ring.
+    lcm_t* lcm = lcm_create("memq://?queue_size=4");
+    std::vector<std::vector<uint8_t> > received_buffers;
+
+    lcm_subscribe(lcm, "channel", MemqBufferedHandler, &received_buffers);
+
+    uint8_t* loan = (uint8_t*) lcm_publish_loan(lcm, "channel", 1);
+    ASSERT_TRUE(loan != NULL);
+    std::vector<std::vector<uint8_t> > buffers;
+    for (int buf_num = 1; buf_num <= 10; ++buf_num) {
+        std::vector<uint8_t> buf(1, buf_num);
+        EXPECT_EQ(0, lcm_publish(lcm, "channel", &buf[0], buf.size()));
+        buffers.push_back(buf);
+    }
+    for (int buf_num = 1; buf_num <= 10; ++buf_num)
+        EXPECT_LT(0, lcm_handle_timeout(lcm, 1000));
+    EXPECT_EQ(0, lcm_handle_timeout(lcm, 0));
+    EXPECT_EQ(buffers, received_buffers);
+
+    // the loaned message counts as published when it's committed
+    loan[0] = 0;
+    EXPECT_EQ(0, lcm_publish_commit(lcm, loan, 1));
+    buffers.push_back(std::vector<uint8_t>(1, 0));
+    EXPECT_LT(0, lcm_handle_timeout(lcm, 1000));
+    EXPECT_EQ(buffers, received_buffers);
+
+    // and the ring is back in order
+    received_buffers.clear();
+    buffers.clear();
+    for (int buf_num = 0; buf_num < 10; ++buf_num) {
+        std::vector<uint8_t> buf(1, buf_num);
+        EXPECT_EQ(0, lcm_publish(lcm, "channel", &buf[0], buf.size()));
+        buffers.push_back(buf);
+        EXPECT_LT(0, lcm_handle_timeout(lcm, 1000));
+    }
+    EXPECT_EQ(buffers, received_buffers);
+
+    lcm_destroy(lcm);
+}
+
+TEST(LCM_C, MemqPublishv) {
+    // A message published in pieces is received as their concatenation.
+    lcm_t* lcm = lcm_create("memq://");
+    std::vector<std::vector<uint8_t> > received_buffers;
+
+    lcm_subscribe(lcm, "channel", MemqBufferedHandler, &received_buffers);
+
+    std::vector<uint8_t> header(16, 1);
+    std::vector<uint8_t> body(1000, 2);
+    struct iovec iov[3];
+    iov[0].iov_base = &header[0];
+    iov[0].iov_len = header.size();
+    iov[1].iov_base = NULL;
+    iov[1].iov_len = 0;
+    iov[2].iov_base = &body[0];
+    iov[2].iov_len = body.size();
+    EXPECT_EQ(0, lcm_publishv(lcm, "channel", iov, 3));
+    EXPECT_LT(0, lcm_handle_timeout(lcm, 1000));
+
+    std::vector<uint8_t> expected(header);
+    expected.insert(expected.end(), body.begin(), body.end());
+    ASSERT_EQ(1u, received_buffers.size());
+    EXPECT_EQ(expected, received_buffers[0]);
+
+    lcm_destroy(lcm);
+}
+
+static void MemqRetainHandler(const lcm_recv_buf_t* rbuf, const char* channel,
+        void* user_data) {
+    std::vector<lcm_recv_buf_t*>* retained =
+        (std::vector<lcm_recv_buf_t*>*) user_data;
+    retained->push_back(lcm_recv_buf_retain(rbuf));
+}
+
+TEST(LCM_C, MemqRetain) {
+    // Retained messages stay intact while later messages reuse the ring.
+    lcm_t* lcm = lcm_create("memq://?queue_size=2");
+    std::vector<lcm_recv_buf_t*> retained;
+
+    lcm_subscribe(lcm, "channel", MemqRetainHandler, &retained);
+    lcm_subscribe(lcm, "channel", MemqRetainHandler, &retained);
+
+    std::vector<std::vector<uint8_t> > buffers;
+    for (int buf_num = 0; buf_num < 10; ++buf_num) {
+        std::vector<uint8_t> buf(1 + rand() % 200);
+        for (size_t byte_index = 0; byte_index < buf.size(); ++byte_index) {
+            buf[byte_index] = rand() % 255;
+        }
+        lcm_publish(lcm, "channel", &buf[0], buf.size());
+        buffers.push_back(buf);
+        EXPECT_LT(0, lcm_handle_timeout(lcm, 1000));
+    }
+
+    ASSERT_EQ(2 * buffers.size(), retained.size());
+    for (size_t i = 0; i < retained.size(); ++i) {
+        const std::vector<uint8_t>& expected = buffers[i / 2];
+        lcm_recv_buf_t* rbuf = retained[i];
+        ASSERT_TRUE(rbuf != NULL);
+        EXPECT_EQ(expected.size(), rbuf->data_size);
+        EXPECT_EQ(0, memcmp(&expected[0], rbuf->data, rbuf->data_size));
+    }
+    lcm_destroy(lcm);
+
+    // retained buffers outlive the lcm_t
+    for (size_t i = 0; i < retained.size(); ++i) {
+        lcm_recv_buf_release(retained[i]);
+    }
+}
+
+struct MemqRetainedCopy {
+    std::vector<uint8_t> seen;
+    lcm_recv_buf_t* retained;
+};
+
+static void MemqRetainCopyHandler(const lcm_recv_buf_t* rbuf,
+        const char* channel, void* user_data) {
+    std::vector<MemqRetainedCopy>* copies =
+        (std::vector<MemqRetainedCopy>*) user_data;
+    MemqRetainedCopy copy;
+    if (rbuf->data)
+        copy.seen.assign((uint8_t*) rbuf->data,
+                (uint8_t*) rbuf->data + rbuf->data_size);
+    copy.retained = lcm_recv_buf_retain(rbuf);
+    copies->push_back(copy);
+}
+
+TEST(LCM_C, MemqRetainOverflow) {
+    // Messages that don't fit in the ring go through the overflow queue.
+    // Retaining one of those doesn't change what the later handlers see.
+    lcm_t* lcm = lcm_create("memq://?queue_size=2");
+    std::vector<MemqRetainedCopy> copies;
+
+    lcm_subscribe(lcm, "channel", MemqRetainCopyHandler, &copies);
+    lcm_subscribe(lcm, "channel", MemqRetainCopyHandler, &copies);
+
+    std::vector<std::vector<uint8_t> > buffers;
+    for (int buf_num = 0; buf_num < 10; ++buf_num) {
+        std::vector<uint8_t> buf(1 + rand() % 200);
+        for (size_t byte_index = 0; byte_index < buf.size(); ++byte_index) {
+            buf[byte_index] = rand() % 255;
+        }
+        lcm_publish(lcm, "channel", &buf[0], buf.size());
+        buffers.push_back(buf);
+    }
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        EXPECT_LT(0, lcm_handle_timeout(lcm, 1000));
+    }
+
+    ASSERT_EQ(2 * buffers.size(), copies.size());
+    for (size_t i = 0; i < copies.size(); ++i) {
+        const std::vector<uint8_t>& expected = buffers[i / 2];
+        EXPECT_EQ(expected, copies[i].seen);
+        lcm_recv_buf_t* rbuf = copies[i].retained;
+        ASSERT_TRUE(rbuf != NULL);
+        EXPECT_EQ(expected.size(), rbuf->data_size);
+        EXPECT_EQ(0, memcmp(&expected[0], rbuf->data, rbuf->data_size));
+    }
+    lcm_destroy(lcm);
+
+    for (size_t i = 0; i < copies.size(); ++i) {
+        lcm_recv_buf_release(copies[i].retained);
+    }
+}
@@ -0,0 +1,572 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm.h>
+#include <lcm/lcmtypes/channel_port_map_delta_t.h>
+#include <lcm/lcmtypes/channel_port_map_update_t.h>
+
+// Four ports, the last two of which are handed out to busy channels
+#define MC_ADDR "239.255.76.67"
+#define PORT_START 7720
+#define URL "mpudpm://" MC_ADDR ":7720?ttl=0&nports=4&port_assign=traffic" \
+    "&dedicated_ports=2&heavy_rate=1000"
+#define FIRST_DEDICATED_PORT (PORT_START + 2)
+
+// control channels, which are always on the first port of the range
+#define UPDATE_CHANNEL "#!mpudpm_CH2PRT_UPD"
+#define REQUEST_CHANNEL "#!mpudpm_CH2PRT_REQ"
+#define DELTA_CHANNEL "#!mpudpm_CH2PRT_DELTA"
+
+// Receives everything sent to a port of the multicast group, to see which
+// channels are on it
+class PortListener {
+  public:
+    explicit PortListener(int port) {
+        fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+        int opt = 1;
+        setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
+        EXPECT_EQ(0, bind(fd_, (struct sockaddr*) &addr, sizeof(addr)));
+        struct ip_mreq mreq;
+        mreq.imr_multiaddr.s_addr = inet_addr(MC_ADDR);
+        mreq.imr_interface.s_addr = INADDR_ANY;
+        EXPECT_EQ(0, setsockopt(fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                    sizeof(mreq)));
+        fcntl(fd_, F_SETFL, O_NONBLOCK);
+    }
+    ~PortListener() { close(fd_); }
+
+    struct Packet {
+        std::string channel;
+        std::vector<uint8_t> data;
+    };
+
+    // Short messages that arrived since the last call
+    std::vector<Packet> Packets() {
+        std::vector<Packet> packets;
+        char buf[65536];
+        ssize_t len;
+        while ((len = recv(fd_, buf, sizeof(buf) - 1, 0)) > 0) {
+            uint32_t magic;
+            memcpy(&magic, buf, 4);
+            if (len > 8 && ntohl(magic) == 0x4c433032) {
+                buf[len] = 0;
+                Packet packet;
+                packet.channel = buf + 8;
+                size_t offset = 8 + packet.channel.size() + 1;
+                if (offset <= (size_t) len)
+                    packet.data.assign(buf + offset, buf + len);
+                packets.push_back(packet);
+            }
+        }
+        return packets;
+    }
+
+    // Channels of the short messages that arrived since the last call
+    std::set<std::string> Channels() {
+        std::set<std::string> channels;
+        std::vector<Packet> packets = Packets();
+        for (size_t i = 0; i < packets.size(); i++)
+            channels.insert(packets[i].channel);
+        return channels;
+    }
+
+  private:
+    int fd_;
+};
+
+// Sends a short message to port, as if it was published by another process
+static void SendPacket(int port, const char* channel, const void* data,
+        size_t len) {
+    std::vector<char> packet(8 + strlen(channel) + 1 + len);
+    uint32_t header[2] = { htonl(0x4c433032), 0 };
+    memcpy(&packet[0], header, 8);
+    strcpy(&packet[8], channel);
+    if (len)
+        memcpy(&packet[8 + strlen(channel) + 1], data, len);
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    unsigned char ttl = 0;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(MC_ADDR);
+    addr.sin_port = htons(port);
+    EXPECT_EQ((ssize_t) packet.size(), sendto(fd, &packet[0], packet.size(),
+                0, (struct sockaddr*) &addr, sizeof(addr)));
+    close(fd);
+}
+
+static void SendUpdate(int port, const channel_port_map_delta_t* update) {
+    std::vector<char> buf(channel_port_map_delta_t_encoded_size(update));
+    ASSERT_LT(0, channel_port_map_delta_t_encode(&buf[0], 0, buf.size(),
+                update));
+    SendPacket(port, DELTA_CHANNEL, &buf[0], buf.size());
+}
+
+// Sends a mapping update that claims to be from another process, which has
+// moved channel to port
+static void SendMove(const char* channel, int port) {
+    channel_to_port_move_t mapping;
+    mapping.channel = const_cast<char*>(channel);
+    mapping.port = port;
+    mapping.generation = 1;
+    mapping.switch_delay_usec = 0;
+    channel_port_map_delta_t update;
+    update.num_ports = 4;
+    update.num_dedicated_ports = 2;
+    update.sender_id = 0x1234567 + port;
+    update.version = 1;
+    update.is_snapshot = 1;
+    update.num_channels = 1;
+    update.mapping = &mapping;
+    SendUpdate(PORT_START, &update);
+}
+
+// Publishes 100 KB/s on channel for the given time, and returns the ports
+// (of the dedicated ones) that it was last seen on
+static std::set<int> PublishFor(lcm_t* lcm, const char* channel, int msec,
+        std::vector<PortListener*>& listeners) {
+    std::vector<uint8_t> data(1000);
+    auto end = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(msec);
+    while (std::chrono::steady_clock::now() < end) {
+        for (size_t i = 0; i < listeners.size(); i++)
+            listeners[i]->Channels();
+        EXPECT_EQ(0, lcm_publish(lcm, channel, &data[0], data.size()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::set<int> ports;
+    for (size_t i = 0; i < listeners.size(); i++) {
+        if (listeners[i]->Channels().count(channel))
+            ports.insert(FIRST_DEDICATED_PORT + i);
+    }
+    return ports;
+}
+
+TEST(LCM_C, MpudpmDedicatedPortCollision) {
+    PortListener first(FIRST_DEDICATED_PORT);
+    PortListener second(FIRST_DEDICATED_PORT + 1);
+    std::vector<PortListener*> listeners;
+    listeners.push_back(&first);
+    listeners.push_back(&second);
+
+    lcm_t* lcm = lcm_create(URL);
+    ASSERT_TRUE(lcm != NULL);
+
+    // a busy channel gets the first free dedicated port
+    std::set<int> ports = PublishFor(lcm, "M_BUSY", 2000, listeners);
+    ASSERT_EQ(std::set<int>({ FIRST_DEDICATED_PORT }), ports);
+
+    // someone else moved a channel with a higher name there too, so they
+    // have to move it on
+    SendMove("Z_BUSY", FIRST_DEDICATED_PORT);
+    ports = PublishFor(lcm, "M_BUSY", 1000, listeners);
+    EXPECT_EQ(std::set<int>({ FIRST_DEDICATED_PORT }), ports);
+
+    // a channel with a lower name keeps the port, so we move on
+    SendMove("A_BUSY", FIRST_DEDICATED_PORT);
+    ports = PublishFor(lcm, "M_BUSY", 1000, listeners);
+    EXPECT_EQ(std::set<int>({ FIRST_DEDICATED_PORT + 1 }), ports);
+
+    lcm_destroy(lcm);
+}
+
+static void CountHandler(const lcm_recv_buf_t* rbuf, const char* channel,
+        void* user_data) {
+    std::map<std::string, int>* counts = (std::map<std::string, int>*) user_data;
+    (*counts)[channel]++;
+}
+
+// Handles messages until expected_total have arrived, or nothing has for a
+// while
+static void HandleUntil(lcm_t* lcm, std::map<std::string, int>& counts,
+        int expected_total) {
+    for (;;) {
+        int total = 0;
+        for (std::map<std::string, int>::iterator it = counts.begin();
+                it != counts.end(); ++it)
+            total += it->second;
+        if (total >= expected_total || lcm_handle_timeout(lcm, 1000) <= 0)
+            break;
+    }
+    // anything extra
+    while (lcm_handle_timeout(lcm, 100) > 0)
+        ;
+}
+
+TEST(LCM_C, MpudpmManyPorts) {
+    // many more sockets than one receive loop iteration reads from
+    lcm_t* lcm = lcm_create("mpudpm://" MC_ADDR ":7900?ttl=0&nports=100");
+    ASSERT_TRUE(lcm != NULL);
+
+    const int num_channels = 200;
+    std::map<std::string, int> counts;
+    std::vector<lcm_subscription_t*> subs;
+    for (int i = 0; i < num_channels; i++) {
+        char channel[32];
+        snprintf(channel, sizeof(channel), "CH_%d", i);
+        subs.push_back(lcm_subscribe(lcm, channel, CountHandler, &counts));
+    }
+    lcm_subscription_set_queue_capacity(subs[0], 1000);
+
+    // a message on every channel, and a burst on one of them that takes
+    // more than one batch to read
+    char data[100] = { 0 };
+    const int burst = 150;
+    for (int i = 0; i < num_channels; i++) {
+        char channel[32];
+        snprintf(channel, sizeof(channel), "CH_%d", i);
+        EXPECT_EQ(0, lcm_publish(lcm, channel, data, sizeof(data)));
+    }
+    for (int i = 0; i < burst; i++)
+        EXPECT_EQ(0, lcm_publish(lcm, "CH_0", data, sizeof(data)));
+    HandleUntil(lcm, counts, num_channels + burst);
+    ASSERT_EQ(num_channels, (int) counts.size());
+    EXPECT_EQ(1 + burst, counts["CH_0"]);
+    for (int i = 1; i < num_channels; i++) {
+        char channel[32];
+        snprintf(channel, sizeof(channel), "CH_%d", i);
+        EXPECT_EQ(1, counts[channel]) << channel;
+    }
+
+    // sockets that are no longer needed are taken out of the receive loop,
+    // and the rest keep working
+    for (int i = 0; i < num_channels; i += 2)
+        lcm_unsubscribe(lcm, subs[i]);
+    counts.clear();
+    for (int i = 0; i < num_channels; i++) {
+        char channel[32];
+        snprintf(channel, sizeof(channel), "CH_%d", i);
+        EXPECT_EQ(0, lcm_publish(lcm, channel, data, sizeof(data)));
+    }
+    HandleUntil(lcm, counts, num_channels / 2);
+    EXPECT_EQ(num_channels / 2, (int) counts.size());
+    for (int i = 1; i < num_channels; i += 2) {
+        char channel[32];
+        snprintf(channel, sizeof(channel), "CH_%d", i);
+        EXPECT_EQ(1, counts[channel]) << channel;
+    }
+
+    lcm_destroy(lcm);
+}
+
+struct MapUpdate {
+    int64_t sender_id;
+    int32_t version;
+    bool is_snapshot;
+    std::set<std::string> channels;
+};
+
+// Waits a bit, and returns the packets that arrived on channel
+static std::vector<PortListener::Packet> Receive(PortListener& listener,
+        const char* channel) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::vector<PortListener::Packet> packets = listener.Packets();
+    std::vector<PortListener::Packet> on_channel;
+    for (size_t i = 0; i < packets.size(); i++) {
+        if (packets[i].channel == channel)
+            on_channel.push_back(packets[i]);
+    }
+    return on_channel;
+}
+
+// Mapping updates other than empty heartbeats
+static std::vector<MapUpdate> ReceiveUpdates(PortListener& listener) {
+    std::vector<PortListener::Packet> packets = Receive(listener,
+            DELTA_CHANNEL);
+    std::vector<MapUpdate> updates;
+    for (size_t i = 0; i < packets.size(); i++) {
+        channel_port_map_delta_t msg;
+        EXPECT_LT(0, channel_port_map_delta_t_decode(&packets[i].data[0], 0,
+                    packets[i].data.size(), &msg));
+        MapUpdate update;
+        update.sender_id = msg.sender_id;
+        update.version = msg.version;
+        update.is_snapshot = msg.is_snapshot;
+        for (int j = 0; j < msg.num_channels; j++)
+            update.channels.insert(msg.mapping[j].channel);
+        if (update.is_snapshot || !update.channels.empty())
+            updates.push_back(update);
+        channel_port_map_delta_t_decode_cleanup(&msg);
+    }
+    return updates;
+}
+
+// Full maps, in the format that older versions send and understand
+static std::vector<std::map<std::string, int> > ReceiveFullMaps(
+        PortListener& listener) {
+    std::vector<PortListener::Packet> packets = Receive(listener,
+            UPDATE_CHANNEL);
+    std::vector<std::map<std::string, int> > maps;
+    for (size_t i = 0; i < packets.size(); i++) {
+        channel_port_map_update_t msg;
+        EXPECT_LT(0, channel_port_map_update_t_decode(&packets[i].data[0], 0,
+                    packets[i].data.size(), &msg));
+        std::map<std::string, int> map;
+        for (int j = 0; j < msg.num_channels; j++)
+            map[msg.mapping[j].channel] = (uint16_t) msg.mapping[j].port;
+        maps.push_back(map);
+        channel_port_map_update_t_decode_cleanup(&msg);
+    }
+    return maps;
+}
+
+static std::vector<std::string> ReceiveRequests(PortListener& listener) {
+    std::vector<PortListener::Packet> packets = Receive(listener,
+            REQUEST_CHANNEL);
+    std::vector<std::string> requests;
+    for (size_t i = 0; i < packets.size(); i++)
+        requests.push_back(std::string(packets[i].data.begin(),
+                    packets[i].data.end()));
+    return requests;
+}
+
+// Sends a mapping update that claims to be version of another process's map,
+// with channel added to it
+static void SendDelta(int port, int64_t sender_id, int32_t version,
+        const char* channel) {
+    channel_to_port_move_t mapping;
+    mapping.channel = const_cast<char*>(channel);
+    mapping.port = port;
+    mapping.generation = 0;
+    mapping.switch_delay_usec = 0;
+    channel_port_map_delta_t update;
+    update.num_ports = 4;
+    update.num_dedicated_ports = 0;
+    update.sender_id = sender_id;
+    update.version = version;
+    update.is_snapshot = 0;
+    update.num_channels = 1;
+    update.mapping = &mapping;
+    SendUpdate(port, &update);
+}
+
+TEST(LCM_C, MpudpmMappingUpdates) {
+    const int port = 7800;
+    PortListener control(port);
+    lcm_t* lcm = lcm_create("mpudpm://" MC_ADDR ":7800?ttl=0&nports=4");
+    ASSERT_TRUE(lcm != NULL);
+    char data[10] = { 0 };
+
+    // a new channel goes out in an update of its own
+    EXPECT_EQ(0, lcm_publish(lcm, "NEW_A", data, sizeof(data)));
+    std::vector<MapUpdate> updates = ReceiveUpdates(control);
+    ASSERT_EQ(1u, updates.size());
+    EXPECT_FALSE(updates[0].is_snapshot);
+    EXPECT_EQ(std::set<std::string>({ "NEW_A" }), updates[0].channels);
+    int64_t sender_id = updates[0].sender_id;
+    int32_t version = updates[0].version;
+
+    // publishing on it again doesn't need another one
+    EXPECT_EQ(0, lcm_publish(lcm, "NEW_A", data, sizeof(data)));
+    EXPECT_EQ(0u, ReceiveUpdates(control).size());
+
+    // the next update only has the channel that's new, and the next version
+    EXPECT_EQ(0, lcm_publish(lcm, "NEW_B", data, sizeof(data)));
+    updates = ReceiveUpdates(control);
+    ASSERT_EQ(1u, updates.size());
+    EXPECT_FALSE(updates[0].is_snapshot);
+    EXPECT_EQ(std::set<std::string>({ "NEW_B" }), updates[0].channels);
+    EXPECT_EQ(sender_id, updates[0].sender_id);
+    EXPECT_EQ(version + 1, updates[0].version);
+
+    // a request for someone else's snapshot is left for them to answer
+    std::string request = "r " + std::to_string(sender_id + 1);
+    SendPacket(port, REQUEST_CHANNEL, request.c_str(), request.size());
+    EXPECT_EQ(0u, ReceiveUpdates(control).size());
+
+    // a request for ours is answered with the whole map
+    request = "r " + std::to_string(sender_id);
+    SendPacket(port, REQUEST_CHANNEL, request.c_str(), request.size());
+    updates = ReceiveUpdates(control);
+    ASSERT_EQ(1u, updates.size());
+    EXPECT_TRUE(updates[0].is_snapshot);
+    EXPECT_EQ(std::set<std::string>({ "NEW_A", "NEW_B" }),
+            updates[0].channels);
+    EXPECT_EQ(version + 1, updates[0].version);
+
+    // updates from another process are fine as long as no version is
+    // skipped
+    const int64_t peer_id = 42;
+    SendDelta(port, peer_id, 1, "PEER_1");
+    EXPECT_EQ(0u, ReceiveRequests(control).size());
+    SendDelta(port, peer_id, 2, "PEER_2");
+    EXPECT_EQ(0u, ReceiveRequests(control).size());
+
+    // when one is, that process is asked for a snapshot
+    SendDelta(port, peer_id, 4, "PEER_4");
+    std::vector<std::string> requests = ReceiveRequests(control);
+    ASSERT_EQ(1u, requests.size());
+    EXPECT_EQ("r 42", requests[0]);
+
+    lcm_destroy(lcm);
+}
+
+TEST(LCM_C, MpudpmOldMapFormat) {
+    // processes running older versions only know about full maps, so those
+    // keep going out, and keep being accepted
+    const int port = 7820;
+    PortListener control(port);
+    lcm_t* lcm = lcm_create("mpudpm://" MC_ADDR ":7820?ttl=0&nports=4");
+    ASSERT_TRUE(lcm != NULL);
+    char data[10] = { 0 };
+
+    // a new channel goes out in a full map as well as in an update
+    EXPECT_EQ(0, lcm_publish(lcm, "NEW_A", data, sizeof(data)));
+    std::vector<std::map<std::string, int> > maps = ReceiveFullMaps(control);
+    ASSERT_EQ(1u, maps.size());
+    ASSERT_EQ(1u, maps[0].count("NEW_A"));
+    int new_a_port = maps[0]["NEW_A"];
+    EXPECT_LE(port, new_a_port);
+    EXPECT_GT(port + 4, new_a_port);
+
+    // a plain request, which is all older versions send, gets the full map
+    SendPacket(port, REQUEST_CHANNEL, "r", 1);
+    maps = ReceiveFullMaps(control);
+    ASSERT_EQ(1u, maps.size());
+    EXPECT_EQ(1u, maps[0].size());
+    EXPECT_EQ(new_a_port, maps[0]["NEW_A"]);
+
+    // a full map from an older process adds the channels it lists, which
+    // are then published on the port it gave
+    const int old_port = port + (new_a_port - port + 1) % 4;
+    PortListener old_listener(old_port);
+    channel_to_port_t mapping[2];
+    mapping[0].channel = const_cast<char*>("NEW_A");
+    mapping[0].port = old_port;
+    mapping[1].channel = const_cast<char*>("OLD_CH");
+    mapping[1].port = old_port;
+    channel_port_map_update_t update;
+    update.num_ports = 4;
+    update.num_channels = 2;
+    update.mapping = mapping;
+    std::vector<char> buf(channel_port_map_update_t_encoded_size(&update));
+    ASSERT_LT(0, channel_port_map_update_t_encode(&buf[0], 0, buf.size(),
+                &update));
+    SendPacket(port, UPDATE_CHANNEL, &buf[0], buf.size());
+    ReceiveFullMaps(control);
+    old_listener.Channels();
+
+    EXPECT_EQ(0, lcm_publish(lcm, "OLD_CH", data, sizeof(data)));
+    // channels we already had stay where they were
+    EXPECT_EQ(0, lcm_publish(lcm, "NEW_A", data, sizeof(data)));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_EQ(std::set<std::string>({ "OLD_CH" }), old_listener.Channels());
+
+    lcm_destroy(lcm);
+}
+
+TEST(LCM_C, MpudpmRegexConsolidation) {
+    // everything hashes to the one shared port
+    const int port = 7810;
+    const char* url = "mpudpm://" MC_ADDR ":7810?ttl=0&nports=3"
+        "&port_assign=traffic&dedicated_ports=2";
+    PortListener first(port + 1);
+    PortListener second(port + 2);
+
+    lcm_t* sub = lcm_create(url);
+    ASSERT_TRUE(sub != NULL);
+    std::map<std::string, int> counts;
+    lcm_subscribe(sub, "WANT_.*", CountHandler, &counts);
+    lcm_t* pub = lcm_create(url);
+    ASSERT_TRUE(pub != NULL);
+
+    // the subscriber throws away most of what arrives on the shared port,
+    // so it has the channel it wants moved to a dedicated port
+    std::vector<uint8_t> want(100);
+    std::vector<uint8_t> noise(2000);
+    std::set<std::string> dedicated_channels;
+    int count_when_moved = -1;
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(15);
+    while (std::chrono::steady_clock::now() < end) {
+        EXPECT_EQ(0, lcm_publish(pub, "WANT_1", &want[0], want.size()));
+        EXPECT_EQ(0, lcm_publish(pub, "NOISE", &noise[0], noise.size()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        while (lcm_handle_timeout(sub, 0) > 0)
+            ;
+
+        std::set<std::string> channels = first.Channels();
+        std::set<std::string> more = second.Channels();
+        channels.insert(more.begin(), more.end());
+        dedicated_channels.insert(channels.begin(), channels.end());
+        if (count_when_moved < 0 && channels.count("WANT_1")) {
+            count_when_moved = counts["WANT_1"];
+            // keep going for a bit to see that it's still received
+            end = std::chrono::steady_clock::now() +
+                std::chrono::seconds(1);
+        }
+    }
+    lcm_destroy(pub);
+    lcm_destroy(sub);
+
+    EXPECT_EQ(std::set<std::string>({ "WANT_1" }), dedicated_channels);
+    ASSERT_LE(0, count_when_moved);
+    EXPECT_LT(count_when_moved + 50, counts["WANT_1"]);
+    EXPECT_EQ(0u, counts.count("NOISE"));
+}
+
+// Whether a datagram sent to the multicast group comes back to this host.
+// Without a multicast route, there's nothing to test.
+static bool MulticastAvailable() {
+    const int port = 7719;
+    int rfd = socket(AF_INET, SOCK_DGRAM, 0);
+    int sfd = socket(AF_INET, SOCK_DGRAM, 0);
+    int opt = 1;
+    setsockopt(rfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr.s_addr = inet_addr(MC_ADDR);
+    mreq.imr_interface.s_addr = INADDR_ANY;
+    unsigned char ttl = 0;
+    setsockopt(sfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    struct timeval timeout = { 0, 500000 };
+    setsockopt(rfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    bool available = false;
+    if (0 == bind(rfd, (struct sockaddr*) &addr, sizeof(addr)) &&
+            0 == setsockopt(rfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                sizeof(mreq))) {
+        addr.sin_addr.s_addr = inet_addr(MC_ADDR);
+        char buf[16];
+        available = sendto(sfd, "probe", 5, 0, (struct sockaddr*) &addr,
+                sizeof(addr)) == 5 && recv(rfd, buf, sizeof(buf), 0) == 5;
+    }
+    close(rfd);
+    close(sfd);
+    return available;
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    if (!MulticastAvailable()) {
+        // ctest reports the test as skipped
+        fprintf(stderr, "Multicast to %s isn't available.  Skipping.\n",
+                MC_ADDR);
+        return 77;
+    }
+    return RUN_ALL_TESTS();
+}
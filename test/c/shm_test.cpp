@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm.h>
+
+struct ShmSegment {
+    // Use a segment private to this test run, and remove it when done.
+    ShmSegment() {
+        snprintf(name, sizeof(name), "lcmtest%d", (int)getpid());
+        snprintf(url, sizeof(url), "shm://%s?slots=16&slot_size=65536", name);
+    }
+    ~ShmSegment() {
+        char path[128];
+        snprintf(path, sizeof(path), "/lcm-shm-%s", name);
+        shm_unlink(path);
+    }
+    char name[64];
+    char url[128];
+};
+
+void ShmHandler(const lcm_recv_buf_t* rbuf, const char* channel,
+        void* user_data) {
+    std::vector<std::vector<uint8_t> >* received_buffers =
+        (std::vector<std::vector<uint8_t> >*)user_data;
+    std::vector<uint8_t> buf(rbuf->data_size);
+    memcpy(&buf[0], rbuf->data, rbuf->data_size);
+    received_buffers->push_back(buf);
+}
+
+TEST(LCM_C, ShmPublishSubscribe) {
+    // Publish from one instance, and receive on another instance attached to
+    // the same segment.
+    ShmSegment segment;
+    lcm_t* publisher = lcm_create(segment.url);
+    lcm_t* subscriber = lcm_create(segment.url);
+    ASSERT_TRUE(publisher != NULL);
+    ASSERT_TRUE(subscriber != NULL);
+
+    std::vector<std::vector<uint8_t> > received_buffers;
+    lcm_subscribe(subscriber, "channel", ShmHandler, &received_buffers);
+
+    std::vector<std::vector<uint8_t> > buffers(3);
+    for (int buf_num = 0; buf_num < 3; ++buf_num) {
+        std::vector<uint8_t>& buf = buffers[buf_num];
+        buf.resize(1000 * (buf_num + 1));
+        for (size_t byte_index = 0; byte_index < buf.size(); ++byte_index) {
+            buf[byte_index] = rand() % 255;
+        }
+        EXPECT_EQ(0, lcm_publish(publisher, "channel", &buf[0], buf.size()));
+        // messages on other channels are skipped
+        EXPECT_EQ(0, lcm_publish(publisher, "other", &buf[0], buf.size()));
+    }
+
+    for (int buf_num = 0; buf_num < 3; ++buf_num) {
+        EXPECT_LT(0, lcm_handle_timeout(subscriber, 5000));
+    }
+    EXPECT_EQ(0, lcm_handle_timeout(subscriber, 10));
+    EXPECT_EQ(buffers, received_buffers);
+
+    // too large for a slot
+    std::vector<uint8_t> big(65537);
+    EXPECT_GT(0, lcm_publish(publisher, "channel", &big[0], big.size()));
+
+    lcm_destroy(subscriber);
+    lcm_destroy(publisher);
+}
+
+TEST(LCM_C, ShmLoan) {
+    // Messages written into loaned slots are received as committed, and
+    // aborted loans are never delivered.
+    ShmSegment segment;
+    lcm_t* publisher = lcm_create(segment.url);
+    lcm_t* subscriber = lcm_create(segment.url);
+    ASSERT_TRUE(publisher != NULL);
+    ASSERT_TRUE(subscriber != NULL);
+
+    std::vector<std::vector<uint8_t> > received_buffers;
+    lcm_subscribe(subscriber, "channel", ShmHandler, &received_buffers);
+
+    std::vector<std::vector<uint8_t> > buffers;
+    for (int buf_num = 0; buf_num < 40; ++buf_num) {
+        std::vector<uint8_t> buf(1 + rand() % 2000);
+        for (size_t byte_index = 0; byte_index < buf.size(); ++byte_index) {
+            buf[byte_index] = rand() % 255;
+        }
+        uint8_t* loan = (uint8_t*) lcm_publish_loan(publisher, "channel",
+                4096);
+        ASSERT_TRUE(loan != NULL);
+        if (buf_num % 3 == 2) {
+            lcm_publish_abort(publisher, loan);
+            continue;
+        }
+        memcpy(loan, &buf[0], buf.size());
+        EXPECT_EQ(0, lcm_publish_commit(publisher, loan, buf.size()));
+        buffers.push_back(buf);
+        EXPECT_LT(0, lcm_handle_timeout(subscriber, 5000));
+    }
+    EXPECT_EQ(0, lcm_handle_timeout(subscriber, 10));
+    EXPECT_EQ(buffers, received_buffers);
+
+    // too large for a slot
+    EXPECT_TRUE(lcm_publish_loan(publisher, "channel", 65537) == NULL);
+
+    lcm_destroy(subscriber);
+    lcm_destroy(publisher);
+}
+
+static bool ShmSegmentExists(const ShmSegment& segment) {
+    char path[128];
+    snprintf(path, sizeof(path), "/lcm-shm-%s", segment.name);
+    int fd = shm_open(path, O_RDWR, 0);
+    if (fd < 0)
+        return false;
+    close(fd);
+    return true;
+}
+
+TEST(LCM_C, ShmUnlink) {
+    // The segment is removed when the last instance detaches
+    ShmSegment segment;
+    lcm_t* first = lcm_create(segment.url);
+    lcm_t* second = lcm_create(segment.url);
+    ASSERT_TRUE(first != NULL);
+    ASSERT_TRUE(second != NULL);
+    lcm_destroy(first);
+    EXPECT_TRUE(ShmSegmentExists(segment));
+    lcm_destroy(second);
+    EXPECT_FALSE(ShmSegmentExists(segment));
+
+    // and created again by the next one
+    lcm_t* third = lcm_create(segment.url);
+    ASSERT_TRUE(third != NULL);
+    EXPECT_TRUE(ShmSegmentExists(segment));
+    lcm_destroy(third);
+    EXPECT_FALSE(ShmSegmentExists(segment));
+}
+
+static void ShmIntHandler(const lcm_recv_buf_t* rbuf, const char* channel,
+        void* user_data) {
+    int i;
+    memcpy(&i, rbuf->data, sizeof(i));
+    ((std::vector<int>*)user_data)->push_back(i);
+}
+
+TEST(LCM_C, ShmStalledPublisher) {
+    // A loan that isn't committed by the time the ring wraps around to it
+    // makes the publish that lands on its slot fail, instead of writing to
+    // the slot while it's in use.
+    ShmSegment segment;
+    lcm_t* publisher = lcm_create(segment.url);
+    lcm_t* subscriber = lcm_create(segment.url);
+    ASSERT_TRUE(publisher != NULL);
+    ASSERT_TRUE(subscriber != NULL);
+    std::vector<int> received;
+    lcm_subscribe(subscriber, "channel", ShmIntHandler, &received);
+
+    int* loan = (int*)lcm_publish_loan(publisher, "channel", sizeof(int));
+    ASSERT_TRUE(loan != NULL);
+    for (int i = 1; i < 16; i++)
+        EXPECT_EQ(0, lcm_publish(publisher, "channel", &i, sizeof(i)));
+    int i = 16;
+    EXPECT_EQ(-1, lcm_publish(publisher, "channel", &i, sizeof(i)));
+    *loan = 0;
+    EXPECT_EQ(0, lcm_publish_commit(publisher, loan, sizeof(int)));
+    for (i = 0; i < 16; i++)
+        EXPECT_LT(0, lcm_handle_timeout(subscriber, 5000));
+
+    // readers skip the failed message
+    i = 17;
+    EXPECT_EQ(0, lcm_publish(publisher, "channel", &i, sizeof(i)));
+    EXPECT_LT(0, lcm_handle_timeout(subscriber, 5000));
+    EXPECT_EQ(0, lcm_handle_timeout(subscriber, 10));
+
+    std::vector<int> expected;
+    for (i = 0; i < 16; i++)
+        expected.push_back(i);
+    expected.push_back(17);
+    EXPECT_EQ(expected, received);
+
+    lcm_destroy(subscriber);
+    lcm_destroy(publisher);
+}
+
+TEST(LCM_C, ShmDeadPublisher) {
+    // A publisher that exits in the middle of a message doesn't stall
+    // readers, and its slot is taken over when the ring wraps around to it.
+    ShmSegment segment;
+    lcm_t* publisher = lcm_create(segment.url);
+    lcm_t* subscriber = lcm_create(segment.url);
+    ASSERT_TRUE(publisher != NULL);
+    ASSERT_TRUE(subscriber != NULL);
+    std::vector<int> received;
+    lcm_subscribe(subscriber, "channel", ShmIntHandler, &received);
+
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        lcm_t* lcm = lcm_create(segment.url);
+        if (lcm)
+            lcm_publish_loan(lcm, "channel", sizeof(int));
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+
+    // the message it left behind is skipped
+    std::vector<int> expected;
+    for (int i = 1; i < 16; i++) {
+        EXPECT_EQ(0, lcm_publish(publisher, "channel", &i, sizeof(i)));
+        expected.push_back(i);
+    }
+    for (int i = 1; i < 16; i++)
+        EXPECT_LT(0, lcm_handle_timeout(subscriber, 5000));
+    EXPECT_EQ(expected, received);
+
+    // and its slot is used again
+    int i = 16;
+    EXPECT_EQ(0, lcm_publish(publisher, "channel", &i, sizeof(i)));
+    expected.push_back(i);
+    EXPECT_LT(0, lcm_handle_timeout(subscriber, 5000));
+    EXPECT_EQ(0, lcm_handle_timeout(subscriber, 10));
+    EXPECT_EQ(expected, received);
+
+    lcm_destroy(subscriber);
+    lcm_destroy(publisher);
+}
@@ -0,0 +1,83 @@
+#include <string.h>
+#include <gtest/gtest.h>
+
+#include "bridge_echo.h"
+
+static void Add(bridge_echoes_t* echoes, const char* channel, int i,
+        int64_t now) {
+    bridge_echoes_add(echoes, channel, &i, sizeof(i), now);
+}
+
+static int Match(bridge_echoes_t* echoes, const char* channel, int i,
+        int64_t now) {
+    return bridge_echoes_match(echoes, channel, &i, sizeof(i), now);
+}
+
+TEST(LCM_C, TcpqServerBridgeEcho) {
+    bridge_echoes_t* echoes = bridge_echoes_new(1000);
+    Add(echoes, "A", 1, 0);
+    Add(echoes, "A", 2, 0);
+    Add(echoes, "B", 2, 0);
+
+    // other messages are relayed
+    EXPECT_EQ(0, Match(echoes, "A", 3, 10));
+    EXPECT_EQ(0, Match(echoes, "C", 1, 10));
+    // each echo is only recognized once
+    EXPECT_EQ(1, Match(echoes, "A", 1, 10));
+    EXPECT_EQ(0, Match(echoes, "A", 1, 10));
+    EXPECT_EQ(1, Match(echoes, "A", 2, 10));
+    EXPECT_EQ(1, Match(echoes, "B", 2, 10));
+    EXPECT_EQ(0u, bridge_echoes_size(echoes));
+
+    // identical messages are matched as many times as they were published
+    Add(echoes, "A", 4, 20);
+    Add(echoes, "A", 4, 20);
+    EXPECT_EQ(1, Match(echoes, "A", 4, 30));
+    EXPECT_EQ(1, Match(echoes, "A", 4, 30));
+    EXPECT_EQ(0, Match(echoes, "A", 4, 30));
+    bridge_echoes_destroy(echoes);
+}
+
+TEST(LCM_C, TcpqServerBridgeEchoCompare) {
+    // Messages are compared in full, not by their hash alone
+    bridge_echoes_t* echoes = bridge_echoes_new(1000);
+    const char data[] = "heartbeat";
+    bridge_echoes_add(echoes, "HB", data, sizeof(data), 0);
+    EXPECT_EQ(0, bridge_echoes_match(echoes, "HBX", data, sizeof(data), 10));
+    EXPECT_EQ(0, bridge_echoes_match(echoes, "HB", "heartbeaT", sizeof(data),
+                10));
+    EXPECT_EQ(0, bridge_echoes_match(echoes, "HB", data, sizeof(data) - 1,
+                10));
+    EXPECT_EQ(1, bridge_echoes_match(echoes, "HB", data, sizeof(data), 10));
+
+    // these two messages on channel A have the same hash, and length
+    bridge_echoes_add(echoes, "A", "kgrtiqmw", 8, 20);
+    EXPECT_EQ(0, bridge_echoes_match(echoes, "A", "ypbfgctc", 8, 30));
+    EXPECT_EQ(1, bridge_echoes_match(echoes, "A", "kgrtiqmw", 8, 30));
+    EXPECT_EQ(0u, bridge_echoes_size(echoes));
+    bridge_echoes_destroy(echoes);
+}
+
+TEST(LCM_C, TcpqServerBridgeEchoDropped) {
+    // When the bridge drops the echo of a message, the echoes of the
+    // messages published after it are still recognized, and aren't relayed
+    // back to the clients as duplicates.
+    bridge_echoes_t* echoes = bridge_echoes_new(1000);
+    for (int i = 0; i < 100; i++)
+        Add(echoes, "A", i, i);
+    int relayed = 0;
+    for (int i = 0; i < 100; i++) {
+        if (i % 10 == 0)
+            continue;   // dropped
+        if (!Match(echoes, "A", i, 100 + i))
+            relayed++;
+    }
+    EXPECT_EQ(0, relayed);
+    EXPECT_EQ(10u, bridge_echoes_size(echoes));
+
+    // the dropped ones are forgotten once they expire
+    EXPECT_EQ(0, Match(echoes, "A", 0, 1001));
+    EXPECT_EQ(0, Match(echoes, "A", 10, 2000));
+    EXPECT_EQ(0u, bridge_echoes_size(echoes));
+    bridge_echoes_destroy(echoes);
+}
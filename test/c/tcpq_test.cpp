@@ -0,0 +1,122 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm.h>
+
+// Runs lcm-tcpq-server on a port of its own for the lifetime of a test
+class TcpqServer {
+  public:
+    TcpqServer() : port_(20000 + getpid() % 20000) {
+        pid_ = fork();
+        if (pid_ == 0) {
+            char port[16];
+            snprintf(port, sizeof(port), "%d", port_);
+            execl(TCPQ_SERVER, TCPQ_SERVER, port, (char*) NULL);
+            _exit(127);
+        }
+        // wait for it to accept connections
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port_);
+        for (int i = 0; i < 500; i++) {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            int status = connect(fd, (struct sockaddr*) &addr, sizeof(addr));
+            close(fd);
+            if (status == 0)
+                break;
+            usleep(10000);
+        }
+    }
+    ~TcpqServer() {
+        kill(pid_, SIGTERM);
+        waitpid(pid_, NULL, 0);
+    }
+    std::string Url(const std::string& options) const {
+        char url[64];
+        snprintf(url, sizeof(url), "tcpq://127.0.0.1:%d", port_);
+        return url + options;
+    }
+
+  private:
+    int port_;
+    pid_t pid_;
+};
+
+static void TcpqHandler(const lcm_recv_buf_t* rbuf, const char* channel,
+        void* user_data) {
+    std::vector<std::vector<uint8_t> >* received_buffers =
+        (std::vector<std::vector<uint8_t> >*) user_data;
+    uint8_t* data = (uint8_t*) rbuf->data;
+    received_buffers->push_back(std::vector<uint8_t>(data,
+                data + rbuf->data_size));
+}
+
+// Publishes a message made of pieces of each of the given sizes, and checks
+// that the server relays it back as their concatenation.
+static void TcpqCheckPublishv(const std::string& url,
+        const std::vector<size_t>& sizes) {
+    lcm_t* lcm = lcm_create(url.c_str());
+    ASSERT_TRUE(lcm != NULL) << url;
+    std::vector<std::vector<uint8_t> > received_buffers;
+    lcm_subscribe(lcm, "channel", TcpqHandler, &received_buffers);
+
+    std::vector<std::vector<uint8_t> > pieces(sizes.size());
+    std::vector<struct iovec> iov(sizes.size());
+    std::vector<uint8_t> expected;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        pieces[i].resize(sizes[i]);
+        for (size_t byte_index = 0; byte_index < sizes[i]; ++byte_index)
+            pieces[i][byte_index] = rand() % 255;
+        iov[i].iov_base = sizes[i] ? &pieces[i][0] : NULL;
+        iov[i].iov_len = sizes[i];
+        expected.insert(expected.end(), pieces[i].begin(), pieces[i].end());
+    }
+    // twice, so that a message also follows one that's still queued
+    for (int i = 0; i < 2; i++)
+        EXPECT_EQ(0, lcm_publishv(lcm, "channel", &iov[0], iov.size()));
+    while (received_buffers.size() < 2 && lcm_handle_timeout(lcm, 2000) > 0)
+        ;
+    ASSERT_EQ(2u, received_buffers.size()) << url;
+    EXPECT_EQ(expected, received_buffers[0]) << url;
+    EXPECT_EQ(expected, received_buffers[1]) << url;
+
+    lcm_destroy(lcm);
+}
+
+TEST(LCM_C, TcpqPublishv) {
+    TcpqServer server;
+
+    std::vector<size_t> small;
+    small.push_back(16);
+    small.push_back(0);
+    small.push_back(1000);
+
+    // more pieces than fit on the stack, and more data than fits in a
+    // socket buffer
+    std::vector<size_t> large;
+    large.push_back(1);
+    large.push_back(300000);
+    large.push_back(0);
+    for (int i = 0; i < 20; i++)
+        large.push_back(5000 + i);
+
+    const char* options[] = {
+        "", "?cork=1", "?coalesce_bytes=4096", "?cork=1&coalesce_bytes=65536",
+    };
+    for (size_t i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+        TcpqCheckPublishv(server.Url(options[i]), small);
+        TcpqCheckPublishv(server.Url(options[i]), large);
+    }
+}
@@ -1,3 +1,6 @@
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
 #include <gtest/gtest.h>
 
 #include <lcm/lcm.h>
@@ -12,3 +15,108 @@ TEST(LCM_C, InvalidCreation) {
   lcm = lcm_create("udpm://239.255.1.1:65536");
   EXPECT_EQ(NULL, lcm);
 }
+
+static void UdpmHandler(const lcm_recv_buf_t* rbuf, const char* channel,
+        void* user_data) {
+  std::vector<std::vector<uint8_t> >* received_buffers =
+      (std::vector<std::vector<uint8_t> >*)user_data;
+  uint8_t* data = (uint8_t*)rbuf->data;
+  received_buffers->push_back(std::vector<uint8_t>(data,
+              data + rbuf->data_size));
+}
+
+// Publishes a message made of pieces of the given sizes, and checks that it's
+// received as their concatenation.
+static void UdpmCheckPublishv(lcm_t* lcm, const std::vector<size_t>& sizes) {
+  std::vector<std::vector<uint8_t> > received_buffers;
+  lcm_subscription_t* sub =
+      lcm_subscribe(lcm, "channel", UdpmHandler, &received_buffers);
+
+  std::vector<std::vector<uint8_t> > pieces(sizes.size());
+  std::vector<struct iovec> iov(sizes.size());
+  std::vector<uint8_t> expected;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    pieces[i].resize(sizes[i]);
+    for (size_t byte_index = 0; byte_index < sizes[i]; ++byte_index) {
+      pieces[i][byte_index] = rand() % 255;
+    }
+    iov[i].iov_base = sizes[i] ? &pieces[i][0] : NULL;
+    iov[i].iov_len = sizes[i];
+    expected.insert(expected.end(), pieces[i].begin(), pieces[i].end());
+  }
+  EXPECT_EQ(0, lcm_publishv(lcm, "channel", &iov[0], iov.size()));
+  EXPECT_LT(0, lcm_handle_timeout(lcm, 1000));
+  ASSERT_EQ(1u, received_buffers.size());
+  EXPECT_EQ(expected, received_buffers[0]);
+
+  lcm_unsubscribe(lcm, sub);
+}
+
+TEST(LCM_C, UdpmPublishv) {
+  lcm_t* lcm = lcm_create("udpm://239.255.76.67:7668?ttl=0");
+  ASSERT_TRUE(lcm != NULL);
+
+  // a single packet
+  std::vector<size_t> sizes;
+  sizes.push_back(16);
+  sizes.push_back(0);
+  sizes.push_back(1000);
+  UdpmCheckPublishv(lcm, sizes);
+
+  // fragments that start and end in the middle of pieces, including more
+  // pieces than fit on the stack.  Small enough to fit in a default kernel
+  // receive buffer.
+  sizes.clear();
+  sizes.push_back(1);
+  sizes.push_back(70000);
+  sizes.push_back(0);
+  sizes.push_back(29999);
+  for (int i = 0; i < 20; i++)
+    sizes.push_back(1000 + i);
+  UdpmCheckPublishv(lcm, sizes);
+
+  lcm_destroy(lcm);
+}
+
+TEST(LCM_C, UdpmLoopbackShortcut) {
+  lcm_t* lcm =
+      lcm_create("udpm://239.255.76.67:7669?ttl=0&loopback_shortcut=1");
+  ASSERT_TRUE(lcm != NULL);
+  // stands in for another process on the same host
+  lcm_t* other = lcm_create("udpm://239.255.76.67:7669?ttl=0");
+  ASSERT_TRUE(other != NULL);
+
+  std::vector<std::vector<uint8_t> > received_buffers;
+  std::vector<std::vector<uint8_t> > other_received_buffers;
+  lcm_subscribe(lcm, "channel", UdpmHandler, &received_buffers);
+  lcm_subscribe(other, "channel", UdpmHandler, &other_received_buffers);
+
+  // a single packet, and a fragmented message
+  size_t sizes[] = { 1000, 100000 };
+  for (int i = 0; i < 2; i++) {
+    std::vector<uint8_t> data(sizes[i]);
+    for (size_t byte_index = 0; byte_index < data.size(); ++byte_index) {
+      data[byte_index] = rand() % 255;
+    }
+    received_buffers.clear();
+    other_received_buffers.clear();
+    EXPECT_EQ(0, lcm_publish(lcm, "channel", &data[0], data.size()));
+
+    // it's queued by lcm_publish() itself, without waiting for the network
+    EXPECT_LT(0, lcm_handle_timeout(lcm, 0));
+    ASSERT_EQ(1u, received_buffers.size());
+    EXPECT_EQ(data, received_buffers[0]);
+
+    // other processes still receive it
+    EXPECT_LT(0, lcm_handle_timeout(other, 1000));
+    ASSERT_EQ(1u, other_received_buffers.size());
+    EXPECT_EQ(data, other_received_buffers[0]);
+
+    // and the copy looped back by the kernel is dropped
+    EXPECT_EQ(0, lcm_handle_timeout(lcm, 200));
+    EXPECT_EQ(1u, received_buffers.size());
+  }
+
+  lcm_destroy(other);
+  lcm_destroy(lcm);
+}
@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <lcm/lcm.h>
+
+TEST(LCM_C, UdpuInvalidCreation) {
+    lcm_t* lcm = lcm_create("udpu://127.0.0.1:65536");
+    EXPECT_EQ(NULL, lcm);
+
+    lcm = lcm_create("udpu://127.0.0.1:7667?peers=127.0.0.1:0");
+    EXPECT_EQ(NULL, lcm);
+}
+
+void UdpuLoopbackHandler(const lcm_recv_buf_t* rbuf, const char* channel,
+        void* user_data) {
+    std::vector<uint8_t>* received_buf = (std::vector<uint8_t>*)user_data;
+    received_buf->resize(rbuf->data_size);
+    memcpy(&(*received_buf)[0], rbuf->data, rbuf->data_size);
+}
+
+TEST(LCM_C, UdpuLoopback) {
+    // Transmit to ourselves over the loopback interface.  Use one message
+    // that fits in a single datagram, and one that must be fragmented.
+    lcm_t* lcm = lcm_create("udpu://127.0.0.1:17667?peers=127.0.0.1:17667");
+    ASSERT_TRUE(lcm != NULL);
+
+    std::vector<uint8_t> received_buf;
+    lcm_subscribe(lcm, "channel", UdpuLoopbackHandler, &received_buf);
+
+    const int buf_sizes[] = { 1024, 100000 };
+    for (int i = 0; i < 2; ++i) {
+        std::vector<uint8_t> buf(buf_sizes[i]);
+        for (int byte_index = 0; byte_index < buf_sizes[i]; ++byte_index) {
+            buf[byte_index] = rand() % 255;
+        }
+
+        received_buf.clear();
+        EXPECT_EQ(0, lcm_publish(lcm, "channel", &buf[0], buf.size()));
+        EXPECT_LT(0, lcm_handle_timeout(lcm, 5000));
+        EXPECT_EQ(buf, received_buf);
+    }
+
+    lcm_destroy(lcm);
+}
+
+TEST(LCM_C, UdpuPublishv) {
+    // A message published in pieces is received as their concatenation,
+    // whether or not it has to be fragmented.
+    lcm_t* lcm = lcm_create("udpu://127.0.0.1:17668?peers=127.0.0.1:17668");
+    ASSERT_TRUE(lcm != NULL);
+
+    std::vector<uint8_t> received_buf;
+    lcm_subscribe(lcm, "channel", UdpuLoopbackHandler, &received_buf);
+
+    const int total_sizes[] = { 1024, 100000 };
+    for (int i = 0; i < 2; ++i) {
+        std::vector<uint8_t> buf(total_sizes[i]);
+        for (int byte_index = 0; byte_index < total_sizes[i]; ++byte_index) {
+            buf[byte_index] = rand() % 255;
+        }
+        struct iovec iov[3];
+        iov[0].iov_base = &buf[0];
+        iov[0].iov_len = 16;
+        iov[1].iov_base = NULL;
+        iov[1].iov_len = 0;
+        iov[2].iov_base = &buf[16];
+        iov[2].iov_len = buf.size() - 16;
+
+        received_buf.clear();
+        EXPECT_EQ(0, lcm_publishv(lcm, "channel", iov, 3));
+        EXPECT_LT(0, lcm_handle_timeout(lcm, 5000));
+        EXPECT_EQ(buf, received_buf);
+    }
+
+    lcm_destroy(lcm);
+}